@@ -25,7 +25,10 @@ LOCAL_SRC_FILES := \
 	src/pomp_log.c \
 	src/pomp_loop.c \
 	src/pomp_msg.c \
+	src/pomp_pool.c \
 	src/pomp_prot.c \
+	src/pomp_rpc.c \
+	src/pomp_sub.c \
 	src/pomp_timer.c
 
 ifdef NDK_PROJECT_PATH
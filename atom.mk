@@ -31,7 +31,10 @@ LOCAL_SRC_FILES := \
 	src/pomp_log.c \
 	src/pomp_loop.c \
 	src/pomp_msg.c \
+	src/pomp_pool.c \
 	src/pomp_prot.c \
+	src/pomp_rpc.c \
+	src/pomp_sub.c \
 	src/pomp_timer.c
 
 ifeq ("$(TARGET_OS)","windows")
@@ -40,6 +43,8 @@ endif
 
 ifeq ("$(TARGET_OS_FLAVOUR)","android")
   LOCAL_LDLIBS += -llog
+else ifeq ("$(TARGET_OS)","linux")
+  LOCAL_LDLIBS += -lpthread
 endif
 
 LOCAL_DOXYFILE := Doxyfile
@@ -57,6 +62,48 @@ LOCAL_SRC_FILES := examples/ping.c
 LOCAL_LIBRARIES := libpomp
 include $(BUILD_EXECUTABLE)
 
+ifneq ("$(TARGET_OS)","windows")
+include $(CLEAR_VARS)
+LOCAL_MODULE := pomp-bench-workers
+LOCAL_CATEGORY_PATH := libs/pomp/examples
+LOCAL_DESCRIPTION := Benchmark of libpomp server worker loops
+LOCAL_SRC_FILES := examples/bench_workers.c
+LOCAL_LIBRARIES := libpomp
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := pomp-bench-async
+LOCAL_CATEGORY_PATH := libs/pomp/examples
+LOCAL_DESCRIPTION := Benchmark of libpomp messages sent from several threads
+LOCAL_SRC_FILES := examples/bench_async.c
+LOCAL_LIBRARIES := libpomp
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := pomp-bench-edge
+LOCAL_CATEGORY_PATH := libs/pomp/examples
+LOCAL_DESCRIPTION := Benchmark of libpomp syscalls per message
+LOCAL_SRC_FILES := examples/bench_edge.c
+LOCAL_LIBRARIES := libpomp
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := pomp-bench-latency
+LOCAL_CATEGORY_PATH := libs/pomp/examples
+LOCAL_DESCRIPTION := Benchmark of libpomp ping-pong latency with busy polling
+LOCAL_SRC_FILES := examples/bench_latency.c
+LOCAL_LIBRARIES := libpomp
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := pomp-bench-loop
+LOCAL_CATEGORY_PATH := libs/pomp/examples
+LOCAL_DESCRIPTION := Benchmark of libpomp loop iterations with many fds
+LOCAL_SRC_FILES := examples/bench_loop.c
+LOCAL_LIBRARIES := libpomp
+include $(BUILD_EXECUTABLE)
+endif
+
 include $(CLEAR_VARS)
 LOCAL_MODULE := pomp-ping-cpp
 LOCAL_CATEGORY_PATH := libs/pomp/examples
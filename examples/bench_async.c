@@ -0,0 +1,307 @@
+/**
+ * @file bench_async.c
+ *
+ * @brief Measure messages sent to a context by several producer threads.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "ping_common.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_DATA	1
+
+#define DIAG_PFX "BENCH: "
+
+#define diag(_fmt, ...) \
+	fprintf(stderr, DIAG_PFX _fmt "\n", ##__VA_ARGS__)
+
+/** Maximum number of producer threads */
+#define MAX_PRODUCERS	64
+
+/** How producers hand over messages to the loop */
+enum mode {
+	MODE_ASYNC = 0,		/**< pomp_ctx_send_msg_async */
+	MODE_POST,		/**< pomp_loop_post of each message */
+};
+
+/** Producer thread */
+struct producer {
+	pthread_t         thread;
+	enum mode         mode;
+	uint32_t          idx;
+	uint32_t          msgcount;
+	uint32_t          errors;
+};
+
+/** Client receiving all messages in its own thread */
+struct receiver {
+	const struct sockaddr_in  *addr;
+	pthread_t                 thread;
+	uint32_t                  msgcount;
+	uint32_t                  count;
+	volatile int              done;
+};
+
+/** Loop of the server context, run by the main thread */
+static struct pomp_loop *s_loop;
+
+/** Server context */
+static struct pomp_ctx *s_ctx;
+
+/** Number of connections of the server */
+static uint32_t s_connected;
+
+/** Set when the receiver has got all messages */
+static uint32_t s_finished;
+
+/**
+ */
+static void post_send_cb(void *userdata)
+{
+	struct pomp_msg *msg = userdata;
+	pomp_ctx_send_msg(s_ctx, msg);
+	pomp_msg_destroy(msg);
+}
+
+/**
+ */
+static void *producer_thread(void *arg)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct producer *producer = arg;
+	struct pomp_msg *msg = pomp_msg_new();
+	struct pomp_msg *ref = NULL;
+
+	if (msg == NULL)
+		return NULL;
+
+	for (i = 0; i < producer->msgcount; i++) {
+		res = pomp_msg_write(msg, MSG_DATA, "%u%u", producer->idx, i);
+		if (res == 0 && producer->mode == MODE_ASYNC) {
+			res = pomp_ctx_send_msg_async(s_ctx, msg);
+		} else if (res == 0) {
+			ref = pomp_msg_new_ref(msg);
+			res = ref == NULL ? -ENOMEM :
+					pomp_loop_post(s_loop, &post_send_cb, ref);
+		}
+		if (res < 0)
+			producer->errors++;
+		pomp_msg_clear(msg);
+	}
+
+	pomp_msg_destroy(msg);
+	return NULL;
+}
+
+/**
+ */
+static void server_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	if (event == POMP_EVENT_CONNECTED)
+		s_connected++;
+}
+
+/**
+ */
+static void receiver_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct receiver *receiver = userdata;
+
+	if (event == POMP_EVENT_MSG && ++receiver->count == receiver->msgcount)
+		receiver->done = 1;
+}
+
+/**
+ */
+static void *receiver_thread(void *arg)
+{
+	struct receiver *receiver = arg;
+	struct pomp_ctx *ctx = NULL;
+
+	ctx = pomp_ctx_new(&receiver_event_cb, receiver);
+	if (ctx == NULL)
+		return NULL;
+
+	if (pomp_ctx_connect(ctx, (const struct sockaddr *)receiver->addr,
+			sizeof(*receiver->addr)) == 0) {
+		while (!receiver->done)
+			pomp_ctx_wait_and_process(ctx, 1000);
+	}
+
+	pomp_ctx_stop(ctx);
+	pomp_ctx_destroy(ctx);
+
+	/* Notify main thread */
+	__sync_add_and_fetch(&s_finished, 1);
+	pomp_loop_wakeup(s_loop);
+	return NULL;
+}
+
+/**
+ */
+static double get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ */
+static int run(enum mode mode, uint32_t producercount, uint32_t msgcount)
+{
+	int res = 0;
+	uint32_t i = 0, errors = 0;
+	struct producer producers[MAX_PRODUCERS];
+	struct receiver receiver;
+	struct sockaddr_in addr;
+	const struct sockaddr *local_addr = NULL;
+	uint32_t local_addrlen = 0;
+	double start = 0, elapsed = 0;
+
+	/* Start server on an ephemeral port */
+	s_ctx = pomp_ctx_new_with_loop(&server_event_cb, NULL, s_loop);
+	if (s_ctx == NULL)
+		return -ENOMEM;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	res = pomp_ctx_listen(s_ctx, (const struct sockaddr *)&addr,
+			sizeof(addr));
+	if (res < 0)
+		goto out;
+	local_addr = pomp_ctx_get_local_addr(s_ctx, &local_addrlen);
+	if (local_addr == NULL || local_addrlen != sizeof(addr)) {
+		res = -EINVAL;
+		goto out;
+	}
+	memcpy(&addr, local_addr, sizeof(addr));
+
+	/* Wait for the receiver to be connected */
+	memset(&receiver, 0, sizeof(receiver));
+	receiver.addr = &addr;
+	receiver.msgcount = producercount * msgcount;
+	s_connected = 0;
+	s_finished = 0;
+	pthread_create(&receiver.thread, NULL, &receiver_thread, &receiver);
+	while (s_connected == 0)
+		pomp_loop_wait_and_process(s_loop, -1);
+
+	/* Run producers, the main thread sends their messages */
+	start = get_time();
+	for (i = 0; i < producercount; i++) {
+		producers[i].mode = mode;
+		producers[i].idx = i;
+		producers[i].msgcount = msgcount;
+		producers[i].errors = 0;
+		pthread_create(&producers[i].thread, NULL, &producer_thread,
+				&producers[i]);
+	}
+	while (__sync_add_and_fetch(&s_finished, 0) == 0)
+		pomp_loop_wait_and_process(s_loop, -1);
+	elapsed = get_time() - start;
+
+	for (i = 0; i < producercount; i++) {
+		pthread_join(producers[i].thread, NULL);
+		errors += producers[i].errors;
+	}
+	pthread_join(receiver.thread, NULL);
+
+	printf("mode=%s producers=%u msgs=%u errors=%u time=%.3fs "
+			"rate=%.0f msg/s\n",
+			mode == MODE_ASYNC ? "async" : "post",
+			producercount, producercount * msgcount, errors,
+			elapsed, (double)producercount * msgcount / elapsed);
+
+out:
+	pomp_ctx_stop(s_ctx);
+	pomp_ctx_destroy(s_ctx);
+	s_ctx = NULL;
+	return res;
+}
+
+/**
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "%s [-t <producers>] [-m <msgs>]\n", progname);
+	fprintf(stderr, "    <producers> threads (default 8) each sending "
+			"<msgs> messages (default 100000)\n");
+	fprintf(stderr, "    through pomp_ctx_send_msg_async and then "
+			"through pomp_loop_post\n");
+}
+
+/**
+ */
+int main(int argc, char *argv[])
+{
+	int argidx = 0;
+	uint32_t producercount = 8, msgcount = 100000;
+
+	/* Parse arguments */
+	for (argidx = 1; argidx < argc; argidx++) {
+		if (argidx + 1 >= argc) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		} else if (strcmp(argv[argidx], "-t") == 0) {
+			producercount = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-m") == 0) {
+			msgcount = (uint32_t)atoi(argv[++argidx]);
+		} else {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (producercount == 0 || producercount > MAX_PRODUCERS
+			|| msgcount == 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	s_loop = pomp_loop_new();
+	if (s_loop == NULL)
+		exit(EXIT_FAILURE);
+
+	if (run(MODE_ASYNC, producercount, msgcount) == 0)
+		run(MODE_POST, producercount, msgcount);
+
+	pomp_loop_destroy(s_loop);
+	return 0;
+}
@@ -0,0 +1,343 @@
+/**
+ * @file bench_edge.c
+ *
+ * @brief Measure syscalls per message in level and edge-triggered modes.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "ping_common.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_DATA	1
+
+/** Maximum size of message payload */
+#define MAX_PAYLOAD	65536
+
+/** Loop of the server context, run by the main thread */
+static struct pomp_loop *s_loop;
+
+/** Connection of the receiver in the server */
+static struct pomp_conn *s_conn;
+
+/** Size of socket buffers, 0 to keep system defaults */
+static int s_sockbuf = 16384;
+
+/** Set when the output queue of the server is empty */
+static int s_ready;
+
+/** Set when the receiver has got all messages */
+static uint32_t s_finished;
+
+/** Client receiving all messages in its own thread */
+struct receiver {
+	const struct sockaddr_in  *addr;
+	int                       edgetriggered;
+	pthread_t                 thread;
+	uint32_t                  msgcount;
+	uint32_t                  count;
+	volatile int              done;
+};
+
+/** Counters of a run */
+struct counters {
+	struct pomp_loop_stats  stats;
+	uint64_t                syscr;
+	uint64_t                syscw;
+};
+
+/**
+ */
+static void socket_cb(struct pomp_ctx *ctx, int fd,
+		enum pomp_socket_kind kind, void *userdata)
+{
+	if (s_sockbuf <= 0 || kind == POMP_SOCKET_KIND_SERVER)
+		return;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &s_sockbuf, sizeof(s_sockbuf));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &s_sockbuf, sizeof(s_sockbuf));
+}
+
+/**
+ */
+static void send_cb(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		struct pomp_buffer *buf, uint32_t status, void *cookie,
+		void *userdata)
+{
+	if (status & POMP_SEND_STATUS_QUEUE_EMPTY)
+		s_ready = 1;
+}
+
+/**
+ */
+static void server_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	if (event == POMP_EVENT_CONNECTED)
+		s_conn = conn;
+	else if (event == POMP_EVENT_DISCONNECTED)
+		s_conn = NULL;
+}
+
+/**
+ */
+static void receiver_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct receiver *receiver = userdata;
+
+	if (event == POMP_EVENT_MSG && ++receiver->count == receiver->msgcount)
+		receiver->done = 1;
+}
+
+/**
+ */
+static void *receiver_thread(void *arg)
+{
+	struct receiver *receiver = arg;
+	struct pomp_ctx *ctx = NULL;
+
+	ctx = pomp_ctx_new(&receiver_event_cb, receiver);
+	if (ctx == NULL)
+		return NULL;
+
+	pomp_ctx_set_socket_cb(ctx, &socket_cb);
+	pomp_ctx_set_edge_triggered(ctx, receiver->edgetriggered);
+	if (pomp_ctx_connect(ctx, (const struct sockaddr *)receiver->addr,
+			sizeof(*receiver->addr)) == 0) {
+		while (!receiver->done)
+			pomp_ctx_wait_and_process(ctx, 1000);
+	}
+
+	pomp_ctx_stop(ctx);
+	pomp_ctx_destroy(ctx);
+
+	/* Notify main thread */
+	__sync_add_and_fetch(&s_finished, 1);
+	pomp_loop_wakeup(s_loop);
+	return NULL;
+}
+
+/**
+ */
+static double get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Get counters of the server loop and read/write syscalls of the process
+ * (both server and receiver), if io accounting is available.
+ */
+static void get_counters(struct counters *counters)
+{
+	FILE *file = NULL;
+	char line[128];
+	unsigned long long val = 0;
+
+	memset(counters, 0, sizeof(*counters));
+	pomp_loop_get_stats(s_loop, &counters->stats);
+
+	file = fopen("/proc/self/io", "r");
+	if (file == NULL)
+		return;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "syscr: %llu", &val) == 1)
+			counters->syscr = val;
+		else if (sscanf(line, "syscw: %llu", &val) == 1)
+			counters->syscw = val;
+	}
+	fclose(file);
+}
+
+/**
+ */
+static int run(int edgetriggered, uint32_t msgcount, uint32_t burst,
+		uint32_t size)
+{
+	int res = 0;
+	uint32_t i = 0, sent = 0;
+	struct pomp_ctx *ctx = NULL;
+	struct pomp_msg *msg = NULL;
+	struct receiver receiver;
+	struct sockaddr_in addr;
+	const struct sockaddr *local_addr = NULL;
+	uint32_t local_addrlen = 0;
+	static uint8_t payload[MAX_PAYLOAD];
+	struct counters start, end;
+	double starttime = 0, elapsed = 0;
+
+	/* Start server on an ephemeral port */
+	ctx = pomp_ctx_new_with_loop(&server_event_cb, NULL, s_loop);
+	msg = pomp_msg_new();
+	if (ctx == NULL || msg == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	pomp_ctx_set_socket_cb(ctx, &socket_cb);
+	pomp_ctx_set_send_cb(ctx, &send_cb);
+	res = pomp_ctx_set_edge_triggered(ctx, edgetriggered);
+	if (res < 0)
+		goto out;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	res = pomp_ctx_listen(ctx, (const struct sockaddr *)&addr,
+			sizeof(addr));
+	if (res < 0)
+		goto out;
+	local_addr = pomp_ctx_get_local_addr(ctx, &local_addrlen);
+	if (local_addr == NULL || local_addrlen != sizeof(addr)) {
+		res = -EINVAL;
+		goto out;
+	}
+	memcpy(&addr, local_addr, sizeof(addr));
+
+	res = pomp_msg_write(msg, MSG_DATA, "%p%u", payload, size);
+	if (res < 0)
+		goto out;
+
+	/* Wait for the receiver to be connected */
+	memset(&receiver, 0, sizeof(receiver));
+	receiver.addr = &addr;
+	receiver.edgetriggered = edgetriggered;
+	receiver.msgcount = msgcount;
+	s_conn = NULL;
+	s_finished = 0;
+	pthread_create(&receiver.thread, NULL, &receiver_thread, &receiver);
+	while (s_conn == NULL)
+		pomp_loop_wait_and_process(s_loop, -1);
+
+	/* Send bursts of messages, next one when the output queue is empty */
+	get_counters(&start);
+	starttime = get_time();
+	s_ready = 1;
+	while (sent < msgcount && s_conn != NULL) {
+		if (s_ready) {
+			s_ready = 0;
+			for (i = 0; i < burst && sent < msgcount; i++, sent++)
+				pomp_conn_send_msg(s_conn, msg);
+		}
+		pomp_loop_wait_and_process(s_loop, s_ready ? 0 : -1);
+	}
+	while (__sync_add_and_fetch(&s_finished, 0) == 0)
+		pomp_loop_wait_and_process(s_loop, -1);
+	elapsed = get_time() - starttime;
+	get_counters(&end);
+	pthread_join(receiver.thread, NULL);
+
+	printf("mode=%s msgs=%u size=%u time=%.3fs rate=%.0f msg/s "
+			"waits/msg=%.3f events/msg=%.3f fd_changes/msg=%.3f "
+			"rw_syscalls/msg=%.3f\n",
+			edgetriggered ? "edge" : "level", msgcount, size,
+			elapsed, (double)msgcount / elapsed,
+			(double)(end.stats.waits - start.stats.waits)
+				/ msgcount,
+			(double)(end.stats.events - start.stats.events)
+				/ msgcount,
+			(double)(end.stats.fd_changes - start.stats.fd_changes)
+				/ msgcount,
+			(double)(end.syscr - start.syscr
+				+ end.syscw - start.syscw) / msgcount);
+
+out:
+	if (msg != NULL)
+		pomp_msg_destroy(msg);
+	if (ctx != NULL) {
+		pomp_ctx_stop(ctx);
+		pomp_ctx_destroy(ctx);
+	}
+	return res;
+}
+
+/**
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "%s [-m <msgs>] [-b <burst>] [-s <size>] "
+			"[-k <sockbuf>]\n", progname);
+	fprintf(stderr, "    send <msgs> messages (default 200000) of <size> "
+			"bytes (default 1024)\n");
+	fprintf(stderr, "    by bursts of <burst> messages (default 64) "
+			"with socket buffers of <sockbuf>\n");
+	fprintf(stderr, "    bytes (default 16384, 0 for system default), "
+			"first in level-triggered\n");
+	fprintf(stderr, "    mode then in edge-triggered mode\n");
+}
+
+/**
+ */
+int main(int argc, char *argv[])
+{
+	int argidx = 0;
+	uint32_t msgcount = 200000, burst = 64, size = 1024;
+
+	/* Parse arguments */
+	for (argidx = 1; argidx < argc; argidx++) {
+		if (argidx + 1 >= argc) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		} else if (strcmp(argv[argidx], "-m") == 0) {
+			msgcount = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-b") == 0) {
+			burst = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-s") == 0) {
+			size = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-k") == 0) {
+			s_sockbuf = atoi(argv[++argidx]);
+		} else {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (msgcount == 0 || burst == 0 || size > MAX_PAYLOAD) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	s_loop = pomp_loop_new();
+	if (s_loop == NULL)
+		exit(EXIT_FAILURE);
+
+	if (run(0, msgcount, burst, size) == 0) {
+		if (run(1, msgcount, burst, size) == -ENOSYS)
+			fprintf(stderr, "edge-triggered mode not supported\n");
+	}
+
+	pomp_loop_destroy(s_loop);
+	return 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * @file bench_latency.c
+ *
+ * @brief Measure ping-pong latency with and without loop busy polling.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "ping_common.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_PING	1
+#define MSG_PONG	2
+
+/** Echo server run in its own thread */
+struct server {
+	struct pomp_loop     *loop;
+	struct pomp_ctx      *ctx;
+	struct sockaddr_in   addr;
+	pthread_t            thread;
+	volatile int         stop;
+};
+
+/** Client side of a run */
+struct client {
+	struct pomp_conn     *conn;
+	uint32_t             pongs;
+};
+
+/**
+ */
+static void server_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	if (event == POMP_EVENT_MSG && pomp_msg_get_id(msg) == MSG_PING)
+		pomp_conn_send(conn, MSG_PONG, NULL);
+}
+
+/**
+ */
+static void *server_thread(void *arg)
+{
+	struct server *server = arg;
+
+	while (!server->stop)
+		pomp_loop_wait_and_process(server->loop, 100);
+	return NULL;
+}
+
+/**
+ */
+static void client_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct client *client = userdata;
+
+	if (event == POMP_EVENT_CONNECTED)
+		client->conn = conn;
+	else if (event == POMP_EVENT_DISCONNECTED)
+		client->conn = NULL;
+	else if (event == POMP_EVENT_MSG && pomp_msg_get_id(msg) == MSG_PONG)
+		client->pongs++;
+}
+
+/**
+ */
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ */
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *)a;
+	uint64_t vb = *(const uint64_t *)b;
+	return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+/**
+ */
+static double percentile_us(const uint64_t *samples, uint32_t count,
+		double pct)
+{
+	uint32_t idx = (uint32_t)(pct / 100.0 * (double)(count - 1) + 0.5);
+	return (double)samples[idx] / 1000.0;
+}
+
+/**
+ */
+static int run(uint32_t busypoll, uint32_t count, uint32_t warmup)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct server server;
+	struct client client;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx = NULL;
+	const struct sockaddr *local_addr = NULL;
+	uint32_t local_addrlen = 0;
+	uint64_t *samples = NULL;
+	uint64_t start = 0;
+	struct pomp_loop_stats stats;
+
+	memset(&server, 0, sizeof(server));
+	memset(&client, 0, sizeof(client));
+
+	samples = calloc(count, sizeof(*samples));
+	server.loop = pomp_loop_new();
+	loop = pomp_loop_new();
+	if (samples == NULL || server.loop == NULL || loop == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	pomp_loop_set_busy_poll(server.loop, busypoll);
+	pomp_loop_set_busy_poll(loop, busypoll);
+
+	/* Start echo server on an ephemeral port */
+	server.ctx = pomp_ctx_new_with_loop(&server_event_cb, &server,
+			server.loop);
+	if (server.ctx == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	pomp_ctx_set_busy_poll(server.ctx, busypoll);
+	server.addr.sin_family = AF_INET;
+	server.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	res = pomp_ctx_listen(server.ctx, (const struct sockaddr *)&server.addr,
+			sizeof(server.addr));
+	if (res < 0)
+		goto out;
+	local_addr = pomp_ctx_get_local_addr(server.ctx, &local_addrlen);
+	if (local_addr == NULL || local_addrlen != sizeof(server.addr)) {
+		res = -EINVAL;
+		goto out;
+	}
+	memcpy(&server.addr, local_addr, sizeof(server.addr));
+	pthread_create(&server.thread, NULL, &server_thread, &server);
+
+	/* Connect client */
+	ctx = pomp_ctx_new_with_loop(&client_event_cb, &client, loop);
+	if (ctx == NULL) {
+		res = -ENOMEM;
+		goto stop;
+	}
+	pomp_ctx_set_busy_poll(ctx, busypoll);
+	res = pomp_ctx_connect(ctx, (const struct sockaddr *)&server.addr,
+			sizeof(server.addr));
+	if (res < 0)
+		goto stop;
+	while (client.conn == NULL)
+		pomp_loop_wait_and_process(loop, -1);
+
+	/* Ping-pong, one message in flight at a time */
+	for (i = 0; i < warmup + count && client.conn != NULL; i++) {
+		start = get_time_ns();
+		client.pongs = 0;
+		pomp_conn_send(client.conn, MSG_PING, NULL);
+		while (client.pongs == 0 && client.conn != NULL)
+			pomp_loop_wait_and_process(loop, -1);
+		if (i >= warmup)
+			samples[i - warmup] = get_time_ns() - start;
+	}
+	if (i < warmup + count) {
+		res = -EPIPE;
+		goto stop;
+	}
+
+	qsort(samples, count, sizeof(*samples), &compare_u64);
+	pomp_loop_get_stats(loop, &stats);
+	printf("busypoll=%uus count=%u p50=%.1fus p99=%.1fus p99.9=%.1fus "
+			"max=%.1fus busy_polls=%.1f%%\n",
+			busypoll, count,
+			percentile_us(samples, count, 50.0),
+			percentile_us(samples, count, 99.0),
+			percentile_us(samples, count, 99.9),
+			(double)samples[count - 1] / 1000.0,
+			stats.waits == 0 ? 0.0 :
+			100.0 * (double)stats.busy_polls / (double)stats.waits);
+
+stop:
+	server.stop = 1;
+	pomp_loop_wakeup(server.loop);
+	pthread_join(server.thread, NULL);
+
+out:
+	if (ctx != NULL) {
+		pomp_ctx_stop(ctx);
+		pomp_ctx_destroy(ctx);
+	}
+	if (server.ctx != NULL) {
+		pomp_ctx_stop(server.ctx);
+		pomp_ctx_destroy(server.ctx);
+	}
+	if (loop != NULL)
+		pomp_loop_destroy(loop);
+	if (server.loop != NULL)
+		pomp_loop_destroy(server.loop);
+	free(samples);
+	return res;
+}
+
+/**
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "%s [-n <count>] [-p <busypoll>]\n", progname);
+	fprintf(stderr, "    measure <count> round trips (default 100000) "
+			"first with blocking waits\n");
+	fprintf(stderr, "    then with <busypoll> microseconds of busy "
+			"polling (default 50)\n");
+}
+
+/**
+ */
+int main(int argc, char *argv[])
+{
+	int argidx = 0;
+	uint32_t count = 100000, busypoll = 50;
+
+	/* Parse arguments */
+	for (argidx = 1; argidx < argc; argidx++) {
+		if (argidx + 1 >= argc) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		} else if (strcmp(argv[argidx], "-n") == 0) {
+			count = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-p") == 0) {
+			busypoll = (uint32_t)atoi(argv[++argidx]);
+		} else {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (count == 0 || busypoll == 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Spinning only helps if both sides run on their own cpu */
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+		fprintf(stderr, "warning: less than 2 cpus online\n");
+
+	if (run(0, count, count / 10) == 0)
+		run(busypoll, count, count / 10);
+	return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file bench_loop.c
+ *
+ * @brief Measure the cost of a loop iteration depending on the number of fds.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "ping_common.h"
+
+#include <time.h>
+#include <sys/resource.h>
+
+/** Maximum number of registered fds */
+#define MAX_FDS		16384
+
+/**
+ * Internal loop operations, only exported by builds with tests enabled. They
+ * allow measuring the poll implementation on platforms where it is not the
+ * default one.
+ */
+struct pomp_loop_ops;
+extern const struct pomp_loop_ops pomp_loop_poll_ops __attribute__((weak));
+extern const struct pomp_loop_ops *pomp_loop_set_ops(
+		const struct pomp_loop_ops *ops) __attribute__((weak));
+
+/** Read end and write end of pipes */
+static int s_fds[MAX_FDS][2];
+
+/**
+ */
+static void fd_cb(int fd, uint32_t revents, void *userdata)
+{
+	uint32_t *count = userdata;
+	(*count)++;
+}
+
+/**
+ */
+static double get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run iterations of a loop with 'fdcount' registered fds, 'active' of them
+ * being always readable.
+ */
+static int run(uint32_t fdcount, uint32_t active, uint32_t iterations)
+{
+	int res = 0;
+	uint32_t i = 0, count = 0, created = 0, registered = 0;
+	struct pomp_loop *loop = NULL;
+	double start = 0, elapsed = 0;
+
+	loop = pomp_loop_new();
+	if (loop == NULL)
+		return -ENOMEM;
+
+	/* Fds are never read, so active ones stay readable */
+	for (i = 0; i < fdcount; i++) {
+		if (pipe(s_fds[i]) < 0) {
+			res = -errno;
+			fprintf(stderr, "pipe: %s\n", strerror(errno));
+			goto out;
+		}
+		created++;
+		if (i < active && write(s_fds[i][1], "x", 1) != 1) {
+			res = -errno;
+			goto out;
+		}
+		res = pomp_loop_add(loop, s_fds[i][0], POMP_FD_EVENT_IN,
+				&fd_cb, &count);
+		if (res < 0)
+			goto out;
+		registered++;
+	}
+
+	/* Each iteration also changes the events of an idle fd */
+	start = get_time();
+	for (i = 0; i < iterations; i++) {
+		if (fdcount > active) {
+			pomp_loop_update(loop, s_fds[fdcount - 1][0], (i & 1) ?
+					POMP_FD_EVENT_IN : POMP_FD_EVENT_PRI);
+		}
+		pomp_loop_wait_and_process(loop, 0);
+	}
+	elapsed = get_time() - start;
+
+	printf("fds=%u active=%u iterations=%u time/iter=%.2fus "
+			"time/fd=%.1fns\n",
+			fdcount, active, iterations,
+			elapsed * 1e6 / iterations,
+			elapsed * 1e9 / iterations / fdcount);
+	if (count != iterations * active)
+		fprintf(stderr, "unexpected notifications: %u\n", count);
+
+out:
+	for (i = 0; i < registered; i++)
+		pomp_loop_remove(loop, s_fds[i][0]);
+	for (i = 0; i < created; i++) {
+		close(s_fds[i][0]);
+		close(s_fds[i][1]);
+	}
+	pomp_loop_destroy(loop);
+	return res;
+}
+
+/**
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "%s [-a <active>] [-p]\n", progname);
+	fprintf(stderr, "    run loop iterations with 16 to %u fds, "
+			"<active> of them (default 8)\n", MAX_FDS);
+	fprintf(stderr, "    being always readable, -p to use the poll "
+			"implementation\n");
+}
+
+/**
+ */
+int main(int argc, char *argv[])
+{
+	int argidx = 0;
+	uint32_t active = 8, fdcount = 0, maxfds = MAX_FDS;
+	struct rlimit rlim;
+
+	/* Parse arguments */
+	for (argidx = 1; argidx < argc; argidx++) {
+		if (strcmp(argv[argidx], "-p") == 0) {
+			if (pomp_loop_set_ops == NULL ||
+					&pomp_loop_poll_ops == NULL) {
+				fprintf(stderr, "poll implementation not "
+						"available in this build\n");
+				exit(EXIT_FAILURE);
+			}
+			pomp_loop_set_ops(&pomp_loop_poll_ops);
+		} else if (strcmp(argv[argidx], "-a") == 0 &&
+				argidx + 1 < argc) {
+			active = (uint32_t)atoi(argv[++argidx]);
+		} else {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (active == 0 || active > 16) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Each pipe needs 2 fds, keep some for the loop itself */
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == 0) {
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+		getrlimit(RLIMIT_NOFILE, &rlim);
+		if (rlim.rlim_cur != RLIM_INFINITY &&
+				(rlim.rlim_cur - 16) / 2 < maxfds)
+			maxfds = (uint32_t)((rlim.rlim_cur - 16) / 2);
+	}
+
+	for (fdcount = 16; fdcount <= maxfds; fdcount *= 4) {
+		if (run(fdcount, active, 4000000 / fdcount + 1000) < 0)
+			break;
+	}
+	return 0;
+}
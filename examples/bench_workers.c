@@ -0,0 +1,349 @@
+/**
+ * @file bench_workers.c
+ *
+ * @brief Measure the scaling of a server with 1 to N worker loops.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "ping_common.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_PING	1
+
+#define DIAG_PFX "BENCH: "
+
+#define diag(_fmt, ...) \
+	fprintf(stderr, DIAG_PFX _fmt "\n", ##__VA_ARGS__)
+
+/** Maximum number of worker loops */
+#define MAX_LOOPS	64
+
+/** Worker loop run by its own thread */
+struct worker {
+	struct pomp_loop  *loop;
+	pthread_t         thread;
+	uint32_t          cpu;
+	int               pin;
+	volatile int      stop;
+};
+
+/** Client run by its own thread with its own context */
+struct client {
+	const struct sockaddr_in  *addr;
+	pthread_t                 thread;
+	uint32_t                  msgcount;
+	uint32_t                  count;
+	int                       done;
+};
+
+/** Loop of the server context, run by the main thread */
+static struct pomp_loop *s_loop;
+
+/** Number of clients that have finished */
+static uint32_t s_finished;
+
+/**
+ */
+static void *worker_thread(void *arg)
+{
+	struct worker *worker = arg;
+#ifdef __linux__
+	cpu_set_t cpuset;
+
+	if (worker->pin) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(worker->cpu, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+				&cpuset) != 0) {
+			diag("Unable to pin worker on cpu %u", worker->cpu);
+		}
+	}
+#endif /* __linux__ */
+
+	while (!worker->stop)
+		pomp_loop_wait_and_process(worker->loop, -1);
+	return NULL;
+}
+
+/**
+ */
+static int worker_start(struct worker *worker, uint32_t cpu, int pin)
+{
+	memset(worker, 0, sizeof(*worker));
+	worker->cpu = cpu;
+	worker->pin = pin;
+	worker->loop = pomp_loop_new();
+	if (worker->loop == NULL)
+		return -ENOMEM;
+	return -pthread_create(&worker->thread, NULL, &worker_thread, worker);
+}
+
+/**
+ */
+static void worker_stop(struct worker *worker)
+{
+	worker->stop = 1;
+	pomp_loop_wakeup(worker->loop);
+	pthread_join(worker->thread, NULL);
+	pomp_loop_destroy(worker->loop);
+	worker->loop = NULL;
+}
+
+/**
+ */
+static void server_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	/* Echo messages from the worker thread owning the connection */
+	if (event == POMP_EVENT_MSG)
+		pomp_conn_send_msg(conn, msg);
+}
+
+/**
+ */
+static void client_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct client *client = userdata;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		pomp_conn_send(conn, MSG_PING, "%u", client->count);
+		break;
+
+	case POMP_EVENT_MSG:
+		if (++client->count < client->msgcount)
+			pomp_conn_send(conn, MSG_PING, "%u", client->count);
+		else
+			client->done = 1;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		break;
+	}
+}
+
+/**
+ */
+static void *client_thread(void *arg)
+{
+	struct client *client = arg;
+	struct pomp_ctx *ctx = NULL;
+
+	ctx = pomp_ctx_new(&client_event_cb, client);
+	if (ctx == NULL)
+		return NULL;
+
+	if (pomp_ctx_connect(ctx, (const struct sockaddr *)client->addr,
+			sizeof(*client->addr)) == 0) {
+		while (!client->done)
+			pomp_ctx_wait_and_process(ctx, 1000);
+	}
+
+	pomp_ctx_stop(ctx);
+	pomp_ctx_destroy(ctx);
+
+	/* Notify main thread */
+	__sync_add_and_fetch(&s_finished, 1);
+	pomp_loop_wakeup(s_loop);
+	return NULL;
+}
+
+/**
+ */
+static double get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ */
+static int run(uint32_t loopcount, uint32_t clientcount, uint32_t msgcount,
+		enum pomp_worker_policy policy)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct worker workers[MAX_LOOPS];
+	struct pomp_loop *loops[MAX_LOOPS];
+	struct client *clients = NULL;
+	struct pomp_ctx *ctx = NULL;
+	struct sockaddr_in addr;
+	const struct sockaddr *local_addr = NULL;
+	uint32_t local_addrlen = 0;
+	int pin = policy == POMP_WORKER_POLICY_REUSEPORT_CPU;
+	double start = 0, elapsed = 0;
+
+	/* Start worker loops */
+	for (i = 0; i < loopcount; i++) {
+		res = worker_start(&workers[i], i, pin);
+		if (res < 0)
+			return res;
+		loops[i] = workers[i].loop;
+	}
+
+	/* Start server on an ephemeral port */
+	ctx = pomp_ctx_new_with_loop(&server_event_cb, NULL, s_loop);
+	if (ctx == NULL)
+		return -ENOMEM;
+	res = pomp_ctx_set_workers(ctx, loops, loopcount, policy);
+	if (res < 0) {
+		diag("pomp_ctx_set_workers: err=%d(%s)", res, strerror(-res));
+		goto out;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	res = pomp_ctx_listen(ctx, (const struct sockaddr *)&addr,
+			sizeof(addr));
+	if (res < 0)
+		goto out;
+	local_addr = pomp_ctx_get_local_addr(ctx, &local_addrlen);
+	if (local_addr == NULL || local_addrlen != sizeof(addr)) {
+		res = -EINVAL;
+		goto out;
+	}
+	memcpy(&addr, local_addr, sizeof(addr));
+
+	/* Run clients */
+	clients = calloc(clientcount, sizeof(*clients));
+	if (clients == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	s_finished = 0;
+	start = get_time();
+	for (i = 0; i < clientcount; i++) {
+		clients[i].addr = &addr;
+		clients[i].msgcount = msgcount;
+		pthread_create(&clients[i].thread, NULL, &client_thread,
+				&clients[i]);
+	}
+
+	/* Accept connections until all clients have finished */
+	while (__sync_add_and_fetch(&s_finished, 0) < clientcount)
+		pomp_loop_wait_and_process(s_loop, -1);
+	elapsed = get_time() - start;
+	for (i = 0; i < clientcount; i++)
+		pthread_join(clients[i].thread, NULL);
+
+	printf("loops=%u clients=%u msgs=%u time=%.3fs rate=%.0f msg/s\n",
+			loopcount, clientcount, clientcount * msgcount,
+			elapsed, (double)clientcount * msgcount / elapsed);
+
+out:
+	/* Stop waits for the workers to close their connections */
+	free(clients);
+	pomp_ctx_stop(ctx);
+	pomp_ctx_destroy(ctx);
+	for (i = 0; i < loopcount; i++)
+		worker_stop(&workers[i]);
+	return res;
+}
+
+/**
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "%s [-n <loops>] [-c <clients>] [-m <msgs>] "
+			"[-p <policy>]\n", progname);
+	fprintf(stderr, "    run the benchmark with 1 to <loops> worker "
+			"loops (default 4)\n");
+	fprintf(stderr, "    <clients> connections (default 32) doing "
+			"<msgs> round trips (default 10000)\n");
+	fprintf(stderr, "<policy> : dispatch, reuseport or reuseport-cpu "
+			"(default dispatch)\n");
+}
+
+/**
+ */
+int main(int argc, char *argv[])
+{
+	int argidx = 0;
+	uint32_t n = 0;
+	uint32_t loopcount = 4, clientcount = 32, msgcount = 10000;
+	enum pomp_worker_policy policy = POMP_WORKER_POLICY_ROUND_ROBIN;
+
+	/* Parse arguments */
+	for (argidx = 1; argidx < argc; argidx++) {
+		if (argidx + 1 >= argc) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		} else if (strcmp(argv[argidx], "-n") == 0) {
+			loopcount = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-c") == 0) {
+			clientcount = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-m") == 0) {
+			msgcount = (uint32_t)atoi(argv[++argidx]);
+		} else if (strcmp(argv[argidx], "-p") == 0) {
+			argidx++;
+			if (strcmp(argv[argidx], "dispatch") == 0) {
+				policy = POMP_WORKER_POLICY_ROUND_ROBIN;
+			} else if (strcmp(argv[argidx], "reuseport") == 0) {
+				policy = POMP_WORKER_POLICY_REUSEPORT;
+			} else if (strcmp(argv[argidx], "reuseport-cpu") == 0) {
+				policy = POMP_WORKER_POLICY_REUSEPORT_CPU;
+			} else {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (loopcount == 0 || loopcount > MAX_LOOPS
+			|| clientcount == 0 || msgcount == 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Loop of the server context, only used to accept in dispatch mode */
+	s_loop = pomp_loop_new();
+	if (s_loop == NULL)
+		exit(EXIT_FAILURE);
+
+	for (n = 1; n <= loopcount; n++) {
+		if (run(n, clientcount, msgcount, policy) < 0)
+			break;
+	}
+
+	pomp_loop_destroy(s_loop);
+	return 0;
+}
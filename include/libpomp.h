@@ -129,6 +129,83 @@ enum pomp_send_status {
 	POMP_SEND_STATUS_QUEUE_EMPTY = 0x08,	/**< No more buffer in queue */
 };
 
+/** Policy used by a server to dispatch accepted connections to workers */
+enum pomp_worker_policy {
+	/** Each worker in turn */
+	POMP_WORKER_POLICY_ROUND_ROBIN = 0,
+	/** Worker with the least number of connections */
+	POMP_WORKER_POLICY_LEAST_LOADED,
+	/**
+	 * Each worker listens on its own socket with SO_REUSEPORT and the
+	 * kernel balances new connections between them. Only TCP/IP sockets
+	 * can be shared, unix sockets use round robin instead.
+	 */
+	POMP_WORKER_POLICY_REUSEPORT,
+	/**
+	 * Same as POMP_WORKER_POLICY_REUSEPORT but a connection is given to
+	 * the worker whose index is the cpu receiving it (modulo the number of
+	 * workers). Worker threads should be pinned on their cpu.
+	 */
+	POMP_WORKER_POLICY_REUSEPORT_CPU,
+};
+
+/** Policy used by a pooled client to choose the connection of a message */
+enum pomp_balance_policy {
+	/** Each connection in turn */
+	POMP_BALANCE_POLICY_ROUND_ROBIN = 0,
+	/** Connection with the least data waiting to be written */
+	POMP_BALANCE_POLICY_LEAST_QUEUED,
+	/**
+	 * Connection chosen by rendezvous hashing of the message id (or the
+	 * key given to pomp_ctx_send_msg_key), so messages with the same key
+	 * keep using the same connection. Only the keys of a disconnected
+	 * connection move to other ones.
+	 */
+	POMP_BALANCE_POLICY_HASH,
+};
+
+/**
+ * First message id reserved for messages handled internally by the library.
+ * Applications shall not use message ids greater or equal to this value.
+ */
+#define POMP_MSGID_RESERVED_BASE	0xffffff00u
+
+/**
+ * Subscribe to a range of message ids, format is "%u%u" (first, last).
+ * Handled internally by server contexts with subscription enabled.
+ */
+#define POMP_MSGID_SUBSCRIBE		(POMP_MSGID_RESERVED_BASE + 0)
+
+/**
+ * Unsubscribe from a range of message ids, format is "%u%u" (first, last).
+ * Handled internally by server contexts with subscription enabled.
+ */
+#define POMP_MSGID_UNSUBSCRIBE		(POMP_MSGID_RESERVED_BASE + 1)
+
+/**
+ * Rpc request, format is "%u%u" (rpc id, message id) followed by the
+ * arguments of the request. Handled internally by all contexts.
+ */
+#define POMP_MSGID_RPC_REQUEST		(POMP_MSGID_RESERVED_BASE + 2)
+
+/**
+ * Rpc reply, format is "%u%u" (rpc id, message id) followed by the
+ * arguments of the reply. Handled internally by all contexts.
+ */
+#define POMP_MSGID_RPC_REPLY		(POMP_MSGID_RESERVED_BASE + 3)
+
+/**
+ * Heartbeat ping, format is "%llu" (time stamp of the sender). Sent by
+ * contexts with a heartbeat, always answered internally with a pong.
+ */
+#define POMP_MSGID_PING			(POMP_MSGID_RESERVED_BASE + 4)
+
+/**
+ * Heartbeat pong, format is "%llu" (time stamp of the ping). Handled
+ * internally to measure the round trip time of the connection.
+ */
+#define POMP_MSGID_PONG			(POMP_MSGID_RESERVED_BASE + 5)
+
 /** Peer credentials for local sockets */
 struct pomp_cred {
 	uint32_t	pid;	/**< PID of sending process */
@@ -136,6 +213,57 @@ struct pomp_cred {
 	uint32_t	gid;	/**< GID of sending process */
 };
 
+/** Statistics of the pool of threads running message handlers */
+struct pomp_handler_pool_stats {
+	uint32_t	threads;	/**< Number of threads */
+	uint32_t	queued;		/**< Messages waiting for a thread */
+	uint32_t	max_queued;	/**< Highest number of waiting messages */
+	uint32_t	running;	/**< Handlers currently running */
+	uint64_t	handled;	/**< Number of handled messages */
+	uint64_t	steals;		/**< Connections taken by an idle thread
+					  *  from the queue of another one */
+	uint64_t	total_handler_time_us;	/**< Cumulated handler time */
+	uint64_t	max_handler_time_us;	/**< Longest handler time */
+};
+
+/** Statistics of a loop */
+struct pomp_loop_stats {
+	uint64_t	waits;		/**< Number of waits for events */
+	uint64_t	events;		/**< Number of events returned by waits */
+	uint64_t	fd_changes;	/**< Number of fd registrations,
+					  *  updates and removals applied to
+					  *  the implementation */
+	uint64_t	full_waits;	/**< Number of waits that returned as
+					  *  many events as the batch size */
+	uint32_t	batch_size;	/**< Current maximum number of events
+					  *  returned by a wait, 0 if not
+					  *  limited by the implementation */
+	uint64_t	busy_polls;	/**< Number of waits satisfied while
+					  *  busy polling */
+	uint64_t	fd_coalesced;	/**< Number of fd updates merged or
+					  *  dropped before reaching the
+					  *  implementation */
+};
+
+/** Statistics of inbound rate limiting */
+struct pomp_throttle_stats {
+	uint64_t	throttles;	/**< Number of times reads (or accepts)
+					  *  were suspended */
+	uint64_t	throttled_us;	/**< Cumulated time reads (or accepts)
+					  *  were suspended */
+	uint64_t	rejected;	/**< Number of connections closed because
+					  *  the maximum was reached */
+};
+
+/** Round trip time of a connection, measured by heartbeats (in us) */
+struct pomp_conn_rtt {
+	uint32_t	last;		/**< Last sample */
+	uint32_t	srtt;		/**< Smoothed round trip time */
+	uint32_t	rttvar;		/**< Smoothed deviation (jitter) */
+	uint32_t	min;		/**< Minimum sample */
+	uint32_t	count;		/**< Number of samples, 0 if none */
+};
+
 /**
  * Context event callback prototype.
  * @param ctx : context.
@@ -221,6 +349,20 @@ typedef void (*pomp_timer_cb_t) (struct pomp_timer *timer, void *userdata);
  */
 typedef void (*pomp_idle_cb_t)(void *userdata);
 
+/**
+ * Rpc completion callback.
+ * @param conn : connection on which the request was sent.
+ * @param status : 0 if a reply was received, -ETIMEDOUT if no reply was
+ * received before the timeout, -ECANCELED if the connection was closed.
+ * @param msg : reply message if status is 0, NULL otherwise.
+ * @param userdata : user data given in pomp_rpc_call.
+ */
+typedef void (*pomp_rpc_cb_t)(
+		struct pomp_conn *conn,
+		int status,
+		const struct pomp_msg *msg,
+		void *userdata);
+
 /*
  * Context API.
  */
@@ -293,6 +435,263 @@ POMP_API int pomp_ctx_set_send_cb(struct pomp_ctx *ctx, pomp_send_cb_t cb);
 POMP_API int pomp_ctx_setup_keepalive(struct pomp_ctx *ctx, int enable,
 		int idle, int interval, int count);
 
+/**
+ * Setup the reconnection policy of a client context, also used by server and
+ * dgram contexts to retry binding an address not yet available. The delay
+ * between attempts starts at 'initial' and is multiplied after each failed
+ * attempt up to 'max'. Each delay is randomly shortened by up to 'jitter'
+ * percent of it, so that many clients losing a server at the same time do not
+ * reconnect in lockstep. The schedule restarts after a successful connection.
+ * @param ctx : context.
+ * @param initial : first delay (in ms).
+ * @param max : maximum delay (in ms), at least 'initial'.
+ * @param multiplier : growth of delay after each attempt, in percent (100
+ * for a fixed delay, 200 to double it).
+ * @param jitter : randomized part of each delay, in percent (0 to 100).
+ * @param immediate : 1 to retry immediately the first time, 0 otherwise.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default values if nothing else is specified is
+ * (2000, 2000, 100, 0, 0), a fixed delay of 2 seconds. Settings apply to the
+ * next scheduled attempt.
+ */
+POMP_API int pomp_ctx_setup_reconnect(struct pomp_ctx *ctx, uint32_t initial,
+		uint32_t max, uint32_t multiplier, uint32_t jitter,
+		int immediate);
+
+/**
+ * Setup an application level heartbeat. Each connection of the context
+ * periodically sends a ping (POMP_MSGID_PING) that the peer library answers
+ * with a pong, giving round trip time samples (see pomp_conn_get_rtt). A
+ * connection whose peer does not answer within the timeout is disconnected,
+ * so a stalled peer is detected long before TCP keepalive would.
+ * @param ctx : context.
+ * @param interval : interval between pings (in ms), 0 to disable.
+ * @param timeout : time without ping or pong from the peer after which the
+ * connection is disconnected (in ms), 0 to only measure round trip times.
+ * It should be several times the interval, detection happens at the first
+ * ping after its expiration.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is disabled. Pings are always answered, whatever the
+ * settings of the context. It can not be used with raw contexts, and does not
+ * apply to dgram contexts. Connections owned by worker loops are checked by
+ * their own worker thread.
+ */
+POMP_API int pomp_ctx_set_heartbeat(struct pomp_ctx *ctx, uint32_t interval,
+		uint32_t timeout);
+
+/**
+ * Limit the data read from a connection per loop iteration, so a peer
+ * sending continuously does not starve other connections and timers of the
+ * loop. Once a limit is reached, reading stops and resumes at the next
+ * iteration of the loop. Limits are checked after each read of the socket,
+ * so they can be exceeded by at most one read buffer. Settings will be
+ * applied to all future connections. Current connections (if any) will not be
+ * affected.
+ * @param ctx : context.
+ * @param maxbytes : maximum number of bytes read per iteration, 0 for no
+ * limit.
+ * @param maxmsgs : maximum number of messages notified per iteration, 0 for
+ * no limit.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is no limit, connections are read until no more data is
+ * available.
+ */
+POMP_API int pomp_ctx_set_read_budget(struct pomp_ctx *ctx,
+		uint32_t maxbytes, uint32_t maxmsgs);
+
+/**
+ * Limit the rate of messages and bytes received on each connection with
+ * token buckets. When a connection has consumed its tokens, its reads are
+ * suspended until they are refilled, so a flooding peer is slowed down by
+ * TCP flow control instead of saturating the loop. Settings will be applied
+ * to all future connections. Current connections (if any) will not be
+ * affected.
+ * @param ctx : context.
+ * @param msgrate : messages per second, 0 for no limit.
+ * @param msgburst : maximum number of messages read at once after an idle
+ * period, 0 for one second of messages.
+ * @param byterate : bytes per second, 0 for no limit.
+ * @param byteburst : maximum number of bytes read at once after an idle
+ * period, 0 for one second of bytes.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is no limit. Limits are checked after each read of the
+ * socket, bytes or messages read in excess are deducted from the following
+ * tokens. Dgram contexts are not affected.
+ */
+POMP_API int pomp_ctx_set_rate_limit(struct pomp_ctx *ctx,
+		uint32_t msgrate, uint32_t msgburst,
+		uint32_t byterate, uint32_t byteburst);
+
+/**
+ * Limit the rate of bytes sent on each connection. TCP/IP connections are
+ * paced by the kernel with SO_MAX_PACING_RATE when available. Otherwise
+ * writes are paced with a token bucket: data not allowed yet stays queued
+ * and is written when tokens are refilled. Settings will be applied to all
+ * future connections. Current connections (if any) will not be affected.
+ * @param ctx : context.
+ * @param rate : bytes per second, 0 for no limit.
+ * @param burst : maximum number of bytes written at once after an idle
+ * period, 0 for one second of bytes. It is not used by the kernel pacing.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is no limit. The send callback (see
+ * pomp_ctx_set_send_cb) is called with POMP_SEND_STATUS_OK once a buffer
+ * is really written, and POMP_SEND_STATUS_QUEUE_EMPTY once all paced data
+ * is written. Buffers still paced when the connection is closed are
+ * completed with POMP_SEND_STATUS_ABORTED. The kernel pacing requires the
+ * fq queueing discipline or a kernel with TCP internal pacing (4.13).
+ * Dgram contexts are not affected.
+ */
+POMP_API int pomp_ctx_set_pacing(struct pomp_ctx *ctx,
+		uint32_t rate, uint32_t burst);
+
+/**
+ * Setup the admission control of a server context. Connections accepted
+ * beyond the maximum are closed immediately. Accepts beyond the rate are
+ * postponed, the pending connections waiting in the listening queue of the
+ * system until tokens are refilled.
+ * @param ctx : context.
+ * @param maxconns : maximum number of connections, 0 for the default.
+ * @param acceptrate : accepted connections per second, 0 for no limit.
+ * @param acceptburst : maximum number of connections accepted at once, 0
+ * for one second of connections.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is a maximum of 32 connections and no rate limit. With
+ * workers, the maximum and the rate are shared by all listening sockets,
+ * including the own sockets of workers with SO_REUSEPORT policies. Workers
+ * accepting concurrently may exceed the rate by a few connections, delaying
+ * next accepts accordingly.
+ */
+POMP_API int pomp_ctx_set_admission(struct pomp_ctx *ctx, uint32_t maxconns,
+		uint32_t acceptrate, uint32_t acceptburst);
+
+/**
+ * Get the statistics of the admission control of a server context.
+ * @param ctx : context.
+ * @param stats : structure to fill, throttles count the pauses of accepts.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_ctx_get_throttle_stats(const struct pomp_ctx *ctx,
+		struct pomp_throttle_stats *stats);
+
+/**
+ * Register the fds of connections in edge-triggered mode, with both input
+ * and output events always monitored. The loop does not need to be updated
+ * anymore when the output queue of a connection becomes empty or not, at the
+ * cost of always reading and writing until the operation would block.
+ * Settings will be applied to all future connections. Current connections (if
+ * any) will not be affected.
+ * @param ctx : context.
+ * @param enable : 1 to enable, 0, to disable.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -ENOSYS is returned if the loop implementation does not support
+ * edge-triggered notifications (only epoll does).
+ *
+ * @remarks Default is level-triggered mode. Datagram contexts are not
+ * affected.
+ */
+POMP_API int pomp_ctx_set_edge_triggered(struct pomp_ctx *ctx, int enable);
+
+/**
+ * Set the SO_BUSY_POLL option on the TCP/IP and UDP sockets of the context,
+ * so blocking receives poll the device queue for the given time instead of
+ * waiting for an interrupt. To be combined with pomp_loop_set_busy_poll for
+ * lowest latency. Settings will be applied to all future sockets. Current
+ * sockets (if any) will not be affected.
+ * @param ctx : context.
+ * @param usecs : busy poll time in microseconds, 0 to disable.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -ENOSYS is returned if the option is not supported by the platform.
+ *
+ * @remarks Default is disabled. Values above the system default
+ * (net.core.busy_read) require the CAP_NET_ADMIN capability, failure to set
+ * the option on a socket is only logged.
+ */
+POMP_API int pomp_ctx_set_busy_poll(struct pomp_ctx *ctx, uint32_t usecs);
+
+/**
+ * Enable subscription based broadcast in a server context.
+ * Clients then only receive the messages broadcast with pomp_ctx_send_msg
+ * (and variants) whose id they have subscribed to. Subscription messages
+ * (POMP_MSGID_SUBSCRIBE and POMP_MSGID_UNSUBSCRIBE) are handled internally
+ * and not notified to the application. Messages sent explicitly to a
+ * connection are not filtered.
+ * @param ctx : context.
+ * @param enable : 1 to enable, 0, to disable.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks this function shall be called before starting the context and can
+ * not be used with raw contexts.
+ */
+POMP_API int pomp_ctx_set_subscription(struct pomp_ctx *ctx, int enable);
+
+/**
+ * Let worker loops own the connections accepted by a server context.
+ * The context loop only accepts connections, each one is then handed over to
+ * a worker loop chosen with the given policy. With SO_REUSEPORT policies the
+ * workers accept connections themselves on their own listening socket. All
+ * events of a connection (connection, messages, disconnection) are notified
+ * in the thread running its worker loop, so the event callback shall be
+ * thread safe. Broadcasts
+ * with pomp_ctx_send_msg (and variants) are queued to every worker and sent
+ * by their own thread.
+ * @param ctx : context.
+ * @param loops : array of worker loops, each one run by its own thread.
+ * @param count : number of worker loops, 0 to use the context loop only.
+ * @param policy : policy used to choose the worker of a new connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -ENOSYS is returned if threads or the policy are not supported.
+ *
+ * @remarks this function shall be called before starting the context. Worker
+ * loops shall be different from the context loop and keep running until
+ * pomp_ctx_stop returns, as it waits for the workers to disconnect their
+ * connections, so pomp_ctx_stop returns -EBUSY if called from a worker
+ * thread. A connection shall only be used from its worker thread and
+ * pomp_ctx_get_next_conn does not list worker connections.
+ */
+POMP_API int pomp_ctx_set_workers(struct pomp_ctx *ctx,
+		struct pomp_loop * const *loops, uint32_t count,
+		enum pomp_worker_policy policy);
+
+/**
+ * Run the handling of messages in a pool of threads instead of the thread of
+ * the loop. Messages received on a connection are notified one at a time in
+ * their order of reception, messages of different connections are notified
+ * in parallel, so the event callback shall be thread safe. Connection and
+ * disconnection events are still notified in the thread of the loop, the
+ * disconnection once the messages of the connection have been handled or
+ * dropped. Messages sent from a thread of the pool with pomp_conn_send_msg,
+ * pomp_ctx_send_msg, pomp_rpc_reply (and variants) are queued and written
+ * by the thread of the loop.
+ * @param ctx : context.
+ * @param threadcount : number of threads, 0 to handle messages in the thread
+ * of the loop.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -ENOSYS is returned if threads are not supported.
+ *
+ * @remarks this function shall be called before starting the context and can
+ * not be used with raw contexts. Other functions of the context and of its
+ * connections (pomp_rpc_call for example) shall not be called from a thread
+ * of the pool.
+ */
+POMP_API int pomp_ctx_set_handler_pool(struct pomp_ctx *ctx,
+		uint32_t threadcount);
+
+/**
+ * Get statistics of the pool of threads running message handlers.
+ * @param ctx : context.
+ * @param stats : returned statistics.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -ENOENT is returned if no pool is set.
+ */
+POMP_API int pomp_ctx_get_handler_pool_stats(struct pomp_ctx *ctx,
+		struct pomp_handler_pool_stats *stats);
+
 /**
  * Destroy a context.
  * @param ctx : context.
@@ -323,6 +722,32 @@ POMP_API int pomp_ctx_listen(struct pomp_ctx *ctx,
 POMP_API int pomp_ctx_connect(struct pomp_ctx *ctx,
 		const struct sockaddr *addr, uint32_t addrlen);
 
+/**
+ * Start a pooled client, maintaining several connections spread over one or
+ * more server addresses. Each connection reconnects on its own like a client
+ * started with pomp_ctx_connect. Messages sent with pomp_ctx_send_msg (and
+ * variants) go to a single connection chosen with the given policy among the
+ * connected ones, so sends fail over to the remaining connections when a
+ * server goes away. Events of all connections are notified with this context.
+ * Call pomp_ctx_stop to disconnect and stop everything.
+ * @param ctx : context.
+ * @param addrs : array of remote addresses to connect to.
+ * @param addrlens : array of remote address sizes.
+ * @param addrcount : number of addresses.
+ * @param conncount : number of connections, assigned to addresses in turn.
+ * @param policy : policy used to choose the connection of a message.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Settings of the context (keepalive, reconnection, callbacks,
+ * subscriptions...) shall be set before starting it. -ENOTCONN is returned
+ * by sends if no connection is established. Raw buffers sent with the hash
+ * policy always use the same key.
+ */
+POMP_API int pomp_ctx_connect_pool(struct pomp_ctx *ctx,
+		const struct sockaddr * const *addrs, const uint32_t *addrlens,
+		uint32_t addrcount, uint32_t conncount,
+		enum pomp_balance_policy policy);
+
 /**
  * Bind a connection-less context (inet-udp).
  * @param ctx : context.
@@ -422,7 +847,8 @@ POMP_API const struct sockaddr *pomp_ctx_get_local_addr(struct pomp_ctx *ctx,
 
 /**
  * Send a message to a context.
- * For server it will broadcast to all connected clients. If there is no
+ * For server it will broadcast to all connected clients (only to the ones
+ * subscribed to the message id if subscription is enabled). If there is no
  * connection, the message is lost and no error is returned.
  * For client, if there is no connection, -ENOTCONN is returned.
  * @param ctx : context.
@@ -436,6 +862,37 @@ POMP_API const struct sockaddr *pomp_ctx_get_local_addr(struct pomp_ctx *ctx,
 POMP_API int pomp_ctx_send_msg(struct pomp_ctx *ctx,
 		const struct pomp_msg *msg);
 
+/**
+ * Send a message to a pooled client context, choosing its connection with
+ * the given key instead of the message id for POMP_BALANCE_POLICY_HASH.
+ * Same as pomp_ctx_send_msg for other contexts and policies.
+ * @param ctx : context.
+ * @param key : key of the message (for example a session or object id).
+ * @param msg : message to send.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_ctx_send_msg_key(struct pomp_ctx *ctx, uint32_t key,
+		const struct pomp_msg *msg);
+
+/**
+ * Send a message to a context from any thread.
+ * A reference on the message is queued without locking and the loop of the
+ * context sends it later like 'pomp_ctx_send_msg'. All messages queued until
+ * the loop processes them need a single wakeup and are written with as few
+ * system calls as possible.
+ * @param ctx : context.
+ * @param msg : finished message to send. It is shared and can not be
+ * modified anymore, it can be destroyed by the caller after the call.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks : this function is thread-safe. Messages from a same thread are
+ * sent in order. Errors occurring when the loop sends the message are not
+ * reported. The context shall not be destroyed while some threads may still
+ * call this function.
+ */
+POMP_API int pomp_ctx_send_msg_async(struct pomp_ctx *ctx,
+		const struct pomp_msg *msg);
+
 /**
  * Send a message on dgram context to a remote address.
  * @param ctx : context.
@@ -521,6 +978,32 @@ POMP_API int pomp_ctx_send_raw_buf_to(struct pomp_ctx *ctx,
 		struct pomp_buffer *buf,
 		const struct sockaddr *addr, uint32_t addrlen);
 
+/**
+ * Subscribe a client context to a range of message ids.
+ * The subscription is recorded in the context and sent to the server now if
+ * connected and again after each (re)connection.
+ * @param ctx : context.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks the server context shall have enabled subscription with
+ * pomp_ctx_set_subscription, otherwise it will be notified of the
+ * subscription messages as regular messages.
+ */
+POMP_API int pomp_ctx_subscribe(struct pomp_ctx *ctx,
+		uint32_t first, uint32_t last);
+
+/**
+ * Unsubscribe a client context from a range of message ids.
+ * @param ctx : context.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_ctx_unsubscribe(struct pomp_ctx *ctx,
+		uint32_t first, uint32_t last);
+
 /*
  * Connection API.
  */
@@ -565,6 +1048,30 @@ POMP_API const struct pomp_cred *pomp_conn_get_peer_cred(
  */
 POMP_API int pomp_conn_get_fd(struct pomp_conn *conn);
 
+/**
+ * Get the round trip time of a connection, measured by the heartbeat of its
+ * context (see pomp_ctx_set_heartbeat).
+ * @param conn : connection.
+ * @param rtt : structure to fill, its count is 0 if no sample was received.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_conn_get_rtt(const struct pomp_conn *conn,
+		struct pomp_conn_rtt *rtt);
+
+/**
+ * Get the statistics of the inbound rate limiting of a connection (see
+ * pomp_ctx_set_rate_limit).
+ * @param conn : connection.
+ * @param stats : structure to fill, the current suspension (if any) is
+ * included.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks this function shall be called in the thread of the loop of the
+ * connection.
+ */
+POMP_API int pomp_conn_get_throttle_stats(const struct pomp_conn *conn,
+		struct pomp_throttle_stats *stats);
+
 /**
  * Suspend read operation on connection.
  * @param conn : connection.
@@ -579,6 +1086,27 @@ POMP_API int pomp_conn_suspend_read(struct pomp_conn *conn);
  */
 POMP_API int pomp_conn_resume_read(struct pomp_conn *conn);
 
+/**
+ * Move a connection of a server to another worker loop. The connection keeps
+ * its pending output buffers, its partially received message, its received
+ * file descriptors and its subscriptions, so no data is lost or reordered.
+ * The connection stops reading immediately and is handed over once the
+ * current event of its loop has been processed. All following events of the
+ * connection are notified in the thread of the new loop.
+ * @param conn : connection.
+ * @param loop : worker loop given in pomp_ctx_set_workers.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if a migration is already in progress or a message is
+ * being encoded in place.
+ *
+ * @remarks this function shall be called in the thread of the current loop
+ * of the connection, for example from the event callback, and the connection
+ * shall not be used by this thread after the call. Messages already read are
+ * still notified by the current loop and rpc requests sent on the connection
+ * and not yet completed are cancelled.
+ */
+POMP_API int pomp_conn_migrate(struct pomp_conn *conn, struct pomp_loop *loop);
+
 /**
  * Send a message to the peer of the connection.
  * @param conn : connection.
@@ -592,6 +1120,22 @@ POMP_API int pomp_conn_resume_read(struct pomp_conn *conn);
 POMP_API int pomp_conn_send_msg(struct pomp_conn *conn,
 		const struct pomp_msg *msg);
 
+/**
+ * Send a message to the peer of the connection from any thread.
+ * Same as 'pomp_ctx_send_msg_async' but for a single connection. The message
+ * is dropped if the connection is closed before the loop processes it.
+ * @param conn : connection.
+ * @param msg : finished message to send. It is shared and can not be
+ * modified anymore, it can be destroyed by the caller after the call.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks : this function is thread-safe but the connection shall be valid
+ * during the call (for example by removing it from the application when the
+ * DISCONNECTED event is received, before the structure is released).
+ */
+POMP_API int pomp_conn_send_msg_async(struct pomp_conn *conn,
+		const struct pomp_msg *msg);
+
 /**
  * Format and send a message to the peer of the connection.
  * @param conn : connection.
@@ -635,6 +1179,99 @@ POMP_API int pomp_conn_sendv(struct pomp_conn *conn, uint32_t msgid,
 POMP_API int pomp_conn_send_raw_buf(struct pomp_conn *conn,
 		struct pomp_buffer *buf);
 
+/*
+ * RPC API.
+ */
+
+/**
+ * Send a request on a connection and wait asynchronously for its reply.
+ * The request is notified to the peer as a normal message with the given id,
+ * the peer shall answer with pomp_rpc_reply.
+ * @param conn : connection.
+ * @param msgid : message id of the request.
+ * @param timeout : maximum time to wait for the reply (in ms), 0 for no
+ * timeout.
+ * @param cb : function to call when the request is completed. It is always
+ * called exactly once if this function succeeded.
+ * @param userdata : user data for the callback.
+ * @param fmt : format string. Can be NULL if no arguments given.
+ * @param ... : request arguments.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks file descriptors can not be sent in requests.
+ */
+POMP_API int pomp_rpc_call(struct pomp_conn *conn, uint32_t msgid,
+		uint32_t timeout, pomp_rpc_cb_t cb, void *userdata,
+		const char *fmt, ...) POMP_ATTRIBUTE_FORMAT_PRINTF(6, 7);
+
+/**
+ * Send a request on a connection and wait asynchronously for its reply.
+ * @param conn : connection.
+ * @param msgid : message id of the request.
+ * @param timeout : maximum time to wait for the reply (in ms), 0 for no
+ * timeout.
+ * @param cb : function to call when the request is completed.
+ * @param userdata : user data for the callback.
+ * @param fmt : format string. Can be NULL if no arguments given.
+ * @param args : request arguments.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_rpc_callv(struct pomp_conn *conn, uint32_t msgid,
+		uint32_t timeout, pomp_rpc_cb_t cb, void *userdata,
+		const char *fmt, va_list args);
+
+/**
+ * Send an already encoded message as a request on a connection.
+ * @param conn : connection.
+ * @param msg : request message. Its content is copied.
+ * @param timeout : maximum time to wait for the reply (in ms), 0 for no
+ * timeout.
+ * @param cb : function to call when the request is completed.
+ * @param userdata : user data for the callback.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_rpc_call_msg(struct pomp_conn *conn,
+		const struct pomp_msg *msg, uint32_t timeout,
+		pomp_rpc_cb_t cb, void *userdata);
+
+/**
+ * Reply to a request.
+ * @param conn : connection on which the request was received.
+ * @param req : request message, as notified to the event callback or a copy
+ * of it.
+ * @param msgid : message id of the reply.
+ * @param fmt : format string. Can be NULL if no arguments given.
+ * @param ... : reply arguments.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EINVAL is returned if the message is not a rpc request.
+ */
+POMP_API int pomp_rpc_reply(struct pomp_conn *conn,
+		const struct pomp_msg *req, uint32_t msgid,
+		const char *fmt, ...) POMP_ATTRIBUTE_FORMAT_PRINTF(4, 5);
+
+/**
+ * Reply to a request.
+ * @param conn : connection on which the request was received.
+ * @param req : request message.
+ * @param msgid : message id of the reply.
+ * @param fmt : format string. Can be NULL if no arguments given.
+ * @param args : reply arguments.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_rpc_replyv(struct pomp_conn *conn,
+		const struct pomp_msg *req, uint32_t msgid,
+		const char *fmt, va_list args);
+
+/**
+ * Reply to a request with an already encoded message.
+ * @param conn : connection on which the request was received.
+ * @param req : request message.
+ * @param msg : reply message. Its content is copied.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_rpc_reply_msg(struct pomp_conn *conn,
+		const struct pomp_msg *req, const struct pomp_msg *msg);
+
 /*
  * Buffer API.
  */
@@ -767,6 +1404,17 @@ POMP_API struct pomp_msg *pomp_msg_new(void);
  */
 POMP_API struct pomp_msg *pomp_msg_new_copy(const struct pomp_msg *msg);
 
+/**
+ * Create a new message structure sharing the internal buffer of a finished
+ * message. No data is copied, the buffer becomes read-only.
+ * This can be used in the event callback of a received message to keep it
+ * after the callback returns, for example to forward it later on other
+ * connections without copying the payload.
+ * @param msg : message to reference.
+ * @return new message structure or NULL in case of error.
+ */
+POMP_API struct pomp_msg *pomp_msg_new_ref(const struct pomp_msg *msg);
+
 /**
  * Create a new message structure from a buufer with data.
  * @param buf : buffer with message content (header + playload).
@@ -788,6 +1436,14 @@ POMP_API int pomp_msg_destroy(struct pomp_msg *msg);
  */
 POMP_API uint32_t pomp_msg_get_id(const struct pomp_msg *msg);
 
+/**
+ * Get the rpc id of a request message.
+ * @param msg : message.
+ * @return rpc id of the message, 0 if it is not a rpc request or in case of
+ * error.
+ */
+POMP_API uint32_t pomp_msg_get_rpc_id(const struct pomp_msg *msg);
+
 /**
  * Get the internal buffer of the message.
  * @param msg : message.
@@ -997,13 +1653,13 @@ POMP_API int pomp_loop_wakeup(struct pomp_loop *loop);
 /**
  * Register a function to be called when loop is idle, i.e. there is no event
  * to be processed. The registered function will be called only once and in
- * the order they are registered.
+ * the order they are registered. A function registered while idle functions
+ * are being called will be called during the next iteration of the loop, and
+ * the wait of this iteration will not block.
  * @param loop : loop.
  * @param cb : callback to call.
  * @param userdata : user data for callback.
- * @return 0 in case of success, negative errno value in case of error. In
- * particular it is an error to register an idle function while currently
- * registered function are being called (-EPERM will be returned).
+ * @return 0 in case of success, negative errno value in case of error.
  *
  * @remarks: this function is useful to register cleanup functions when called
  * by an fd event callback for example.
@@ -1023,6 +1679,98 @@ POMP_API int pomp_loop_idle_add(struct pomp_loop *loop, pomp_idle_cb_t cb,
 POMP_API int pomp_loop_idle_remove(struct pomp_loop *loop, pomp_idle_cb_t cb,
 		void *userdata);
 
+/**
+ * Limit the time spent calling idle functions during an iteration of the
+ * loop. Once the budget is exceeded, remaining functions are kept in order
+ * and called during the next iteration, whose wait will not block.
+ * @param loop : loop.
+ * @param usecs : time budget in microseconds, 0 for no limit.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is no limit. The budget is checked after each call, so
+ * at least one function is called per iteration.
+ */
+POMP_API int pomp_loop_set_idle_budget(struct pomp_loop *loop,
+		uint32_t usecs);
+
+/**
+ * Post a function to be called by the thread running the loop. Functions are
+ * called in the order they are posted, after the fd events of the current
+ * iteration have been processed. The loop is woken up if needed.
+ * @param loop : loop.
+ * @param cb : callback to call.
+ * @param userdata : user data for callback.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks: this function is safe to call from another thread that the one
+ * associated normally with the loop. Functions still pending when the loop
+ * is destroyed are not called.
+ */
+POMP_API int pomp_loop_post(struct pomp_loop *loop, pomp_idle_cb_t cb,
+		void *userdata);
+
+/**
+ * Remove functions posted and not yet called.
+ * @param loop : loop.
+ * @param cb : callback given in pomp_loop_post.
+ * @param userdata : user data given in pomp_loop_post.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks: if nothing match the given criteria, no error is returned. A
+ * function already being called by the loop thread is not waited for.
+ */
+POMP_API int pomp_loop_post_remove(struct pomp_loop *loop, pomp_idle_cb_t cb,
+		void *userdata);
+
+/**
+ * Get statistics of a loop, cumulated since its creation.
+ * @param loop : loop.
+ * @param stats : structure to fill.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks this function shall be called in the thread of the loop.
+ */
+POMP_API int pomp_loop_get_stats(struct pomp_loop *loop,
+		struct pomp_loop_stats *stats);
+
+/**
+ * Set the maximum number of events returned by a single wait of the loop.
+ * The batch starts small and doubles each time a wait returns a full batch,
+ * up to this maximum, so busy loops with many active fds need less waits.
+ * @param loop : loop.
+ * @param maxevents : maximum number of events per wait.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is 1024. Only the epoll implementation limits the events
+ * returned per wait, others always return all ready fds.
+ */
+POMP_API int pomp_loop_set_max_events(struct pomp_loop *loop,
+		uint32_t maxevents);
+
+/**
+ * Enable busy polling of the loop. Before blocking, a wait first checks
+ * for events without sleeping, with a cpu pause between checks, for at most
+ * the given time. This removes the sleep and wakeup latency of the kernel
+ * when events arrive quickly, at the cost of burning a cpu while waiting.
+ * @param loop : loop.
+ * @param usecs : maximum spinning time per wait in microseconds, 0 to
+ * disable.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is disabled. Best used with a loop running on a
+ * dedicated cpu.
+ */
+POMP_API int pomp_loop_set_busy_poll(struct pomp_loop *loop, uint32_t usecs);
+
+/**
+ * Get the current monotonic time. While events of the loop are processed,
+ * the time is read once, by the first call after the wait, and the same
+ * value is returned to all callbacks of the iteration.
+ * @param loop : loop.
+ * @return monotonic time in microseconds, 0 in case of error.
+ */
+POMP_API uint64_t pomp_loop_now(struct pomp_loop *loop);
+
 /*
  * Timer API.
  */
@@ -1062,6 +1810,30 @@ POMP_API int pomp_timer_set(struct pomp_timer *timer, uint32_t delay);
 POMP_API int pomp_timer_set_periodic(struct pomp_timer *timer, uint32_t delay,
 		uint32_t period);
 
+/**
+ * Set a one shot timer with a microsecond resolution.
+ * @param timer : timer to set.
+ * @param delay : expiration delay in microseconds.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks The effective resolution depends on the implementation: timerfd,
+ * posix timers and kqueue honour microseconds, win32 rounds up to the next
+ * millisecond.
+ */
+POMP_API int pomp_timer_set_us(struct pomp_timer *timer, uint64_t delay);
+
+/**
+ * Set a periodic timer with a microsecond resolution.
+ * @param timer : timer to set.
+ * @param delay : initial expiration delay in microseconds.
+ * @param period : period in microseconds.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks See pomp_timer_set_us for the effective resolution.
+ */
+POMP_API int pomp_timer_set_periodic_us(struct pomp_timer *timer,
+		uint64_t delay, uint64_t period);
+
 /**
  * Clear a timer.
  * @param timer : timer to clear.
@@ -1069,6 +1841,23 @@ POMP_API int pomp_timer_set_periodic(struct pomp_timer *timer, uint32_t delay,
  */
 POMP_API int pomp_timer_clear(struct pomp_timer *timer);
 
+/**
+ * Allow a timer to expire later than requested, so that timers of the same
+ * loop whose expirations are close wake up the loop only once. A timer with
+ * a slack expires between its deadline and its deadline plus the slack;
+ * all such timers of a loop share a single system timer, armed for the
+ * earliest of those latest expirations, and every timer whose deadline is
+ * reached at that time is notified. Periodic timers keep their nominal
+ * schedule.
+ * @param timer : timer.
+ * @param slack : slack in microseconds, 0 to disable.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks Default is no slack. Changing the slack clears the timer, it
+ * applies to the next call to a set function.
+ */
+POMP_API int pomp_timer_set_slack(struct pomp_timer *timer, uint32_t slack);
+
 /*
  * Address string parsing/formatting utilities.
  */
@@ -1154,6 +1943,127 @@ POMP_API int pomp_msg_finish(struct pomp_msg *msg);
  */
 POMP_API int pomp_msg_clear(struct pomp_msg *msg);
 
+/*
+ * Message slot patching.
+ *
+ * A message encoded with slots can be sent several times, patching slots
+ * between sends. The buffer is shared with the connection while the data is
+ * queued, patch functions return -EBUSY until it has been released. When a
+ * send callback is registered with pomp_ctx_set_send_cb, the status
+ * POMP_SEND_STATUS_OK for the message buffer indicates it can be patched
+ * again. Message will be sent 'as is', so it shall be finished only once.
+ */
+
+/**
+ * Patch the value of a 8-bit signed integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_i8.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_i8(struct pomp_msg *msg, uint32_t slot,
+		int8_t v);
+
+/**
+ * Patch the value of a 8-bit unsigned integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_u8.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_u8(struct pomp_msg *msg, uint32_t slot,
+		uint8_t v);
+
+/**
+ * Patch the value of a 16-bit signed integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_i16.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_i16(struct pomp_msg *msg, uint32_t slot,
+		int16_t v);
+
+/**
+ * Patch the value of a 16-bit unsigned integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_u16.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_u16(struct pomp_msg *msg, uint32_t slot,
+		uint16_t v);
+
+/**
+ * Patch the value of a 32-bit signed integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_i32.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_i32(struct pomp_msg *msg, uint32_t slot,
+		int32_t v);
+
+/**
+ * Patch the value of a 32-bit unsigned integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_u32.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_u32(struct pomp_msg *msg, uint32_t slot,
+		uint32_t v);
+
+/**
+ * Patch the value of a 64-bit signed integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_i64.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_i64(struct pomp_msg *msg, uint32_t slot,
+		int64_t v);
+
+/**
+ * Patch the value of a 64-bit unsigned integer slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_u64.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_u64(struct pomp_msg *msg, uint32_t slot,
+		uint64_t v);
+
+/**
+ * Patch the value of a 32-bit floating point slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_f32.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_f32(struct pomp_msg *msg, uint32_t slot,
+		float v);
+
+/**
+ * Patch the value of a 64-bit floating point slot.
+ * @param msg : message.
+ * @param slot : slot handle returned by pomp_encoder_write_slot_f64.
+ * @param v : new value.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the message buffer is still in use by a send.
+ */
+POMP_API int pomp_msg_patch_f64(struct pomp_msg *msg, uint32_t slot,
+		double v);
+
 /*
  * Encoder API (Advanced).
  */
@@ -1337,6 +2247,157 @@ POMP_API int pomp_encoder_write_f64(struct pomp_encoder *enc, double v);
  */
 POMP_API int pomp_encoder_write_fd(struct pomp_encoder *enc, int v);
 
+/*
+ * Encoder slot API (Advanced).
+ *
+ * A slot is a fixed width argument whose value can be modified in place with
+ * pomp_msg_patch_xxx functions after the message has been encoded (and even
+ * finished). This allows a message template to be encoded once and only the
+ * changing values to be updated before each send. Integers of 32 and 64 bits
+ * are encoded as varint padded to their maximum size so the result is still
+ * a valid message for any peer.
+ */
+
+/**
+ * Encode a 8-bit signed integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_i8.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_i8(struct pomp_encoder *enc, int8_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 8-bit unsigned integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_u8.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_u8(struct pomp_encoder *enc, uint8_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 16-bit signed integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_i16.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_i16(struct pomp_encoder *enc, int16_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 16-bit unsigned integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_u16.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_u16(struct pomp_encoder *enc, uint16_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 32-bit signed integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_i32.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_i32(struct pomp_encoder *enc, int32_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 32-bit unsigned integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_u32.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_u32(struct pomp_encoder *enc, uint32_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 64-bit signed integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_i64.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_i64(struct pomp_encoder *enc, int64_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 64-bit unsigned integer in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_u64.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_u64(struct pomp_encoder *enc, uint64_t v,
+		uint32_t *slot);
+
+/**
+ * Encode a 32-bit floating point in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_f32.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_f32(struct pomp_encoder *enc, float v,
+		uint32_t *slot);
+
+/**
+ * Encode a 64-bit floating point in a slot that can be patched later.
+ * @param enc : encoder.
+ * @param v : initial value to encode.
+ * @param slot : returned slot handle to give to pomp_msg_patch_f64.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_encoder_write_slot_f64(struct pomp_encoder *enc, double v,
+		uint32_t *slot);
+
+/*
+ * Connection API (Advanced).
+ */
+
+/**
+ * Start encoding a message directly in the transmit buffer of a connection.
+ * It avoids the allocation of a message and a buffer for each send and
+ * messages committed before the connection becomes writable are written
+ * together with a single system call.
+ * @param conn : connection.
+ * @param msgid : message id.
+ * @param size_hint : expected size of payload, used to reserve space.
+ * @return encoder to use to write message arguments or NULL in case of error.
+ * The encoder is owned by the connection and is valid until
+ * pomp_conn_commit_msg or pomp_conn_abort_msg is called.
+ *
+ * @remarks only supported on stream connections that are not raw.
+ * @remarks file descriptors can not be encoded this way.
+ * @remarks the send callback is called with the internal transmit buffer of
+ * the connection when all its committed messages have been written.
+ */
+POMP_API struct pomp_encoder *pomp_conn_begin_msg(struct pomp_conn *conn,
+		uint32_t msgid, size_t size_hint);
+
+/**
+ * Finish the message being encoded with pomp_conn_begin_msg and queue it for
+ * sending.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ * In case of error, the message is discarded.
+ */
+POMP_API int pomp_conn_commit_msg(struct pomp_conn *conn);
+
+/**
+ * Discard the message being encoded with pomp_conn_begin_msg.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+POMP_API int pomp_conn_abort_msg(struct pomp_conn *conn);
+
 /*
  * Decoder API (Advanced).
  */
@@ -112,6 +112,11 @@ public:
 		return pomp_msg_get_id(getMsg());
 	}
 
+	/** Get the rpc id of a request message, 0 if not a request. */
+	inline uint32_t getRpcId() const {
+		return pomp_msg_get_rpc_id(getMsg());
+	}
+
 	/** Write and encode a message. */
 	inline int write(uint32_t msgid, const char *fmt, ...) POMP_ATTRIBUTE_FORMAT_PRINTF(3, 4) {
 		va_list args;
@@ -213,6 +218,16 @@ public:
 		return pomp_conn_get_fd(mConn);
 	}
 
+	/** Get round trip time measured by the heartbeat of the context. */
+	inline int getRtt(struct pomp_conn_rtt *rtt) const {
+		return pomp_conn_get_rtt(mConn, rtt);
+	}
+
+	/** Get the statistics of the inbound rate limiting. */
+	inline int getThrottleStats(struct pomp_throttle_stats *stats) const {
+		return pomp_conn_get_throttle_stats(mConn, stats);
+	}
+
 	/** Send a message to the peer of the connection. */
 	inline int sendMsg(const Message &msg) {
 		return pomp_conn_send_msg(mConn, msg.getMsg());
@@ -232,6 +247,17 @@ public:
 		return pomp_conn_sendv(mConn, msgid, fmt, args);
 	}
 
+	/** Send a request to the peer of the connection. */
+	inline int callMsg(const Message &msg, uint32_t timeout,
+			pomp_rpc_cb_t cb, void *userdata) {
+		return pomp_rpc_call_msg(mConn, msg.getMsg(), timeout, cb, userdata);
+	}
+
+	/** Reply to a request received on the connection. */
+	inline int replyMsg(const Message &req, const Message &msg) {
+		return pomp_rpc_reply_msg(mConn, req.getMsg(), msg.getMsg());
+	}
+
 #ifdef POMP_CXX11
 	/** Format and send a message to the peer of the connection. */
 	template<typename Fmt, typename... ArgsW>
@@ -242,6 +268,27 @@ public:
 			res = sendMsg(msg);
 		return res;
 	}
+
+	/** Format and send a request to the peer of the connection. */
+	template<typename Fmt, typename... ArgsW>
+	inline int call(uint32_t timeout, pomp_rpc_cb_t cb, void *userdata,
+			const ArgsW&... args) {
+		Message msg;
+		int res = msg.write<Fmt>(args...);
+		if (res == 0)
+			res = callMsg(msg, timeout, cb, userdata);
+		return res;
+	}
+
+	/** Format and send a reply to a request received on the connection. */
+	template<typename Fmt, typename... ArgsW>
+	inline int reply(const Message &req, const ArgsW&... args) {
+		Message msg;
+		int res = msg.write<Fmt>(args...);
+		if (res == 0)
+			res = replyMsg(req, msg);
+		return res;
+	}
 #endif /* POMP_CXX11 */
 };
 
@@ -341,6 +388,16 @@ public:
 		return pomp_loop_wakeup(mLoop);
 	}
 
+	/** Get the monotonic time (in us) cached for the current iteration. */
+	inline uint64_t now() {
+		return pomp_loop_now(mLoop);
+	}
+
+	/** Spin for events before blocking in waits. */
+	inline int setBusyPoll(uint32_t usecs) {
+		return pomp_loop_set_busy_poll(mLoop, usecs);
+	}
+
 	/** Get internal pomp_loop */
 	inline operator struct pomp_loop *() {
 		return mLoop;
@@ -407,10 +464,21 @@ public:
 		return pomp_timer_set_periodic(mTimer, delay, period);
 	}
 
+	inline int setUs(uint64_t delay, uint64_t period = 0) {
+		if (period == 0)
+			return pomp_timer_set_us(mTimer, delay);
+		else
+			return pomp_timer_set_periodic_us(mTimer, delay, period);
+	}
+
 	inline int clear() {
 		return pomp_timer_clear(mTimer);
 	}
 
+	inline int setSlack(uint32_t slack) {
+		return pomp_timer_set_slack(mTimer, slack);
+	}
+
 #ifdef POMP_CXX11
 	/** Handler wrapper that can take a std::function */
 	class HandlerFunc : public Handler {
@@ -532,6 +600,15 @@ public:
 		return pomp_ctx_connect(mCtx, addr, addrlen);
 	}
 
+	/** Start a pooled client with several connections. */
+	inline int connectPool(const struct sockaddr * const *addrs,
+			const uint32_t *addrlens, uint32_t addrcount,
+			uint32_t conncount,
+			enum pomp_balance_policy policy) {
+		return pomp_ctx_connect_pool(mCtx, addrs, addrlens,
+				addrcount, conncount, policy);
+	}
+
 	/** Bind a connection-less context (inet-udp). */
 	inline int bind(const struct sockaddr *addr, uint32_t addrlen) {
 		return pomp_ctx_bind(mCtx, addr, addrlen);
@@ -579,11 +656,76 @@ public:
 		return mConnections;
 	}
 
+	/** Enable subscription based broadcast in a server. */
+	inline int setSubscription(bool enable) {
+		return pomp_ctx_set_subscription(mCtx, enable ? 1 : 0);
+	}
+
+	/** Subscribe a client to a range of message ids. */
+	inline int subscribe(uint32_t first, uint32_t last) {
+		return pomp_ctx_subscribe(mCtx, first, last);
+	}
+
+	/** Unsubscribe a client from a range of message ids. */
+	inline int unsubscribe(uint32_t first, uint32_t last) {
+		return pomp_ctx_unsubscribe(mCtx, first, last);
+	}
+
+	/** Limit the data read from a connection per loop iteration. */
+	inline int setReadBudget(uint32_t maxbytes, uint32_t maxmsgs) {
+		return pomp_ctx_set_read_budget(mCtx, maxbytes, maxmsgs);
+	}
+
+	/** Limit the rate of messages and bytes received on connections. */
+	inline int setRateLimit(uint32_t msgrate, uint32_t msgburst,
+			uint32_t byterate, uint32_t byteburst) {
+		return pomp_ctx_set_rate_limit(mCtx, msgrate, msgburst,
+				byterate, byteburst);
+	}
+
+	/** Limit the rate of bytes sent on connections. */
+	inline int setPacing(uint32_t rate, uint32_t burst) {
+		return pomp_ctx_set_pacing(mCtx, rate, burst);
+	}
+
+	/** Setup the admission control of a server context. */
+	inline int setAdmission(uint32_t maxconns, uint32_t acceptrate,
+			uint32_t acceptburst) {
+		return pomp_ctx_set_admission(mCtx, maxconns, acceptrate,
+				acceptburst);
+	}
+
+	/** Get the statistics of the admission control of a server. */
+	inline int getThrottleStats(struct pomp_throttle_stats *stats) const {
+		return pomp_ctx_get_throttle_stats(mCtx, stats);
+	}
+
+	/** Set the SO_BUSY_POLL option on TCP/IP and UDP sockets. */
+	inline int setBusyPoll(uint32_t usecs) {
+		return pomp_ctx_set_busy_poll(mCtx, usecs);
+	}
+
+	inline int setupReconnect(uint32_t initial, uint32_t max,
+			uint32_t multiplier, uint32_t jitter,
+			bool immediate = false) {
+		return pomp_ctx_setup_reconnect(mCtx, initial, max,
+				multiplier, jitter, immediate ? 1 : 0);
+	}
+
+	inline int setHeartbeat(uint32_t interval, uint32_t timeout) {
+		return pomp_ctx_set_heartbeat(mCtx, interval, timeout);
+	}
+
 	/** Send a message to all connections. */
 	inline int sendMsg(const Message &msg) {
 		return pomp_ctx_send_msg(mCtx, msg.getMsg());
 	}
 
+	/** Send a message on the connection of a pool chosen by a key. */
+	inline int sendMsgKey(uint32_t key, const Message &msg) {
+		return pomp_ctx_send_msg_key(mCtx, key, msg.getMsg());
+	}
+
 	/** Send a message on dgram context to a remote address. */
 	inline int sendMsgTo(const Message &msg, const struct sockaddr *addr, uint32_t addrlen) {
 		return pomp_ctx_send_msg_to(mCtx, msg.getMsg(), addr, addrlen);
@@ -67,12 +67,21 @@
 #      define HAVE_SYS_TIMERFD_H
 #    endif
 #  endif
+#  ifndef HAVE_SYS_UIO_H
+#    define HAVE_SYS_UIO_H
+#  endif
 #  ifndef HAVE_SYS_UN_H
 #    define HAVE_SYS_UN_H
 #  endif
 #  ifndef HAVE_NETINET_TCP_H
 #    define HAVE_NETINET_TCP_H
 #  endif
+#  ifndef HAVE_LINUX_FILTER_H
+#    define HAVE_LINUX_FILTER_H
+#  endif
+#  ifndef HAVE_PTHREAD_H
+#    define HAVE_PTHREAD_H
+#  endif
 #endif
 
 #if defined(__FreeBSD__) || defined(__APPLE__)
@@ -91,12 +100,18 @@
 #  ifndef HAVE_SYS_SOCKET_H
 #    define HAVE_SYS_SOCKET_H
 #  endif
+#  ifndef HAVE_SYS_UIO_H
+#    define HAVE_SYS_UIO_H
+#  endif
 #  ifndef HAVE_SYS_UN_H
 #    define HAVE_SYS_UN_H
 #  endif
 #  ifndef HAVE_NETINET_TCP_H
 #    define HAVE_NETINET_TCP_H
 #  endif
+#  ifndef HAVE_PTHREAD_H
+#    define HAVE_PTHREAD_H
+#  endif
 #endif
 
 #if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE >= 199309L)
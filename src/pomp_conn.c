@@ -37,6 +37,16 @@
 /** Internal read buffer size */
 #define POMP_CONN_READ_SIZE	4096
 
+/** Initial size of transmit buffer for messages encoded in place */
+#define POMP_CONN_TX_SIZE	4096
+
+/** Maximum number of pending IO buffers written in a single gather write */
+#define POMP_CONN_IOV_MAX	64
+
+/** Minimum number of bytes written at once by the userspace pacer (about a
+ * TCP segment), unless less data is pending */
+#define POMP_CONN_PACING_QUANTUM	1460
+
 /**
  * Determine if a read/write error in non-blocking could not be completed.
  * POSIX.1-2001 allows either error to be returned for this case, and
@@ -52,7 +62,7 @@
  * Determine if a connection is a local unix socket.
  */
 #define POMP_CONN_IS_LOCAL(_conn) \
-	((_conn)->local_addr.ss_family == AF_UNIX)
+	((_conn)->family == AF_UNIX)
 
 /** IO buffer for asynchronous write operations */
 struct pomp_io_buffer {
@@ -69,6 +79,10 @@ struct pomp_conn {
 	/** Associated client/server context */
 	struct pomp_ctx		*ctx;
 
+	/** Unique identifier, distinguishes a connection from a previous one
+	 * allocated at the same address */
+	uint32_t		id;
+
 	/** Associated loop */
 	struct pomp_loop	*loop;
 
@@ -99,6 +113,12 @@ struct pomp_conn {
 	/** Pending write tail io buffer */
 	struct pomp_io_buffer	*tailbuf;
 
+	/** Address family of the socket */
+	int			family;
+
+	/** Addresses and credentials have been queried from the socket */
+	int			addrfetched;
+
 	/** Local address */
 	struct sockaddr_storage	local_addr;
 
@@ -125,8 +145,78 @@ struct pomp_conn {
 
 	/** Read suspended flag */
 	int			read_suspended;
+
+	/** Fd registered in edge-triggered mode, IN and OUT always monitored */
+	int			edgetriggered;
+
+	/** Maximum number of bytes read per loop iteration, 0 for no limit */
+	uint32_t		maxreadbytes;
+
+	/** Maximum number of messages read per loop iteration, 0 for no limit */
+	uint32_t		maxreadmsgs;
+
+	/** Transmit buffer where messages are directly encoded */
+	struct pomp_buffer	*txbuf;
+
+	/** Offset of next byte to write in transmit buffer */
+	size_t			txoff;
+
+	/** Offset in transmit buffer of message being encoded */
+	size_t			txstart;
+
+	/** Message being encoded in transmit buffer (buffer not owned) */
+	struct pomp_msg		txmsg;
+
+	/** Encoder of message being encoded in transmit buffer */
+	struct pomp_encoder	txenc;
+
+	/** Buffers are only queued until the connection is uncorked */
+	int			corked;
+
+	/** OUT events were already monitored when the connection was corked */
+	int			corkasync;
+
+	/** Loop the connection is being migrated to, NULL otherwise */
+	struct pomp_loop	*migrateloop;
+
+	/** Heartbeat state */
+	struct {
+		/** Time a ping or pong was last received (in us) */
+		uint64_t		lastrecv;
+		/** Round trip time measured with pongs */
+		struct pomp_conn_rtt	rtt;
+	} heartbeat;
+
+	/** Inbound rate limiting */
+	struct {
+		/** Received messages */
+		struct pomp_token_bucket	msgs;
+		/** Received bytes */
+		struct pomp_token_bucket	bytes;
+		/** Timer resuming reads, created on first throttle */
+		struct pomp_timer		*timer;
+		/** Reads suspended until tokens are refilled */
+		int				throttled;
+		/** Time reads were suspended (in us) */
+		uint64_t			since;
+		/** Statistics */
+		struct pomp_throttle_stats	stats;
+	} ratelimit;
+
+	/** Outbound pacing done in userspace */
+	struct {
+		/** Written bytes */
+		struct pomp_token_bucket	bytes;
+		/** Timer resuming writes, created on first use */
+		struct pomp_timer		*timer;
+		/** Writes postponed until tokens are refilled */
+		int				paced;
+	} pacing;
 };
 
+/** Last identifier given to a connection */
+static volatile uint32_t s_conn_next_id;
+
 /**
  * Create a new IO buffer.
  * @param buf : buffer with data to write.
@@ -167,16 +257,147 @@ static int pomp_io_buffer_destroy(struct pomp_io_buffer *iobuf)
 	return 0;
 }
 
+/**
+ * Notify the completion of an IO buffer and destroy it.
+ * @param iobuf : IO buffer.
+ * @param conn : connection.
+ * @param status : send status to notify.
+ *
+ * @remarks if the buffer is still referenced by someone else, our reference
+ * is released before the notification so the owner can modify it again from
+ * the callback (to patch a message for example).
+ */
+static void pomp_io_buffer_complete(struct pomp_io_buffer *iobuf,
+		struct pomp_conn *conn, uint32_t status)
+{
+	struct pomp_buffer *buf = iobuf->buf;
+
+	if (buf->refcount > 1) {
+		pomp_io_buffer_destroy(iobuf);
+		pomp_ctx_notify_send(conn->ctx, conn, buf, status);
+	} else {
+		pomp_ctx_notify_send(conn->ctx, conn, buf, status);
+		pomp_io_buffer_destroy(iobuf);
+	}
+}
+
+/**
+ * Function called when the tokens of a paced connection are refilled.
+ * @param timer : timer.
+ * @param userdata : connection.
+ */
+static void pomp_conn_pacing_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_conn *conn = userdata;
+
+	/* Monitor OUT events again (or re-arm the fd in edge-triggered mode),
+	 * the write path stops monitoring them if nothing is pending */
+	conn->pacing.paced = 0;
+	if (!conn->edgetriggered)
+		(void)pomp_loop_update2(conn->loop, conn->fd,
+				POMP_FD_EVENT_OUT, 0);
+	else
+		(void)pomp_loop_update2(conn->loop, conn->fd, 0, 0);
+}
+
+/**
+ * Apply the userspace pacing of a connection to a write. When not enough
+ * tokens are available, the write is postponed: OUT events are no more
+ * monitored and a timer monitors them again once tokens are refilled.
+ * @param conn : connection.
+ * @param len : number of bytes to write.
+ * @return number of bytes that can be written now, 0 if the write shall be
+ * postponed.
+ */
+static size_t pomp_conn_pace(struct pomp_conn *conn, size_t len)
+{
+	struct pomp_token_bucket *tb = &conn->pacing.bytes;
+	uint64_t wait = 0;
+	size_t quantum = 0;
+	int64_t need = 0;
+
+	if (tb->rate == 0 || len == 0)
+		return len;
+
+	/* Wait for a minimum amount of tokens to avoid waking up per byte */
+	pomp_token_bucket_refill(tb, pomp_loop_now(conn->loop));
+	quantum = tb->burst < POMP_CONN_PACING_QUANTUM ?
+			tb->burst : POMP_CONN_PACING_QUANTUM;
+	need = (int64_t)(len < quantum ? len : quantum) * POMP_TOKEN_SCALE;
+	if (tb->tokens >= need) {
+		if ((uint64_t)tb->tokens / POMP_TOKEN_SCALE < len)
+			len = (size_t)(tb->tokens / POMP_TOKEN_SCALE);
+		return len;
+	}
+
+	/* Write anyway if the timer can not be used */
+	if (conn->pacing.timer == NULL) {
+		conn->pacing.timer = pomp_timer_new(conn->loop,
+				&pomp_conn_pacing_cb, conn);
+		if (conn->pacing.timer == NULL)
+			return len;
+	}
+	wait = (uint64_t)(need - tb->tokens) / tb->rate + 1;
+	if (pomp_timer_set_us(conn->pacing.timer, wait) < 0)
+		return len;
+
+	if (!conn->pacing.paced && !conn->edgetriggered)
+		(void)pomp_loop_update2(conn->loop, conn->fd,
+				0, POMP_FD_EVENT_OUT);
+	conn->pacing.paced = 1;
+	return 0;
+}
+
+/**
+ * Stop the userspace pacing of a connection.
+ * @param conn : connection.
+ */
+static void pomp_conn_unpace(struct pomp_conn *conn)
+{
+	if (conn->pacing.timer == NULL)
+		return;
+	conn->pacing.paced = 0;
+	pomp_timer_destroy(conn->pacing.timer);
+	conn->pacing.timer = NULL;
+}
+
+/**
+ * Setup the outbound pacing of a new connection. The kernel paces TCP/IP
+ * sockets with SO_MAX_PACING_RATE when available, otherwise writes are
+ * paced in userspace.
+ * @param conn : connection.
+ * @param rate : bytes per second, 0 for no limit.
+ * @param burst : maximum number of bytes written at once.
+ */
+static void pomp_conn_setup_pacing(struct pomp_conn *conn,
+		uint32_t rate, uint32_t burst)
+{
+	if (rate == 0 || conn->isdgram)
+		return;
+
+#ifdef SO_MAX_PACING_RATE
+	if (conn->family == AF_INET || conn->family == AF_INET6) {
+		if (setsockopt(conn->fd, SOL_SOCKET, SO_MAX_PACING_RATE,
+				&rate, sizeof(rate)) == 0) {
+			return;
+		}
+		POMP_LOG_FD_ERRNO("setsockopt.SO_MAX_PACING_RATE", conn->fd);
+	}
+#endif /* SO_MAX_PACING_RATE */
+
+	pomp_token_bucket_init(&conn->pacing.bytes, rate, burst,
+			pomp_loop_now(conn->loop));
+}
+
 static int pomp_io_buffer_write_normal(struct pomp_io_buffer *iobuf,
-		struct pomp_conn *conn)
+		struct pomp_conn *conn, size_t len)
 {
 	int res = 0;
 	ssize_t writelen = 0;
 
 	/* Write data ignoring interrupts */
 	do {
-		writelen = write(conn->fd, iobuf->buf->data + iobuf->off,
-				iobuf->len - iobuf->off);
+		writelen = write(conn->fd, iobuf->buf->data + iobuf->off, len);
 	} while (writelen < 0 && errno == EINTR);
 
 	/* Log errors except EAGAIN */
@@ -227,7 +448,7 @@ static int pomp_io_buffer_write_dgram(struct pomp_io_buffer *iobuf,
  * case of error. -EAGAIN is returned if write can not be completed immediately.
  */
 static int pomp_io_buffer_write_with_fds(struct pomp_io_buffer *iobuf,
-		struct pomp_conn *conn)
+		struct pomp_conn *conn, size_t len)
 {
 #ifdef SCM_RIGHTS
 	int res = 0;
@@ -245,7 +466,7 @@ static int pomp_io_buffer_write_with_fds(struct pomp_io_buffer *iobuf,
 
 	/* Setup the data part of the socket message */
 	iov.iov_base = iobuf->buf->data + iobuf->off;
-	iov.iov_len = iobuf->len - iobuf->off;
+	iov.iov_len = len;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
 
@@ -280,7 +501,7 @@ static int pomp_io_buffer_write_with_fds(struct pomp_io_buffer *iobuf,
 	/* Return number of bytes written */
 	return (int)writelen;
 #else /* !SCM_RIGHTS */
-	return pomp_io_buffer_write_normal(iobuf, conn);
+	return pomp_io_buffer_write_normal(iobuf, conn, len);
 #endif /* !SCM_RIGHTS */
 }
 
@@ -296,20 +517,103 @@ static int pomp_io_buffer_write(struct pomp_io_buffer *iobuf,
 		struct pomp_conn *conn)
 {
 	int res = 0;
+	size_t len = 0;
+
+	/* Datagrams are not paced, they can not be split */
+	if (!conn->isdgram) {
+		len = pomp_conn_pace(conn, iobuf->len - iobuf->off);
+		if (len == 0)
+			return -EAGAIN;
+	}
 
 	/* When offset is 0 and buffer has file descriptors in it, write them */
 	if (conn->isdgram)
 		res = pomp_io_buffer_write_dgram(iobuf, conn);
 	else if (iobuf->off == 0 && iobuf->buf->fdcount > 0)
-		res = pomp_io_buffer_write_with_fds(iobuf, conn);
+		res = pomp_io_buffer_write_with_fds(iobuf, conn, len);
 	else
-		res = pomp_io_buffer_write_normal(iobuf, conn);
+		res = pomp_io_buffer_write_normal(iobuf, conn, len);
 	if (res < 0)
 		return res;
 
-	/* Update internal offset */
+	/* Update internal offset and consume pacing tokens */
 	iobuf->off += (size_t)res;
+	if (!conn->isdgram)
+		pomp_token_bucket_take(&conn->pacing.bytes, (uint64_t)res);
+	return 0;
+}
+
+/**
+ * Write as many pending IO buffers as possible with a single gather write.
+ * The internal offsets of the IO buffers are updated in case of success.
+ * Dgram connections and buffers with file descriptors are written one by one.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EAGAIN is returned if write can not be completed immediately.
+ */
+static int pomp_conn_write_queue(struct pomp_conn *conn)
+{
+#ifdef HAVE_SYS_UIO_H
+	int res = 0;
+	ssize_t writelen = 0;
+	struct iovec iov[POMP_CONN_IOV_MAX];
+	int iovcnt = 0;
+	size_t len = 0, total = 0, maxlen = 0;
+	struct pomp_io_buffer *iobuf = conn->headbuf;
+
+	if (conn->isdgram || iobuf->next == NULL ||
+			(iobuf->off == 0 && iobuf->buf->fdcount > 0)) {
+		return pomp_io_buffer_write(iobuf, conn);
+	}
+
+	/* Stop at the first buffer with file descriptors, they shall be sent
+	 * with their first byte */
+	while (iobuf != NULL && iovcnt < POMP_CONN_IOV_MAX) {
+		if (iobuf->off == 0 && iobuf->buf->fdcount > 0)
+			break;
+		iov[iovcnt].iov_base = iobuf->buf->data + iobuf->off;
+		iov[iovcnt].iov_len = iobuf->len - iobuf->off;
+		total += iov[iovcnt].iov_len;
+		iovcnt++;
+		iobuf = iobuf->next;
+	}
+
+	/* Truncate the write to the bytes allowed by the pacing */
+	maxlen = pomp_conn_pace(conn, total);
+	if (maxlen == 0)
+		return -EAGAIN;
+	for (iovcnt = 0, total = 0; total < maxlen; iovcnt++) {
+		if (iov[iovcnt].iov_len > maxlen - total)
+			iov[iovcnt].iov_len = maxlen - total;
+		total += iov[iovcnt].iov_len;
+	}
+
+	/* Write data ignoring interrupts */
+	do {
+		writelen = writev(conn->fd, iov, iovcnt);
+	} while (writelen < 0 && errno == EINTR);
+
+	/* Log errors except EAGAIN */
+	if (writelen < 0) {
+		res = -errno;
+		if (!POMP_CONN_WOULD_BLOCK(errno))
+			POMP_LOG_FD_ERRNO("writev", conn->fd);
+		return res;
+	}
+	pomp_token_bucket_take(&conn->pacing.bytes, (uint64_t)writelen);
+
+	/* Update internal offsets */
+	for (iobuf = conn->headbuf; writelen > 0; iobuf = iobuf->next) {
+		len = iobuf->len - iobuf->off;
+		if ((size_t)writelen < len)
+			len = (size_t)writelen;
+		iobuf->off += len;
+		writelen -= (ssize_t)len;
+	}
 	return 0;
+#else /* !HAVE_SYS_UIO_H */
+	return pomp_io_buffer_write(conn->headbuf, conn);
+#endif /* !HAVE_SYS_UIO_H */
 }
 
 static int pomp_conn_add_rx_fd(struct pomp_conn *conn, int fd)
@@ -425,23 +729,73 @@ static int pomp_conn_fixup_rx_fds(struct pomp_conn *conn,
 	return res;
 }
 
+/**
+ * Get the events to monitor when registering the fd of a connection.
+ * @param conn : connection.
+ * @return events to monitor.
+ */
+static uint32_t pomp_conn_get_fd_events(const struct pomp_conn *conn)
+{
+	if (conn->edgetriggered)
+		return POMP_FD_EVENT_IN | POMP_FD_EVENT_OUT | POMP_FD_EVENT_ET;
+	return POMP_FD_EVENT_IN;
+}
+
+/**
+ * Start monitoring OUT events to write pending data (async mode).
+ * @param conn : connection.
+ * @param blocked : 1 if the last write would have blocked, in which case an
+ * edge-triggered fd will be notified once writable again.
+ */
+static void pomp_conn_enter_async(struct pomp_conn *conn, int blocked)
+{
+	/* OUT events will be monitored once tokens of the pacing are
+	 * refilled */
+	if (conn->pacing.paced)
+		return;
+
+	POMP_LOGI("conn=%p fd=%d enter async mode", conn, conn->fd);
+	if (!conn->edgetriggered) {
+		pomp_loop_update2(conn->loop, conn->fd, POMP_FD_EVENT_OUT, 0);
+	} else if (!blocked) {
+		/* Re-arm the fd to be notified while it is writable */
+		pomp_loop_update2(conn->loop, conn->fd, 0, 0);
+	}
+}
+
+/**
+ * Stop monitoring OUT events once all pending data are written.
+ * @param conn : connection.
+ */
+static void pomp_conn_exit_async(struct pomp_conn *conn)
+{
+	/* OUT events stay monitored in edge-triggered mode */
+	if (conn->edgetriggered)
+		return;
+
+	POMP_LOGI("conn=%p fd=%d exit async mode", conn, conn->fd);
+	pomp_loop_update2(conn->loop, conn->fd, 0, POMP_FD_EVENT_OUT);
+}
+
 /**
  * Function called when some data have been read on the connection fd. It
  * tries to decode a message and notify the associated context when a full
  * message has been successfully parsed.
  * @param conn : connection.
+ * @return number of messages decoded.
  */
-static void pomp_conn_process_read_buf(struct pomp_conn *conn)
+static uint32_t pomp_conn_process_read_buf(struct pomp_conn *conn)
 {
 	size_t len = 0, off = 0;
 	ssize_t usedlen = 0;
+	uint32_t msgcount = 0;
 	struct pomp_msg *msg = NULL;
 	const void *data = NULL;
 
 	/* No protocol decoding for raw context */
 	if (conn->israw) {
 		pomp_ctx_notify_raw_buf(conn->ctx, conn, conn->readbuf);
-		return;
+		return 1;
 	}
 
 	/* Get data from buffer */
@@ -466,8 +820,11 @@ static void pomp_conn_process_read_buf(struct pomp_conn *conn)
 				pomp_ctx_notify_msg(conn->ctx, conn, msg);
 			pomp_prot_release_msg(conn->prot, msg);
 			msg = NULL;
+			msgcount++;
 		}
 	}
+
+	return msgcount;
 }
 
 static int pomp_conn_process_read_normal(struct pomp_conn *conn)
@@ -589,19 +946,125 @@ static int pomp_conn_process_read_with_fds(struct pomp_conn *conn)
 #endif /* !SCM_RIGHTS */
 }
 
+/**
+ * Determine if the read budget of the current loop iteration is exhausted.
+ * @param conn : connection.
+ * @param bytes : number of bytes read in this iteration.
+ * @param msgs : number of messages read in this iteration.
+ * @return 1 if reading shall stop until next iteration, 0 otherwise.
+ */
+static int pomp_conn_read_budget_reached(const struct pomp_conn *conn,
+		size_t bytes, uint32_t msgs)
+{
+	return (conn->maxreadbytes != 0 && bytes >= conn->maxreadbytes)
+		|| (conn->maxreadmsgs != 0 && msgs >= conn->maxreadmsgs);
+}
+
+/**
+ * Determine if the tokens of the rate limits of a connection are exhausted.
+ * @param conn : connection.
+ * @return 1 if reading shall stop until tokens are refilled, 0 otherwise.
+ */
+static int pomp_conn_rate_exhausted(const struct pomp_conn *conn)
+{
+	return pomp_token_bucket_wait(&conn->ratelimit.msgs) != 0
+		|| pomp_token_bucket_wait(&conn->ratelimit.bytes) != 0;
+}
+
+/**
+ * Function called when the tokens of a throttled connection are refilled.
+ * @param timer : timer.
+ * @param userdata : connection.
+ */
+static void pomp_conn_throttle_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_conn *conn = userdata;
+	uint64_t now = pomp_loop_now(conn->loop);
+
+	conn->ratelimit.throttled = 0;
+	conn->ratelimit.stats.throttled_us += now - conn->ratelimit.since;
+	if (!conn->read_suspended && conn->migrateloop == NULL)
+		(void)pomp_loop_update2(conn->loop, conn->fd,
+				POMP_FD_EVENT_IN, 0);
+}
+
+/**
+ * Suspend reads of a connection until the tokens of its rate limits are
+ * refilled.
+ * @param conn : connection.
+ * @param now : current time (in us).
+ */
+static void pomp_conn_throttle(struct pomp_conn *conn, uint64_t now)
+{
+	uint64_t wait = 0, bytewait = 0;
+
+	wait = pomp_token_bucket_wait(&conn->ratelimit.msgs);
+	bytewait = pomp_token_bucket_wait(&conn->ratelimit.bytes);
+	if (bytewait > wait)
+		wait = bytewait;
+
+	if (conn->ratelimit.timer == NULL) {
+		conn->ratelimit.timer = pomp_timer_new(conn->loop,
+				&pomp_conn_throttle_cb, conn);
+		if (conn->ratelimit.timer == NULL)
+			return;
+	}
+	if (pomp_timer_set_us(conn->ratelimit.timer, wait) < 0)
+		return;
+
+	conn->ratelimit.throttled = 1;
+	conn->ratelimit.since = now;
+	conn->ratelimit.stats.throttles++;
+	if (!conn->read_suspended)
+		(void)pomp_loop_update2(conn->loop, conn->fd,
+				0, POMP_FD_EVENT_IN);
+}
+
+/**
+ * Stop the throttling of a connection, reads are resumed by the caller.
+ * @param conn : connection.
+ */
+static void pomp_conn_unthrottle(struct pomp_conn *conn)
+{
+	if (conn->ratelimit.timer == NULL)
+		return;
+	if (conn->ratelimit.throttled) {
+		conn->ratelimit.throttled = 0;
+		conn->ratelimit.stats.throttled_us +=
+				pomp_loop_now(conn->loop) -
+				conn->ratelimit.since;
+	}
+	pomp_timer_destroy(conn->ratelimit.timer);
+	conn->ratelimit.timer = NULL;
+}
+
 /**
  * Function called when the fd is readable. It reads as many bytes as possible
  * until either there is no more data immediately available ('read' returned
- * EAGAIN) or EOF is reached or another error is returned by 'read'.
+ * EAGAIN) or EOF is reached or another error is returned by 'read' or the
+ * read budget of the connection is exhausted. In the last case, the fd is
+ * still readable and will be processed again at next loop iteration.
  * @param conn : connection.
  */
 static void pomp_conn_process_read(struct pomp_conn *conn)
 {
 	int res = 0;
+	size_t bytes = 0;
+	uint32_t msgs = 0, n = 0;
+	uint64_t now = 0;
 
 	/* Do not read fd on read suspended */
-	if (conn->read_suspended)
+	if (conn->read_suspended || conn->ratelimit.throttled)
+		return;
+
+	/* Tokens may still be in debt after a migration */
+	now = pomp_loop_now(conn->loop);
+	pomp_token_bucket_refill(&conn->ratelimit.msgs, now);
+	pomp_token_bucket_refill(&conn->ratelimit.bytes, now);
+	if (pomp_conn_rate_exhausted(conn)) {
+		pomp_conn_throttle(conn, now);
 		return;
+	}
 
 	do {
 		/* If current read buffer is shared, unref it */
@@ -627,13 +1090,35 @@ static void pomp_conn_process_read(struct pomp_conn *conn)
 		/* Process read data */
 		if (res > 0) {
 			conn->readbuf->len = (size_t)res;
-			pomp_conn_process_read_buf(conn);
+			bytes += (size_t)res;
+			n = pomp_conn_process_read_buf(conn);
+			msgs += n;
+			pomp_token_bucket_take(&conn->ratelimit.bytes,
+					(uint64_t)res);
+			pomp_token_bucket_take(&conn->ratelimit.msgs, n);
 		} else if (res == 0 || !POMP_CONN_WOULD_BLOCK(-res)) {
 			/* Error or EOF, finish this connection */
 			if (!conn->isdgram)
 				conn->removeflag = 1;
 		}
-	} while (res > 0 && !conn->read_suspended);
+	} while (res > 0 && !conn->read_suspended && conn->migrateloop == NULL
+			&& !pomp_conn_read_budget_reached(conn, bytes, msgs)
+			&& !pomp_conn_rate_exhausted(conn));
+
+	/* Rate limit reached, wait for tokens */
+	if (!conn->removeflag && !conn->read_suspended
+			&& conn->migrateloop == NULL
+			&& pomp_conn_rate_exhausted(conn)) {
+		pomp_conn_throttle(conn, now);
+	}
+
+	/* Budget reached with data still available, an edge-triggered fd
+	 * needs to be re-armed to be notified at next iteration */
+	if (res > 0 && conn->edgetriggered && !conn->read_suspended
+			&& !conn->ratelimit.throttled
+			&& conn->migrateloop == NULL) {
+		pomp_loop_update2(conn->loop, conn->fd, 0, 0);
+	}
 
 	/* Always reset peer address after reading message on dgram sockets */
 	if (conn->isdgram) {
@@ -643,22 +1128,129 @@ static void pomp_conn_process_read(struct pomp_conn *conn)
 }
 
 /**
- * Function called when the fd is writable and there is some IO buffer pending.
- * It resumes writing until either there is no more pending IO buffer or
- * data can not be written immediately ('write' returned EAGAIN).
+ * Get the end of committed data in the transmit buffer.
  * @param conn : connection.
+ * @return offset of the end of data that can be written.
  */
-static void pomp_conn_process_write(struct pomp_conn *conn)
+static size_t pomp_conn_tx_end(const struct pomp_conn *conn)
+{
+	if (conn->txbuf == NULL)
+		return 0;
+	else if (conn->txmsg.buf != NULL)
+		return conn->txstart;
+	else
+		return conn->txbuf->len;
+}
+
+/**
+ * Determine if some data of the transmit buffer still needs to be written.
+ * @param conn : connection.
+ * @return 1 if some data is pending, 0 otherwise.
+ */
+static int pomp_conn_tx_pending(const struct pomp_conn *conn)
+{
+	return conn->txoff < pomp_conn_tx_end(conn);
+}
+
+/**
+ * Move pending data of the transmit buffer at the end of the IO buffer queue.
+ * It is used to keep ordering when a buffer is sent with the normal API while
+ * some messages encoded in place are still pending. A new transmit buffer
+ * will be allocated for next messages.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_conn_seal_tx(struct pomp_conn *conn)
+{
+	struct pomp_io_buffer *iobuf = NULL;
+
+	iobuf = pomp_io_buffer_new(conn->txbuf, conn->txoff);
+	if (iobuf == NULL)
+		return -ENOMEM;
+
+	/* Add in queue, OUT events are already monitored */
+	if (conn->tailbuf == NULL) {
+		conn->headbuf = iobuf;
+		conn->tailbuf = iobuf;
+	} else {
+		conn->tailbuf->next = iobuf;
+		conn->tailbuf = iobuf;
+	}
+
+	/* The IO buffer is now the only owner */
+	pomp_buffer_unref(conn->txbuf);
+	conn->txbuf = NULL;
+	conn->txoff = 0;
+	return 0;
+}
+
+/**
+ * Write pending data of the transmit buffer.
+ * @param conn : connection.
+ */
+static void pomp_conn_process_write_tx(struct pomp_conn *conn)
+{
+	int res = 0;
+	struct pomp_io_buffer tmpiobuf;
+
+	/* Prepare a local temp io buffer */
+	memset(&tmpiobuf, 0, sizeof(tmpiobuf));
+	tmpiobuf.buf = conn->txbuf;
+	tmpiobuf.len = pomp_conn_tx_end(conn);
+	tmpiobuf.off = conn->txoff;
+
+	/* Write it */
+	res = pomp_io_buffer_write(&tmpiobuf, conn);
+	if (POMP_CONN_WOULD_BLOCK(-res)) {
+		return;
+	} else if (res < 0) {
+		/* Error, finish this connection */
+		conn->removeflag = 1;
+		return;
+	}
+
+	conn->txoff = tmpiobuf.off;
+	if (conn->txoff == tmpiobuf.len) {
+		pomp_ctx_notify_send(conn->ctx, conn, conn->txbuf,
+				POMP_SEND_STATUS_OK |
+				POMP_SEND_STATUS_QUEUE_EMPTY);
+	}
+}
+
+/**
+ * Release file descriptors put in the transmit buffer. They are not supported
+ * for messages encoded in place.
+ * @param conn : connection.
+ */
+static void pomp_conn_clear_tx_fds(struct pomp_conn *conn)
+{
+	uint32_t i = 0;
+	int fd = 0;
+
+	for (i = 0; i < conn->txbuf->fdcount; i++) {
+		fd = pomp_buffer_get_fd(conn->txbuf, conn->txbuf->fdoffs[i]);
+		if (fd >= 0 && close(fd) < 0)
+			POMP_LOG_FD_ERRNO("close", fd);
+	}
+	conn->txbuf->fdcount = 0;
+}
+
+/**
+ * Write pending IO buffers and then messages encoded in place until either
+ * everything is written or data can not be written immediately ('write'
+ * returned EAGAIN).
+ * @param conn : connection.
+ */
+static void pomp_conn_write_pending(struct pomp_conn *conn)
 {
 	int res = 0;
 	struct pomp_io_buffer *iobuf = NULL;
 	uint32_t status = 0;
 
 	/* Write pending buffers */
-	iobuf = conn->headbuf;
-	while (iobuf != NULL) {
-		/* Try to write buffer */
-		res = pomp_io_buffer_write(iobuf, conn);
+	while (conn->headbuf != NULL) {
+		/* Try to write buffers */
+		res = pomp_conn_write_queue(conn);
 		if (POMP_CONN_WOULD_BLOCK(-res)) {
 			break;
 		} else if (res < 0) {
@@ -667,30 +1259,44 @@ static void pomp_conn_process_write(struct pomp_conn *conn)
 			break;
 		}
 
-		/* Remove pending buffer if completed */
-		if (iobuf->off == iobuf->len) {
+		/* Remove pending buffers completed */
+		iobuf = conn->headbuf;
+		while (iobuf != NULL && iobuf->off == iobuf->len) {
 			conn->headbuf = iobuf->next;
 			if (conn->headbuf == NULL)
 				conn->tailbuf = NULL;
 
 			status = POMP_SEND_STATUS_OK;
-			if (conn->headbuf == NULL)
+			if (conn->headbuf == NULL && !pomp_conn_tx_pending(conn))
 				status |= POMP_SEND_STATUS_QUEUE_EMPTY;
-			pomp_ctx_notify_send(conn->ctx, conn,
-					iobuf->buf, status);
-
-			pomp_io_buffer_destroy(iobuf);
+			pomp_io_buffer_complete(iobuf, conn, status);
 			iobuf = conn->headbuf;
 		}
 	}
 
-	/* If queue is empty, stop monitoring OUT events */
-	if (conn->headbuf == NULL) {
-		POMP_LOGI("conn=%p fd=%d exit async mode", conn, conn->fd);
-		pomp_loop_update2(conn->loop, conn->fd, 0, POMP_FD_EVENT_OUT);
+	/* Messages encoded in place are after the queue */
+	if (conn->headbuf == NULL && !conn->removeflag
+			&& pomp_conn_tx_pending(conn)) {
+		pomp_conn_process_write_tx(conn);
 	}
 }
 
+/**
+ * Function called when the fd is writable and there is some IO buffer pending.
+ * It resumes writing until either there is no more pending IO buffer or
+ * data can not be written immediately ('write' returned EAGAIN).
+ * @param conn : connection.
+ */
+static void pomp_conn_process_write(struct pomp_conn *conn)
+{
+	/* Write pending buffers */
+	pomp_conn_write_pending(conn);
+
+	/* If queue is empty, stop monitoring OUT events */
+	if (conn->headbuf == NULL && !pomp_conn_tx_pending(conn))
+		pomp_conn_exit_async(conn);
+}
+
 /**
  * Function called when the fd of the connection has an event to process.
  * @param fd : fd of the connection .
@@ -700,7 +1306,8 @@ static void pomp_conn_process_write(struct pomp_conn *conn)
 static void pomp_conn_cb(int fd, uint32_t revents, void *userdata)
 {
 	struct pomp_conn *conn = userdata;
-	if (!conn->removeflag && (revents & POMP_FD_EVENT_IN))
+	if (!conn->removeflag && conn->migrateloop == NULL
+			&& (revents & POMP_FD_EVENT_IN))
 		pomp_conn_process_read(conn);
 	if (!conn->removeflag && (revents & POMP_FD_EVENT_OUT))
 		pomp_conn_process_write(conn);
@@ -708,6 +1315,29 @@ static void pomp_conn_cb(int fd, uint32_t revents, void *userdata)
 		pomp_ctx_remove_conn(conn->ctx, conn);
 }
 
+/**
+ * Function called by the current loop of a connection being migrated, once
+ * the event being processed is completed.
+ * @param userdata : connection.
+ */
+static void pomp_conn_migrate_idle_cb(void *userdata)
+{
+	int res = 0;
+	struct pomp_conn *conn = userdata;
+
+	/* The connection belongs to the new loop in case of success */
+	res = pomp_ctx_migrate_conn(conn->ctx, conn, conn->migrateloop);
+	if (res < 0) {
+		POMP_LOGE("pomp_ctx_migrate_conn err=%d(%s)",
+				res, strerror(-res));
+		conn->migrateloop = NULL;
+		if (!conn->read_suspended && !conn->ratelimit.throttled) {
+			(void)pomp_loop_update2(conn->loop, conn->fd,
+					POMP_FD_EVENT_IN, 0);
+		}
+	}
+}
+
 /**
  * Create a new connection object to wrap read/write operations on a fd.
  * @param ctx : associated context.
@@ -722,10 +1352,8 @@ struct pomp_conn *pomp_conn_new(struct pomp_ctx *ctx,
 {
 	int res = 0;
 	struct pomp_conn *conn = NULL;
-#ifdef SO_PEERCRED
-	socklen_t optlen = 0;
-	struct ucred cred;
-#endif /* SO_PEERCRED */
+	uint32_t msgrate = 0, msgburst = 0, byterate = 0, byteburst = 0;
+	uint32_t pacingrate = 0, pacingburst = 0;
 
 	POMP_RETURN_VAL_IF_FAILED(ctx != NULL, -EINVAL, NULL);
 	POMP_RETURN_VAL_IF_FAILED(loop != NULL, -EINVAL, NULL);
@@ -738,13 +1366,29 @@ struct pomp_conn *pomp_conn_new(struct pomp_ctx *ctx,
 
 	/* Initialize structure */
 	conn->ctx = ctx;
+	conn->id = pomp_atomic_inc_u32(&s_conn_next_id);
 	conn->loop = loop;
 	conn->fd = fd;
 	conn->isdgram = isdgram;
 	conn->israw = israw;
+	conn->family = pomp_ctx_get_family(ctx);
+	conn->edgetriggered = !isdgram && pomp_ctx_is_edge_triggered(ctx)
+			&& pomp_loop_has_edge_triggered();
+	pomp_ctx_get_read_budget(ctx, &conn->maxreadbytes, &conn->maxreadmsgs);
+	if (!isdgram) {
+		pomp_ctx_get_rate_limit(ctx, &msgrate, &msgburst,
+				&byterate, &byteburst);
+		pomp_token_bucket_init(&conn->ratelimit.msgs, msgrate,
+				msgburst, pomp_loop_now(loop));
+		pomp_token_bucket_init(&conn->ratelimit.bytes, byterate,
+				byteburst, pomp_loop_now(loop));
+	}
+	pomp_ctx_get_pacing(ctx, &pacingrate, &pacingburst);
+	pomp_conn_setup_pacing(conn, pacingrate, pacingburst);
 	conn->removeflag = 0;
 	conn->read_suspended = 0;
 	conn->readbuf = NULL;
+	(void)time_get_monotonic_us(&conn->heartbeat.lastrecv);
 
 	/* Allocate protocol */
 	if (!israw) {
@@ -753,52 +1397,12 @@ struct pomp_conn *pomp_conn_new(struct pomp_ctx *ctx,
 			goto error;
 	}
 
-	/* Always monitor IN events */
-	res = pomp_loop_add(conn->loop, conn->fd, POMP_FD_EVENT_IN,
-			&pomp_conn_cb, conn);
+	/* Always monitor IN events, and OUT events in edge-triggered mode */
+	res = pomp_loop_add(conn->loop, conn->fd,
+			pomp_conn_get_fd_events(conn), &pomp_conn_cb, conn);
 	if (res < 0)
 		goto error;
 
-	/* Get local address information */
-	conn->local_addrlen = sizeof(conn->local_addr);
-	if (getsockname(fd, (struct sockaddr *)&conn->local_addr,
-			&conn->local_addrlen) < 0) {
-		POMP_LOG_FD_ERRNO("getsockname", fd);
-		conn->local_addrlen = 0;
-	}
-
-	/* Get peer address information */
-	if (!isdgram) {
-		conn->peer_addrlen = sizeof(conn->peer_addr);
-		if (getpeername(fd, (struct sockaddr *)&conn->peer_addr,
-				&conn->peer_addrlen) < 0) {
-			res = -errno;
-			POMP_LOG_FD_ERRNO("getpeername", fd);
-			conn->peer_addrlen = 0;
-
-			/* Do NOT ignore the 'peer not connected' error,
-			 * abort now */
-			if (res == -ENOTCONN)
-				goto error;
-		}
-	}
-
-	/* Get peer credentials information */
-#ifdef SO_PEERCRED
-	if (!isdgram && conn->peer_addr.ss_family == AF_UNIX) {
-		memset(&cred, 0, sizeof(cred));
-		optlen = sizeof(cred);
-		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED,
-				&cred, &optlen) < 0) {
-			POMP_LOG_FD_ERRNO("getsockopt.SO_PEERCRED", fd);
-		} else {
-			conn->peer_cred.pid = cred.pid;
-			conn->peer_cred.uid = cred.uid;
-			conn->peer_cred.gid = cred.gid;
-		}
-	}
-#endif /* SO_PEERCRED */
-
 	return conn;
 
 	/* Cleanup in case of error */
@@ -826,6 +1430,8 @@ int pomp_conn_destroy(struct pomp_conn *conn)
 		pomp_prot_destroy(conn->prot);
 	if (conn->readbuf != NULL)
 		pomp_buffer_unref(conn->readbuf);
+	if (conn->txbuf != NULL)
+		pomp_buffer_unref(conn->txbuf);
 	free(conn);
 	return 0;
 }
@@ -843,6 +1449,17 @@ int pomp_conn_close(struct pomp_conn *conn)
 	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(conn->fd >= 0, -EINVAL);
 
+	/* Cancel a migration not started yet */
+	if (conn->migrateloop != NULL) {
+		(void)pomp_loop_idle_remove(conn->loop,
+				&pomp_conn_migrate_idle_cb, conn);
+		conn->migrateloop = NULL;
+	}
+
+	/* Stop rate limiting and pacing */
+	pomp_conn_unthrottle(conn);
+	pomp_conn_unpace(conn);
+
 	/* Close remaining received file descriptors */
 	pomp_conn_clear_rx_fds(conn);
 
@@ -861,14 +1478,25 @@ int pomp_conn_close(struct pomp_conn *conn)
 			conn->tailbuf = NULL;
 
 		status = POMP_SEND_STATUS_ABORTED;
-		if (conn->headbuf == NULL)
+		if (conn->headbuf == NULL && !pomp_conn_tx_pending(conn))
 			status |= POMP_SEND_STATUS_QUEUE_EMPTY;
-		pomp_ctx_notify_send(conn->ctx, conn, iobuf->buf, status);
-
-		pomp_io_buffer_destroy(iobuf);
+		pomp_io_buffer_complete(iobuf, conn, status);
 		iobuf = conn->headbuf;
 	}
 
+	/* Abort messages encoded in place (including a partial one) */
+	if (conn->txbuf != NULL) {
+		if (conn->txmsg.buf != NULL)
+			(void)pomp_conn_abort_msg(conn);
+		if (pomp_conn_tx_pending(conn)) {
+			pomp_ctx_notify_send(conn->ctx, conn, conn->txbuf,
+					POMP_SEND_STATUS_ABORTED |
+					POMP_SEND_STATUS_QUEUE_EMPTY);
+		}
+		conn->txoff = 0;
+		conn->txbuf->len = 0;
+	}
+
 	/* Release resources */
 	close(conn->fd);
 	conn->fd = -1;
@@ -899,6 +1527,221 @@ int pomp_conn_set_next(struct pomp_conn *conn, struct pomp_conn *next)
 	return 0;
 }
 
+/**
+ * Get the context owning a connection.
+ * @param conn : connection.
+ * @return context or NULL in case of error.
+ */
+struct pomp_ctx *pomp_conn_get_ctx(const struct pomp_conn *conn)
+{
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
+	return conn->ctx;
+}
+
+/**
+ * Get the unique identifier of a connection.
+ * @param conn : connection.
+ * @return identifier or 0 in case of error.
+ */
+uint32_t pomp_conn_get_id(const struct pomp_conn *conn)
+{
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, 0);
+	return conn->id;
+}
+
+/**
+ * Determine if a connection is corked.
+ * @param conn : connection.
+ * @return 1 if the connection is corked, 0 otherwise.
+ */
+int pomp_conn_is_corked(const struct pomp_conn *conn)
+{
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, 0);
+	return conn->corked;
+}
+
+/**
+ * Get the loop of a connection.
+ * @param conn : connection.
+ * @return loop or NULL in case of error.
+ */
+struct pomp_loop *pomp_conn_get_loop(const struct pomp_conn *conn)
+{
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
+	return conn->loop;
+}
+
+/**
+ * Get the number of bytes waiting to be written on a connection.
+ * @param conn : connection.
+ * @return number of queued bytes.
+ */
+size_t pomp_conn_get_queued(const struct pomp_conn *conn)
+{
+	size_t queued = 0;
+	const struct pomp_io_buffer *iobuf = NULL;
+
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, 0);
+	for (iobuf = conn->headbuf; iobuf != NULL; iobuf = iobuf->next)
+		queued += iobuf->len - iobuf->off;
+	if (pomp_conn_tx_pending(conn))
+		queued += pomp_conn_tx_end(conn) - conn->txoff;
+	return queued;
+}
+
+/**
+ * Send a heartbeat ping on a connection, or disconnect it if the peer has
+ * not answered for too long.
+ * @param conn : connection.
+ * @param now : current time (in us).
+ * @param timeout : maximum time without ping or pong from the peer (in us),
+ * 0 for no limit.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -ETIMEDOUT is returned if the connection has been disconnected.
+ */
+int pomp_conn_heartbeat(struct pomp_conn *conn, uint64_t now,
+		uint64_t timeout)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+
+	if (timeout != 0 && now > conn->heartbeat.lastrecv + timeout) {
+		POMP_LOGW("conn(fd=%d): no heartbeat for %" PRIu64 " us",
+				conn->fd, now - conn->heartbeat.lastrecv);
+		(void)pomp_conn_disconnect(conn);
+		return -ETIMEDOUT;
+	}
+
+	/* The pong returns our own time stamp */
+	return pomp_conn_send(conn, POMP_MSGID_PING, "%llu",
+			(unsigned long long)now);
+}
+
+/**
+ * Handle a heartbeat ping or pong received on a connection. A ping is
+ * answered with a pong carrying the same time stamp, a pong gives a round
+ * trip time sample.
+ * @param conn : connection.
+ * @param msg : received message.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_conn_process_heartbeat(struct pomp_conn *conn,
+		const struct pomp_msg *msg)
+{
+	int res = 0;
+	unsigned long long stamp = 0;
+	uint64_t now = 0, sample = 0;
+	struct pomp_conn_rtt *rtt = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+
+	res = pomp_msg_read(msg, "%llu", &stamp);
+	if (res < 0)
+		return res;
+	res = time_get_monotonic_us(&now);
+	if (res < 0)
+		return res;
+	conn->heartbeat.lastrecv = now;
+
+	if (msg->msgid == POMP_MSGID_PING)
+		return pomp_conn_send(conn, POMP_MSGID_PONG, "%llu", stamp);
+
+	/* Ignore time stamps from the future (not sent by us) */
+	if (stamp > now)
+		return -EINVAL;
+	sample = now - stamp;
+	if (sample > UINT32_MAX)
+		sample = UINT32_MAX;
+
+	/* Smoothed as TCP does (RFC 6298) */
+	rtt = &conn->heartbeat.rtt;
+	if (rtt->count == 0) {
+		rtt->srtt = (uint32_t)sample;
+		rtt->rttvar = (uint32_t)sample / 2;
+		rtt->min = (uint32_t)sample;
+	} else {
+		rtt->rttvar = (uint32_t)(((uint64_t)rtt->rttvar * 3 +
+				(sample > rtt->srtt ? sample - rtt->srtt :
+				rtt->srtt - sample)) / 4);
+		rtt->srtt = (uint32_t)(((uint64_t)rtt->srtt * 7 + sample) / 8);
+		if (sample < rtt->min)
+			rtt->min = (uint32_t)sample;
+	}
+	rtt->last = (uint32_t)sample;
+	rtt->count++;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_conn_get_throttle_stats(const struct pomp_conn *conn,
+		struct pomp_throttle_stats *stats)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(stats != NULL, -EINVAL);
+	*stats = conn->ratelimit.stats;
+	if (conn->ratelimit.throttled) {
+		stats->throttled_us += pomp_loop_now(conn->loop) -
+				conn->ratelimit.since;
+	}
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_conn_get_rtt(const struct pomp_conn *conn, struct pomp_conn_rtt *rtt)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(rtt != NULL, -EINVAL);
+	*rtt = conn->heartbeat.rtt;
+	return 0;
+}
+
+/**
+ * Cork a connection. Buffers sent are only queued until the connection is
+ * uncorked so they can be written together with a gather write.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_conn_cork(struct pomp_conn *conn)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	if (conn->corked)
+		return 0;
+
+	conn->corked = 1;
+	conn->corkasync = conn->headbuf != NULL || pomp_conn_tx_pending(conn);
+	return 0;
+}
+
+/**
+ * Uncork a connection and write buffers queued while it was corked.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_conn_uncork(struct pomp_conn *conn)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	if (!conn->corked)
+		return 0;
+
+	/* Nothing to do if the loop is already waiting for OUT events */
+	conn->corked = 0;
+	if (conn->fd < 0 || conn->corkasync || conn->headbuf == NULL)
+		return 0;
+
+	/* Monitor OUT events for remaining data, it also makes sure that a
+	 * connection in error is removed during next iteration */
+	pomp_conn_write_pending(conn);
+	if (conn->removeflag || conn->headbuf != NULL
+			|| pomp_conn_tx_pending(conn)) {
+		pomp_conn_enter_async(conn, !conn->removeflag);
+	}
+	return 0;
+}
+
 /*
  * See documentation in public header.
  */
@@ -916,6 +1759,60 @@ int pomp_conn_disconnect(struct pomp_conn *conn)
 	return 0;
 }
 
+/**
+ * Query addresses and credentials of the connection socket, once, on first
+ * request of the user. It is not done on creation to keep accepting
+ * connections cheap.
+ * @param conn : connection.
+ */
+static void pomp_conn_fetch_addrs(struct pomp_conn *conn)
+{
+#ifdef SO_PEERCRED
+	socklen_t optlen = 0;
+	struct ucred cred;
+#endif /* SO_PEERCRED */
+
+	if (conn->addrfetched || conn->fd < 0)
+		return;
+	conn->addrfetched = 1;
+
+	/* Get local address information */
+	conn->local_addrlen = sizeof(conn->local_addr);
+	if (getsockname(conn->fd, (struct sockaddr *)&conn->local_addr,
+			&conn->local_addrlen) < 0) {
+		POMP_LOG_FD_ERRNO("getsockname", conn->fd);
+		conn->local_addrlen = 0;
+	}
+
+	/* Peer address of dgram sockets is the one of the last message */
+	if (conn->isdgram)
+		return;
+
+	/* Get peer address information */
+	conn->peer_addrlen = sizeof(conn->peer_addr);
+	if (getpeername(conn->fd, (struct sockaddr *)&conn->peer_addr,
+			&conn->peer_addrlen) < 0) {
+		POMP_LOG_FD_ERRNO("getpeername", conn->fd);
+		conn->peer_addrlen = 0;
+	}
+
+	/* Get peer credentials information */
+#ifdef SO_PEERCRED
+	if (conn->peer_addr.ss_family == AF_UNIX) {
+		memset(&cred, 0, sizeof(cred));
+		optlen = sizeof(cred);
+		if (getsockopt(conn->fd, SOL_SOCKET, SO_PEERCRED,
+				&cred, &optlen) < 0) {
+			POMP_LOG_FD_ERRNO("getsockopt.SO_PEERCRED", conn->fd);
+		} else {
+			conn->peer_cred.pid = cred.pid;
+			conn->peer_cred.uid = cred.uid;
+			conn->peer_cred.gid = cred.gid;
+		}
+	}
+#endif /* SO_PEERCRED */
+}
+
 /*
  * See documentation in public header.
  */
@@ -924,6 +1821,7 @@ const struct sockaddr *pomp_conn_get_local_addr(struct pomp_conn *conn,
 {
 	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
 	POMP_RETURN_VAL_IF_FAILED(addrlen != NULL, -EINVAL, NULL);
+	pomp_conn_fetch_addrs(conn);
 	*addrlen = conn->local_addrlen;
 	return (const struct sockaddr *)&conn->local_addr;
 }
@@ -936,6 +1834,7 @@ const struct sockaddr *pomp_conn_get_peer_addr(struct pomp_conn *conn,
 {
 	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
 	POMP_RETURN_VAL_IF_FAILED(addrlen != NULL, -EINVAL, NULL);
+	pomp_conn_fetch_addrs(conn);
 	*addrlen = conn->peer_addrlen;
 	return (const struct sockaddr *)&conn->peer_addr;
 }
@@ -946,6 +1845,7 @@ const struct sockaddr *pomp_conn_get_peer_addr(struct pomp_conn *conn,
 const struct pomp_cred *pomp_conn_get_peer_cred(struct pomp_conn *conn)
 {
 	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
+	pomp_conn_fetch_addrs(conn);
 	if (conn->peer_addr.ss_family == AF_UNIX)
 		return &conn->peer_cred;
 	else
@@ -969,6 +1869,13 @@ int pomp_conn_suspend_read(struct pomp_conn *conn)
 	int res;
 
 	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+
+	/* IN events are already disabled during a migration */
+	if (conn->migrateloop != NULL) {
+		conn->read_suspended = 1;
+		return 0;
+	}
+
 	res = pomp_loop_update2(conn->loop, conn->fd, 0, POMP_FD_EVENT_IN);
 	if (res == 0)
 		conn->read_suspended = 1;
@@ -984,6 +1891,14 @@ int pomp_conn_resume_read(struct pomp_conn *conn)
 	int res;
 
 	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+
+	/* IN events will be enabled by the new loop, or once tokens of the
+	 * rate limits are refilled */
+	if (conn->migrateloop != NULL || conn->ratelimit.throttled) {
+		conn->read_suspended = 0;
+		return 0;
+	}
+
 	res = pomp_loop_update2(conn->loop, conn->fd, POMP_FD_EVENT_IN, 0);
 	if (res == 0)
 		conn->read_suspended = 0;
@@ -991,6 +1906,90 @@ int pomp_conn_resume_read(struct pomp_conn *conn)
 	return res;
 }
 
+/*
+ * See documentation in public header.
+ */
+int pomp_conn_migrate(struct pomp_conn *conn, struct pomp_loop *loop)
+{
+	int res = 0;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn->fd >= 0, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(!conn->removeflag, -ENOTCONN);
+	POMP_RETURN_ERR_IF_FAILED(conn->migrateloop == NULL, -EBUSY);
+	POMP_RETURN_ERR_IF_FAILED(conn->txmsg.buf == NULL, -EBUSY);
+	POMP_RETURN_ERR_IF_FAILED(!conn->corked, -EBUSY);
+
+	if (loop == conn->loop)
+		return 0;
+
+	res = pomp_ctx_check_migrate(conn->ctx, conn, loop);
+	if (res < 0)
+		return res;
+
+	/* Hand over the connection when no callback uses it anymore */
+	res = pomp_loop_idle_add(conn->loop, &pomp_conn_migrate_idle_cb, conn);
+	if (res < 0)
+		return res;
+
+	/* Leave data in the socket for the new loop */
+	conn->migrateloop = loop;
+	if (!conn->read_suspended)
+		(void)pomp_loop_update2(conn->loop, conn->fd, 0, POMP_FD_EVENT_IN);
+	return 0;
+}
+
+/**
+ * Stop monitoring the fd of a connection in its current loop. The connection
+ * keeps all its state and can then be attached to another loop.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_conn_detach(struct pomp_conn *conn)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn->fd >= 0, -EINVAL);
+
+	/* The timers belong to the current loop, the new one throttles or
+	 * paces again at its first read or write if tokens are missing */
+	pomp_conn_unthrottle(conn);
+	pomp_conn_unpace(conn);
+	return pomp_loop_remove(conn->loop, conn->fd);
+}
+
+/**
+ * Monitor the fd of a detached connection in a new loop. It shall be called
+ * in the thread of the new loop.
+ * @param conn : connection.
+ * @param loop : new loop.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_conn_attach(struct pomp_conn *conn, struct pomp_loop *loop)
+{
+	int res = 0;
+	uint32_t events = 0;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn->fd >= 0, -EINVAL);
+
+	/* Resume writing of pending data in the new loop */
+	events = pomp_conn_get_fd_events(conn);
+	if (conn->headbuf != NULL || pomp_conn_tx_pending(conn))
+		events |= POMP_FD_EVENT_OUT;
+
+	conn->loop = loop;
+	conn->migrateloop = NULL;
+	res = pomp_loop_add(loop, conn->fd, events, &pomp_conn_cb, conn);
+	if (res < 0)
+		return res;
+
+	if (conn->read_suspended)
+		(void)pomp_loop_update2(loop, conn->fd, 0, POMP_FD_EVENT_IN);
+	return 0;
+}
+
 /**
  * Internal send buffer function.
  */
@@ -1020,6 +2019,17 @@ static int pomp_conn_send_buf_internal(struct pomp_conn *conn,
 	if (addrlen > sizeof(struct sockaddr_storage))
 		return -EINVAL;
 
+	/* Keep ordering with messages encoded in place */
+	if (conn->txmsg.buf != NULL) {
+		POMP_LOGW("conn=%p : message being encoded in place", conn);
+		return -EBUSY;
+	}
+	if (pomp_conn_tx_pending(conn)) {
+		res = pomp_conn_seal_tx(conn);
+		if (res < 0)
+			return res;
+	}
+
 	/* If buffer has file descriptors in it, the connection must be a
 	 * local unix socket */
 	if (buf->fdcount > 0 && !POMP_CONN_IS_LOCAL(conn)) {
@@ -1028,7 +2038,7 @@ static int pomp_conn_send_buf_internal(struct pomp_conn *conn,
 	}
 
 	/* Try to send now if possible */
-	if (conn->headbuf == NULL) {
+	if (conn->headbuf == NULL && !conn->corked) {
 		/* Prepare a local temp io buffer */
 		memset(&tmpiobuf, 0, sizeof(tmpiobuf));
 		tmpiobuf.buf = buf;
@@ -1066,11 +2076,12 @@ static int pomp_conn_send_buf_internal(struct pomp_conn *conn,
 	}
 
 	if (conn->tailbuf == NULL) {
-		/* No previous pending buffer */
-		POMP_LOGI("conn=%p fd=%d enter async mode", conn, conn->fd);
+		/* No previous pending buffer, when corked the write will be
+		 * attempted when uncorked */
 		conn->headbuf = iobuf;
 		conn->tailbuf = iobuf;
-		pomp_loop_update2(conn->loop, conn->fd, POMP_FD_EVENT_OUT, 0);
+		if (!conn->corked)
+			pomp_conn_enter_async(conn, 1);
 	} else {
 		/* Simply add tail */
 		conn->tailbuf->next = iobuf;
@@ -1102,9 +2113,23 @@ int pomp_conn_send_msg_to(struct pomp_conn *conn, const struct pomp_msg *msg,
 int pomp_conn_send_msg(struct pomp_conn *conn, const struct pomp_msg *msg)
 {
 	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+
+	/* Handlers running in the pool let the loop send the message */
+	if (conn != NULL && pomp_ctx_is_pool_thread(conn->ctx))
+		return pomp_ctx_post_msg(conn->ctx, conn, msg);
 	return pomp_conn_send_buf_internal(conn, msg->buf, NULL, 0);
 }
 
+/*
+ * See documentation in public header.
+ */
+int pomp_conn_send_msg_async(struct pomp_conn *conn,
+		const struct pomp_msg *msg)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	return pomp_ctx_post_msg(conn->ctx, conn, msg);
+}
+
 /*
  * See documentation in public header.
  */
@@ -1160,3 +2185,120 @@ int pomp_conn_send_raw_buf(struct pomp_conn *conn, struct pomp_buffer *buf)
 {
 	return pomp_conn_send_buf_internal(conn, buf, NULL, 0);
 }
+
+/*
+ * See documentation in public header.
+ */
+struct pomp_encoder *pomp_conn_begin_msg(struct pomp_conn *conn,
+		uint32_t msgid, size_t size_hint)
+{
+	int res = 0;
+	size_t len = 0;
+
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(conn->fd >= 0, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(!conn->isdgram, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(!conn->israw, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(conn->txmsg.buf == NULL, -EBUSY, NULL);
+
+	/* A send callback keeping a reference makes the transmit buffer
+	 * read-only, queue its pending data and use a new one */
+	if (conn->txbuf != NULL && conn->txbuf->refcount > 1) {
+		if (pomp_conn_tx_pending(conn)) {
+			if (pomp_conn_seal_tx(conn) < 0)
+				return NULL;
+		} else {
+			pomp_buffer_unref(conn->txbuf);
+			conn->txbuf = NULL;
+		}
+	}
+
+	/* Allocate transmit buffer if needed */
+	if (conn->txbuf == NULL) {
+		conn->txbuf = pomp_buffer_new(POMP_CONN_TX_SIZE);
+		if (conn->txbuf == NULL)
+			return NULL;
+		conn->txoff = 0;
+	}
+
+	/* Reclaim space of data already written */
+	len = conn->txbuf->len;
+	if (conn->txoff == len) {
+		conn->txoff = 0;
+		conn->txbuf->len = 0;
+	} else if (conn->txoff >= len / 2) {
+		memmove(conn->txbuf->data, conn->txbuf->data + conn->txoff,
+				len - conn->txoff);
+		conn->txbuf->len = len - conn->txoff;
+		conn->txoff = 0;
+	}
+
+	/* Reserve space for the message */
+	res = pomp_buffer_ensure_capacity(conn->txbuf, conn->txbuf->len +
+			POMP_PROT_HEADER_SIZE + size_hint);
+	if (res < 0)
+		return NULL;
+
+	/* Setup message and encoder, header will be written at commit */
+	conn->txstart = conn->txbuf->len;
+	conn->txmsg.msgid = msgid;
+	conn->txmsg.finished = 0;
+	conn->txmsg.buf = conn->txbuf;
+	conn->txenc.msg = &conn->txmsg;
+	conn->txenc.pos = conn->txstart + POMP_PROT_HEADER_SIZE;
+	return &conn->txenc;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_conn_commit_msg(struct pomp_conn *conn)
+{
+	int res = 0;
+	int pending = 0;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn->txmsg.buf != NULL, -EINVAL);
+
+	/* File descriptors can not be mixed with other messages */
+	if (conn->txbuf->fdcount > 0) {
+		POMP_LOGE("Unable to send message with file descriptors");
+		(void)pomp_conn_abort_msg(conn);
+		return -EPERM;
+	}
+
+	/* Write header */
+	res = pomp_msg_finish_at(&conn->txmsg, conn->txstart);
+	if (res < 0) {
+		(void)pomp_conn_abort_msg(conn);
+		return res;
+	}
+
+	/* Message is now part of pending data */
+	pending = pomp_conn_tx_pending(conn) || conn->headbuf != NULL;
+	memset(&conn->txmsg, 0, sizeof(conn->txmsg));
+	memset(&conn->txenc, 0, sizeof(conn->txenc));
+
+	/* Data will be written when the fd is writable, coalescing all messages
+	 * committed until then in a single write */
+	if (!pending)
+		pomp_conn_enter_async(conn, 0);
+
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_conn_abort_msg(struct pomp_conn *conn)
+{
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn->txmsg.buf != NULL, -EINVAL);
+
+	/* Drop everything written since the begin */
+	pomp_conn_clear_tx_fds(conn);
+	conn->txbuf->len = conn->txstart;
+	memset(&conn->txmsg, 0, sizeof(conn->txmsg));
+	memset(&conn->txenc, 0, sizeof(conn->txenc));
+	return 0;
+}
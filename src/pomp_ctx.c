@@ -37,14 +37,12 @@
 /** Maximum number of active connections for a server */
 #define POMP_SERVER_MAX_CONN_COUNT	32
 
-/** Next bind attempt delay for server (in ms) */
-#define POMP_SERVER_RECONNECT_DELAY	2000
+/** Maximum number of connections accepted per event of a listening socket */
+#define POMP_SERVER_ACCEPT_BUDGET	64
 
-/** Reconnection delay for client (in ms) */
-#define POMP_CLIENT_RECONNECT_DELAY	2000
-
-/** Next bind attempt for dgram (in ms) */
-#define POMP_DGRAM_RECONNECT_DELAY	2000
+/** Default reconnection delay for client, bind retry for server and dgram
+ * (in ms) */
+#define POMP_CTX_RECONNECT_DELAY	2000
 
 /** Determine if a socket address family is TCP/IP */
 #define POMP_IS_INET(_family) \
@@ -80,6 +78,114 @@ enum pomp_ctx_type {
 	POMP_CTX_TYPE_DGRAM,		/**< Connection-less (inet-udp) */
 };
 
+/** Suspension of accepts of a listening socket by the accept rate */
+struct pomp_ctx_accept_pause {
+	/** Timer resuming accepts in the loop of the socket, created on first
+	 * use */
+	struct pomp_timer	*timer;
+
+	/** Accepts suspended until tokens are refilled (protected by the
+	 * workers mutex if any) */
+	int			paused;
+
+	/** Time accepts were suspended (in us) */
+	uint64_t		since;
+};
+
+/** Worker loop owning part of the connections of a server */
+struct pomp_ctx_worker {
+	/** Associated context */
+	struct pomp_ctx		*ctx;
+
+	/** Loop of the worker, run by its own thread */
+	struct pomp_loop	*loop;
+
+	/** List of connections owned by the worker */
+	struct pomp_conn	*conns;
+
+	/** Number of connections, including the ones being handed over
+	 * (protected by the workers mutex) */
+	uint32_t		conncount;
+
+	/** Subscriptions of the worker connections, created when needed */
+	struct pomp_sub_table	*subtable;
+
+	/** Pending rpc requests of the worker connections */
+	struct pomp_rpc		*rpc;
+
+	/** Own listening socket for SO_REUSEPORT policies or -1 */
+	int			fd;
+
+	/** Suspension of accepts of the own listening socket */
+	struct pomp_ctx_accept_pause	pause;
+
+#ifdef POMP_HAVE_COND
+	/** Thread running the loop, known once it processed an operation
+	 * (protected by the workers mutex) */
+	pthread_t		thread;
+	int			hasthread;
+#endif /* POMP_HAVE_COND */
+};
+
+/** Operation posted to a worker loop */
+struct pomp_ctx_worker_op {
+	/** Target worker */
+	struct pomp_ctx_worker	*worker;
+
+	/** Function to call in the worker thread */
+	pomp_idle_cb_t		cb;
+
+	/** Accepted fd to take ownership of or -1 */
+	int			fd;
+
+	/** Migrated connection or NULL */
+	struct pomp_conn	*conn;
+
+	/** Messages sent from other threads to connections or NULL */
+	struct pomp_ctx_async_batch	*batch;
+
+	/** Message to broadcast or NULL */
+	struct pomp_msg		*msg;
+
+	/** Raw buffer to broadcast or NULL */
+	struct pomp_buffer	*buf;
+
+	/** Subscriptions of a migrated connection */
+	struct pomp_sub_set	subs;
+
+	/** Heartbeat timeout (in us) */
+	uint64_t		timeout;
+};
+
+/** Message sent from another thread, waiting for the loop of the context */
+struct pomp_ctx_async_msg {
+	/** Previously queued message */
+	struct pomp_ctx_async_msg	*next;
+
+	/** Destination connection or NULL for the context */
+	struct pomp_conn	*conn;
+
+	/** Identifier of the destination connection, the message is dropped
+	 * if the address is reused by another connection */
+	uint32_t		connid;
+
+	/** Destination connection was corked to send the message */
+	int			corked;
+
+	/** Message sharing the buffer of the one given by the sender */
+	struct pomp_msg		msg;
+};
+
+/** Messages to connections of workers, shared by the operations posted to
+ * all workers, each one sending the messages of its connections */
+struct pomp_ctx_async_batch {
+	/** Number of users (protected by the workers mutex) */
+	uint32_t			refcount;
+
+	/** Queued messages in order */
+	struct pomp_ctx_async_msg	*list;
+};
+
 /** Client/Server context */
 struct pomp_ctx {
 	/** Type of context */
@@ -129,6 +235,113 @@ struct pomp_ctx {
 		int		count;
 	} keepalive;
 
+	/** Register connections in edge-triggered mode */
+	int			edgetriggered;
+
+	/** SO_BUSY_POLL time of inet sockets (us), 0 if disabled */
+	uint32_t		busypoll;
+
+	/** Client contexts of a pooled client, none for a single connection */
+	struct {
+		/** Array of client contexts, one per connection */
+		struct pomp_ctx			**members;
+		/** Number of client contexts */
+		uint32_t			count;
+		/** Policy used to choose the connection of a message */
+		enum pomp_balance_policy	policy;
+		/** Next member for round robin */
+		uint32_t			next;
+	} cpool;
+
+	/** Inbound rate limits of new connections, 0 for no limit */
+	struct {
+		uint32_t	msgrate;
+		uint32_t	msgburst;
+		uint32_t	byterate;
+		uint32_t	byteburst;
+	} ratelimit;
+
+	/** Outbound pacing of new connections, 0 for no limit */
+	struct {
+		uint32_t	rate;
+		uint32_t	burst;
+	} pacing;
+
+	/** Admission control of a server, the bucket and the statistics are
+	 * shared by all listening sockets (protected by the workers mutex if
+	 * any) */
+	struct {
+		/** Maximum number of connections */
+		uint32_t			maxconns;
+		/** Accepted connections */
+		struct pomp_token_bucket	accepts;
+		/** Suspension of accepts of the socket of the context */
+		struct pomp_ctx_accept_pause	pause;
+		/** Statistics */
+		struct pomp_throttle_stats	stats;
+	} admission;
+
+	/** Application level heartbeat, disabled if interval is 0 */
+	struct {
+		uint32_t		interval;	/**< Ping interval (ms) */
+		uint32_t		timeout;	/**< Disconnect delay (ms) */
+		struct pomp_timer	*timer;		/**< Ping timer */
+	} heartbeat;
+
+	/** Reconnection policy and current schedule */
+	struct {
+		uint32_t	initial;	/**< First delay (ms) */
+		uint32_t	max;		/**< Maximum delay (ms) */
+		uint32_t	multiplier;	/**< Growth of delay (percent) */
+		uint32_t	jitter;		/**< Randomized part (percent) */
+		int		immediate;	/**< First retry without delay */
+		uint32_t	attempts;	/**< Attempts since last success */
+		uint32_t	delay;		/**< Next delay before jitter */
+		uint32_t	seed;		/**< State of jitter generator */
+	} reconnect;
+
+	/** Read budget of connections per loop iteration, 0 for no limit */
+	struct {
+		uint32_t	maxbytes;
+		uint32_t	maxmsgs;
+	} readbudget;
+
+	/** Subscriptions of clients (server with subscription enabled) */
+	struct pomp_sub_table	*subtable;
+
+	/** Message ids subscribed by client */
+	struct pomp_sub_set	subs;
+
+	/** Pending rpc requests, created on first request */
+	struct pomp_rpc		*rpc;
+
+	/** Threads running message handlers, NULL to use the loop thread */
+	struct pomp_pool	*pool;
+
+	/** Messages sent from other threads. Lock-free stack where senders
+	 * push and the loop takes all messages at once */
+	struct pomp_ctx_async_msg	*volatile async;
+
+	/** Worker loops of a server, none if connections use the ctx loop */
+	struct {
+		/** Array of workers */
+		struct pomp_ctx_worker	*entries;
+		/** Number of workers */
+		uint32_t		count;
+		/** Policy used to dispatch accepted connections */
+		enum pomp_worker_policy	policy;
+		/** Next worker for round robin dispatch */
+		uint32_t		next;
+		/** Number of posted operations not yet processed */
+		uint32_t		pending;
+		/** Server is being stopped, migrated connections are removed */
+		int			stopping;
+		/** Protect connection counts and pending operations */
+		struct pomp_mutex	mutex;
+		/** Signaled when all posted operations are processed */
+		struct pomp_cond	cond;
+	} workers;
+
 	/** Client/Server specific parameters */
 	union {
 		/** Server specific parameters */
@@ -254,221 +467,1398 @@ out:
 }
 
 /**
- * Accept a new connection in a server context.
- * The user will be notified and the connection fd will be monitored for io.
+ * Setup busy polling for inet socket fd.
  * @param ctx : context.
+ * @param fd : fd to configure.
  * @return 0 in case of success, negative errno value in case of error.
  */
-static int server_accept_conn(struct pomp_ctx *ctx)
+static int fd_socket_setup_busy_poll(struct pomp_ctx *ctx, int fd)
 {
 	int res = 0;
-	int fd = -1;
-	struct pomp_conn *conn = NULL;
+#ifdef SO_BUSY_POLL
+	int busypoll = (int)ctx->busypoll;
 
-	/* Accept connection */
-	fd = accept(ctx->u.server.fd, NULL, NULL);
-	if (fd < 0) {
+	if (busypoll == 0)
+		return 0;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busypoll,
+			sizeof(busypoll)) < 0) {
 		res = -errno;
-		POMP_LOG_FD_ERRNO("accept", ctx->u.server.fd);
-		goto error;
+		POMP_LOG_FD_ERRNO("setsockopt.SO_BUSY_POLL", fd);
 	}
+#endif /* SO_BUSY_POLL */
+	return res;
+}
 
-	/* If maximum number of connection is reached, close fd immediately */
-	if (ctx->u.server.conncount >= POMP_SERVER_MAX_CONN_COUNT) {
-		POMP_LOGI("Maximum number of connections reached");
-		close(fd);
-		return 0;
-	}
+/**
+ * Restart the reconnection schedule after a successful connection or bind.
+ * @param ctx : context.
+ */
+static void ctx_reconnect_reset(struct pomp_ctx *ctx)
+{
+	ctx->reconnect.attempts = 0;
+	ctx->reconnect.delay = ctx->reconnect.initial;
+}
 
-	/* Notify application */
-	if (ctx->sockcb != NULL)
-		(*ctx->sockcb)(ctx, fd, POMP_SOCKET_KIND_PEER, ctx->userdata);
+/**
+ * Schedule the next reconnection (or bind) attempt of a context. Delay grows
+ * geometrically up to the maximum, and is randomly shortened by up to the
+ * jitter so contexts disconnected at the same time do not retry in lockstep.
+ * @param ctx : context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int ctx_reconnect_schedule(struct pomp_ctx *ctx)
+{
+	uint32_t delay = 0, spread = 0;
+	uint64_t next = 0;
+
+	if (ctx->reconnect.attempts++ == 0 && ctx->reconnect.immediate)
+		return pomp_timer_set_us(ctx->timer, 1);
+
+	delay = ctx->reconnect.delay;
+	next = (uint64_t)delay * ctx->reconnect.multiplier / 100;
+	ctx->reconnect.delay = next > ctx->reconnect.max ?
+			ctx->reconnect.max : (uint32_t)next;
+
+	if (ctx->reconnect.jitter != 0) {
+		/* xorshift32, quality is not a concern here */
+		ctx->reconnect.seed ^= ctx->reconnect.seed << 13;
+		ctx->reconnect.seed ^= ctx->reconnect.seed >> 17;
+		ctx->reconnect.seed ^= ctx->reconnect.seed << 5;
+		spread = (uint32_t)((uint64_t)delay *
+				ctx->reconnect.jitter / 100);
+		delay -= ctx->reconnect.seed % (spread + 1);
+	}
 
-	/* Setup socket flags */
-	res = fd_setup_flags(fd);
-	if (res < 0)
-		goto error;
+	/* A zero delay would clear the timer */
+	return pomp_timer_set_us(ctx->timer, delay == 0 ?
+			1 : (uint64_t)delay * 1000);
+}
 
-	/* Enable keep alive for TCP/IP sockets */
-	if (POMP_IS_INET(ctx->addr->sa_family))
-		fd_socket_setup_keepalive(ctx, fd);
+/**
+ * Remove a connection from a list.
+ * @param head : head of the list.
+ * @param conn : connection to remove.
+ * @return 1 if the connection was found, 0 otherwise.
+ */
+static int conn_list_remove(struct pomp_conn **head, struct pomp_conn *conn)
+{
+	struct pomp_conn *prev = NULL;
 
-	/* Allocate connection structure, transfer ownership of fd */
-	conn = pomp_conn_new(ctx, ctx->loop, fd, 0, ctx->israw);
-	if (conn == NULL) {
-		res = -ENOMEM;
-		goto error;
+	if (*head == conn) {
+		/* This was the first in the list */
+		*head = pomp_conn_get_next(conn);
+		return 1;
 	}
-	fd = -1;
 
-	/* Add in list */
-	pomp_conn_set_next(conn, ctx->u.server.conns);
-	ctx->u.server.conns = conn;
-	ctx->u.server.conncount++;
+	prev = *head;
+	while (prev != NULL) {
+		if (pomp_conn_get_next(prev) == conn) {
+			pomp_conn_set_next(prev, pomp_conn_get_next(conn));
+			return 1;
+		}
+		prev = pomp_conn_get_next(prev);
+	}
 
-	/* Notify user */
-	pomp_ctx_notify_event(ctx, POMP_EVENT_CONNECTED, conn);
 	return 0;
+}
 
-	/* Cleanup in case of error */
-error:
-	if (conn != NULL) {
-		pomp_conn_close(conn);
-		pomp_conn_destroy(conn);
+/**
+ * Find the worker running a loop.
+ * @param ctx : context.
+ * @param loop : loop.
+ * @return worker or NULL if the loop is not a worker loop.
+ */
+static struct pomp_ctx_worker *server_find_worker_by_loop(
+		struct pomp_ctx *ctx, const struct pomp_loop *loop)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < ctx->workers.count; i++) {
+		if (ctx->workers.entries[i].loop == loop)
+			return &ctx->workers.entries[i];
 	}
-	if (fd >= 0)
-		close(fd);
-	return res;
+	return NULL;
 }
 
 /**
- * Function called when the server socket fd is ready for events.
- * @param fd : triggered fd.
- * @param revents : event that occurred.
- * @param userdata : context object.
+ * Find the worker owning a connection of a server.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @return worker or NULL if the connection uses the context loop.
  */
-static void server_cb(int fd, uint32_t revents, void *userdata)
+static struct pomp_ctx_worker *server_find_worker(struct pomp_ctx *ctx,
+		const struct pomp_conn *conn)
 {
-	struct pomp_ctx *ctx = userdata;
-
-	/* Handle incoming connection */
-	server_accept_conn(ctx);
+	return server_find_worker_by_loop(ctx, pomp_conn_get_loop(conn));
 }
 
 /**
- * Start a server context.
- * It will start listening for incoming connection.
- * @return 0 in case of success, negative errno value in case of error.
+ * Choose the worker that will own a new connection. Workers mutex shall be
+ * locked by caller.
+ * @param ctx : context.
+ * @return worker.
  */
-static int server_start(struct pomp_ctx *ctx)
+static struct pomp_ctx_worker *server_pick_worker(struct pomp_ctx *ctx)
 {
-	int res = 0;
-	int sockopt = 0;
+	uint32_t i = 0;
+	struct pomp_ctx_worker *worker = NULL;
+
+	switch (ctx->workers.policy) {
+	case POMP_WORKER_POLICY_LEAST_LOADED:
+		worker = &ctx->workers.entries[0];
+		for (i = 1; i < ctx->workers.count; i++) {
+			if (ctx->workers.entries[i].conncount
+					< worker->conncount) {
+				worker = &ctx->workers.entries[i];
+			}
+		}
+		break;
 
-	/* Create server socket */
-	ctx->u.server.fd = socket(ctx->addr->sa_family, SOCK_STREAM, 0);
-	if (ctx->u.server.fd < 0) {
-		res = -errno;
-		POMP_LOG_ERRNO("socket");
-		goto error;
+	case POMP_WORKER_POLICY_ROUND_ROBIN: /* NO BREAK */
+	default:
+		worker = &ctx->workers.entries[ctx->workers.next];
+		ctx->workers.next = (ctx->workers.next + 1) % ctx->workers.count;
+		break;
 	}
 
-	/* Notify application */
-	if (ctx->sockcb != NULL) {
-		(*ctx->sockcb)(ctx, ctx->u.server.fd,
-				POMP_SOCKET_KIND_SERVER, ctx->userdata);
-	}
+	return worker;
+}
 
-	/* Setup socket flags */
-	res = fd_setup_flags(ctx->u.server.fd);
-	if (res < 0)
-		goto error;
+/**
+ * Get the total number of connections of a server with workers. Workers
+ * mutex shall be locked by caller.
+ * @param ctx : context.
+ * @return number of connections.
+ */
+static uint32_t server_get_worker_conncount(struct pomp_ctx *ctx)
+{
+	uint32_t i = 0, count = 0;
+	for (i = 0; i < ctx->workers.count; i++)
+		count += ctx->workers.entries[i].conncount;
+	return count;
+}
 
-	/* Allow reuse of address */
-	sockopt = 1;
-	if (setsockopt(ctx->u.server.fd, SOL_SOCKET, SO_REUSEADDR,
-			&sockopt, sizeof(sockopt)) < 0) {
-		res = -errno;
-		POMP_LOG_FD_ERRNO("setsockopt.SO_REUSEADDR", ctx->u.server.fd);
-		goto error;
-	}
+/**
+ * Lock the admission control of a server, shared with the threads of its
+ * workers.
+ * @param ctx : context.
+ */
+static void server_admission_lock(struct pomp_ctx *ctx)
+{
+	if (ctx->workers.count > 0)
+		pomp_mutex_lock(&ctx->workers.mutex);
+}
 
-	/* For non abstract unix socket, unlink file before bind */
-	if (ctx->addr->sa_family == AF_UNIX
-			&& POMP_GET_UNIX_PATH(ctx->addr)[0] != '\0') {
-		unlink(POMP_GET_UNIX_PATH(ctx->addr));
-	}
+/**
+ * Unlock the admission control of a server.
+ * @param ctx : context.
+ */
+static void server_admission_unlock(struct pomp_ctx *ctx)
+{
+	if (ctx->workers.count > 0)
+		pomp_mutex_unlock(&ctx->workers.mutex);
+}
 
-	/* Bind to address  */
-	if (bind(ctx->u.server.fd, ctx->addr, ctx->addrlen) < 0) {
-		/* Handle case where address do not match an existent
-		 * interface to try again later */
-		if (errno != EADDRNOTAVAIL) {
-			res = -errno;
-			POMP_LOG_FD_ERRNO("bind", ctx->u.server.fd);
-			goto error;
-		}
-		/* Free resources, try again later */
-		close(ctx->u.server.fd);
-		ctx->u.server.fd = -1;
-		res = pomp_timer_set(ctx->timer, POMP_SERVER_RECONNECT_DELAY);
-		if (res < 0)
-			goto error;
-		return 0;
-	}
+/**
+ * Stop the suspension of accepts of a listening socket. It shall be called
+ * in the thread of the loop of the socket.
+ * @param ctx : context.
+ * @param pause : suspension of the socket.
+ * @param now : current time (in us).
+ * @return 1 if accepts were suspended, 0 otherwise.
+ */
+static int server_admission_unpause(struct pomp_ctx *ctx,
+		struct pomp_ctx_accept_pause *pause, uint64_t now)
+{
+	int paused = 0;
 
-	/* Get local address information */
-	ctx->u.server.local_addrlen = sizeof(ctx->u.server.local_addr);
-	if (getsockname(ctx->u.server.fd,
-			(struct sockaddr *)&ctx->u.server.local_addr,
-			&ctx->u.server.local_addrlen) < 0) {
-		POMP_LOG_FD_ERRNO("getsockname", ctx->u.server.fd);
-		ctx->u.server.local_addrlen = 0;
+	server_admission_lock(ctx);
+	paused = pause->paused;
+	if (paused) {
+		pause->paused = 0;
+		ctx->admission.stats.throttled_us += now - pause->since;
 	}
+	server_admission_unlock(ctx);
 
-	/* Start listening */
-	if (listen(ctx->u.server.fd, SOMAXCONN) < 0) {
-		res = -errno;
-		POMP_LOG_FD_ERRNO("listen", ctx->u.server.fd);
-		goto error;
-	}
+	if (paused && pause->timer != NULL)
+		(void)pomp_timer_clear(pause->timer);
+	return paused;
+}
 
-	/* Add to loop */
-	res = pomp_loop_add(ctx->loop, ctx->u.server.fd, POMP_FD_EVENT_IN,
-			&server_cb, ctx);
-	if (res < 0)
-		goto error;
+/**
+ * Stop the suspension of accepts of a listening socket and release its
+ * timer. It shall be called in the thread of the loop of the socket.
+ * @param ctx : context.
+ * @param pause : suspension of the socket.
+ * @param loop : loop of the socket.
+ */
+static void server_admission_stop(struct pomp_ctx *ctx,
+		struct pomp_ctx_accept_pause *pause, struct pomp_loop *loop)
+{
+	(void)server_admission_unpause(ctx, pause, pomp_loop_now(loop));
+	if (pause->timer != NULL) {
+		pomp_timer_destroy(pause->timer);
+		pause->timer = NULL;
+	}
+}
 
-	return 0;
+/**
+ * Release a list of queued messages.
+ * @param amsg : first message of the list.
+ */
+static void ctx_async_free(struct pomp_ctx_async_msg *amsg)
+{
+	struct pomp_ctx_async_msg *next = NULL;
 
-	/* Cleanup in case of error */
-error:
-	if (ctx->u.server.fd >= 0) {
-		pomp_loop_remove(ctx->loop, ctx->u.server.fd);
-		close(ctx->u.server.fd);
-		ctx->u.server.fd = -1;
-		memset(&ctx->u.server.local_addr, 0,
-				sizeof(ctx->u.server.local_addr));
-		ctx->u.server.local_addrlen = 0;
+	while (amsg != NULL) {
+		next = amsg->next;
+		pomp_buffer_unref(amsg->msg.buf);
+		free(amsg);
+		amsg = next;
 	}
-	return res;
 }
 
 /**
- * Stop server context.
- * It will disconnect (with notification) all connections and free all internal
- * resources.
+ * Release a reference on a batch of queued messages.
  * @param ctx : context.
- * @return 0 in case of success, negative errno value in case of error.
+ * @param batch : batch of messages.
  */
-static int server_stop(struct pomp_ctx *ctx)
+static void ctx_async_batch_unref(struct pomp_ctx *ctx,
+		struct pomp_ctx_async_batch *batch)
 {
-	/* Remove all connections */
-	while (ctx->u.server.conns != NULL)
-		pomp_ctx_remove_conn(ctx, ctx->u.server.conns);
+	uint32_t refcount = 0;
 
-	/* Stop server socket */
-	if (ctx->u.server.fd >= 0) {
-		pomp_loop_remove(ctx->loop, ctx->u.server.fd);
-		close(ctx->u.server.fd);
-		ctx->u.server.fd = -1;
-	}
+	pomp_mutex_lock(&ctx->workers.mutex);
+	refcount = --batch->refcount;
+	pomp_mutex_unlock(&ctx->workers.mutex);
 
-	/* For non abstract unix socket, unlink file also */
-	if (ctx->addr->sa_family == AF_UNIX
-			&& POMP_GET_UNIX_PATH(ctx->addr)[0] != '\0') {
-		unlink(POMP_GET_UNIX_PATH(ctx->addr));
+	if (refcount == 0) {
+		ctx_async_free(batch->list);
+		free(batch);
 	}
+}
 
-	/* Clear bound local address */
-	memset(&ctx->u.server.local_addr, 0, sizeof(ctx->u.server.local_addr));
-	ctx->u.server.local_addrlen = 0;
-
-	return 0;
+/**
+ * Release an operation not posted to a worker.
+ * @param op : operation.
+ */
+static void worker_op_free(struct pomp_ctx_worker_op *op)
+{
+	if (op->batch != NULL)
+		ctx_async_batch_unref(op->worker->ctx, op->batch);
+	if (op->fd >= 0)
+		close(op->fd);
+	if (op->msg != NULL)
+		pomp_msg_destroy(op->msg);
+	if (op->buf != NULL)
+		pomp_buffer_unref(op->buf);
+	pomp_sub_set_clear(&op->subs);
+	free(op);
 }
 
 /**
- * Complete the client connection with the server.
+ * Release an operation processed by a worker and wake up the thread waiting
+ * for all operations to complete.
+ * @param op : operation.
+ */
+static void worker_op_done(struct pomp_ctx_worker_op *op)
+{
+	struct pomp_ctx *ctx = op->worker->ctx;
+
+	worker_op_free(op);
+
+	pomp_mutex_lock(&ctx->workers.mutex);
+	if (--ctx->workers.pending == 0)
+		pomp_cond_broadcast(&ctx->workers.cond);
+	pomp_mutex_unlock(&ctx->workers.mutex);
+}
+
+/**
+ * Create an operation for a worker loop.
+ * @param worker : worker.
+ * @param fd : accepted fd to hand over or -1.
+ * @param conn : migrated connection or NULL.
+ * @param msg : message to broadcast or NULL, a reference is taken.
+ * @param buf : raw buffer to broadcast or NULL, a reference is taken.
+ * @return operation or NULL in case of error.
+ */
+static struct pomp_ctx_worker_op *worker_op_new(struct pomp_ctx_worker *worker,
+		int fd, struct pomp_conn *conn,
+		const struct pomp_msg *msg, struct pomp_buffer *buf)
+{
+	struct pomp_ctx_worker_op *op = NULL;
+
+	op = calloc(1, sizeof(*op));
+	if (op == NULL)
+		return NULL;
+	op->worker = worker;
+	op->fd = fd;
+	op->conn = conn;
+
+	if (msg != NULL) {
+		op->msg = pomp_msg_new_ref(msg);
+		if (op->msg == NULL) {
+			free(op);
+			return NULL;
+		}
+	}
+	if (buf != NULL) {
+		op->buf = buf;
+		pomp_buffer_ref(buf);
+	}
+	return op;
+}
+
+/**
+ * Function called in a worker thread to run a posted operation. The thread
+ * is recorded so a blocking call made from it can be detected.
+ * @param userdata : operation.
+ */
+static void worker_op_run_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_ctx_worker *worker = op->worker;
+
+#ifdef POMP_HAVE_COND
+	pomp_mutex_lock(&worker->ctx->workers.mutex);
+	worker->thread = pthread_self();
+	worker->hasthread = 1;
+	pomp_mutex_unlock(&worker->ctx->workers.mutex);
+#endif /* POMP_HAVE_COND */
+
+	(*op->cb)(op);
+}
+
+/**
+ * Post an operation to its worker loop. In case of error, the operation is
+ * still accounted as pending and shall be released with worker_op_done.
+ * @param op : operation.
+ * @param cb : function to call in the worker thread.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int worker_op_post(struct pomp_ctx_worker_op *op, pomp_idle_cb_t cb)
+{
+	struct pomp_ctx *ctx = op->worker->ctx;
+
+	pomp_mutex_lock(&ctx->workers.mutex);
+	ctx->workers.pending++;
+	pomp_mutex_unlock(&ctx->workers.mutex);
+
+	op->cb = cb;
+	return pomp_loop_post(op->worker->loop, &worker_op_run_cb, op);
+}
+
+/**
+ * Determine if the caller is running in the thread of a worker loop.
+ * @param ctx : context.
+ * @return 1 if the caller is a worker thread, 0 otherwise.
+ */
+static int server_is_worker_thread(struct pomp_ctx *ctx)
+{
+	int res = 0;
+#ifdef POMP_HAVE_COND
+	uint32_t i = 0;
+	pthread_t self = pthread_self();
+
+	pomp_mutex_lock(&ctx->workers.mutex);
+	for (i = 0; i < ctx->workers.count && !res; i++) {
+		res = ctx->workers.entries[i].hasthread &&
+			pthread_equal(ctx->workers.entries[i].thread, self);
+	}
+	pomp_mutex_unlock(&ctx->workers.mutex);
+#endif /* POMP_HAVE_COND */
+	return res;
+}
+
+/**
+ * Post an operation to a worker loop.
+ * @param worker : worker.
+ * @param cb : function to call in the worker thread.
+ * @param fd : accepted fd to hand over (ownership transferred in case of
+ * success) or -1.
+ * @param conn : migrated connection or NULL.
+ * @param msg : message to broadcast or NULL, a reference is taken.
+ * @param buf : raw buffer to broadcast or NULL, a reference is taken.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int worker_post(struct pomp_ctx_worker *worker, pomp_idle_cb_t cb,
+		int fd, struct pomp_conn *conn,
+		const struct pomp_msg *msg, struct pomp_buffer *buf)
+{
+	int res = 0;
+	struct pomp_ctx_worker_op *op = NULL;
+
+	op = worker_op_new(worker, fd, conn, msg, buf);
+	if (op == NULL)
+		return -ENOMEM;
+
+	res = worker_op_post(op, cb);
+	if (res < 0) {
+		/* Leave fd to caller */
+		op->fd = -1;
+		worker_op_done(op);
+	}
+	return res;
+}
+
+/**
+ * Create a connection owned by a worker from an accepted fd. It shall be
+ * called in the worker thread and the connection count of the worker shall
+ * already account for it.
+ * @param worker : worker.
+ * @param fd : accepted fd, ownership is transferred in case of success.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int worker_add_conn(struct pomp_ctx_worker *worker, int fd)
+{
+	struct pomp_ctx *ctx = worker->ctx;
+	struct pomp_conn *conn = NULL;
+
+	/* Allocate connection structure, transfer ownership of fd */
+	conn = pomp_conn_new(ctx, worker->loop, fd, 0, ctx->israw);
+	if (conn == NULL)
+		return -ENOMEM;
+
+	/* Add in list of worker */
+	pomp_conn_set_next(conn, worker->conns);
+	worker->conns = conn;
+
+	/* Notify user */
+	pomp_ctx_notify_event(ctx, POMP_EVENT_CONNECTED, conn);
+	return 0;
+}
+
+/**
+ * Function called in a worker thread to take ownership of an accepted fd.
+ * @param userdata : worker operation.
+ */
+static void worker_accept_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_ctx_worker *worker = op->worker;
+	struct pomp_ctx *ctx = worker->ctx;
+
+	if (worker_add_conn(worker, op->fd) < 0) {
+		pomp_mutex_lock(&ctx->workers.mutex);
+		worker->conncount--;
+		pomp_mutex_unlock(&ctx->workers.mutex);
+	} else {
+		op->fd = -1;
+	}
+	worker_op_done(op);
+}
+
+/**
+ * Send a message to a subscribed connection of a server.
+ * @param conn : connection.
+ * @param userdata : message to send.
+ */
+static void server_send_msg_cb(struct pomp_conn *conn, void *userdata)
+{
+	const struct pomp_msg *msg = userdata;
+	(void)pomp_conn_send_msg(conn, msg);
+}
+
+/**
+ * Function called in a worker thread to broadcast a message or a raw buffer
+ * to its connections.
+ * @param userdata : worker operation.
+ */
+static void worker_send_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_ctx_worker *worker = op->worker;
+	struct pomp_conn *conn = NULL;
+
+	if (op->msg != NULL && worker->ctx->subtable != NULL) {
+		/* Only send to subscribed connections */
+		if (worker->subtable != NULL) {
+			(void)pomp_sub_table_foreach(worker->subtable,
+					op->msg->msgid, &server_send_msg_cb,
+					op->msg);
+		}
+	} else {
+		/* Broadcast to all connections, ignore errors */
+		for (conn = worker->conns; conn != NULL;
+				conn = pomp_conn_get_next(conn)) {
+			if (op->msg != NULL)
+				(void)pomp_conn_send_msg(conn, op->msg);
+			else
+				(void)pomp_conn_send_raw_buf(conn, op->buf);
+		}
+	}
+
+	worker_op_done(op);
+}
+
+/**
+ * Function called in a worker thread to disconnect all its connections when
+ * the server is stopped.
+ * @param userdata : worker operation.
+ */
+static void worker_stop_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_ctx_worker *worker = op->worker;
+
+	/* Stop own listening socket */
+	server_admission_stop(worker->ctx, &worker->pause, worker->loop);
+	if (worker->fd >= 0) {
+		pomp_loop_remove(worker->loop, worker->fd);
+		close(worker->fd);
+		worker->fd = -1;
+	}
+
+	/* Remove all connections */
+	while (worker->conns != NULL)
+		pomp_ctx_remove_conn(worker->ctx, worker->conns);
+
+	/* Free resources bound to the worker loop */
+	if (worker->subtable != NULL) {
+		pomp_sub_table_destroy(worker->subtable);
+		worker->subtable = NULL;
+	}
+	if (worker->rpc != NULL) {
+		pomp_rpc_destroy(worker->rpc);
+		worker->rpc = NULL;
+	}
+
+	worker_op_done(op);
+}
+
+/**
+ * Restore the subscriptions of a connection migrated to a worker.
+ * @param worker : worker owning the connection.
+ * @param conn : connection.
+ * @param subs : subscriptions of the connection.
+ */
+static void worker_restore_subs(struct pomp_ctx_worker *worker,
+		struct pomp_conn *conn, const struct pomp_sub_set *subs)
+{
+	uint32_t i = 0;
+
+	if (subs->count == 0)
+		return;
+
+	if (worker->subtable == NULL)
+		worker->subtable = pomp_sub_table_new();
+	if (worker->subtable == NULL)
+		return;
+
+	for (i = 0; i < subs->count; i++) {
+		(void)pomp_sub_table_update(worker->subtable, conn,
+				subs->ranges[i].first, subs->ranges[i].last, 1);
+	}
+}
+
+/**
+ * Function called in a worker thread to take ownership of a connection
+ * migrated from another worker.
+ * @param userdata : worker operation.
+ */
+static void worker_migrate_cb(void *userdata)
+{
+	int res = 0, stopping = 0;
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_ctx_worker *worker = op->worker;
+	struct pomp_ctx *ctx = worker->ctx;
+	struct pomp_conn *conn = op->conn;
+
+	/* Add in list of worker, even in case of error so it can be removed */
+	res = pomp_conn_attach(conn, worker->loop);
+	pomp_conn_set_next(conn, worker->conns);
+	worker->conns = conn;
+
+	pomp_mutex_lock(&ctx->workers.mutex);
+	stopping = ctx->workers.stopping;
+	pomp_mutex_unlock(&ctx->workers.mutex);
+
+	/* The worker may already have removed its connections */
+	if (res < 0 || stopping)
+		pomp_ctx_remove_conn(ctx, conn);
+	else
+		worker_restore_subs(worker, conn, &op->subs);
+
+	worker_op_done(op);
+}
+
+/**
+ * Function called in a worker thread to send heartbeat pings on its
+ * connections and disconnect the ones whose peer is stalled.
+ * @param userdata : worker operation.
+ */
+static void worker_heartbeat_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_conn *conn = NULL, *next = NULL;
+	uint64_t now = 0;
+
+	if (time_get_monotonic_us(&now) == 0) {
+		for (conn = op->worker->conns; conn != NULL; conn = next) {
+			next = pomp_conn_get_next(conn);
+			(void)pomp_conn_heartbeat(conn, now, op->timeout);
+		}
+	}
+	worker_op_done(op);
+}
+
+/**
+ * Function called periodically to send heartbeat pings on the connections
+ * of a context and disconnect the ones whose peer is stalled.
+ * @param timer : heartbeat timer.
+ * @param userdata : context.
+ */
+static void ctx_heartbeat_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	struct pomp_conn *conn = NULL, *next = NULL;
+	struct pomp_ctx_worker_op *op = NULL;
+	uint64_t now = 0, timeout = 0;
+	uint32_t i = 0;
+
+	if (ctx->addr == NULL || time_get_monotonic_us(&now) < 0)
+		return;
+	timeout = (uint64_t)ctx->heartbeat.timeout * 1000;
+
+	switch (ctx->type) {
+	case POMP_CTX_TYPE_SERVER:
+		for (conn = ctx->u.server.conns; conn != NULL; conn = next) {
+			next = pomp_conn_get_next(conn);
+			(void)pomp_conn_heartbeat(conn, now, timeout);
+		}
+
+		/* Connections of workers are checked in their own thread */
+		for (i = 0; i < ctx->workers.count; i++) {
+			op = worker_op_new(&ctx->workers.entries[i],
+					-1, NULL, NULL, NULL);
+			if (op == NULL)
+				continue;
+			op->timeout = timeout;
+			if (worker_op_post(op, &worker_heartbeat_cb) < 0)
+				worker_op_done(op);
+		}
+		break;
+
+	case POMP_CTX_TYPE_CLIENT:
+		/* Clients of a pool have their own heartbeat */
+		if (ctx->u.client.conn != NULL)
+			(void)pomp_conn_heartbeat(ctx->u.client.conn,
+					now, timeout);
+		break;
+
+	case POMP_CTX_TYPE_DGRAM:
+		break;
+	}
+}
+
+/**
+ * Start or stop the heartbeat timer according to the context state.
+ * @param ctx : context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int ctx_heartbeat_update(struct pomp_ctx *ctx)
+{
+	if (ctx->heartbeat.timer == NULL)
+		return 0;
+	if (ctx->addr == NULL || ctx->heartbeat.interval == 0)
+		return pomp_timer_clear(ctx->heartbeat.timer);
+	return pomp_timer_set_periodic(ctx->heartbeat.timer,
+			ctx->heartbeat.interval, ctx->heartbeat.interval);
+}
+
+/**
+ * Hand over an accepted connection fd to a worker loop.
+ * @param ctx : context.
+ * @param fd : accepted fd, ownership is transferred in case of success.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int server_dispatch_conn(struct pomp_ctx *ctx, int fd)
+{
+	int res = 0;
+	struct pomp_ctx_worker *worker = NULL;
+
+	pomp_mutex_lock(&ctx->workers.mutex);
+	worker = server_pick_worker(ctx);
+	worker->conncount++;
+	pomp_mutex_unlock(&ctx->workers.mutex);
+
+	res = worker_post(worker, &worker_accept_cb, fd, NULL, NULL, NULL);
+	if (res < 0) {
+		pomp_mutex_lock(&ctx->workers.mutex);
+		worker->conncount--;
+		pomp_mutex_unlock(&ctx->workers.mutex);
+	}
+	return res;
+}
+
+/**
+ * Accept a pending connection on a listening socket. The returned fd has
+ * FD_CLOEXEC and O_NONBLOCK set.
+ * @param sfd : listening socket.
+ * @return accepted fd in case of success, negative errno value in case of
+ * error, -EAGAIN if no more connections are pending.
+ */
+static int server_accept_fd(int sfd)
+{
+	int res = 0;
+	int fd = -1;
+
+	/* Accept connection ignoring interrupts */
+	do {
+#ifdef POMP_HAVE_ACCEPT4
+		fd = accept4(sfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else /* !POMP_HAVE_ACCEPT4 */
+		fd = accept(sfd, NULL, NULL);
+#endif /* !POMP_HAVE_ACCEPT4 */
+	} while (fd < 0 && errno == EINTR);
+
+	if (fd < 0) {
+		res = -errno;
+		if (res == -EWOULDBLOCK)
+			return -EAGAIN;
+		POMP_LOG_FD_ERRNO("accept", sfd);
+		return res;
+	}
+
+#ifndef POMP_HAVE_ACCEPT4
+	/* Setup socket flags */
+	res = fd_setup_flags(fd);
+	if (res < 0) {
+		close(fd);
+		return res;
+	}
+#endif /* !POMP_HAVE_ACCEPT4 */
+
+	return fd;
+}
+
+/**
+ * Function called when the tokens of accepts of a server are refilled.
+ * @param timer : timer.
+ * @param userdata : context.
+ */
+static void server_admission_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+
+	(void)server_admission_unpause(ctx, &ctx->admission.pause,
+			pomp_loop_now(ctx->loop));
+	if (ctx->addr != NULL && ctx->u.server.fd >= 0) {
+		(void)pomp_loop_update2(ctx->loop, ctx->u.server.fd,
+				POMP_FD_EVENT_IN, 0);
+	}
+}
+
+/**
+ * Function called in a worker thread when the tokens of accepts of a server
+ * are refilled.
+ * @param timer : timer.
+ * @param userdata : worker.
+ */
+static void worker_admission_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_ctx_worker *worker = userdata;
+
+	(void)server_admission_unpause(worker->ctx, &worker->pause,
+			pomp_loop_now(worker->loop));
+	if (worker->fd >= 0) {
+		(void)pomp_loop_update2(worker->loop, worker->fd,
+				POMP_FD_EVENT_IN, 0);
+	}
+}
+
+/**
+ * Determine if a server can accept a connection now according to its accept
+ * rate. Otherwise accepts of the listening socket are suspended until tokens
+ * are refilled, pending connections stay in the listening queue of the
+ * system. The rate is shared by the socket of the context and the own
+ * sockets of workers.
+ * @param ctx : context.
+ * @param sfd : listening socket.
+ * @param worker : worker owning the listening socket, NULL for the socket of
+ * the context.
+ * @return 1 if a connection can be accepted, 0 otherwise.
+ */
+static int server_admit(struct pomp_ctx *ctx, int sfd,
+		struct pomp_ctx_worker *worker)
+{
+	struct pomp_loop *loop = worker != NULL ? worker->loop : ctx->loop;
+	struct pomp_ctx_accept_pause *pause = worker != NULL ?
+			&worker->pause : &ctx->admission.pause;
+	uint64_t now = 0, wait = 0;
+
+	now = pomp_loop_now(loop);
+	server_admission_lock(ctx);
+	if (ctx->admission.accepts.rate != 0) {
+		pomp_token_bucket_refill(&ctx->admission.accepts, now);
+		wait = pomp_token_bucket_wait(&ctx->admission.accepts);
+	}
+	server_admission_unlock(ctx);
+	if (wait == 0)
+		return 1;
+
+	if (pause->timer == NULL) {
+		pause->timer = pomp_timer_new(loop, worker != NULL ?
+				&worker_admission_cb : &server_admission_cb,
+				worker != NULL ? (void *)worker : (void *)ctx);
+		if (pause->timer == NULL)
+			return 1;
+	}
+	if (pomp_timer_set_us(pause->timer, wait) < 0)
+		return 1;
+
+	server_admission_lock(ctx);
+	pause->paused = 1;
+	pause->since = now;
+	ctx->admission.stats.throttles++;
+	server_admission_unlock(ctx);
+	(void)pomp_loop_update2(loop, sfd, 0, POMP_FD_EVENT_IN);
+	return 0;
+}
+
+/**
+ * Take a token of the accept rate of a server for an accepted connection.
+ * Sockets of workers check and take tokens separately, so concurrent
+ * accepts can put the bucket in debt, delaying next accepts accordingly.
+ * @param ctx : context.
+ */
+static void server_admission_take(struct pomp_ctx *ctx)
+{
+	server_admission_lock(ctx);
+	pomp_token_bucket_take(&ctx->admission.accepts, 1);
+	server_admission_unlock(ctx);
+}
+
+/**
+ * Add an accepted connection in a server context.
+ * The user will be notified and the connection fd will be monitored for io.
+ * @param ctx : context.
+ * @param fd : accepted fd (ownership transferred).
+ * @param worker : worker owning the listening socket, NULL for the socket of
+ * the context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int server_add_conn(struct pomp_ctx *ctx, int fd,
+		struct pomp_ctx_worker *worker)
+{
+	int res = 0;
+	uint32_t conncount = 0;
+	struct pomp_conn *conn = NULL;
+
+	/* If maximum number of connection is reached, close fd immediately.
+	 * A worker accepting on its own socket reserves its slot at once so
+	 * concurrent accepts of other workers see it */
+	if (ctx->workers.count > 0) {
+		pomp_mutex_lock(&ctx->workers.mutex);
+		conncount = server_get_worker_conncount(ctx);
+		if (conncount >= ctx->admission.maxconns)
+			ctx->admission.stats.rejected++;
+		else if (worker != NULL)
+			worker->conncount++;
+		pomp_mutex_unlock(&ctx->workers.mutex);
+	} else {
+		conncount = ctx->u.server.conncount;
+		if (conncount >= ctx->admission.maxconns)
+			ctx->admission.stats.rejected++;
+	}
+	if (conncount >= ctx->admission.maxconns) {
+		POMP_LOGI("Maximum number of connections reached");
+		close(fd);
+		return 0;
+	}
+
+	/* Notify application */
+	if (ctx->sockcb != NULL)
+		(*ctx->sockcb)(ctx, fd, POMP_SOCKET_KIND_PEER, ctx->userdata);
+
+	/* Enable keep alive and busy polling for TCP/IP sockets */
+	if (POMP_IS_INET(ctx->addr->sa_family)) {
+		fd_socket_setup_keepalive(ctx, fd);
+		fd_socket_setup_busy_poll(ctx, fd);
+	}
+
+	/* Accepted by a worker on its own socket, keep it in this thread */
+	if (worker != NULL) {
+		res = worker_add_conn(worker, fd);
+		if (res < 0) {
+			pomp_mutex_lock(&ctx->workers.mutex);
+			worker->conncount--;
+			pomp_mutex_unlock(&ctx->workers.mutex);
+			goto error;
+		}
+		return 0;
+	}
+
+	/* Let a worker loop own the connection, it will notify user */
+	if (ctx->workers.count > 0) {
+		res = server_dispatch_conn(ctx, fd);
+		if (res < 0)
+			goto error;
+		return 0;
+	}
+
+	/* Allocate connection structure, transfer ownership of fd */
+	conn = pomp_conn_new(ctx, ctx->loop, fd, 0, ctx->israw);
+	if (conn == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+	fd = -1;
+
+	/* Add in list */
+	pomp_conn_set_next(conn, ctx->u.server.conns);
+	ctx->u.server.conns = conn;
+	ctx->u.server.conncount++;
+
+	/* Notify user */
+	pomp_ctx_notify_event(ctx, POMP_EVENT_CONNECTED, conn);
+	return 0;
+
+	/* Cleanup in case of error */
+error:
+	if (fd >= 0)
+		close(fd);
+	return res;
+}
+
+/**
+ * Accept pending connections in a server context, until there is no more
+ * pending connection or the budget of an event is reached. Remaining
+ * connections will trigger a new event of the listening socket.
+ * @param ctx : context.
+ * @param sfd : listening socket.
+ * @param worker : worker owning the listening socket, NULL for the socket of
+ * the context.
+ */
+static void server_accept_conns(struct pomp_ctx *ctx, int sfd,
+		struct pomp_ctx_worker *worker)
+{
+	int fd = -1;
+	uint32_t i = 0;
+
+	for (i = 0; i < POMP_SERVER_ACCEPT_BUDGET; i++) {
+		/* Accept rate shared by all listening sockets */
+		if (!server_admit(ctx, sfd, worker))
+			break;
+
+		/* Stop on error, the event will be triggered again */
+		fd = server_accept_fd(sfd);
+		if (fd < 0)
+			break;
+		server_admission_take(ctx);
+		(void)server_add_conn(ctx, fd, worker);
+
+		/* The socket may have been closed by the user callback */
+		if (worker != NULL ? worker->fd != sfd
+				: ctx->u.server.fd != sfd) {
+			break;
+		}
+	}
+}
+
+/**
+ * Function called when the server socket fd is ready for events.
+ * @param fd : triggered fd.
+ * @param revents : event that occurred.
+ * @param userdata : context object.
+ */
+static void server_cb(int fd, uint32_t revents, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+
+	/* Handle incoming connections */
+	server_accept_conns(ctx, fd, NULL);
+}
+
+/**
+ * Function called when the listening socket of a worker is ready for events.
+ * @param fd : triggered fd.
+ * @param revents : event that occurred.
+ * @param userdata : worker.
+ */
+static void worker_server_cb(int fd, uint32_t revents, void *userdata)
+{
+	struct pomp_ctx_worker *worker = userdata;
+
+	/* Handle incoming connections */
+	server_accept_conns(worker->ctx, fd, worker);
+}
+
+/**
+ * Function called in a worker thread to monitor its own listening socket.
+ * @param userdata : worker operation.
+ */
+static void worker_listen_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+	struct pomp_ctx_worker *worker = op->worker;
+
+	if (pomp_loop_add(worker->loop, op->fd, POMP_FD_EVENT_IN,
+			&worker_server_cb, worker) == 0) {
+		worker->fd = op->fd;
+		op->fd = -1;
+	}
+	worker_op_done(op);
+}
+
+/**
+ * Attach to a SO_REUSEPORT group a classic BPF program choosing the socket
+ * with the index of the cpu that received the connection (modulo the number
+ * of sockets in the group).
+ * @param fd : first socket of the group.
+ * @param count : number of sockets in the group.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int fd_socket_attach_cpu_steering(int fd, uint32_t count)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(HAVE_LINUX_FILTER_H)
+	struct sock_filter code[] = {
+		/* A = cpu id */
+		{BPF_LD | BPF_W | BPF_ABS, 0, 0,
+				(uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+		/* A = A % count */
+		{BPF_ALU | BPF_MOD | BPF_K, 0, 0, count},
+		/* Return A as socket index */
+		{BPF_RET | BPF_A, 0, 0, 0},
+	};
+	struct sock_fprog prog;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+			&prog, sizeof(prog)) < 0) {
+		POMP_LOG_FD_ERRNO("setsockopt.SO_ATTACH_REUSEPORT_CBPF", fd);
+		return -errno;
+	}
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/**
+ * Determine if the workers of a server have their own listening socket.
+ * @param ctx : context.
+ * @return 1 if the workers listen with SO_REUSEPORT, 0 otherwise.
+ *
+ * @remarks only TCP/IP sockets can be shared, unix sockets fall back to the
+ * dispatch of connections accepted by the context.
+ */
+static int server_has_shards(const struct pomp_ctx *ctx)
+{
+	return ctx->workers.count > 0
+			&& (ctx->workers.policy == POMP_WORKER_POLICY_REUSEPORT
+			|| ctx->workers.policy
+				== POMP_WORKER_POLICY_REUSEPORT_CPU)
+			&& POMP_IS_INET(ctx->addr->sa_family);
+}
+
+/**
+ * Create a listening socket for a server.
+ * @param ctx : context.
+ * @param addr : address to bind.
+ * @param addrlen : address size.
+ * @param reuseport : 1 to allow other sockets to listen on the same address.
+ * @return socket fd in case of success, negative errno value in case of
+ * error. -EADDRNOTAVAIL is returned if the address does not match an existent
+ * interface yet.
+ */
+static int server_open_socket(struct pomp_ctx *ctx,
+		const struct sockaddr *addr, uint32_t addrlen, int reuseport)
+{
+	int res = 0;
+	int fd = -1;
+	int sockopt = 0;
+
+	/* Create server socket */
+	fd = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (fd < 0) {
+		res = -errno;
+		POMP_LOG_ERRNO("socket");
+		goto error;
+	}
+
+	/* Notify application */
+	if (ctx->sockcb != NULL)
+		(*ctx->sockcb)(ctx, fd, POMP_SOCKET_KIND_SERVER, ctx->userdata);
+
+	/* Setup socket flags */
+	res = fd_setup_flags(fd);
+	if (res < 0)
+		goto error;
+
+	/* Allow reuse of address */
+	sockopt = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+			&sockopt, sizeof(sockopt)) < 0) {
+		res = -errno;
+		POMP_LOG_FD_ERRNO("setsockopt.SO_REUSEADDR", fd);
+		goto error;
+	}
+
+#ifdef SO_REUSEPORT
+	/* Share address with the sockets of other workers */
+	if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+			&sockopt, sizeof(sockopt)) < 0) {
+		res = -errno;
+		POMP_LOG_FD_ERRNO("setsockopt.SO_REUSEPORT", fd);
+		goto error;
+	}
+#endif /* SO_REUSEPORT */
+
+	/* For non abstract unix socket, unlink file before bind */
+	if (addr->sa_family == AF_UNIX
+			&& POMP_GET_UNIX_PATH(addr)[0] != '\0') {
+		unlink(POMP_GET_UNIX_PATH(addr));
+	}
+
+	/* Bind to address  */
+	if (bind(fd, addr, addrlen) < 0) {
+		/* Handle case where address do not match an existent
+		 * interface to try again later */
+		res = -errno;
+		if (res != -EADDRNOTAVAIL)
+			POMP_LOG_FD_ERRNO("bind", fd);
+		goto error;
+	}
+
+	/* Start listening */
+	if (listen(fd, SOMAXCONN) < 0) {
+		res = -errno;
+		POMP_LOG_FD_ERRNO("listen", fd);
+		goto error;
+	}
+
+	return fd;
+
+	/* Cleanup in case of error */
+error:
+	if (fd >= 0)
+		close(fd);
+	return res;
+}
+
+/**
+ * Get the local address of the listening socket of a server.
+ * @param ctx : context.
+ * @param fd : listening socket.
+ */
+static void server_get_local_addr(struct pomp_ctx *ctx, int fd)
+{
+	ctx->u.server.local_addrlen = sizeof(ctx->u.server.local_addr);
+	if (getsockname(fd, (struct sockaddr *)&ctx->u.server.local_addr,
+			&ctx->u.server.local_addrlen) < 0) {
+		POMP_LOG_FD_ERRNO("getsockname", fd);
+		ctx->u.server.local_addrlen = 0;
+	}
+}
+
+/**
+ * Start a server whose workers each listen on their own socket.
+ * The first socket is bound to the requested address, the others to its
+ * actual local address so an ephemeral port is shared as well.
+ * @param ctx : context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int server_start_shards(struct pomp_ctx *ctx)
+{
+	int res = 0;
+	uint32_t i = 0;
+	int *fds = NULL;
+
+	fds = malloc(ctx->workers.count * sizeof(int));
+	if (fds == NULL)
+		return -ENOMEM;
+	for (i = 0; i < ctx->workers.count; i++)
+		fds[i] = -1;
+
+	/* Create all sockets of the group */
+	for (i = 0; i < ctx->workers.count; i++) {
+		if (i == 0) {
+			res = server_open_socket(ctx, ctx->addr,
+					ctx->addrlen, 1);
+		} else {
+			res = server_open_socket(ctx,
+				(const struct sockaddr *)&ctx->u.server.local_addr,
+				ctx->u.server.local_addrlen, 1);
+		}
+		if (res < 0)
+			goto error;
+		fds[i] = res;
+		if (i == 0)
+			server_get_local_addr(ctx, fds[0]);
+	}
+
+	/* Steer connections to the worker of the receiving cpu */
+	if (ctx->workers.policy == POMP_WORKER_POLICY_REUSEPORT_CPU) {
+		res = fd_socket_attach_cpu_steering(fds[0],
+				ctx->workers.count);
+		if (res < 0)
+			goto error;
+	}
+
+	/* Each worker monitors its socket in its own thread */
+	for (i = 0; i < ctx->workers.count; i++) {
+		res = worker_post(&ctx->workers.entries[i], &worker_listen_cb,
+				fds[i], NULL, NULL, NULL);
+		if (res < 0)
+			goto error;
+		fds[i] = -1;
+	}
+
+	free(fds);
+	ctx_reconnect_reset(ctx);
+	return 0;
+
+	/* Cleanup in case of error */
+error:
+	for (i = 0; i < ctx->workers.count; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+	free(fds);
+
+	/* Try again later if address is not available yet */
+	if (res == -EADDRNOTAVAIL) {
+		memset(&ctx->u.server.local_addr, 0,
+				sizeof(ctx->u.server.local_addr));
+		ctx->u.server.local_addrlen = 0;
+		return ctx_reconnect_schedule(ctx);
+	}
+	return res;
+}
+
+/**
+ * Start a server context.
+ * It will start listening for incoming connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int server_start(struct pomp_ctx *ctx)
+{
+	int res = 0;
+
+	/* Workers with their own listening socket */
+	if (server_has_shards(ctx))
+		return server_start_shards(ctx);
+
+	/* Create server socket */
+	res = server_open_socket(ctx, ctx->addr, ctx->addrlen, 0);
+	if (res == -EADDRNOTAVAIL) {
+		/* Try again later */
+		res = ctx_reconnect_schedule(ctx);
+		if (res < 0)
+			goto error;
+		return 0;
+	} else if (res < 0) {
+		goto error;
+	}
+	ctx->u.server.fd = res;
+
+	/* Get local address information */
+	server_get_local_addr(ctx, ctx->u.server.fd);
+
+	/* Add to loop */
+	res = pomp_loop_add(ctx->loop, ctx->u.server.fd, POMP_FD_EVENT_IN,
+			&server_cb, ctx);
+	if (res < 0)
+		goto error;
+
+	ctx_reconnect_reset(ctx);
+	return 0;
+
+	/* Cleanup in case of error */
+error:
+	if (ctx->u.server.fd >= 0) {
+		close(ctx->u.server.fd);
+		ctx->u.server.fd = -1;
+		memset(&ctx->u.server.local_addr, 0,
+				sizeof(ctx->u.server.local_addr));
+		ctx->u.server.local_addrlen = 0;
+	}
+	return res;
+}
+
+/**
+ * Stop server context.
+ * It will disconnect (with notification) all connections and free all internal
+ * resources.
+ * @param ctx : context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int server_stop(struct pomp_ctx *ctx)
+{
+	uint32_t i = 0;
+
+	/* Waiting for the workers from one of them would deadlock */
+	if (ctx->workers.count > 0 && server_is_worker_thread(ctx)) {
+		POMP_LOGE("Unable to stop server from a worker thread");
+		return -EBUSY;
+	}
+
+	/* Remove all connections */
+	while (ctx->u.server.conns != NULL)
+		pomp_ctx_remove_conn(ctx, ctx->u.server.conns);
+
+	/* Stop listening first so no more connections are dispatched */
+	server_admission_stop(ctx, &ctx->admission.pause, ctx->loop);
+	if (ctx->u.server.fd >= 0) {
+		pomp_loop_remove(ctx->loop, ctx->u.server.fd);
+		close(ctx->u.server.fd);
+		ctx->u.server.fd = -1;
+	}
+
+	/* Ask workers to remove their connections and wait for them */
+	if (ctx->workers.count > 0) {
+		pomp_mutex_lock(&ctx->workers.mutex);
+		ctx->workers.stopping = 1;
+		pomp_mutex_unlock(&ctx->workers.mutex);
+
+		for (i = 0; i < ctx->workers.count; i++) {
+			if (worker_post(&ctx->workers.entries[i],
+					&worker_stop_cb, -1, NULL, NULL, NULL) < 0) {
+				POMP_LOGE("Unable to stop worker %u", i);
+			}
+		}
+
+		pomp_mutex_lock(&ctx->workers.mutex);
+		while (ctx->workers.pending > 0)
+			pomp_cond_wait(&ctx->workers.cond, &ctx->workers.mutex);
+		ctx->workers.stopping = 0;
+		pomp_mutex_unlock(&ctx->workers.mutex);
+	}
+
+	/* For non abstract unix socket, unlink file also */
+	if (ctx->addr->sa_family == AF_UNIX
+			&& POMP_GET_UNIX_PATH(ctx->addr)[0] != '\0') {
+		unlink(POMP_GET_UNIX_PATH(ctx->addr));
+	}
+
+	/* Clear bound local address */
+	memset(&ctx->u.server.local_addr, 0, sizeof(ctx->u.server.local_addr));
+	ctx->u.server.local_addrlen = 0;
+
+	return 0;
+}
+
+/**
+ * Send all message ids subscribed by a client to the server.
+ * @param ctx : context.
+ */
+static void client_send_subs(struct pomp_ctx *ctx)
+{
+	uint32_t i = 0;
+	const struct pomp_sub_range *range = NULL;
+
+	for (i = 0; i < ctx->subs.count; i++) {
+		range = &ctx->subs.ranges[i];
+		(void)pomp_conn_send(ctx->u.client.conn, POMP_MSGID_SUBSCRIBE,
+				"%u%u", range->first, range->last);
+	}
+}
+
+/**
+ * Complete the client connection with the server.
  * If connection is successful, user will be notified and the connection fd will
  * be monitored for io. Otherwise reconnection will be scheduled.
  * @param ctx : context.
@@ -501,9 +1891,11 @@ static int client_complete_conn(struct pomp_ctx *ctx)
 		goto reconnect;
 	}
 
-	/* Enable keep alive for TCP/IP sockets */
-	if (POMP_IS_INET(ctx->addr->sa_family))
+	/* Enable keep alive and busy polling for TCP/IP sockets */
+	if (POMP_IS_INET(ctx->addr->sa_family)) {
 		fd_socket_setup_keepalive(ctx, ctx->u.client.fd);
+		fd_socket_setup_busy_poll(ctx, ctx->u.client.fd);
+	}
 
 	/* Allocate connection structure */
 	conn = pomp_conn_new(ctx, ctx->loop, ctx->u.client.fd, 0, ctx->israw);
@@ -514,6 +1906,12 @@ static int client_complete_conn(struct pomp_ctx *ctx)
 	ctx->u.client.conn = conn;
 	ctx->u.client.fd = -1;
 
+	/* Restore subscriptions */
+	client_send_subs(ctx);
+
+	/* Next disconnection restarts the reconnection schedule */
+	ctx_reconnect_reset(ctx);
+
 	/* Notify user */
 	pomp_ctx_notify_event(ctx, POMP_EVENT_CONNECTED, conn);
 	return 0;
@@ -525,7 +1923,7 @@ reconnect:
 	ctx->u.client.fd = -1;
 
 	/* Try a reconnection */
-	return pomp_timer_set(ctx->timer, POMP_CLIENT_RECONNECT_DELAY);
+	return ctx_reconnect_schedule(ctx);
 }
 
 /**
@@ -592,7 +1990,7 @@ static int client_start(struct pomp_ctx *ctx)
 		pomp_loop_remove(ctx->loop, ctx->u.client.fd);
 		close(ctx->u.client.fd);
 		ctx->u.client.fd = -1;
-		res = pomp_timer_set(ctx->timer, POMP_CLIENT_RECONNECT_DELAY);
+		res = ctx_reconnect_schedule(ctx);
 		if (res < 0)
 			goto error;
 		return 0;
@@ -620,6 +2018,22 @@ error:
  */
 static int client_stop(struct pomp_ctx *ctx)
 {
+	uint32_t i = 0;
+
+	/* Stop and destroy the client contexts of a pool */
+	if (ctx->cpool.members != NULL) {
+		for (i = 0; i < ctx->cpool.count; i++) {
+			if (ctx->cpool.members[i] == NULL)
+				continue;
+			pomp_ctx_stop(ctx->cpool.members[i]);
+			pomp_ctx_destroy(ctx->cpool.members[i]);
+		}
+		free(ctx->cpool.members);
+		ctx->cpool.members = NULL;
+		ctx->cpool.count = 0;
+		return 0;
+	}
+
 	/* Remove current connection */
 	if (ctx->u.client.conn != NULL)
 		pomp_ctx_remove_conn(ctx, ctx->u.client.conn);
@@ -634,6 +2048,213 @@ static int client_stop(struct pomp_ctx *ctx)
 	return 0;
 }
 
+/**
+ * Forward the events of a client context of a pool to the pooled context.
+ * @param member : client context of the pool.
+ * @param event : event to notify.
+ * @param conn : connection of the client context.
+ * @param msg : received message for POMP_EVENT_MSG.
+ * @param userdata : pooled context.
+ */
+static void client_pool_event_cb(struct pomp_ctx *member,
+		enum pomp_event event, struct pomp_conn *conn,
+		const struct pomp_msg *msg, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	(*ctx->eventcb)(ctx, event, conn, msg, ctx->userdata);
+}
+
+/**
+ * Forward the raw data of a client context of a pool to the pooled context.
+ * @param member : client context of the pool.
+ * @param conn : connection of the client context.
+ * @param buf : received data.
+ * @param userdata : pooled context.
+ */
+static void client_pool_raw_cb(struct pomp_ctx *member,
+		struct pomp_conn *conn, struct pomp_buffer *buf,
+		void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	(*ctx->rawcb)(ctx, conn, buf, ctx->userdata);
+}
+
+/**
+ * Forward the socket creations of a client context of a pool to the pooled
+ * context.
+ * @param member : client context of the pool.
+ * @param fd : created socket.
+ * @param kind : kind of socket.
+ * @param userdata : pooled context.
+ */
+static void client_pool_socket_cb(struct pomp_ctx *member, int fd,
+		enum pomp_socket_kind kind, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	if (ctx->sockcb != NULL)
+		(*ctx->sockcb)(ctx, fd, kind, ctx->userdata);
+}
+
+/**
+ * Forward the send completions of a client context of a pool to the pooled
+ * context.
+ * @param member : client context of the pool.
+ * @param conn : connection of the client context.
+ * @param buf : buffer sent.
+ * @param status : status of the send operation.
+ * @param cookie : reserved.
+ * @param userdata : pooled context.
+ */
+static void client_pool_send_cb(struct pomp_ctx *member,
+		struct pomp_conn *conn, struct pomp_buffer *buf,
+		uint32_t status, void *cookie, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	if (ctx->sendcb != NULL)
+		(*ctx->sendcb)(ctx, conn, buf, status, cookie, ctx->userdata);
+}
+
+/**
+ * Create and start a client context of a pool. It inherits the settings of
+ * the pooled context.
+ * @param ctx : pooled context.
+ * @param addr : address to connect to.
+ * @param addrlen : size of address.
+ * @param member : created client context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int client_pool_new_member(struct pomp_ctx *ctx,
+		const struct sockaddr *addr, uint32_t addrlen,
+		struct pomp_ctx **member)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct pomp_ctx *m = NULL;
+
+	m = pomp_ctx_new_with_loop(&client_pool_event_cb, ctx, ctx->loop);
+	if (m == NULL)
+		return -ENOMEM;
+
+	m->israw = ctx->israw;
+	m->rawcb = ctx->israw ? &client_pool_raw_cb : NULL;
+	m->sockcb = ctx->sockcb != NULL ? &client_pool_socket_cb : NULL;
+	m->sendcb = ctx->sendcb != NULL ? &client_pool_send_cb : NULL;
+	m->keepalive = ctx->keepalive;
+	m->edgetriggered = ctx->edgetriggered;
+	m->busypoll = ctx->busypoll;
+	m->readbudget.maxbytes = ctx->readbudget.maxbytes;
+	m->readbudget.maxmsgs = ctx->readbudget.maxmsgs;
+	m->ratelimit = ctx->ratelimit;
+	m->pacing = ctx->pacing;
+
+	/* Each client draws its own reconnection delays */
+	m->reconnect = ctx->reconnect;
+	m->reconnect.seed ^= (uint32_t)(uintptr_t)m;
+	if (m->reconnect.seed == 0)
+		m->reconnect.seed = 1;
+
+	/* Raw contexts have no heartbeat */
+	if (ctx->heartbeat.interval != 0) {
+		res = pomp_ctx_set_heartbeat(m, ctx->heartbeat.interval,
+				ctx->heartbeat.timeout);
+		if (res < 0)
+			goto error;
+	}
+
+	/* Subscriptions are sent on each connection */
+	for (i = 0; i < ctx->subs.count; i++) {
+		res = pomp_sub_set_add(&m->subs, ctx->subs.ranges[i].first,
+				ctx->subs.ranges[i].last);
+		if (res < 0)
+			goto error;
+	}
+
+	res = pomp_ctx_connect(m, addr, addrlen);
+	if (res < 0)
+		goto error;
+
+	*member = m;
+	return 0;
+
+	/* Cleanup in case of error */
+error:
+	pomp_ctx_destroy(m);
+	return res;
+}
+
+/**
+ * Mix the bits of a 32-bit value (finalizer of murmur3).
+ * @param h : value to mix.
+ * @return mixed value.
+ */
+static uint32_t client_pool_hash(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * Choose the connection of a pooled context used to send a message. Only
+ * connected clients are considered, so the traffic of a disconnected one
+ * fails over to the others.
+ * @param ctx : pooled context.
+ * @param key : key of the message for POMP_BALANCE_POLICY_HASH.
+ * @return connection or NULL if no client is connected.
+ */
+static struct pomp_conn *client_pool_pick(struct pomp_ctx *ctx, uint32_t key)
+{
+	uint32_t i = 0, idx = 0, score = 0, best = 0;
+	size_t queued = 0, minqueued = 0;
+	struct pomp_conn *conn = NULL, *found = NULL;
+
+	for (i = 0; i < ctx->cpool.count; i++) {
+		/* Clients are notified while the pool is created */
+		idx = (ctx->cpool.next + i) % ctx->cpool.count;
+		if (ctx->cpool.members[idx] == NULL)
+			continue;
+		conn = ctx->cpool.members[idx]->u.client.conn;
+		if (conn == NULL)
+			continue;
+
+		switch (ctx->cpool.policy) {
+		case POMP_BALANCE_POLICY_ROUND_ROBIN:
+			ctx->cpool.next = (idx + 1) % ctx->cpool.count;
+			return conn;
+
+		case POMP_BALANCE_POLICY_LEAST_QUEUED:
+			/* Ties are broken in round robin order */
+			queued = pomp_conn_get_queued(conn);
+			if (found == NULL || queued < minqueued) {
+				found = conn;
+				minqueued = queued;
+				best = idx;
+			}
+			break;
+
+		case POMP_BALANCE_POLICY_HASH:
+			/* Rendezvous hashing, only the keys of a disconnected
+			 * client move to other ones */
+			score = client_pool_hash(key ^
+					client_pool_hash(idx + 1));
+			if (found == NULL || score > best) {
+				found = conn;
+				best = score;
+			}
+			break;
+		}
+	}
+
+	if (found != NULL && ctx->cpool.policy
+			== POMP_BALANCE_POLICY_LEAST_QUEUED) {
+		ctx->cpool.next = (best + 1) % ctx->cpool.count;
+	}
+	return found;
+}
+
 /**
  * Start a dgram context.
  * It will bind to the context address.
@@ -673,6 +2294,10 @@ static int dgram_start(struct pomp_ctx *ctx)
 		goto error;
 	}
 
+	/* Enable busy polling for UDP sockets */
+	if (POMP_IS_INET(ctx->addr->sa_family))
+		fd_socket_setup_busy_poll(ctx, ctx->u.dgram.fd);
+
 	/* Bind to address  */
 	if (bind(ctx->u.dgram.fd, ctx->addr, ctx->addrlen) < 0) {
 		/* Handle case where address do not match an existent
@@ -703,83 +2328,492 @@ static int dgram_start(struct pomp_ctx *ctx)
 	ctx->u.dgram.conn = conn;
 	ctx->u.dgram.fd = -1;
 
-	return 0;
+	ctx_reconnect_reset(ctx);
+	return 0;
+
+	/* Cleanup and reconnect  */
+reconnect:
+	if (ctx->u.dgram.fd >= 0) {
+		close(ctx->u.dgram.fd);
+		ctx->u.dgram.fd = -1;
+		memset(&ctx->u.dgram.local_addr, 0,
+				sizeof(ctx->u.dgram.local_addr));
+		ctx->u.dgram.local_addrlen = 0;
+	}
+
+	/* Try a reconnection */
+	return ctx_reconnect_schedule(ctx);
+
+	/* Cleanup in case of error */
+error:
+	if (ctx->u.dgram.fd >= 0) {
+		close(ctx->u.dgram.fd);
+		ctx->u.dgram.fd = -1;
+		memset(&ctx->u.dgram.local_addr, 0,
+				sizeof(ctx->u.dgram.local_addr));
+		ctx->u.dgram.local_addrlen = 0;
+	}
+	return res;
+}
+
+/**
+ * Stop a dgram context.
+ * @param ctx : context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int dgram_stop(struct pomp_ctx *ctx)
+{
+	/* Remove fake connection */
+	if (ctx->u.dgram.conn != NULL)
+		pomp_ctx_remove_conn(ctx, ctx->u.dgram.conn);
+
+	/* Unbind socket (normally the fd was owned by fake connection) */
+	if (ctx->u.dgram.fd >= 0) {
+		close(ctx->u.dgram.fd);
+		ctx->u.dgram.fd = -1;
+	}
+
+	/* Clear bound local address */
+	memset(&ctx->u.dgram.local_addr, 0, sizeof(ctx->u.dgram.local_addr));
+	ctx->u.dgram.local_addrlen = 0;
+
+	return 0;
+}
+
+/**
+ * Function called when the timer is triggered.
+ * @param timer : timer
+ * @param userdata : context object.
+ */
+static void timer_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+
+	/* Clear timer */
+	pomp_timer_clear(ctx->timer);
+
+	/* Try reconnecting the client/server */
+	switch (ctx->type) {
+	case POMP_CTX_TYPE_SERVER:
+		server_start(ctx);
+		break;
+
+	case POMP_CTX_TYPE_CLIENT:
+		client_start(ctx);
+		break;
+
+	case POMP_CTX_TYPE_DGRAM:
+		dgram_start(ctx);
+		break;
+	}
+}
+
+/**
+ * Determine if a connection uses the context loop and is still alive.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @return 1 if the connection is still valid, 0 otherwise.
+ */
+static int ctx_has_conn(const struct pomp_ctx *ctx,
+		const struct pomp_conn *conn)
+{
+	uint32_t i = 0;
+	const struct pomp_conn *cur = NULL;
+
+	if (ctx->addr == NULL)
+		return 0;
+
+	switch (ctx->type) {
+	case POMP_CTX_TYPE_SERVER:
+		for (cur = ctx->u.server.conns; cur != NULL;
+				cur = pomp_conn_get_next(cur)) {
+			if (cur == conn)
+				return 1;
+		}
+		return 0;
+
+	case POMP_CTX_TYPE_CLIENT:
+		for (i = 0; i < ctx->cpool.count; i++) {
+			if (ctx->cpool.members[i] != NULL && ctx_has_conn(
+					ctx->cpool.members[i], conn)) {
+				return 1;
+			}
+		}
+		return ctx->u.client.conn == conn;
+
+	case POMP_CTX_TYPE_DGRAM:
+		return ctx->u.dgram.conn == conn;
+	}
+
+	return 0;
+}
+
+/**
+ * Send messages queued by other threads to connections of a loop. Messages
+ * whose connection is gone are dropped. Each destination is corked during
+ * the processing so it is written with a single gather write.
+ * @param ctx : context.
+ * @param worker : worker owning the connections, NULL for the context.
+ * @param list : queued messages in order.
+ */
+static void ctx_async_send_conns(struct pomp_ctx *ctx,
+		struct pomp_ctx_worker *worker, struct pomp_ctx_async_msg *list)
+{
+	int found = 0;
+	struct pomp_ctx_async_msg *amsg = NULL;
+	const struct pomp_conn *cur = NULL;
+
+	for (amsg = list; amsg != NULL; amsg = amsg->next) {
+		/* A connection at the same address may be a new one */
+		if (worker != NULL) {
+			cur = worker->conns;
+			while (cur != NULL && cur != amsg->conn)
+				cur = pomp_conn_get_next(cur);
+			found = cur != NULL;
+		} else {
+			found = ctx_has_conn(ctx, amsg->conn);
+		}
+		if (!found || pomp_conn_get_id(amsg->conn) != amsg->connid)
+			continue;
+
+		if (!pomp_conn_is_corked(amsg->conn)) {
+			(void)pomp_conn_cork(amsg->conn);
+			amsg->corked = 1;
+		}
+		(void)pomp_conn_send_msg(amsg->conn, &amsg->msg);
+	}
+
+	for (amsg = list; amsg != NULL; amsg = amsg->next) {
+		if (amsg->corked)
+			(void)pomp_conn_uncork(amsg->conn);
+	}
+}
+
+/**
+ * Function called in a worker thread to send messages queued by other
+ * threads to its connections.
+ * @param userdata : worker operation.
+ */
+static void worker_async_cb(void *userdata)
+{
+	struct pomp_ctx_worker_op *op = userdata;
+
+	ctx_async_send_conns(op->worker->ctx, op->worker, op->batch->list);
+	worker_op_done(op);
+}
+
+/**
+ * Send messages queued by other threads to connections of workers. The
+ * owner of each connection is only known in its thread, so the messages are
+ * given to all workers.
+ * @param ctx : context.
+ * @param list : queued messages in order, ownership is transferred.
+ */
+static void ctx_async_post_workers(struct pomp_ctx *ctx,
+		struct pomp_ctx_async_msg *list)
+{
+	uint32_t i = 0;
+	struct pomp_ctx_async_batch *batch = NULL;
+	struct pomp_ctx_worker_op *op = NULL;
+
+	batch = calloc(1, sizeof(*batch));
+	if (batch == NULL) {
+		ctx_async_free(list);
+		return;
+	}
+	batch->refcount = 1;
+	batch->list = list;
+
+	for (i = 0; i < ctx->workers.count; i++) {
+		op = worker_op_new(&ctx->workers.entries[i], -1, NULL,
+				NULL, NULL);
+		if (op == NULL)
+			continue;
+
+		pomp_mutex_lock(&ctx->workers.mutex);
+		batch->refcount++;
+		pomp_mutex_unlock(&ctx->workers.mutex);
+		op->batch = batch;
+		if (worker_op_post(op, &worker_async_cb) < 0)
+			worker_op_done(op);
+	}
+
+	ctx_async_batch_unref(ctx, batch);
+}
+
+/**
+ * Function called in the loop thread to send all messages queued by other
+ * threads since the last call. Only connections receiving a message are
+ * corked during the processing.
+ * @param userdata : context.
+ */
+static void ctx_async_cb(void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	struct pomp_ctx_async_msg *amsg = NULL, *next = NULL, *list = NULL;
+
+	/* Take all messages, the stack gives them in reverse order */
+	amsg = pomp_atomic_xchg_ptr((void *volatile *)&ctx->async, NULL);
+	while (amsg != NULL) {
+		next = amsg->next;
+		amsg->next = list;
+		list = amsg;
+		amsg = next;
+	}
+
+	while (list != NULL) {
+		/* Messages to the context are sent in order with the others */
+		if (list->conn == NULL) {
+			amsg = list;
+			list = amsg->next;
+			amsg->next = NULL;
+			(void)pomp_ctx_send_msg(ctx, &amsg->msg);
+			ctx_async_free(amsg);
+			continue;
+		}
 
-	/* Cleanup and reconnect  */
-reconnect:
-	if (ctx->u.dgram.fd >= 0) {
-		close(ctx->u.dgram.fd);
-		ctx->u.dgram.fd = -1;
-		memset(&ctx->u.dgram.local_addr, 0,
-				sizeof(ctx->u.dgram.local_addr));
-		ctx->u.dgram.local_addrlen = 0;
+		/* Detach the following messages to connections */
+		amsg = list;
+		while (amsg->next != NULL && amsg->next->conn != NULL)
+			amsg = amsg->next;
+		next = amsg->next;
+		amsg->next = NULL;
+
+		if (ctx->workers.count > 0) {
+			ctx_async_post_workers(ctx, list);
+		} else {
+			ctx_async_send_conns(ctx, NULL, list);
+			ctx_async_free(list);
+		}
+		list = next;
 	}
+}
 
-	/* Try a reconnection */
-	return pomp_timer_set(ctx->timer, POMP_DGRAM_RECONNECT_DELAY);
+/**
+ * Queue a message sent from another thread. Only the first message queued
+ * since the last processing posts a function to the loop of the context.
+ * @param ctx : context.
+ * @param conn : destination connection or NULL for the context.
+ * @param msg : message to send, its buffer is shared.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_ctx_post_msg(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		const struct pomp_msg *msg)
+{
+	int res = 0;
+	struct pomp_ctx_async_msg *amsg = NULL, *head = NULL;
 
-	/* Cleanup in case of error */
-error:
-	if (ctx->u.dgram.fd >= 0) {
-		close(ctx->u.dgram.fd);
-		ctx->u.dgram.fd = -1;
-		memset(&ctx->u.dgram.local_addr, 0,
-				sizeof(ctx->u.dgram.local_addr));
-		ctx->u.dgram.local_addrlen = 0;
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg->buf != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg->finished, -EINVAL);
+
+	amsg = calloc(1, sizeof(*amsg));
+	if (amsg == NULL)
+		return -ENOMEM;
+	amsg->conn = conn;
+	amsg->connid = conn != NULL ? pomp_conn_get_id(conn) : 0;
+
+	/* Share buffer, it becomes read-only */
+	amsg->msg.msgid = msg->msgid;
+	amsg->msg.finished = 1;
+	amsg->msg.rpcid = msg->rpcid;
+	amsg->msg.buf = msg->buf;
+	pomp_buffer_ref(amsg->msg.buf);
+
+	/* Push on the stack */
+	do {
+		head = ctx->async;
+		amsg->next = head;
+	} while (pomp_atomic_cas_ptr((void *volatile *)&ctx->async,
+			head, amsg) != head);
+
+	/* Loop already notified by a previous message */
+	if (head != NULL)
+		return 0;
+
+	res = pomp_loop_post(ctx->loop, &ctx_async_cb, ctx);
+	if (res < 0) {
+		/* Nobody will process the queue, drop it (including messages
+		 * pushed concurrently) */
+		POMP_LOGE("pomp_loop_post err=%d(%s)", res, strerror(-res));
+		ctx_async_free(pomp_atomic_xchg_ptr(
+				(void *volatile *)&ctx->async, NULL));
 	}
 	return res;
 }
 
 /**
- * Stop a dgram context.
+ * Determine if the caller is a thread of the handler pool of a context.
  * @param ctx : context.
- * @return 0 in case of success, negative errno value in case of error.
+ * @return 1 if the caller runs a handler of the pool, 0 otherwise.
  */
-static int dgram_stop(struct pomp_ctx *ctx)
+int pomp_ctx_is_pool_thread(const struct pomp_ctx *ctx)
 {
-	/* Remove fake connection */
-	if (ctx->u.dgram.conn != NULL)
-		pomp_ctx_remove_conn(ctx, ctx->u.dgram.conn);
+	return ctx != NULL && pomp_pool_is_current(ctx->pool);
+}
 
-	/* Unbind socket (normally the fd was owned by fake connection) */
-	if (ctx->u.dgram.fd >= 0) {
-		close(ctx->u.dgram.fd);
-		ctx->u.dgram.fd = -1;
-	}
+/**
+ * Get the address family of a context, shared by all its connections.
+ * @param ctx : context.
+ * @return address family, AF_UNSPEC if the context is not started.
+ */
+int pomp_ctx_get_family(const struct pomp_ctx *ctx)
+{
+	if (ctx == NULL || ctx->addr == NULL)
+		return AF_UNSPEC;
+	return ctx->addr->sa_family;
+}
 
-	/* Clear bound local address */
-	memset(&ctx->u.dgram.local_addr, 0, sizeof(ctx->u.dgram.local_addr));
-	ctx->u.dgram.local_addrlen = 0;
+/**
+ * Get the outbound pacing of new connections.
+ * @param ctx : context.
+ * @param rate : bytes per second, 0 for no limit.
+ * @param burst : maximum number of bytes written at once.
+ */
+void pomp_ctx_get_pacing(const struct pomp_ctx *ctx,
+		uint32_t *rate, uint32_t *burst)
+{
+	*rate = ctx->pacing.rate;
+	*burst = ctx->pacing.burst;
+}
+
+/**
+ * Get the inbound rate limits of new connections.
+ * @param ctx : context.
+ * @param msgrate : messages per second, 0 for no limit.
+ * @param msgburst : maximum number of messages at once.
+ * @param byterate : bytes per second, 0 for no limit.
+ * @param byteburst : maximum number of bytes at once.
+ */
+void pomp_ctx_get_rate_limit(const struct pomp_ctx *ctx,
+		uint32_t *msgrate, uint32_t *msgburst,
+		uint32_t *byterate, uint32_t *byteburst)
+{
+	*msgrate = ctx->ratelimit.msgrate;
+	*msgburst = ctx->ratelimit.msgburst;
+	*byterate = ctx->ratelimit.byterate;
+	*byteburst = ctx->ratelimit.byteburst;
+}
+
+/**
+ * Get the read budget per loop iteration of new connections.
+ * @param ctx : context.
+ * @param maxbytes : maximum number of bytes, 0 for no limit.
+ * @param maxmsgs : maximum number of messages, 0 for no limit.
+ */
+void pomp_ctx_get_read_budget(const struct pomp_ctx *ctx,
+		uint32_t *maxbytes, uint32_t *maxmsgs)
+{
+	*maxbytes = ctx->readbudget.maxbytes;
+	*maxmsgs = ctx->readbudget.maxmsgs;
+}
+
+/**
+ * Determine if new connections shall be registered in edge-triggered mode.
+ * @param ctx : context.
+ * @return 1 for edge-triggered mode, 0 for level-triggered mode.
+ */
+int pomp_ctx_is_edge_triggered(const struct pomp_ctx *ctx)
+{
+	return ctx->edgetriggered;
+}
 
+/**
+ * Check that a connection can be migrated to a loop. Only connections of a
+ * server owned by a worker can be migrated, to the loop of another worker.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @param loop : destination loop.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_ctx_check_migrate(struct pomp_ctx *ctx,
+		const struct pomp_conn *conn, struct pomp_loop *loop)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->type == POMP_CTX_TYPE_SERVER, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(server_find_worker(ctx, conn) != NULL,
+			-EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(server_find_worker_by_loop(ctx, loop) != NULL,
+			-EINVAL);
 	return 0;
 }
 
 /**
- * Function called when the timer is triggered.
- * @param timer : timer
- * @param userdata : context object.
+ * Migrate a connection to the worker running a loop. It shall be called in
+ * the thread of the worker currently owning the connection, which is then
+ * used by the new worker only.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @param loop : destination loop.
+ * @return 0 in case of success, negative errno value in case of error. The
+ * connection is still owned by its current worker in case of error.
  */
-static void timer_cb(struct pomp_timer *timer, void *userdata)
+int pomp_ctx_migrate_conn(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		struct pomp_loop *loop)
 {
-	struct pomp_ctx *ctx = userdata;
+	int res = 0, stopping = 0;
+	struct pomp_ctx_worker *src = NULL, *dst = NULL;
+	struct pomp_ctx_worker_op *op = NULL;
 
-	/* Clear timer */
-	pomp_timer_clear(ctx->timer);
+	res = pomp_ctx_check_migrate(ctx, conn, loop);
+	if (res < 0)
+		return res;
+	src = server_find_worker(ctx, conn);
+	dst = server_find_worker_by_loop(ctx, loop);
 
-	/* Try reconnecting the client/server */
-	switch (ctx->type) {
-	case POMP_CTX_TYPE_SERVER:
-		server_start(ctx);
-		break;
+	op = worker_op_new(dst, -1, conn, NULL, NULL);
+	if (op == NULL)
+		return -ENOMEM;
 
-	case POMP_CTX_TYPE_CLIENT:
-		client_start(ctx);
-		break;
+	/* Move the connection count, workers are stopped otherwise */
+	pomp_mutex_lock(&ctx->workers.mutex);
+	stopping = ctx->workers.stopping;
+	if (!stopping) {
+		src->conncount--;
+		dst->conncount++;
+	}
+	pomp_mutex_unlock(&ctx->workers.mutex);
+	if (stopping) {
+		worker_op_free(op);
+		return -EBUSY;
+	}
 
-	case POMP_CTX_TYPE_DGRAM:
-		dgram_start(ctx);
-		break;
+	/* Detach from current worker, subscriptions follow the connection
+	 * but pending rpc requests are bound to the worker */
+	res = pomp_conn_detach(conn);
+	if (res < 0)
+		goto error;
+	(void)conn_list_remove(&src->conns, conn);
+	if (src->subtable != NULL)
+		(void)pomp_sub_table_take_conn(src->subtable, conn, &op->subs);
+	if (src->rpc != NULL)
+		pomp_rpc_cancel_conn(src->rpc, conn);
+
+	res = worker_op_post(op, &worker_migrate_cb);
+	if (res < 0) {
+		/* Stay on current worker */
+		(void)pomp_conn_attach(conn, src->loop);
+		pomp_conn_set_next(conn, src->conns);
+		src->conns = conn;
+		worker_restore_subs(src, conn, &op->subs);
+		worker_op_done(op);
+		op = NULL;
+		goto error;
 	}
+
+	return 0;
+
+error:
+	pomp_mutex_lock(&ctx->workers.mutex);
+	src->conncount++;
+	dst->conncount--;
+	pomp_mutex_unlock(&ctx->workers.mutex);
+	if (op != NULL)
+		worker_op_free(op);
+	return res;
 }
 
 /*
@@ -843,95 +2877,443 @@ error:
 /*
  * See documentation in public header.
  */
-struct pomp_ctx *pomp_ctx_new_with_loop(pomp_event_cb_t cb,
-		void *userdata, struct pomp_loop *loop)
+struct pomp_ctx *pomp_ctx_new_with_loop(pomp_event_cb_t cb,
+		void *userdata, struct pomp_loop *loop)
+{
+	struct pomp_ctx *ctx = NULL;
+
+	POMP_RETURN_VAL_IF_FAILED(cb != NULL, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(loop != NULL, -EINVAL, NULL);
+
+	/* Allocate context structure */
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		goto error;
+
+	/* Save parameters */
+	ctx->eventcb = cb;
+	ctx->userdata = userdata;
+	ctx->loop = loop;
+	ctx->extloop = 1;
+	ctx->israw = 0;
+
+	/* Default keepalive settings */
+	ctx->keepalive.enable = 1;
+	ctx->keepalive.idle = 5;
+	ctx->keepalive.interval = 1;
+	ctx->keepalive.count = 2;
+
+	/* Default admission control */
+	ctx->admission.maxconns = POMP_SERVER_MAX_CONN_COUNT;
+
+	/* Default reconnection policy, fixed delay */
+	ctx->reconnect.initial = POMP_CTX_RECONNECT_DELAY;
+	ctx->reconnect.max = POMP_CTX_RECONNECT_DELAY;
+	ctx->reconnect.multiplier = 100;
+	ctx->reconnect.seed = (uint32_t)(uintptr_t)ctx;
+
+	/* Allocate timer */
+	ctx->timer = pomp_timer_new(ctx->loop, &timer_cb, ctx);
+	if (ctx->timer == NULL)
+		goto error;
+
+	return ctx;
+
+	/* Cleanup in case of error */
+error:
+	if (ctx != NULL)
+		pomp_ctx_destroy(ctx);
+	return NULL;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_raw(struct pomp_ctx *ctx, pomp_ctx_raw_cb_t cb)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
+	POMP_RETURN_ERR_IF_FAILED(ctx->subtable == NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->pool == NULL, -EINVAL);
+	ctx->israw = 1;
+	ctx->rawcb = cb;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_socket_cb(struct pomp_ctx *ctx, pomp_socket_cb_t cb)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
+	ctx->sockcb = cb;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_send_cb(struct pomp_ctx *ctx, pomp_send_cb_t cb)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
+	ctx->sendcb = cb;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_setup_keepalive(struct pomp_ctx *ctx, int enable,
+		int idle, int interval, int count)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	ctx->keepalive.enable = enable;
+	ctx->keepalive.idle = idle;
+	ctx->keepalive.interval = interval;
+	ctx->keepalive.count = count;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_read_budget(struct pomp_ctx *ctx,
+		uint32_t maxbytes, uint32_t maxmsgs)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	ctx->readbudget.maxbytes = maxbytes;
+	ctx->readbudget.maxmsgs = maxmsgs;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_rate_limit(struct pomp_ctx *ctx,
+		uint32_t msgrate, uint32_t msgburst,
+		uint32_t byterate, uint32_t byteburst)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	ctx->ratelimit.msgrate = msgrate;
+	ctx->ratelimit.msgburst = msgburst;
+	ctx->ratelimit.byterate = byterate;
+	ctx->ratelimit.byteburst = byteburst;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_pacing(struct pomp_ctx *ctx, uint32_t rate, uint32_t burst)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	ctx->pacing.rate = rate;
+	ctx->pacing.burst = burst;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_admission(struct pomp_ctx *ctx, uint32_t maxconns,
+		uint32_t acceptrate, uint32_t acceptburst)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+
+	server_admission_lock(ctx);
+	ctx->admission.maxconns = maxconns != 0 ?
+			maxconns : POMP_SERVER_MAX_CONN_COUNT;
+	pomp_token_bucket_init(&ctx->admission.accepts, acceptrate,
+			acceptburst, pomp_loop_now(ctx->loop));
+	server_admission_unlock(ctx);
+
+	/* Resume accepts if they were suspended with the previous rate, the
+	 * sockets of workers resume when their timer expires */
+	if (server_admission_unpause(ctx, &ctx->admission.pause,
+			pomp_loop_now(ctx->loop)) &&
+			ctx->addr != NULL && ctx->u.server.fd >= 0) {
+		(void)pomp_loop_update2(ctx->loop, ctx->u.server.fd,
+				POMP_FD_EVENT_IN, 0);
+	}
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_get_throttle_stats(const struct pomp_ctx *ctx,
+		struct pomp_throttle_stats *stats)
+{
+	/* The workers mutex is not part of the observable state */
+	struct pomp_ctx *mctx = (struct pomp_ctx *)ctx;
+	uint64_t now = 0;
+	uint32_t i = 0;
+
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(stats != NULL, -EINVAL);
+
+	/* Include ongoing suspensions of all listening sockets */
+	(void)time_get_monotonic_us(&now);
+	server_admission_lock(mctx);
+	*stats = ctx->admission.stats;
+	if (ctx->admission.pause.paused)
+		stats->throttled_us += now - ctx->admission.pause.since;
+	for (i = 0; i < ctx->workers.count; i++) {
+		if (ctx->workers.entries[i].pause.paused) {
+			stats->throttled_us += now -
+					ctx->workers.entries[i].pause.since;
+		}
+	}
+	server_admission_unlock(mctx);
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_edge_triggered(struct pomp_ctx *ctx, int enable)
 {
-	struct pomp_ctx *ctx = NULL;
-
-	POMP_RETURN_VAL_IF_FAILED(cb != NULL, -EINVAL, NULL);
-	POMP_RETURN_VAL_IF_FAILED(loop != NULL, -EINVAL, NULL);
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	if (enable && !pomp_loop_has_edge_triggered())
+		return -ENOSYS;
+	ctx->edgetriggered = enable ? 1 : 0;
+	return 0;
+}
 
-	/* Allocate context structure */
-	ctx = calloc(1, sizeof(*ctx));
-	if (ctx == NULL)
-		goto error;
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_busy_poll(struct pomp_ctx *ctx, uint32_t usecs)
+{
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+#ifdef SO_BUSY_POLL
+	ctx->busypoll = usecs;
+	return 0;
+#else
+	return usecs == 0 ? 0 : -ENOSYS;
+#endif /* SO_BUSY_POLL */
+}
 
-	/* Save parameters */
-	ctx->eventcb = cb;
-	ctx->userdata = userdata;
-	ctx->loop = loop;
-	ctx->extloop = 1;
-	ctx->israw = 0;
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_setup_reconnect(struct pomp_ctx *ctx, uint32_t initial,
+		uint32_t max, uint32_t multiplier, uint32_t jitter,
+		int immediate)
+{
+	uint64_t now = 0;
 
-	/* Default keepalive settings */
-	ctx->keepalive.enable = 1;
-	ctx->keepalive.idle = 5;
-	ctx->keepalive.interval = 1;
-	ctx->keepalive.count = 2;
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(initial != 0, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(max >= initial, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(multiplier >= 100, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(jitter <= 100, -EINVAL);
+
+	ctx->reconnect.initial = initial;
+	ctx->reconnect.max = max;
+	ctx->reconnect.multiplier = multiplier;
+	ctx->reconnect.jitter = jitter;
+	ctx->reconnect.immediate = immediate;
+
+	/* Contexts created at the same time shall not draw the same delays */
+	if (time_get_monotonic_us(&now) == 0)
+		ctx->reconnect.seed ^= (uint32_t)now ^ (uint32_t)(now >> 32);
+	if (ctx->reconnect.seed == 0)
+		ctx->reconnect.seed = 1;
+
+	ctx_reconnect_reset(ctx);
+	return 0;
+}
 
-	/* Allocate timer */
-	ctx->timer = pomp_timer_new(ctx->loop, &timer_cb, ctx);
-	if (ctx->timer == NULL)
-		goto error;
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_set_heartbeat(struct pomp_ctx *ctx, uint32_t interval,
+		uint32_t timeout)
+{
+	int res = 0;
+	uint32_t i = 0;
 
-	return ctx;
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(!ctx->israw, -EINVAL);
+
+	/* Create timer on first use */
+	if (interval != 0 && ctx->heartbeat.timer == NULL) {
+		ctx->heartbeat.timer = pomp_timer_new(ctx->loop,
+				&ctx_heartbeat_cb, ctx);
+		if (ctx->heartbeat.timer == NULL)
+			return -ENOMEM;
+	}
 
-	/* Cleanup in case of error */
-error:
-	if (ctx != NULL)
-		pomp_ctx_destroy(ctx);
-	return NULL;
+	ctx->heartbeat.interval = interval;
+	ctx->heartbeat.timeout = timeout;
+
+	/* Pooled clients only forward settings to their clients */
+	if (ctx->cpool.members != NULL) {
+		for (i = 0; i < ctx->cpool.count; i++) {
+			if (ctx->cpool.members[i] == NULL)
+				continue;
+			res = pomp_ctx_set_heartbeat(ctx->cpool.members[i],
+					interval, timeout);
+			if (res < 0)
+				return res;
+		}
+		return 0;
+	}
+	return ctx_heartbeat_update(ctx);
 }
 
 /*
  * See documentation in public header.
  */
-int pomp_ctx_set_raw(struct pomp_ctx *ctx, pomp_ctx_raw_cb_t cb)
+int pomp_ctx_set_subscription(struct pomp_ctx *ctx, int enable)
 {
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
-	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(!ctx->israw, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
-	ctx->israw = 1;
-	ctx->rawcb = cb;
+
+	if (enable && ctx->subtable == NULL) {
+		ctx->subtable = pomp_sub_table_new();
+		if (ctx->subtable == NULL)
+			return -ENOMEM;
+	} else if (!enable && ctx->subtable != NULL) {
+		pomp_sub_table_destroy(ctx->subtable);
+		ctx->subtable = NULL;
+	}
 	return 0;
 }
 
 /*
  * See documentation in public header.
  */
-int pomp_ctx_set_socket_cb(struct pomp_ctx *ctx, pomp_socket_cb_t cb)
+int pomp_ctx_set_workers(struct pomp_ctx *ctx,
+		struct pomp_loop * const *loops, uint32_t count,
+		enum pomp_worker_policy policy)
 {
+	int res = 0;
+	uint32_t i = 0;
+	struct pomp_ctx_worker *entries = NULL;
+
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
-	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(count == 0 || loops != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
-	ctx->sockcb = cb;
+	for (i = 0; i < count; i++) {
+		POMP_RETURN_ERR_IF_FAILED(loops[i] != NULL, -EINVAL);
+		POMP_RETURN_ERR_IF_FAILED(loops[i] != ctx->loop, -EINVAL);
+	}
+
+#ifndef POMP_HAVE_COND
+	if (count > 0)
+		return -ENOSYS;
+#endif /* !POMP_HAVE_COND */
+
+#ifndef SO_REUSEPORT
+	if (policy == POMP_WORKER_POLICY_REUSEPORT)
+		return -ENOSYS;
+#endif /* !SO_REUSEPORT */
+
+#if !defined(SO_ATTACH_REUSEPORT_CBPF) || !defined(HAVE_LINUX_FILTER_H)
+	if (policy == POMP_WORKER_POLICY_REUSEPORT_CPU)
+		return -ENOSYS;
+#endif /* !SO_ATTACH_REUSEPORT_CBPF || !HAVE_LINUX_FILTER_H */
+
+	/* Allocate new workers */
+	if (count > 0) {
+		entries = calloc(count, sizeof(*entries));
+		if (entries == NULL)
+			return -ENOMEM;
+		for (i = 0; i < count; i++) {
+			entries[i].ctx = ctx;
+			entries[i].loop = loops[i];
+			entries[i].fd = -1;
+		}
+	}
+
+	/* Synchronization objects are created with the first workers */
+	if (count > 0 && ctx->workers.count == 0) {
+		res = pomp_mutex_init(&ctx->workers.mutex);
+		if (res < 0) {
+			free(entries);
+			return res;
+		}
+		res = pomp_cond_init(&ctx->workers.cond);
+		if (res < 0) {
+			pomp_mutex_clear(&ctx->workers.mutex);
+			free(entries);
+			return res;
+		}
+	} else if (count == 0 && ctx->workers.count > 0) {
+		pomp_cond_clear(&ctx->workers.cond);
+		pomp_mutex_clear(&ctx->workers.mutex);
+	}
+
+	/* Replace previous workers */
+	free(ctx->workers.entries);
+	ctx->workers.entries = entries;
+	ctx->workers.count = count;
+	ctx->workers.policy = policy;
+	ctx->workers.next = 0;
+	ctx->workers.pending = 0;
 	return 0;
 }
 
+/**
+ * Function called in a thread of the handler pool for each message.
+ * @param key : connection on which the message has been received.
+ * @param msg : message.
+ * @param userdata : context.
+ */
+static void ctx_pool_cb(void *key, const struct pomp_msg *msg, void *userdata)
+{
+	struct pomp_ctx *ctx = userdata;
+	(*ctx->eventcb)(ctx, POMP_EVENT_MSG, key, msg, ctx->userdata);
+}
+
 /*
  * See documentation in public header.
  */
-int pomp_ctx_set_send_cb(struct pomp_ctx *ctx, pomp_send_cb_t cb)
+int pomp_ctx_set_handler_pool(struct pomp_ctx *ctx, uint32_t threadcount)
 {
+	struct pomp_pool *pool = NULL;
+
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
-	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(!ctx->israw, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
-	ctx->sendcb = cb;
+
+#ifndef POMP_HAVE_COND
+	if (threadcount > 0)
+		return -ENOSYS;
+#endif /* !POMP_HAVE_COND */
+
+	if (threadcount > 0) {
+		pool = pomp_pool_new(threadcount, &ctx_pool_cb, ctx);
+		if (pool == NULL)
+			return -ENOMEM;
+	}
+
+	/* Replace previous pool */
+	if (ctx->pool != NULL)
+		(void)pomp_pool_destroy(ctx->pool);
+	ctx->pool = pool;
 	return 0;
 }
 
 /*
  * See documentation in public header.
  */
-int pomp_ctx_setup_keepalive(struct pomp_ctx *ctx, int enable,
-		int idle, int interval, int count)
+int pomp_ctx_get_handler_pool_stats(struct pomp_ctx *ctx,
+		struct pomp_handler_pool_stats *stats)
 {
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
-	ctx->keepalive.enable = enable;
-	ctx->keepalive.idle = idle;
-	ctx->keepalive.interval = interval;
-	ctx->keepalive.count = count;
-	return 0;
+	POMP_RETURN_ERR_IF_FAILED(stats != NULL, -EINVAL);
+	if (ctx->pool == NULL)
+		return -ENOENT;
+	return pomp_pool_get_stats(ctx->pool, stats);
 }
 
 /*
@@ -941,8 +3323,24 @@ int pomp_ctx_destroy(struct pomp_ctx *ctx)
 {
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
+	if (ctx->subtable != NULL)
+		pomp_sub_table_destroy(ctx->subtable);
+	pomp_sub_set_clear(&ctx->subs);
+	if (ctx->rpc != NULL)
+		pomp_rpc_destroy(ctx->rpc);
+	if (ctx->workers.count > 0)
+		(void)pomp_ctx_set_workers(ctx, NULL, 0, 0);
+	if (ctx->pool != NULL)
+		(void)pomp_pool_destroy(ctx->pool);
+	if (ctx->loop != NULL)
+		(void)pomp_loop_post_remove(ctx->loop, &ctx_async_cb, ctx);
+	ctx_async_free(ctx->async);
 	if (ctx->timer != NULL)
 		pomp_timer_destroy(ctx->timer);
+	if (ctx->heartbeat.timer != NULL)
+		pomp_timer_destroy(ctx->heartbeat.timer);
+	if (ctx->admission.pause.timer != NULL)
+		pomp_timer_destroy(ctx->admission.pause.timer);
 	if (ctx->loop != NULL && !ctx->extloop)
 		pomp_loop_destroy(ctx->loop);
 	free(ctx);
@@ -974,6 +3372,7 @@ static int pomp_ctx_start(struct pomp_ctx *ctx, enum pomp_ctx_type type,
 
 	/* Save type */
 	ctx->type = type;
+	ctx_reconnect_reset(ctx);
 
 	/* Setup server/client/dgram specific stuff */
 	switch (ctx->type) {
@@ -1006,6 +3405,8 @@ static int pomp_ctx_start(struct pomp_ctx *ctx, enum pomp_ctx_type type,
 		break;
 	}
 
+	if (res == 0)
+		res = ctx_heartbeat_update(ctx);
 	return res;
 }
 
@@ -1027,6 +3428,71 @@ int pomp_ctx_connect(struct pomp_ctx *ctx,
 	return pomp_ctx_start(ctx, POMP_CTX_TYPE_CLIENT, addr, addrlen);
 }
 
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_connect_pool(struct pomp_ctx *ctx,
+		const struct sockaddr * const *addrs, const uint32_t *addrlens,
+		uint32_t addrcount, uint32_t conncount,
+		enum pomp_balance_policy policy)
+{
+	int res = 0;
+	uint32_t i = 0;
+
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(addrs != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(addrlens != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(addrcount != 0, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conncount != 0, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(policy == POMP_BALANCE_POLICY_ROUND_ROBIN
+			|| policy == POMP_BALANCE_POLICY_LEAST_QUEUED
+			|| policy == POMP_BALANCE_POLICY_HASH, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL, -EBUSY);
+	for (i = 0; i < addrcount; i++)
+		POMP_RETURN_ERR_IF_FAILED(addrs[i] != NULL, -EINVAL);
+
+	ctx->cpool.members = calloc(conncount, sizeof(*ctx->cpool.members));
+	if (ctx->cpool.members == NULL)
+		return -ENOMEM;
+	ctx->cpool.count = conncount;
+	ctx->cpool.policy = policy;
+	ctx->cpool.next = 0;
+
+	/* The pooled context is a client of its first address */
+	ctx->addr = malloc(addrlens[0]);
+	if (ctx->addr == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+	ctx->addrlen = addrlens[0];
+	memcpy(ctx->addr, addrs[0], addrlens[0]);
+	ctx->type = POMP_CTX_TYPE_CLIENT;
+	ctx->u.client.fd = -1;
+	ctx->u.client.conn = NULL;
+
+	/* Spread connections over the addresses */
+	for (i = 0; i < conncount; i++) {
+		res = client_pool_new_member(ctx, addrs[i % addrcount],
+				addrlens[i % addrcount],
+				&ctx->cpool.members[i]);
+		if (res < 0)
+			goto error;
+	}
+
+	return 0;
+
+	/* Cleanup in case of error */
+error:
+	if (ctx->addr != NULL) {
+		pomp_ctx_stop(ctx);
+	} else {
+		free(ctx->cpool.members);
+		ctx->cpool.members = NULL;
+		ctx->cpool.count = 0;
+	}
+	return res;
+}
+
 /*
  * See documentation in public header.
  */
@@ -1041,6 +3507,7 @@ int pomp_ctx_bind(struct pomp_ctx *ctx,
  */
 int pomp_ctx_stop(struct pomp_ctx *ctx)
 {
+	int res = 0;
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
 
 	if (ctx->addr == NULL)
@@ -1050,7 +3517,11 @@ int pomp_ctx_stop(struct pomp_ctx *ctx)
 	ctx->stopping = 1;
 	switch (ctx->type) {
 	case POMP_CTX_TYPE_SERVER:
-		server_stop(ctx);
+		res = server_stop(ctx);
+		if (res < 0) {
+			ctx->stopping = 0;
+			return res;
+		}
 		break;
 
 	case POMP_CTX_TYPE_CLIENT:
@@ -1067,6 +3538,7 @@ int pomp_ctx_stop(struct pomp_ctx *ctx)
 	free(ctx->addr);
 	ctx->addr = NULL;
 	ctx->stopping = 0;
+	(void)ctx_heartbeat_update(ctx);
 	return 0;
 }
 
@@ -1121,7 +3593,27 @@ struct pomp_loop *pomp_ctx_get_loop(struct pomp_ctx *ctx)
 struct pomp_conn *pomp_ctx_get_next_conn(const struct pomp_ctx *ctx,
 		const struct pomp_conn *prev)
 {
+	uint32_t i = 0;
+	const struct pomp_ctx *member = NULL;
+
 	POMP_RETURN_VAL_IF_FAILED(ctx != NULL, -EINVAL, NULL);
+
+	/* Connected clients of a pool, following the one of prev */
+	if (ctx->type == POMP_CTX_TYPE_CLIENT && ctx->cpool.members != NULL) {
+		if (prev != NULL) {
+			member = pomp_conn_get_ctx(prev);
+			while (i < ctx->cpool.count
+					&& ctx->cpool.members[i++] != member)
+				;
+		}
+		for (; i < ctx->cpool.count; i++) {
+			member = ctx->cpool.members[i];
+			if (member != NULL && member->u.client.conn != NULL)
+				return member->u.client.conn;
+		}
+		return NULL;
+	}
+
 	POMP_RETURN_VAL_IF_FAILED(ctx->type == POMP_CTX_TYPE_SERVER,
 			-EINVAL, NULL);
 	return prev == NULL ? ctx->u.server.conns : pomp_conn_get_next(prev);
@@ -1135,6 +3627,8 @@ struct pomp_conn *pomp_ctx_get_conn(const struct pomp_ctx *ctx)
 	POMP_RETURN_VAL_IF_FAILED(ctx != NULL, -EINVAL, NULL);
 	POMP_RETURN_VAL_IF_FAILED(ctx->type == POMP_CTX_TYPE_CLIENT,
 			-EINVAL, NULL);
+	if (ctx->cpool.members != NULL)
+		return pomp_ctx_get_next_conn(ctx, NULL);
 	return ctx->u.client.conn;
 }
 
@@ -1158,6 +3652,29 @@ const struct sockaddr *pomp_ctx_get_local_addr(struct pomp_ctx *ctx,
 	}
 }
 
+/**
+ * Post a broadcast to the workers of a server.
+ * @param ctx : context.
+ * @param msg : message to broadcast or NULL.
+ * @param buf : raw buffer to broadcast or NULL.
+ * @return 0 in case of success, negative errno value in case of error
+ * (first error encountered, the others workers are still tried).
+ */
+static int server_post_send(struct pomp_ctx *ctx,
+		const struct pomp_msg *msg, struct pomp_buffer *buf)
+{
+	int res = 0, err = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < ctx->workers.count; i++) {
+		err = worker_post(&ctx->workers.entries[i], &worker_send_cb,
+				-1, NULL, msg, buf);
+		if (err < 0 && res == 0)
+			res = err;
+	}
+	return res;
+}
+
 /*
  * See documentation in public header.
  */
@@ -1169,8 +3686,26 @@ int pomp_ctx_send_msg(struct pomp_ctx *ctx, const struct pomp_msg *msg)
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
 
+	/* Handlers running in the pool let the loop send the message */
+	if (pomp_ctx_is_pool_thread(ctx))
+		return pomp_ctx_post_msg(ctx, NULL, msg);
+
 	switch (ctx->type) {
 	case POMP_CTX_TYPE_SERVER:
+		/* Let each worker send to its own connections */
+		if (ctx->workers.count > 0) {
+			res = server_post_send(ctx, msg, NULL);
+			break;
+		}
+
+		/* Only send to subscribed connections if enabled */
+		if (ctx->subtable != NULL) {
+			(void)pomp_sub_table_foreach(ctx->subtable,
+					msg->msgid, &server_send_msg_cb,
+					(void *)msg);
+			break;
+		}
+
 		/* Broadcast to all connections, ignore errors */
 		conn = ctx->u.server.conns;
 		while (conn != NULL) {
@@ -1180,9 +3715,11 @@ int pomp_ctx_send_msg(struct pomp_ctx *ctx, const struct pomp_msg *msg)
 		break;
 
 	case POMP_CTX_TYPE_CLIENT:
-		/* Send if connected */
-		if (ctx->u.client.conn != NULL)
-			res = pomp_conn_send_msg(ctx->u.client.conn, msg);
+		/* Send if connected, pools hash on message id by default */
+		conn = ctx->cpool.members == NULL ? ctx->u.client.conn :
+				client_pool_pick(ctx, msg->msgid);
+		if (conn != NULL)
+			res = pomp_conn_send_msg(conn, msg);
 		else
 			res = -ENOTCONN;
 		break;
@@ -1195,6 +3732,36 @@ int pomp_ctx_send_msg(struct pomp_ctx *ctx, const struct pomp_msg *msg)
 	return res;
 }
 
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_send_msg_async(struct pomp_ctx *ctx, const struct pomp_msg *msg)
+{
+	return pomp_ctx_post_msg(ctx, NULL, msg);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_send_msg_key(struct pomp_ctx *ctx, uint32_t key,
+		const struct pomp_msg *msg)
+{
+	struct pomp_conn *conn = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+
+	/* Key only matters to pools, handlers running in the thread pool let
+	 * the loop send the message */
+	if (ctx->type != POMP_CTX_TYPE_CLIENT || ctx->cpool.members == NULL
+			|| pomp_ctx_is_pool_thread(ctx)) {
+		return pomp_ctx_send_msg(ctx, msg);
+	}
+
+	conn = client_pool_pick(ctx, key);
+	return conn != NULL ? pomp_conn_send_msg(conn, msg) : -ENOTCONN;
+}
+
 /*
  * See documentation in public header.
  */
@@ -1257,6 +3824,12 @@ int pomp_ctx_send_raw_buf(struct pomp_ctx *ctx, struct pomp_buffer *buf)
 
 	switch (ctx->type) {
 	case POMP_CTX_TYPE_SERVER:
+		/* Let each worker send to its own connections */
+		if (ctx->workers.count > 0) {
+			res = server_post_send(ctx, NULL, buf);
+			break;
+		}
+
 		/* Broadcast to all connections, ignore errors */
 		conn = ctx->u.server.conns;
 		while (conn != NULL) {
@@ -1267,8 +3840,10 @@ int pomp_ctx_send_raw_buf(struct pomp_ctx *ctx, struct pomp_buffer *buf)
 
 	case POMP_CTX_TYPE_CLIENT:
 		/* Send if connected */
-		if (ctx->u.client.conn != NULL)
-			res = pomp_conn_send_raw_buf(ctx->u.client.conn, buf);
+		conn = ctx->cpool.members == NULL ? ctx->u.client.conn :
+				client_pool_pick(ctx, 0);
+		if (conn != NULL)
+			res = pomp_conn_send_raw_buf(conn, buf);
 		else
 			res = -ENOTCONN;
 		break;
@@ -1297,6 +3872,106 @@ int pomp_ctx_send_raw_buf_to(struct pomp_ctx *ctx, struct pomp_buffer *buf,
 	return pomp_conn_send_raw_buf_to(ctx->u.dgram.conn, buf, addr, addrlen);
 }
 
+/**
+ * Update subscriptions of a client.
+ * @param ctx : context.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @param subscribe : 1 to subscribe, 0 to unsubscribe.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int client_update_subs(struct pomp_ctx *ctx,
+		uint32_t first, uint32_t last, int subscribe)
+{
+	int res = 0;
+	uint32_t i = 0, msgid = 0;
+
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(first <= last, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(ctx->addr == NULL
+			|| ctx->type == POMP_CTX_TYPE_CLIENT, -EINVAL);
+
+	/* Record subscription to restore it after reconnection */
+	if (subscribe) {
+		res = pomp_sub_set_add(&ctx->subs, first, last);
+		msgid = POMP_MSGID_SUBSCRIBE;
+	} else {
+		res = pomp_sub_set_remove(&ctx->subs, first, last);
+		msgid = POMP_MSGID_UNSUBSCRIBE;
+	}
+	if (res < 0)
+		return res;
+
+	/* Clients of a pool send it on their own connection */
+	if (ctx->addr != NULL && ctx->cpool.members != NULL) {
+		for (i = 0; i < ctx->cpool.count; i++) {
+			(void)client_update_subs(ctx->cpool.members[i],
+					first, last, subscribe);
+		}
+		return 0;
+	}
+
+	/* Send it now if connected */
+	if (ctx->addr != NULL && ctx->u.client.conn != NULL) {
+		res = pomp_conn_send(ctx->u.client.conn, msgid, "%u%u",
+				first, last);
+	}
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_subscribe(struct pomp_ctx *ctx, uint32_t first, uint32_t last)
+{
+	return client_update_subs(ctx, first, last, 1);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_ctx_unsubscribe(struct pomp_ctx *ctx, uint32_t first, uint32_t last)
+{
+	return client_update_subs(ctx, first, last, 0);
+}
+
+/**
+ * Handle a subscription message received by a server.
+ * @param ctx : context.
+ * @param conn : connection on which the message has been received.
+ * @param msg : subscription message.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int server_process_sub_msg(struct pomp_ctx *ctx,
+		struct pomp_conn *conn, const struct pomp_msg *msg)
+{
+	int res = 0;
+	uint32_t first = 0, last = 0;
+	struct pomp_sub_table *subtable = ctx->subtable;
+	struct pomp_ctx_worker *worker = NULL;
+
+	res = pomp_msg_read(msg, "%u%u", &first, &last);
+	if (res < 0)
+		return res;
+	if (first > last) {
+		POMP_LOGW("Invalid subscription range [%u, %u]", first, last);
+		return -EINVAL;
+	}
+
+	/* Connections of a worker use its own table */
+	worker = server_find_worker(ctx, conn);
+	if (worker != NULL) {
+		if (worker->subtable == NULL)
+			worker->subtable = pomp_sub_table_new();
+		if (worker->subtable == NULL)
+			return -ENOMEM;
+		subtable = worker->subtable;
+	}
+
+	return pomp_sub_table_update(subtable, conn, first, last,
+			msg->msgid == POMP_MSGID_SUBSCRIBE);
+}
+
 /**
  * Remove a connection from the context.
  * @param ctx : context.
@@ -1307,7 +3982,9 @@ int pomp_ctx_send_raw_buf_to(struct pomp_ctx *ctx, struct pomp_buffer *buf,
 int pomp_ctx_remove_conn(struct pomp_ctx *ctx, struct pomp_conn *conn)
 {
 	int found = 0;
-	struct pomp_conn *prev = NULL;
+	struct pomp_ctx_worker *worker = NULL;
+	struct pomp_sub_table *subtable = NULL;
+	struct pomp_rpc *rpc = NULL;
 
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
@@ -1315,25 +3992,18 @@ int pomp_ctx_remove_conn(struct pomp_ctx *ctx, struct pomp_conn *conn)
 	/* Remove from server / client */
 	switch (ctx->type) {
 	case POMP_CTX_TYPE_SERVER:
-		if (ctx->u.server.conns == conn) {
-			/* This was the first in the list */
-			ctx->u.server.conns = pomp_conn_get_next(conn);
-			ctx->u.server.conncount--;
-			found = 1;
+		worker = server_find_worker(ctx, conn);
+		if (worker != NULL) {
+			found = conn_list_remove(&worker->conns, conn);
+			if (found) {
+				pomp_mutex_lock(&ctx->workers.mutex);
+				worker->conncount--;
+				pomp_mutex_unlock(&ctx->workers.mutex);
+			}
 		} else {
-			prev = ctx->u.server.conns;
-			while (prev != NULL) {
-				if (pomp_conn_get_next(prev) != conn) {
-					prev = pomp_conn_get_next(prev);
-					continue;
-				}
-
-				pomp_conn_set_next(prev,
-						pomp_conn_get_next(conn));
+			found = conn_list_remove(&ctx->u.server.conns, conn);
+			if (found)
 				ctx->u.server.conncount--;
-				found = 1;
-				break;
-			}
 		}
 		break;
 
@@ -1355,6 +4025,20 @@ int pomp_ctx_remove_conn(struct pomp_ctx *ctx, struct pomp_conn *conn)
 	if (!found)
 		POMP_LOGE("conn %p not found in ctx %p", conn, ctx);
 
+	/* Forget its subscriptions */
+	subtable = worker != NULL ? worker->subtable : ctx->subtable;
+	if (ctx->type == POMP_CTX_TYPE_SERVER && subtable != NULL)
+		pomp_sub_table_remove_conn(subtable, conn);
+
+	/* Cancel its pending rpc requests */
+	rpc = worker != NULL ? worker->rpc : ctx->rpc;
+	if (rpc != NULL)
+		pomp_rpc_cancel_conn(rpc, conn);
+
+	/* Drop its queued messages and wait for its running handler */
+	if (ctx->pool != NULL)
+		pomp_pool_cancel_key(ctx->pool, conn);
+
 	/* Notify user */
 	if (ctx->type != POMP_CTX_TYPE_DGRAM)
 		pomp_ctx_notify_event(ctx, POMP_EVENT_DISCONNECTED, conn);
@@ -1366,7 +4050,7 @@ int pomp_ctx_remove_conn(struct pomp_ctx *ctx, struct pomp_conn *conn)
 	/* Reconnect client if needed */
 	if (ctx->type == POMP_CTX_TYPE_CLIENT
 			&& !ctx->stopping && ctx->addr != NULL) {
-		pomp_timer_set(ctx->timer, POMP_CLIENT_RECONNECT_DELAY);
+		ctx_reconnect_schedule(ctx);
 	}
 
 	return 0;
@@ -1391,6 +4075,22 @@ int pomp_ctx_notify_event(struct pomp_ctx *ctx, enum pomp_event event,
 	return 0;
 }
 
+/**
+ * Find the rpc context associated with a connection.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @return rpc context or NULL if not created yet.
+ */
+static struct pomp_rpc *ctx_find_rpc(struct pomp_ctx *ctx,
+		const struct pomp_conn *conn)
+{
+	struct pomp_ctx_worker *worker = NULL;
+
+	if (ctx->type == POMP_CTX_TYPE_SERVER)
+		worker = server_find_worker(ctx, conn);
+	return worker != NULL ? worker->rpc : ctx->rpc;
+}
+
 /**
  * Notify a message event.
  * @param ctx : context.
@@ -1401,15 +4101,69 @@ int pomp_ctx_notify_event(struct pomp_ctx *ctx, enum pomp_event event,
 int pomp_ctx_notify_msg(struct pomp_ctx *ctx, struct pomp_conn *conn,
 		const struct pomp_msg *msg)
 {
+	struct pomp_rpc *rpc = NULL;
+
 	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(ctx->eventcb != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
 
+	/* Subscription messages are handled internally */
+	if (ctx->type == POMP_CTX_TYPE_SERVER && ctx->subtable != NULL
+			&& (msg->msgid == POMP_MSGID_SUBSCRIBE
+			|| msg->msgid == POMP_MSGID_UNSUBSCRIBE)) {
+		return server_process_sub_msg(ctx, conn, msg);
+	}
+
+	/* Heartbeats are answered and measured internally */
+	if (msg->msgid == POMP_MSGID_PING || msg->msgid == POMP_MSGID_PONG)
+		return pomp_conn_process_heartbeat(conn, msg);
+
+	/* Rpc messages are unwrapped */
+	if (msg->msgid == POMP_MSGID_RPC_REQUEST)
+		return pomp_rpc_process_request(ctx, conn, msg);
+	if (msg->msgid == POMP_MSGID_RPC_REPLY) {
+		rpc = ctx_find_rpc(ctx, conn);
+		return rpc == NULL ? -ENOENT :
+				pomp_rpc_process_reply(rpc, conn, msg);
+	}
+
+	/* Let a thread of the pool handle it */
+	if (ctx->pool != NULL)
+		return pomp_pool_push(ctx->pool, conn, msg);
+
 	(*ctx->eventcb)(ctx, POMP_EVENT_MSG, conn, msg, ctx->userdata);
 	return 0;
 }
 
+/**
+ * Get the rpc context used by a connection, create it if needed.
+ * Connections owned by a worker loop use the rpc context of the worker.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @return rpc context or NULL in case of error.
+ */
+struct pomp_rpc *pomp_ctx_get_rpc(struct pomp_ctx *ctx,
+		struct pomp_conn *conn)
+{
+	struct pomp_ctx_worker *worker = NULL;
+
+	POMP_RETURN_VAL_IF_FAILED(ctx != NULL, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(conn != NULL, -EINVAL, NULL);
+
+	if (ctx->type == POMP_CTX_TYPE_SERVER)
+		worker = server_find_worker(ctx, conn);
+	if (worker != NULL) {
+		if (worker->rpc == NULL)
+			worker->rpc = pomp_rpc_new(worker->loop);
+		return worker->rpc;
+	}
+
+	if (ctx->rpc == NULL)
+		ctx->rpc = pomp_rpc_new(ctx->loop);
+	return ctx->rpc;
+}
+
 /**
  * Notify a raw buffer read.
  * @param ctx : context.
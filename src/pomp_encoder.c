@@ -167,6 +167,32 @@ static int encoder_write_size_u32(struct pomp_encoder *enc, uint32_t n)
 	return encoder_write_varint(enc, 0, d);
 }
 
+/**
+ * Write fixed size data in message and return the slot where it was put.
+ * @param enc : encoder.
+ * @param type : data type.
+ * @param p : data to write.
+ * @param n : data size.
+ * @param slot : returned offset of data in message.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int encoder_write_slot(struct pomp_encoder *enc, uint8_t type,
+		const void *p, size_t n, uint32_t *slot)
+{
+	int res = 0;
+	POMP_RETURN_ERR_IF_FAILED(enc != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(enc->msg != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(!enc->msg->finished, -EPERM);
+	POMP_RETURN_ERR_IF_FAILED(slot != NULL, -EINVAL);
+
+	res = encoder_write_data(enc, type, p, n);
+	if (res < 0)
+		return res;
+
+	*slot = (uint32_t)(enc->pos - n);
+	return 0;
+}
+
 /**
  * Extract an argument from either a va_list or an array of string arguments
  * _type : type of argument, will be stored in 'v' union.
@@ -676,3 +702,131 @@ int pomp_encoder_write_fd(struct pomp_encoder *enc, int v)
 	/* Write file descriptor */
 	return pomp_buffer_write_fd(enc->msg->buf, &enc->pos, v);
 }
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_i8(struct pomp_encoder *enc, int8_t v,
+		uint32_t *slot)
+{
+	uint8_t d = (uint8_t)v;
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_I8,
+			&d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_u8(struct pomp_encoder *enc, uint8_t v,
+		uint32_t *slot)
+{
+	uint8_t d = v;
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_U8,
+			&d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_i16(struct pomp_encoder *enc, int16_t v,
+		uint32_t *slot)
+{
+	uint16_t d = POMP_HTOLE16(v);
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_I16,
+			&d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_u16(struct pomp_encoder *enc, uint16_t v,
+		uint32_t *slot)
+{
+	uint16_t d = POMP_HTOLE16(v);
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_U16,
+			&d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_i32(struct pomp_encoder *enc, int32_t v,
+		uint32_t *slot)
+{
+	uint8_t d[POMP_PROT_VARINT32_SLOT_SIZE];
+	/* Zigzag encoding, use arithmetic right shift, with sign propagation */
+	pomp_prot_encode_varint_slot(d, sizeof(d),
+			(uint32_t)((v << 1) ^ (v >> 31)));
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_I32,
+			d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_u32(struct pomp_encoder *enc, uint32_t v,
+		uint32_t *slot)
+{
+	uint8_t d[POMP_PROT_VARINT32_SLOT_SIZE];
+	pomp_prot_encode_varint_slot(d, sizeof(d), v);
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_U32,
+			d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_i64(struct pomp_encoder *enc, int64_t v,
+		uint32_t *slot)
+{
+	uint8_t d[POMP_PROT_VARINT64_SLOT_SIZE];
+	/* Zigzag encoding, use arithmetic right shift, with sign propagation */
+	pomp_prot_encode_varint_slot(d, sizeof(d),
+			(uint64_t)((v << 1) ^ (v >> 63)));
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_I64,
+			d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_u64(struct pomp_encoder *enc, uint64_t v,
+		uint32_t *slot)
+{
+	uint8_t d[POMP_PROT_VARINT64_SLOT_SIZE];
+	pomp_prot_encode_varint_slot(d, sizeof(d), v);
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_U64,
+			d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_f32(struct pomp_encoder *enc, float v,
+		uint32_t *slot)
+{
+	union {
+		float f32;
+		uint32_t u32;
+	} d;
+	d.f32 = v;
+	d.u32 = POMP_HTOLE32(d.u32);
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_F32,
+			&d, sizeof(d), slot);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_encoder_write_slot_f64(struct pomp_encoder *enc, double v,
+		uint32_t *slot)
+{
+	union {
+		double f64;
+		uint64_t u64;
+	} d;
+	d.f64 = v;
+	d.u64 = POMP_HTOLE64(d.u64);
+	return encoder_write_slot(enc, POMP_PROT_DATA_TYPE_F64,
+			&d, sizeof(d), slot);
+}
@@ -63,6 +63,16 @@ const struct pomp_loop_ops *pomp_loop_set_ops(const struct pomp_loop_ops *ops)
 	return prev;
 }
 
+/**
+ * Determine if the loop implementation supports edge-triggered
+ * notifications (POMP_FD_EVENT_ET).
+ * @return 1 if supported, 0 otherwise.
+ */
+int pomp_loop_has_edge_triggered(void)
+{
+	return s_pomp_loop_ops->has_edge_triggered;
+}
+
 /**
  * Implementation specific 'new' operation.
  * @param loop : loop.
@@ -91,6 +101,7 @@ static int pomp_loop_do_destroy(struct pomp_loop *loop)
  */
 static int pomp_loop_do_add(struct pomp_loop *loop, struct pomp_fd *pfd)
 {
+	loop->stats.fd_changes++;
 	return (*s_pomp_loop_ops->do_add)(loop, pfd);
 }
 
@@ -102,6 +113,7 @@ static int pomp_loop_do_add(struct pomp_loop *loop, struct pomp_fd *pfd)
  */
 static int pomp_loop_do_update(struct pomp_loop *loop, struct pomp_fd *pfd)
 {
+	loop->stats.fd_changes++;
 	return (*s_pomp_loop_ops->do_update)(loop, pfd);
 }
 
@@ -113,6 +125,7 @@ static int pomp_loop_do_update(struct pomp_loop *loop, struct pomp_fd *pfd)
  */
 static int pomp_loop_do_remove(struct pomp_loop *loop, struct pomp_fd *pfd)
 {
+	loop->stats.fd_changes++;
 	return (*s_pomp_loop_ops->do_remove)(loop, pfd);
 }
 
@@ -134,9 +147,56 @@ static intptr_t pomp_loop_do_get_fd(struct pomp_loop *loop)
  */
 static int pomp_loop_do_wait_and_process(struct pomp_loop *loop, int timeout)
 {
+	loop->stats.waits++;
 	return (*s_pomp_loop_ops->do_wait_and_process)(loop, timeout);
 }
 
+/**
+ * Check for events without blocking until one is found or the busy poll
+ * time of the loop is elapsed.
+ * @param loop : loop.
+ * @param timeout : timeout of wait (in ms) or -1 for infinite wait, updated
+ * with the time remaining after spinning.
+ * @return 0 if events were processed, -ETIMEDOUT if none were found,
+ * negative errno value in case of error.
+ */
+static int pomp_loop_busy_poll(struct pomp_loop *loop, int *timeout)
+{
+	int res = 0;
+	uint64_t start = 0, now = 0, elapsed = 0;
+
+	res = time_get_monotonic_us(&start);
+	if (res < 0)
+		return -ETIMEDOUT;
+
+	/* Spinning checks are not counted as waits unless they succeed */
+	for (;;) {
+		res = (*s_pomp_loop_ops->do_wait_and_process)(loop, 0);
+		if (res != -ETIMEDOUT) {
+			loop->stats.waits++;
+			loop->stats.busy_polls++;
+			return res;
+		}
+
+		if (time_get_monotonic_us(&now) < 0)
+			break;
+		elapsed = now - start;
+		if (elapsed >= loop->busypoll)
+			break;
+		if (*timeout > 0 && elapsed >= (uint64_t)*timeout * 1000)
+			break;
+		pomp_cpu_relax();
+	}
+
+	/* Remaining time for the blocking wait */
+	if (*timeout > 0) {
+		elapsed /= 1000;
+		*timeout = elapsed >= (uint64_t)*timeout ?
+				0 : *timeout - (int)elapsed;
+	}
+	return -ETIMEDOUT;
+}
+
 /**
  * Implementation specific 'wakeup' operation.
  * @param loop : loop.
@@ -148,33 +208,142 @@ static int pomp_loop_do_wakeup(struct pomp_loop *loop)
 }
 
 /**
- * Check if there is some idle entries to call.
+ * Get the hash table bucket of idle entries for a callback and user data.
+ * @param loop : loop.
+ * @param cb : callback.
+ * @param userdata : user data.
+ * @return address of the head of the bucket.
+ */
+static struct pomp_idle_entry **pomp_loop_idle_bucket(struct pomp_loop *loop,
+		pomp_idle_cb_t cb, void *userdata)
+{
+	uintptr_t key = (uintptr_t)cb ^ ((uintptr_t)userdata * 31);
+	key ^= key >> 16;
+	key ^= key >> 7;
+	return &loop->idle.buckets[key % POMP_LOOP_IDLE_BUCKETS];
+}
+
+/**
+ * Remove an idle entry from the queue and the hash table, and put it back
+ * in the pool of free entries.
+ * @param loop : loop.
+ * @param entry : entry to release.
+ */
+static void pomp_loop_idle_release(struct pomp_loop *loop,
+		struct pomp_idle_entry *entry)
+{
+	struct pomp_idle_entry **bucket = NULL;
+
+	/* End of current run moves back if its last entry is removed */
+	if (loop->idle.last == entry)
+		loop->idle.last = entry->prev;
+
+	/* Queue */
+	if (entry->prev != NULL)
+		entry->prev->next = entry->next;
+	else
+		loop->idle.head = entry->next;
+	if (entry->next != NULL)
+		entry->next->prev = entry->prev;
+	else
+		loop->idle.tail = entry->prev;
+
+	/* Hash table */
+	if (entry->hprev != NULL) {
+		entry->hprev->hnext = entry->hnext;
+	} else {
+		bucket = pomp_loop_idle_bucket(loop, entry->cb,
+				entry->userdata);
+		*bucket = entry->hnext;
+	}
+	if (entry->hnext != NULL)
+		entry->hnext->hprev = entry->hprev;
+
+	/* Pool */
+	memset(entry, 0, sizeof(*entry));
+	entry->next = loop->idle.pool;
+	loop->idle.pool = entry;
+}
+
+/**
+ * Check if there is some idle entries to call. Entries registered by the
+ * callbacks are called during the next check.
  * @param loop : loop.
  * @return 0 in case of success, negative errno value in case of error.
  */
 static int pomp_loop_idle_check(struct pomp_loop *loop)
 {
-	uint32_t i = 0;
 	struct pomp_idle_entry *entry = NULL;
+	pomp_idle_cb_t cb = NULL;
+	void *userdata = NULL;
+	uint64_t start = 0, now = 0;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
-	POMP_RETURN_ERR_IF_FAILED(!loop->idle_pending, -EPERM);
+	POMP_RETURN_ERR_IF_FAILED(!loop->idle.running, -EPERM);
 
-	if (loop->idle_count == 0)
+	if (loop->idle.head == NULL)
 		return 0;
 
-	/* Call registered entries, preventing modification during the loop */
-	loop->idle_pending = 1;
-	for (i = 0; i < loop->idle_count; i++) {
-		entry = &loop->idle_entries[i];
+	if (loop->idle.budget > 0 && time_get_monotonic_us(&start) < 0)
+		start = 0;
+
+	/* Call entries up to the current tail, the entry is released before
+	 * the call so it can register itself again */
+	loop->idle.running = 1;
+	loop->idle.last = loop->idle.tail;
+	while (loop->idle.last != NULL) {
+		entry = loop->idle.head;
+		if (entry == loop->idle.last)
+			loop->idle.last = NULL;
+		cb = entry->cb;
+		userdata = entry->userdata;
+		pomp_loop_idle_release(loop, entry);
+		(*cb)(userdata);
+
+		/* Remaining entries are kept for next check */
+		if (loop->idle.budget > 0 && start != 0 &&
+				time_get_monotonic_us(&now) == 0 &&
+				now - start >= loop->idle.budget) {
+			loop->idle.last = NULL;
+		}
+	}
+	loop->idle.running = 0;
+
+	return 0;
+}
+
+/**
+ * Call functions posted from other threads.
+ * @param loop : loop.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_loop_post_check(struct pomp_loop *loop)
+{
+	struct pomp_post_entry *entry = NULL;
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+
+	/* Detach current queue, entries posted by callbacks will be handled
+	 * during next iteration */
+	pomp_mutex_lock(&loop->post.mutex);
+	loop->post.running = loop->post.head;
+	loop->post.head = NULL;
+	loop->post.tail = NULL;
+	pomp_mutex_unlock(&loop->post.mutex);
+
+	/* Entries are taken one by one so they can still be removed by
+	 * previous callbacks */
+	for (;;) {
+		pomp_mutex_lock(&loop->post.mutex);
+		entry = loop->post.running;
+		if (entry != NULL)
+			loop->post.running = entry->next;
+		pomp_mutex_unlock(&loop->post.mutex);
+
+		if (entry == NULL)
+			break;
 		if (!entry->removed)
 			(*entry->cb)(entry->userdata);
+		free(entry);
 	}
-	loop->idle_pending = 0;
-
-	/* Free entries */
-	free(loop->idle_entries);
-	loop->idle_entries = NULL;
-	loop->idle_count = 0;
 
 	return 0;
 }
@@ -218,6 +387,7 @@ struct pomp_fd *pomp_loop_add_pfd(struct pomp_loop *loop, int fd,
 	/* Initialize structure */
 	pfd->fd = fd;
 	pfd->events = events;
+	pfd->regevents = events;
 	pfd->cb = cb;
 	pfd->userdata = userdata;
 	pfd->next = NULL;
@@ -230,6 +400,117 @@ struct pomp_fd *pomp_loop_add_pfd(struct pomp_loop *loop, int fd,
 	return pfd;
 }
 
+/**
+ * Remove a fd from the list of deferred updates.
+ * @param loop : loop.
+ * @param pfd : fd structure in the list.
+ */
+static void pomp_loop_unlink_change(struct pomp_loop *loop,
+		struct pomp_fd *pfd)
+{
+	if (pfd->prevchange != NULL)
+		pfd->prevchange->nextchange = pfd->nextchange;
+	else
+		loop->changes = pfd->nextchange;
+	if (pfd->nextchange != NULL)
+		pfd->nextchange->prevchange = pfd->prevchange;
+	pfd->nextchange = NULL;
+	pfd->prevchange = NULL;
+	pfd->changed = 0;
+}
+
+/**
+ * Apply the events of a fd to the implementation.
+ * @param loop : loop.
+ * @param pfd : fd structure.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_loop_apply_pfd(struct pomp_loop *loop, struct pomp_fd *pfd)
+{
+	int res = 0;
+
+	/* Nothing to do if unchanged, except for edge-triggered fds where a
+	 * modification re-arms the notification */
+	if (pfd->events == pfd->regevents &&
+			(pfd->events & POMP_FD_EVENT_ET) == 0) {
+		loop->stats.fd_coalesced++;
+		return 0;
+	}
+
+	res = pomp_loop_do_update(loop, pfd);
+	if (res < 0)
+		pfd->events = pfd->regevents;
+	else
+		pfd->regevents = pfd->events;
+	return res;
+}
+
+/**
+ * Apply updates deferred while processing events, so several updates of
+ * the same fd during an iteration cost at most one call to the
+ * implementation.
+ * @param loop : loop.
+ */
+static void pomp_loop_apply_changes(struct pomp_loop *loop)
+{
+	int res = 0;
+	struct pomp_fd *pfd = NULL;
+
+	while (loop->changes != NULL) {
+		pfd = loop->changes;
+		pomp_loop_unlink_change(loop, pfd);
+
+		/* The caller already got 0, keep the error for its next
+		 * update of the fd */
+		res = pomp_loop_apply_pfd(loop, pfd);
+		if (res < 0) {
+			POMP_LOGE("update(fd=%d) events=0x%x err=%d(%s)",
+					pfd->fd, pfd->events, -res,
+					strerror(-res));
+			pfd->changeerr = res;
+		}
+	}
+}
+
+/**
+ * Update the events of a fd. While events are processed, the update is
+ * recorded and applied before the next wait. An error of the implementation
+ * when a deferred update is applied is returned by the next update of the
+ * fd, which is then not done.
+ * @param loop : loop.
+ * @param pfd : fd structure.
+ * @param events : new events to monitor.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_loop_update_pfd(struct pomp_loop *loop, struct pomp_fd *pfd,
+		uint32_t events)
+{
+	int res = 0;
+
+	/* Report the failure of a previous deferred update */
+	if (pfd->changeerr < 0) {
+		res = pfd->changeerr;
+		pfd->changeerr = 0;
+		return res;
+	}
+
+	pfd->events = events;
+	if (!loop->processing)
+		return pomp_loop_apply_pfd(loop, pfd);
+
+	if (pfd->changed) {
+		loop->stats.fd_coalesced++;
+	} else {
+		pfd->changed = 1;
+		pfd->prevchange = NULL;
+		pfd->nextchange = loop->changes;
+		if (loop->changes != NULL)
+			loop->changes->prevchange = pfd;
+		loop->changes = pfd;
+	}
+	return 0;
+}
+
 /**
  * Remove a registered fd from loop.
  * @param loop : loop.
@@ -242,6 +523,12 @@ int pomp_loop_remove_pfd(struct pomp_loop *loop, struct pomp_fd *pfd)
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(pfd != NULL, -EINVAL);
 
+	/* Drop deferred update */
+	if (pfd->changed) {
+		pomp_loop_unlink_change(loop, pfd);
+		loop->stats.fd_coalesced++;
+	}
+
 	if (loop->pfds == pfd) {
 		/* This was the first in the list */
 		loop->pfds = pfd->next;
@@ -273,8 +560,16 @@ struct pomp_loop *pomp_loop_new(void)
 	if (loop == NULL)
 		return NULL;
 
+	if (pomp_mutex_init(&loop->post.mutex) < 0) {
+		free(loop);
+		return NULL;
+	}
+
+	loop->maxevents = POMP_LOOP_DEFAULT_MAX_EVENTS;
+
 	/* Implementation specific */
 	if (pomp_loop_do_new(loop) < 0) {
+		pomp_mutex_clear(&loop->post.mutex);
 		free(loop);
 		return NULL;
 	}
@@ -283,6 +578,25 @@ struct pomp_loop *pomp_loop_new(void)
 	return loop;
 }
 
+/**
+ * Determine if a loop still monitors fds registered by its users. The fd of
+ * the shared timer of timers with slack is internal.
+ * @param loop : loop.
+ * @return 1 if some fds are registered by users, 0 otherwise.
+ */
+static int pomp_loop_has_user_fds(const struct pomp_loop *loop)
+{
+	const struct pomp_fd *pfd = NULL;
+
+	for (pfd = loop->pfds; pfd != NULL; pfd = pfd->next) {
+		if (loop->slack.timer == NULL
+				|| pfd->userdata != loop->slack.timer) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 /*
  * See documentation in public header.
  */
@@ -290,6 +604,14 @@ int pomp_loop_destroy(struct pomp_loop *loop)
 {
 	int res = 0;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(loop->slack.timers == NULL, -EBUSY);
+	POMP_RETURN_ERR_IF_FAILED(!pomp_loop_has_user_fds(loop), -EBUSY);
+
+	/* Shared timer of timers with slack is internal, only release it once
+	 * the loop is known to be destroyed */
+	res = pomp_timer_release_slack(loop);
+	if (res < 0)
+		return res;
 	POMP_RETURN_ERR_IF_FAILED(loop->pfds == NULL, -EBUSY);
 
 	/* Implementation specific */
@@ -298,7 +620,19 @@ int pomp_loop_destroy(struct pomp_loop *loop)
 		return res;
 
 	/* Free resources */
-	free(loop->idle_entries);
+	while (loop->post.head != NULL) {
+		struct pomp_post_entry *entry = loop->post.head;
+		loop->post.head = entry->next;
+		free(entry);
+	}
+	pomp_mutex_clear(&loop->post.mutex);
+	while (loop->idle.head != NULL)
+		pomp_loop_idle_release(loop, loop->idle.head);
+	while (loop->idle.pool != NULL) {
+		struct pomp_idle_entry *entry = loop->idle.pool;
+		loop->idle.pool = entry->next;
+		free(entry);
+	}
 	free(loop);
 	return 0;
 }
@@ -342,9 +676,7 @@ int pomp_loop_add(struct pomp_loop *loop, int fd, uint32_t events,
  */
 int pomp_loop_update(struct pomp_loop *loop, int fd, uint32_t events)
 {
-	int res = 0;
 	struct pomp_fd *pfd = NULL;
-	uint32_t oldevents = 0;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(fd >= 0, -EINVAL);
 
@@ -356,12 +688,7 @@ int pomp_loop_update(struct pomp_loop *loop, int fd, uint32_t events)
 	}
 
 	/* Implementation specific */
-	oldevents = pfd->events;
-	pfd->events = events;
-	res = pomp_loop_do_update(loop, pfd);
-	if (res < 0)
-		pfd->events = oldevents;
-	return res;
+	return pomp_loop_update_pfd(loop, pfd, events);
 }
 
 /*
@@ -370,9 +697,7 @@ int pomp_loop_update(struct pomp_loop *loop, int fd, uint32_t events)
 int pomp_loop_update2(struct pomp_loop *loop, int fd,
 		uint32_t events_to_add, uint32_t events_to_remove)
 {
-	int res = 0;
 	struct pomp_fd *pfd = NULL;
-	uint32_t oldevents = 0;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(fd >= 0, -EINVAL);
 
@@ -384,13 +709,8 @@ int pomp_loop_update2(struct pomp_loop *loop, int fd,
 	}
 
 	/* Implementation specific */
-	oldevents = pfd->events;
-	pfd->events |= events_to_add;
-	pfd->events &= ~events_to_remove;
-	res = pomp_loop_do_update(loop, pfd);
-	if (res < 0)
-		pfd->events = oldevents;
-	return res;
+	return pomp_loop_update_pfd(loop, pfd,
+			(pfd->events | events_to_add) & ~events_to_remove);
 }
 
 /*
@@ -452,16 +772,40 @@ int pomp_loop_process_fd(struct pomp_loop *loop)
  */
 int pomp_loop_wait_and_process(struct pomp_loop *loop, int timeout)
 {
-	int res = 0;
+	int res = 0, infinite = 0;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
 
-	/* Implementation specific */
-	res = pomp_loop_do_wait_and_process(loop, timeout);
+	/* Do not block if idle entries are waiting to be called */
+	if (loop->idle.head != NULL && timeout != 0) {
+		infinite = timeout == -1;
+		timeout = 0;
+	}
+
+	/* Apply updates done by a caller processing events of this loop */
+	pomp_loop_apply_changes(loop);
+	loop->processing++;
+	loop->nowvalid = 0;
+
+	/* Implementation specific, spin before blocking if requested */
+	if (loop->busypoll > 0 && timeout != 0) {
+		res = pomp_loop_busy_poll(loop, &timeout);
+		if (res == -ETIMEDOUT && timeout != 0)
+			res = pomp_loop_do_wait_and_process(loop, timeout);
+	} else {
+		res = pomp_loop_do_wait_and_process(loop, timeout);
+	}
+
+	/* Check for functions posted by other threads */
+	pomp_loop_post_check(loop);
 
 	/* Check for idle function to call */
 	pomp_loop_idle_check(loop);
 
-	return res;
+	/* Apply updates done during this iteration */
+	loop->processing--;
+	pomp_loop_apply_changes(loop);
+
+	return infinite && res == -ETIMEDOUT ? 0 : res;
 }
 
 /*
@@ -480,43 +824,173 @@ int pomp_loop_wakeup(struct pomp_loop *loop)
 int pomp_loop_idle_add(struct pomp_loop *loop, pomp_idle_cb_t cb,
 		void *userdata)
 {
-	struct pomp_idle_entry *newentries = NULL;
+	struct pomp_idle_entry *entry = NULL;
+	struct pomp_idle_entry **bucket = NULL;
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+
+	/* Take entry from the pool or allocate it */
+	entry = loop->idle.pool;
+	if (entry != NULL) {
+		loop->idle.pool = entry->next;
+	} else {
+		entry = calloc(1, sizeof(*entry));
+		if (entry == NULL)
+			return -ENOMEM;
+	}
+	entry->cb = cb;
+	entry->userdata = userdata;
+
+	/* Append to queue */
+	entry->prev = loop->idle.tail;
+	entry->next = NULL;
+	if (loop->idle.tail != NULL)
+		loop->idle.tail->next = entry;
+	else
+		loop->idle.head = entry;
+	loop->idle.tail = entry;
+
+	/* Add in hash table */
+	bucket = pomp_loop_idle_bucket(loop, cb, userdata);
+	entry->hprev = NULL;
+	entry->hnext = *bucket;
+	if (*bucket != NULL)
+		(*bucket)->hprev = entry;
+	*bucket = entry;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_loop_idle_remove(struct pomp_loop *loop, pomp_idle_cb_t cb,
+		void *userdata)
+{
+	struct pomp_idle_entry *entry = NULL, *next = NULL;
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+
+	/* Only entries of the same bucket need to be checked */
+	entry = *pomp_loop_idle_bucket(loop, cb, userdata);
+	while (entry != NULL) {
+		next = entry->hnext;
+		if (entry->cb == cb && entry->userdata == userdata)
+			pomp_loop_idle_release(loop, entry);
+		entry = next;
+	}
+
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_loop_post(struct pomp_loop *loop, pomp_idle_cb_t cb, void *userdata)
+{
+	int wakeup = 0;
+	struct pomp_post_entry *entry = NULL;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
-	POMP_RETURN_ERR_IF_FAILED(!loop->idle_pending, -EPERM);
 
 	/* Allocate entry */
-	newentries = realloc(loop->idle_entries, (loop->idle_count + 1)
-			 * sizeof(struct pomp_idle_entry));
-	if (newentries == NULL)
+	entry = calloc(1, sizeof(*entry));
+	if (entry == NULL)
 		return -ENOMEM;
-	loop->idle_entries = newentries;
+	entry->cb = cb;
+	entry->userdata = userdata;
 
-	/* Save entry */
-	loop->idle_entries[loop->idle_count].cb = cb;
-	loop->idle_entries[loop->idle_count].userdata = userdata;
-	loop->idle_entries[loop->idle_count].removed = 0;
-	loop->idle_count++;
-	return 0;
+	/* Append to queue, only the first entry needs to wake up the loop */
+	pomp_mutex_lock(&loop->post.mutex);
+	if (loop->post.tail != NULL) {
+		loop->post.tail->next = entry;
+	} else {
+		loop->post.head = entry;
+		wakeup = 1;
+	}
+	loop->post.tail = entry;
+	pomp_mutex_unlock(&loop->post.mutex);
+
+	return wakeup ? pomp_loop_do_wakeup(loop) : 0;
 }
 
 /*
  * See documentation in public header.
  */
-int pomp_loop_idle_remove(struct pomp_loop *loop, pomp_idle_cb_t cb,
+int pomp_loop_post_remove(struct pomp_loop *loop, pomp_idle_cb_t cb,
 		void *userdata)
 {
-	uint32_t i = 0;
-	struct pomp_idle_entry *entry = NULL;
+	struct pomp_post_entry *entry = NULL;
 	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
 
-	/* Walk entries, just mark matching entries as removed, next call to
-	 * pomp_loop_idle_check will do the cleaning */
-	for (i = 0; i < loop->idle_count; i++) {
-		entry = &loop->idle_entries[i];
+	/* Just mark matching entries as removed, they are freed when the queue
+	 * is processed */
+	pomp_mutex_lock(&loop->post.mutex);
+	for (entry = loop->post.head; entry != NULL; entry = entry->next) {
+		if (entry->cb == cb && entry->userdata == userdata)
+			entry->removed = 1;
+	}
+	for (entry = loop->post.running; entry != NULL; entry = entry->next) {
 		if (entry->cb == cb && entry->userdata == userdata)
 			entry->removed = 1;
 	}
+	pomp_mutex_unlock(&loop->post.mutex);
+
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_loop_get_stats(struct pomp_loop *loop, struct pomp_loop_stats *stats)
+{
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(stats != NULL, -EINVAL);
+	*stats = loop->stats;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_loop_set_max_events(struct pomp_loop *loop, uint32_t maxevents)
+{
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(maxevents > 0, -EINVAL);
+	loop->maxevents = maxevents;
+	return 0;
+}
 
+/*
+ * See documentation in public header.
+ */
+int pomp_loop_set_busy_poll(struct pomp_loop *loop, uint32_t usecs)
+{
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	loop->busypoll = usecs;
 	return 0;
 }
+
+/*
+ * See documentation in public header.
+ */
+int pomp_loop_set_idle_budget(struct pomp_loop *loop, uint32_t usecs)
+{
+	POMP_RETURN_ERR_IF_FAILED(loop != NULL, -EINVAL);
+	loop->idle.budget = usecs;
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+uint64_t pomp_loop_now(struct pomp_loop *loop)
+{
+	POMP_RETURN_VAL_IF_FAILED(loop != NULL, -EINVAL, 0);
+
+	/* Outside of event processing, always read the clock */
+	if (loop->processing > 0 && loop->nowvalid)
+		return loop->now;
+	if (time_get_monotonic_us(&loop->now) < 0)
+		return 0;
+	loop->nowvalid = loop->processing > 0;
+	return loop->now;
+}
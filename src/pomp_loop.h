@@ -35,11 +35,37 @@
 #ifndef _POMP_LOOP_H_
 #define _POMP_LOOP_H_
 
+/**
+ * Internal flag of registered events to use edge-triggered notifications,
+ * only given when supported by the implementation.
+ */
+#define POMP_FD_EVENT_ET	0x80000000
+
+/** Initial number of events returned by a wait */
+#define POMP_LOOP_MIN_EVENTS		16
+
+/** Default maximum number of events returned by a wait */
+#define POMP_LOOP_DEFAULT_MAX_EVENTS	1024
+
+/** Number of buckets of the idle entries hash table */
+#define POMP_LOOP_IDLE_BUCKETS		64
+
 /** Idle entry */
 struct pomp_idle_entry {
 	pomp_idle_cb_t		cb;		/**< Registered callback */
 	void			*userdata;	/**< Callback user data */
+	struct pomp_idle_entry	*prev;		/**< Previous entry in queue */
+	struct pomp_idle_entry	*next;		/**< Next entry in queue/pool */
+	struct pomp_idle_entry	*hprev;		/**< Previous entry in bucket */
+	struct pomp_idle_entry	*hnext;		/**< Next entry in bucket */
+};
+
+/** Entry posted from another thread */
+struct pomp_post_entry {
+	pomp_idle_cb_t		cb;		/**< Posted callback */
+	void			*userdata;	/**< Callback user data */
 	int			removed;	/**< Entry has been removed */
+	struct pomp_post_entry	*next;		/**< Next entry in queue */
 };
 
 /** Fd structure */
@@ -50,6 +76,20 @@ struct pomp_fd {
 	void			*userdata;	/**< Callback user data */
 	struct pomp_fd		*next;		/**< Next structure in list */
 
+	uint32_t		regevents;	/**< Events known by the
+						  *  implementation */
+	int			changed;	/**< In list of changes */
+	struct pomp_fd		*nextchange;	/**< Next in list of changes */
+	struct pomp_fd		*prevchange;	/**< Previous in list of
+						  *  changes */
+	int			changeerr;	/**< Error of a deferred
+						  *  update, returned by the
+						  *  next update */
+
+#ifdef POMP_HAVE_LOOP_POLL
+	uint32_t		pollidx;	/**< Index in pollfd array */
+#endif /* POMP_HAVE_LOOP_POLL */
+
 #ifdef POMP_HAVE_LOOP_WIN32
 	HANDLE			hevt;		/**< Event for notifications */
 #endif /* POMP_HAVE_LOOP_WIN32 */
@@ -59,18 +99,54 @@ struct pomp_fd {
 struct pomp_loop {
 	struct pomp_fd		*pfds;		/**< List of registered fds */
 	uint32_t		pfdcount;	/**< Number of registered fds */
+	struct pomp_fd		*changes;	/**< Fds with deferred updates */
+	int			processing;	/**< Events being processed */
+	uint64_t		now;		/**< Time of current iteration */
+	int			nowvalid;	/**< Time of iteration was read */
+
+	/** Timers with slack, sharing a single implementation timer */
+	struct {
+		struct pomp_timer	*timers; /**< Armed timers */
+		struct pomp_timer	*timer;	/**< Shared timer */
+	} slack;
 
-	struct pomp_idle_entry	*idle_entries;	/**< Idle entries */
-	uint32_t		idle_count;	/**< Number of idle entries */
-	int			idle_pending;	/**< Idle calls in progress */
+	struct pomp_loop_stats	stats;		/**< Statistics */
+	uint32_t		maxevents;	/**< Max events per wait */
+	uint32_t		busypoll;	/**< Busy poll time (us) */
+
+	/** Idle entries */
+	struct {
+		struct pomp_idle_entry	*head;	/**< First entry of queue */
+		struct pomp_idle_entry	*tail;	/**< Last entry of queue */
+		struct pomp_idle_entry	*last;	/**< Last entry to call in
+						  *  current run */
+		struct pomp_idle_entry	*pool;	/**< Free entries */
+		int			running; /**< Entries being called */
+		uint32_t		budget;	/**< Time budget of a run (us) */
+		/** Entries by callback and user data */
+		struct pomp_idle_entry	*buckets[POMP_LOOP_IDLE_BUCKETS];
+	} idle;
+
+	/** Entries posted from other threads */
+	struct {
+		struct pomp_mutex	mutex;	/**< Protect the queue */
+		struct pomp_post_entry	*head;	/**< First entry */
+		struct pomp_post_entry	*tail;	/**< Last entry */
+		struct pomp_post_entry	*running; /**< Entries being called */
+	} post;
 
 #ifdef POMP_HAVE_LOOP_POLL
 	struct pollfd		*pollfds;	/**< Array of pollfd */
+	struct pomp_fd		**pollpfds;	/**< Fd structure of pollfds */
+	uint32_t		pollfdcount;	/**< Used entries of pollfds */
 	uint32_t		pollfdsize;	/**< Allocate size of pollfds */
 #endif /* POMP_HAVE_LOOP_POLL */
 
 #ifdef POMP_HAVE_LOOP_EPOLL
 	int			efd;		/**< epoll fd */
+	struct epoll_event	*events;	/**< Events of a wait */
+	uint32_t		eventsize;	/**< Allocated size of events */
+	int			eventsbusy;	/**< Events used by a wait */
 #endif /* POMP_HAVE_LOOP_EPOLL */
 
 	/** Wakeup notification */
@@ -125,6 +201,9 @@ struct pomp_loop_ops {
 
 	/** Implementation specific 'wakeup' operation. */
 	int (*do_wakeup)(struct pomp_loop *loop);
+
+	/** Implementation supports POMP_FD_EVENT_ET */
+	int has_edge_triggered;
 };
 
 /** Loop operations for 'poll' implementation */
@@ -146,6 +225,8 @@ extern const struct pomp_loop_ops pomp_loop_win32_ops;
 
 const struct pomp_loop_ops *pomp_loop_set_ops(const struct pomp_loop_ops *ops);
 
+int pomp_loop_has_edge_triggered(void);
+
 struct pomp_fd *pomp_loop_find_pfd(struct pomp_loop *loop, int fd);
 
 struct pomp_fd *pomp_loop_add_pfd(struct pomp_loop *loop, int fd,
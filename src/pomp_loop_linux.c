@@ -80,6 +80,8 @@ static uint32_t fd_events_to_epoll(uint32_t events)
 		res |= EPOLLERR;
 	if (events & POMP_FD_EVENT_HUP)
 		res |= EPOLLHUP;
+	if (events & POMP_FD_EVENT_ET)
+		res |= EPOLLET;
 	return res;
 }
 
@@ -122,6 +124,26 @@ static void pomp_loop_epoll_wakeup_cb(struct pomp_loop *loop)
 		POMP_LOG_FD_ERRNO("read", loop->wakeup.fd);
 }
 
+/**
+ * Resize the array of events used by waits.
+ * @param loop : loop.
+ * @param size : new number of events.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_loop_epoll_resize_events(struct pomp_loop *loop, uint32_t size)
+{
+	struct epoll_event *events = NULL;
+
+	events = realloc(loop->events, size * sizeof(*events));
+	if (events == NULL)
+		return -ENOMEM;
+
+	loop->events = events;
+	loop->eventsize = size;
+	loop->stats.batch_size = size;
+	return 0;
+}
+
 /**
  * @see pomp_loop_do_new.
  */
@@ -134,6 +156,11 @@ static int pomp_loop_epoll_do_new(struct pomp_loop *loop)
 	loop->efd = -1;
 	loop->wakeup.fd = -1;
 
+	/* Start with a small batch of events, grown on demand */
+	res = pomp_loop_epoll_resize_events(loop, POMP_LOOP_MIN_EVENTS);
+	if (res < 0)
+		goto error;
+
 	/* Create epoll fd */
 	loop->efd = epoll_create(1);
 	if (loop->efd < 0) {
@@ -177,6 +204,10 @@ error:
 		close(loop->efd);
 		loop->efd = -1;
 	}
+
+	free(loop->events);
+	loop->events = NULL;
+	loop->eventsize = 0;
 	return res;
 }
 
@@ -198,6 +229,9 @@ static int pomp_loop_epoll_do_destroy(struct pomp_loop *loop)
 		loop->efd = -1;
 	}
 
+	free(loop->events);
+	loop->events = NULL;
+	loop->eventsize = 0;
 	return 0;
 }
 
@@ -242,15 +276,25 @@ static int pomp_loop_epoll_do_wait_and_process(struct pomp_loop *loop,
 		int timeout)
 {
 	int res = 0;
-	uint32_t i = 0, nevents = 0;
-	struct epoll_event events[16];
+	uint32_t i = 0, nevents = 0, maxevents = 0;
+	struct epoll_event localevents[POMP_LOOP_MIN_EVENTS];
+	struct epoll_event *events = NULL;
 	struct pomp_fd *pfd = NULL;
 	uint32_t revents = 0;
+	int nested = loop->eventsbusy;
+
+	/* A nested wait (from a callback) can not reuse the loop array */
+	if (nested) {
+		events = localevents;
+		maxevents = POMP_LOOP_MIN_EVENTS;
+	} else {
+		events = loop->events;
+		maxevents = loop->eventsize;
+	}
 
 	/* Wait for epoll events */
 	do {
-		nevents = sizeof(events) / sizeof(events[0]);
-		res = epoll_wait(loop->efd, events, (int)nevents, timeout);
+		res = epoll_wait(loop->efd, events, (int)maxevents, timeout);
 	} while (res < 0 && errno == EINTR);
 
 	if (res < 0) {
@@ -261,6 +305,10 @@ static int pomp_loop_epoll_do_wait_and_process(struct pomp_loop *loop,
 
 	/* Process events */
 	nevents = (uint32_t)res;
+	loop->stats.events += nevents;
+	if (nevents == maxevents)
+		loop->stats.full_waits++;
+	loop->eventsbusy = 1;
 	for (i = 0; i < nevents; i++) {
 		revents = fd_events_from_epoll(events[i].events);
 		if (revents == 0)
@@ -277,6 +325,20 @@ static int pomp_loop_epoll_do_wait_and_process(struct pomp_loop *loop,
 		if (pfd != NULL)
 			(*pfd->cb)(pfd->fd, revents, pfd->userdata);
 	}
+	loop->eventsbusy = nested;
+
+	/* Adapt the batch: grow when full, shrink if the maximum was lowered.
+	 * On allocation failure keep the current array */
+	if (!nested) {
+		if (nevents == maxevents && maxevents < loop->maxevents) {
+			maxevents = maxevents * 2 < loop->maxevents ?
+					maxevents * 2 : loop->maxevents;
+			(void)pomp_loop_epoll_resize_events(loop, maxevents);
+		} else if (maxevents > loop->maxevents) {
+			(void)pomp_loop_epoll_resize_events(loop,
+					loop->maxevents);
+		}
+	}
 
 	return timeout == -1 ? 0 : (nevents > 0 ? 0 : -ETIMEDOUT);
 }
@@ -313,6 +375,7 @@ const struct pomp_loop_ops pomp_loop_epoll_ops = {
 	.do_get_fd = &pomp_loop_epoll_do_get_fd,
 	.do_wait_and_process = &pomp_loop_epoll_do_wait_and_process,
 	.do_wakeup = &pomp_loop_epoll_do_wakeup,
+	.has_edge_triggered = 1,
 };
 
 #endif /* POMP_HAVE_LOOP_EPOLL */
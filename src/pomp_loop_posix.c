@@ -95,6 +95,39 @@ static void pomp_loop_poll_wakeup_cb(struct pomp_loop *loop)
 		POMP_LOG_FD_ERRNO("read", loop->wakeup.pipefds[0]);
 }
 
+/**
+ * Make sure the pollfd array can hold the given number of entries.
+ * @param loop : loop object.
+ * @param count : number of entries.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_loop_poll_reserve(struct pomp_loop *loop, uint32_t count)
+{
+	uint32_t size = 0;
+	struct pollfd *pollfds = NULL;
+	struct pomp_fd **pollpfds = NULL;
+
+	if (count <= loop->pollfdsize)
+		return 0;
+
+	size = loop->pollfdsize == 0 ? 16 : loop->pollfdsize;
+	while (size < count)
+		size *= 2;
+
+	pollfds = realloc(loop->pollfds, size * sizeof(*pollfds));
+	if (pollfds == NULL)
+		return -ENOMEM;
+	loop->pollfds = pollfds;
+
+	pollpfds = realloc(loop->pollpfds, size * sizeof(*pollpfds));
+	if (pollpfds == NULL)
+		return -ENOMEM;
+	loop->pollpfds = pollpfds;
+
+	loop->pollfdsize = size;
+	return 0;
+}
+
 /**
  * @see pomp_loop_do_new.
  */
@@ -104,6 +137,8 @@ static int pomp_loop_poll_do_new(struct pomp_loop *loop)
 
 	/* Initialize implementation specific fields */
 	loop->pollfds = NULL;
+	loop->pollpfds = NULL;
+	loop->pollfdcount = 0;
 	loop->pollfdsize = 0;
 	loop->wakeup.pipefds[0] = -1;
 	loop->wakeup.pipefds[1] = -1;
@@ -112,9 +147,25 @@ static int pomp_loop_poll_do_new(struct pomp_loop *loop)
 	if (pipe(loop->wakeup.pipefds) < 0) {
 		res = -errno;
 		POMP_LOG_ERRNO("pipe");
+		return res;
 	}
 
-	return res;
+	/* Wakeup pipe is always the first entry of the pollfd array */
+	res = pomp_loop_poll_reserve(loop, 1);
+	if (res < 0) {
+		close(loop->wakeup.pipefds[0]);
+		close(loop->wakeup.pipefds[1]);
+		loop->wakeup.pipefds[0] = -1;
+		loop->wakeup.pipefds[1] = -1;
+		return res;
+	}
+	loop->pollfds[0].fd = loop->wakeup.pipefds[0];
+	loop->pollfds[0].events = POLLIN;
+	loop->pollfds[0].revents = 0;
+	loop->pollpfds[0] = NULL;
+	loop->pollfdcount = 1;
+
+	return 0;
 }
 
 /**
@@ -132,11 +183,12 @@ static int pomp_loop_poll_do_destroy(struct pomp_loop *loop)
 		loop->wakeup.pipefds[1] = -1;
 	}
 
-	if (loop->pollfds != NULL) {
-		free(loop->pollfds);
-		loop->pollfds = NULL;
-		loop->pollfdsize = 0;
-	}
+	free(loop->pollfds);
+	loop->pollfds = NULL;
+	free(loop->pollpfds);
+	loop->pollpfds = NULL;
+	loop->pollfdcount = 0;
+	loop->pollfdsize = 0;
 	return 0;
 }
 
@@ -145,7 +197,19 @@ static int pomp_loop_poll_do_destroy(struct pomp_loop *loop)
  */
 static int pomp_loop_poll_do_add(struct pomp_loop *loop, struct pomp_fd *pfd)
 {
-	/* Nothing to do */
+	int res = 0;
+	uint32_t idx = loop->pollfdcount;
+
+	/* Append at the end of the array */
+	res = pomp_loop_poll_reserve(loop, idx + 1);
+	if (res < 0)
+		return res;
+	loop->pollfds[idx].fd = pfd->fd;
+	loop->pollfds[idx].events = fd_events_to_poll(pfd->events);
+	loop->pollfds[idx].revents = 0;
+	loop->pollpfds[idx] = pfd;
+	pfd->pollidx = idx;
+	loop->pollfdcount++;
 	return 0;
 }
 
@@ -154,7 +218,7 @@ static int pomp_loop_poll_do_add(struct pomp_loop *loop, struct pomp_fd *pfd)
  */
 static int pomp_loop_poll_do_update(struct pomp_loop *loop, struct pomp_fd *pfd)
 {
-	/* Nothing to do */
+	loop->pollfds[pfd->pollidx].events = fd_events_to_poll(pfd->events);
 	return 0;
 }
 
@@ -163,7 +227,17 @@ static int pomp_loop_poll_do_update(struct pomp_loop *loop, struct pomp_fd *pfd)
  */
 static int pomp_loop_poll_do_remove(struct pomp_loop *loop, struct pomp_fd *pfd)
 {
-	/* Nothing to do */
+	uint32_t idx = pfd->pollidx;
+	uint32_t last = loop->pollfdcount - 1;
+
+	/* Move the last entry (with its pending revents) in the hole */
+	if (idx != last) {
+		loop->pollfds[idx] = loop->pollfds[last];
+		loop->pollpfds[idx] = loop->pollpfds[last];
+		loop->pollpfds[idx]->pollidx = idx;
+	}
+	loop->pollpfds[last] = NULL;
+	loop->pollfdcount--;
 	return 0;
 }
 
@@ -182,46 +256,13 @@ static int pomp_loop_poll_do_wait_and_process(struct pomp_loop *loop,
 		int timeout)
 {
 	int res = 0;
-	uint32_t i = 0, nevents = 0;
+	uint32_t i = 0, nevents = 0, nprocessed = 0;
 	struct pomp_fd *pfd = NULL;
-	struct pollfd *pollfds = NULL;
 	uint32_t revents = 0;
-	uint32_t pfdcount = 0;
-
-	/* Remember number of fds now because it can change during callback
-	 * processing */
-	pfdcount = loop->pfdcount + 1;
-
-	/* Make sure internal pollfd array is big enough */
-	if (loop->pollfdsize < pfdcount) {
-		pollfds = realloc(loop->pollfds,
-				pfdcount * sizeof(struct pollfd));
-		if (pollfds == NULL)
-			return -ENOMEM;
-		loop->pollfds = pollfds;
-		loop->pollfdsize = pfdcount;
-	}
-	memset(loop->pollfds, 0, loop->pollfdsize * sizeof(struct pollfd));
-
-	/* Wakeup pipe */
-	loop->pollfds[0].fd = loop->wakeup.pipefds[0];
-	loop->pollfds[0].events = POLLIN;
-	loop->pollfds[0].revents = 0;
-
-	/* Registered fds */
-	for (pfd = loop->pfds, i = 1; pfd != NULL; pfd = pfd->next, i++) {
-		if (i >= pfdcount) {
-			POMP_LOGE("Internal fd list corruption");
-			break;
-		}
-		loop->pollfds[i].fd = pfd->fd;
-		loop->pollfds[i].events = fd_events_to_poll(pfd->events);
-		loop->pollfds[i].revents = 0;
-	}
 
 	/* Wait for poll events */
 	do {
-		res = poll(loop->pollfds, pfdcount, timeout);
+		res = poll(loop->pollfds, loop->pollfdcount, timeout);
 	} while (res < 0 && errno == EINTR);
 
 	if (res < 0) {
@@ -230,23 +271,27 @@ static int pomp_loop_poll_do_wait_and_process(struct pomp_loop *loop,
 		return res;
 	}
 
-	/* Process events */
+	/* Process events, stop as soon as all ready fds have been seen.
+	 * Callbacks can add entries (with no revents) at the end of the array
+	 * or remove some, the last entry being moved in the hole. A moved
+	 * entry that was not yet seen is then notified at the next wait */
 	nevents = (uint32_t)res;
-	for (i = 0; i < pfdcount; i++) {
+	loop->stats.events += nevents;
+	for (i = 0; i < loop->pollfdcount && nprocessed < nevents; i++) {
 		revents = fd_events_from_poll(loop->pollfds[i].revents);
 		if (revents == 0)
 			continue;
+		loop->pollfds[i].revents = 0;
+		nprocessed++;
 
 		/* Check for wakeup event */
-		if (loop->pollfds[i].fd == loop->wakeup.pipefds[0]) {
+		if (i == 0) {
 			pomp_loop_poll_wakeup_cb(loop);
 			continue;
 		}
 
-		/* The list might be modified during the callback call */
-		pfd = pomp_loop_find_pfd(loop, loop->pollfds[i].fd);
-		if (pfd != NULL)
-			(*pfd->cb)(pfd->fd, revents, pfd->userdata);
+		pfd = loop->pollpfds[i];
+		(*pfd->cb)(pfd->fd, revents, pfd->userdata);
 	}
 
 	return timeout == -1 ? 0 : (nevents > 0 ? 0 : -ETIMEDOUT);
@@ -285,6 +330,7 @@ const struct pomp_loop_ops pomp_loop_poll_ops = {
 	.do_get_fd = &pomp_loop_poll_do_get_fd,
 	.do_wait_and_process = &pomp_loop_poll_do_wait_and_process,
 	.do_wakeup = &pomp_loop_poll_do_wakeup,
+	.has_edge_triggered = 0,
 };
 
 #endif /* POMP_HAVE_LOOP_POLL */
@@ -316,6 +316,7 @@ static int pomp_loop_win32_do_wait_and_process(struct pomp_loop *loop,
 		goto out;
 	}
 	hevt = hevts[waitres - WAIT_OBJECT_0];
+	loop->stats.events++;
 
 	/* Check for the wakeup event */
 	if (hevt == loop->wakeup.hevt) {
@@ -418,6 +419,7 @@ const struct pomp_loop_ops pomp_loop_win32_ops = {
 	.do_get_fd = &pomp_loop_win32_do_get_fd,
 	.do_wait_and_process = &pomp_loop_win32_do_wait_and_process,
 	.do_wakeup = &pomp_loop_win32_do_wakeup,
+	.has_edge_triggered = 0,
 };
 
 #endif /* POMP_HAVE_LOOP_WIN32 */
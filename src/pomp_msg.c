@@ -64,6 +64,7 @@ struct pomp_msg *pomp_msg_new_copy(const struct pomp_msg *msg)
 
 	newmsg->msgid = msg->msgid;
 	newmsg->finished = msg->finished;
+	newmsg->rpcid = msg->rpcid;
 
 	/* Copy buffer */
 	if (msg->buf != NULL) {
@@ -84,6 +85,31 @@ error:
 	return NULL;
 }
 
+/*
+ * See documentation in public header.
+ */
+struct pomp_msg *pomp_msg_new_ref(const struct pomp_msg *msg)
+{
+	struct pomp_msg *newmsg = NULL;
+
+	POMP_RETURN_VAL_IF_FAILED(msg != NULL, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(msg->buf != NULL, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(msg->finished, -EINVAL, NULL);
+
+	/* Allocate message structure */
+	newmsg = calloc(1, sizeof(*newmsg));
+	if (newmsg == NULL)
+		return NULL;
+
+	/* Share buffer, it becomes read-only */
+	newmsg->msgid = msg->msgid;
+	newmsg->finished = 1;
+	newmsg->rpcid = msg->rpcid;
+	newmsg->buf = msg->buf;
+	pomp_buffer_ref(newmsg->buf);
+	return newmsg;
+}
+
 /*
  * See documentation in public header.
  */
@@ -164,6 +190,7 @@ int pomp_msg_init(struct pomp_msg *msg, uint32_t msgid)
 
 	msg->msgid = msgid;
 	msg->finished = 0;
+	msg->rpcid = 0;
 
 	/* Allocate new buffer */
 	msg->buf = pomp_buffer_new(0);
@@ -173,13 +200,18 @@ int pomp_msg_init(struct pomp_msg *msg, uint32_t msgid)
 	return 0;
 }
 
-/*
- * See documentation in public header.
+/**
+ * Finish message encoding by writing the header at the given offset of the
+ * message buffer. The payload is assumed to follow the header up to the end
+ * of the buffer.
+ * @param msg : message.
+ * @param off : offset of the header in the buffer.
+ * @return 0 in case of success, negative errno value in case of error.
  */
-int pomp_msg_finish(struct pomp_msg *msg)
+int pomp_msg_finish_at(struct pomp_msg *msg, size_t off)
 {
 	int res = 0;
-	size_t pos = 0;
+	size_t pos = off;
 	uint32_t d = 0;
 
 	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
@@ -187,7 +219,8 @@ int pomp_msg_finish(struct pomp_msg *msg)
 	POMP_RETURN_ERR_IF_FAILED(!msg->finished, -EINVAL);
 
 	/* Make sure we will be able to write header */
-	res = pomp_buffer_ensure_capacity(msg->buf, POMP_PROT_HEADER_SIZE);
+	res = pomp_buffer_ensure_capacity(msg->buf,
+			off + POMP_PROT_HEADER_SIZE);
 	if (res < 0)
 		return res;
 
@@ -205,10 +238,10 @@ int pomp_msg_finish(struct pomp_msg *msg)
 
 	/* Message size (make sure we have at least the header size in
 	 * case no payload was written in buffer) */
-	if (msg->buf->len < POMP_PROT_HEADER_SIZE)
+	if (msg->buf->len < off + POMP_PROT_HEADER_SIZE)
 		d = POMP_HTOLE32(POMP_PROT_HEADER_SIZE);
 	else
-		d = POMP_HTOLE32((uint32_t)msg->buf->len);
+		d = POMP_HTOLE32((uint32_t)(msg->buf->len - off));
 	(void)pomp_buffer_write(msg->buf, &pos, &d, sizeof(d));
 
 	/* Message can not be modified anymore */
@@ -216,6 +249,14 @@ int pomp_msg_finish(struct pomp_msg *msg)
 	return 0;
 }
 
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_finish(struct pomp_msg *msg)
+{
+	return pomp_msg_finish_at(msg, 0);
+}
+
 /*
  * See documentation in public header.
  */
@@ -225,6 +266,7 @@ int pomp_msg_clear(struct pomp_msg *msg)
 
 	msg->msgid = 0;
 	msg->finished = 0;
+	msg->rpcid = 0;
 
 	/* Release buffer */
 	if (msg->buf != NULL)
@@ -243,6 +285,15 @@ uint32_t pomp_msg_get_id(const struct pomp_msg *msg)
 	return msg->msgid;
 }
 
+/*
+ * See documentation in public header.
+ */
+uint32_t pomp_msg_get_rpc_id(const struct pomp_msg *msg)
+{
+	POMP_RETURN_VAL_IF_FAILED(msg != NULL, -EINVAL, 0);
+	return msg->rpcid;
+}
+
 /*
  * See documentation in public header.
  */
@@ -411,3 +462,172 @@ int pomp_msg_adump(const struct pomp_msg *msg, char **dst)
 	(void)pomp_decoder_clear(&dec);
 	return res;
 }
+
+/**
+ * Overwrite the data of a slot previously written with one of the
+ * pomp_encoder_write_slot_xxx functions.
+ * @param msg : message.
+ * @param slot : offset of the slot data in message.
+ * @param type : data type of the slot.
+ * @param p : data to write.
+ * @param n : data size.
+ * @return 0 in case of success, negative errno value in case of error.
+ * -EBUSY is returned if the buffer is still referenced elsewhere (typically
+ * by the send queue of a connection).
+ */
+static int msg_patch_slot(struct pomp_msg *msg, uint32_t slot, uint8_t type,
+		const void *p, size_t n)
+{
+	size_t i = 0;
+	const uint8_t *data = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg->buf != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(slot > POMP_PROT_HEADER_SIZE, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(slot + n <= msg->buf->len, -EINVAL);
+
+	/* Not an error, caller shall wait for the send to complete */
+	if (msg->buf->refcount > 1)
+		return -EBUSY;
+
+	/* Make sure the slot was created with the same type */
+	data = msg->buf->data + slot;
+	if (data[-1] != type) {
+		POMP_LOGW("msg : slot type mismatch %d(%d)", data[-1], type);
+		return -EINVAL;
+	}
+
+	/* For varint, make sure the slot has the fixed width expected */
+	if (type == POMP_PROT_DATA_TYPE_I32 || type == POMP_PROT_DATA_TYPE_U32
+			|| type == POMP_PROT_DATA_TYPE_I64
+			|| type == POMP_PROT_DATA_TYPE_U64) {
+		for (i = 0; i < n; i++) {
+			if (((data[i] & 0x80) != 0) != (i + 1 < n)) {
+				POMP_LOGW("msg : slot %u is not fixed width",
+						slot);
+				return -EINVAL;
+			}
+		}
+	}
+
+	memcpy(msg->buf->data + slot, p, n);
+	return 0;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_i8(struct pomp_msg *msg, uint32_t slot, int8_t v)
+{
+	uint8_t d = (uint8_t)v;
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_I8,
+			&d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_u8(struct pomp_msg *msg, uint32_t slot, uint8_t v)
+{
+	uint8_t d = v;
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_U8,
+			&d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_i16(struct pomp_msg *msg, uint32_t slot, int16_t v)
+{
+	uint16_t d = POMP_HTOLE16(v);
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_I16,
+			&d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_u16(struct pomp_msg *msg, uint32_t slot, uint16_t v)
+{
+	uint16_t d = POMP_HTOLE16(v);
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_U16,
+			&d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_i32(struct pomp_msg *msg, uint32_t slot, int32_t v)
+{
+	uint8_t d[POMP_PROT_VARINT32_SLOT_SIZE];
+	/* Zigzag encoding, use arithmetic right shift, with sign propagation */
+	pomp_prot_encode_varint_slot(d, sizeof(d),
+			(uint32_t)((v << 1) ^ (v >> 31)));
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_I32,
+			d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_u32(struct pomp_msg *msg, uint32_t slot, uint32_t v)
+{
+	uint8_t d[POMP_PROT_VARINT32_SLOT_SIZE];
+	pomp_prot_encode_varint_slot(d, sizeof(d), v);
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_U32,
+			d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_i64(struct pomp_msg *msg, uint32_t slot, int64_t v)
+{
+	uint8_t d[POMP_PROT_VARINT64_SLOT_SIZE];
+	/* Zigzag encoding, use arithmetic right shift, with sign propagation */
+	pomp_prot_encode_varint_slot(d, sizeof(d),
+			(uint64_t)((v << 1) ^ (v >> 63)));
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_I64,
+			d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_u64(struct pomp_msg *msg, uint32_t slot, uint64_t v)
+{
+	uint8_t d[POMP_PROT_VARINT64_SLOT_SIZE];
+	pomp_prot_encode_varint_slot(d, sizeof(d), v);
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_U64,
+			d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_f32(struct pomp_msg *msg, uint32_t slot, float v)
+{
+	union {
+		float f32;
+		uint32_t u32;
+	} d;
+	d.f32 = v;
+	d.u32 = POMP_HTOLE32(d.u32);
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_F32,
+			&d, sizeof(d));
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_msg_patch_f64(struct pomp_msg *msg, uint32_t slot, double v)
+{
+	union {
+		double f64;
+		uint64_t u64;
+	} d;
+	d.f64 = v;
+	d.u64 = POMP_HTOLE64(d.u64);
+	return msg_patch_slot(msg, slot, POMP_PROT_DATA_TYPE_F64,
+			&d, sizeof(d));
+}
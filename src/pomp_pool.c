@@ -0,0 +1,593 @@
+/**
+ * @file pomp_pool.c
+ *
+ * @brief Thread pool running message handlers.
+ *
+ * Messages are queued per key (the connection they have been received on) in
+ * a strand, a strand being run by at most one thread at a time so messages
+ * with the same key are handled in order while different keys are handled in
+ * parallel.
+ *
+ * Each thread has its own queue of ready strands. New strands are dispatched
+ * round robin, a thread keeps a strand in its own queue while it has
+ * messages and steals strands from the other queues when its own is empty.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "pomp_priv.h"
+
+/** Number of buckets in hash table of strands (shall be a power of 2) */
+#define POMP_POOL_HASH_SIZE	64
+
+#ifdef POMP_HAVE_COND
+
+/** Queued message */
+struct pomp_pool_item {
+	struct pomp_msg		*msg;		/**< Message (shared buffer) */
+	struct pomp_pool_item	*next;		/**< Next item in strand */
+};
+
+/** Messages of a key, handled in order */
+struct pomp_pool_strand {
+	void			*key;		/**< Key of messages */
+	struct pomp_pool_item	*head;		/**< First queued message */
+	struct pomp_pool_item	*tail;		/**< Last queued message */
+	uint32_t		count;		/**< Number of queued messages */
+	int			running;	/**< A handler is running */
+	int			ready;		/**< In a ready queue */
+	struct pomp_pool_strand	*hnext;		/**< Next in hash bucket */
+	struct pomp_pool_strand	*qnext;		/**< Next in ready queue */
+};
+
+/** Thread of the pool */
+struct pomp_pool_thread {
+	struct pomp_pool	*pool;		/**< Associated pool */
+	pthread_t		thread;		/**< Thread handle */
+	int			started;	/**< Thread has been created */
+	struct pomp_pool_strand	*head;		/**< First ready strand */
+	struct pomp_pool_strand	*tail;		/**< Last ready strand */
+};
+
+/** Thread pool */
+struct pomp_pool {
+	/** Function to call for each message */
+	pomp_pool_cb_t		cb;
+
+	/** User data for callback */
+	void			*userdata;
+
+	/** Threads, each one with its queue of ready strands */
+	struct pomp_pool_thread	*threads;
+
+	/** Number of threads */
+	uint32_t		threadcount;
+
+	/** Thread receiving the next new strand */
+	uint32_t		next;
+
+	/** Hash table of strands with queued or running messages */
+	struct pomp_pool_strand	*buckets[POMP_POOL_HASH_SIZE];
+
+	/** Threads shall exit */
+	int			stopped;
+
+	/** Number of threads waiting for a key to be idle */
+	uint32_t		cancelling;
+
+	/** Statistics */
+	struct pomp_handler_pool_stats	stats;
+
+	/** Protect everything above */
+	struct pomp_mutex	mutex;
+
+	/** Signaled when a strand becomes ready or the pool is stopped */
+	struct pomp_cond	cond;
+
+	/** Signaled when a handler completes and a cancel is waiting */
+	struct pomp_cond	idlecond;
+};
+
+/**
+ * Get the hash bucket of a key.
+ * @param pool : pool.
+ * @param key : key.
+ * @return bucket.
+ */
+static struct pomp_pool_strand **pool_get_bucket(struct pomp_pool *pool,
+		const void *key)
+{
+	uintptr_t h = (uintptr_t)key;
+	h ^= h >> 4;
+	h ^= h >> 12;
+	return &pool->buckets[h & (POMP_POOL_HASH_SIZE - 1)];
+}
+
+/**
+ * Find the strand of a key.
+ * @param pool : pool.
+ * @param key : key.
+ * @return strand or NULL if not found.
+ */
+static struct pomp_pool_strand *pool_find(struct pomp_pool *pool,
+		const void *key)
+{
+	struct pomp_pool_strand *strand = *pool_get_bucket(pool, key);
+	while (strand != NULL && strand->key != key)
+		strand = strand->hnext;
+	return strand;
+}
+
+/**
+ * Remove a strand from the hash table and free it. It shall be neither
+ * running nor ready.
+ * @param pool : pool.
+ * @param strand : strand.
+ */
+static void pool_free_strand(struct pomp_pool *pool,
+		struct pomp_pool_strand *strand)
+{
+	struct pomp_pool_strand **prev = pool_get_bucket(pool, strand->key);
+	while (*prev != strand)
+		prev = &(*prev)->hnext;
+	*prev = strand->hnext;
+	free(strand);
+}
+
+/**
+ * Drop all queued messages of a strand.
+ * @param pool : pool.
+ * @param strand : strand.
+ */
+static void pool_drop_items(struct pomp_pool *pool,
+		struct pomp_pool_strand *strand)
+{
+	struct pomp_pool_item *item = NULL;
+
+	while (strand->head != NULL) {
+		item = strand->head;
+		strand->head = item->next;
+		pomp_msg_destroy(item->msg);
+		free(item);
+	}
+	strand->tail = NULL;
+	pool->stats.queued -= strand->count;
+	strand->count = 0;
+}
+
+/**
+ * Add a strand at the end of the ready queue of a thread.
+ * @param thread : thread.
+ * @param strand : strand.
+ */
+static void pool_enqueue(struct pomp_pool_thread *thread,
+		struct pomp_pool_strand *strand)
+{
+	strand->ready = 1;
+	strand->qnext = NULL;
+	if (thread->tail == NULL)
+		thread->head = strand;
+	else
+		thread->tail->qnext = strand;
+	thread->tail = strand;
+}
+
+/**
+ * Take the first strand of the ready queue of a thread.
+ * @param thread : thread.
+ * @return strand or NULL if the queue is empty.
+ */
+static struct pomp_pool_strand *pool_dequeue(struct pomp_pool_thread *thread)
+{
+	struct pomp_pool_strand *strand = thread->head;
+	if (strand == NULL)
+		return NULL;
+	thread->head = strand->qnext;
+	if (thread->head == NULL)
+		thread->tail = NULL;
+	strand->qnext = NULL;
+	strand->ready = 0;
+	return strand;
+}
+
+/**
+ * Get the next strand to run by a thread, from its own queue or stolen from
+ * the queue of another thread.
+ * @param thread : thread.
+ * @return strand or NULL if all queues are empty.
+ */
+static struct pomp_pool_strand *pool_next_strand(
+		struct pomp_pool_thread *thread)
+{
+	struct pomp_pool *pool = thread->pool;
+	struct pomp_pool_strand *strand = NULL;
+	uint32_t idx = (uint32_t)(thread - pool->threads);
+	uint32_t i = 0;
+
+	strand = pool_dequeue(thread);
+	if (strand != NULL)
+		return strand;
+
+	for (i = 1; i < pool->threadcount; i++) {
+		strand = pool_dequeue(
+				&pool->threads[(idx + i) % pool->threadcount]);
+		if (strand != NULL) {
+			pool->stats.steals++;
+			return strand;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Thread function of the pool.
+ * @param userdata : thread.
+ * @return NULL.
+ */
+static void *pool_thread_main(void *userdata)
+{
+	struct pomp_pool_thread *thread = userdata;
+	struct pomp_pool *pool = thread->pool;
+	struct pomp_pool_strand *strand = NULL;
+	struct pomp_pool_item *item = NULL;
+	uint64_t start = 0, end = 0, elapsed = 0;
+
+	pomp_mutex_lock(&pool->mutex);
+	while (!pool->stopped) {
+		strand = pool_next_strand(thread);
+		if (strand == NULL) {
+			pomp_cond_wait(&pool->cond, &pool->mutex);
+			continue;
+		}
+
+		/* Messages may have been dropped since it was queued */
+		item = strand->head;
+		if (item == NULL) {
+			pool_free_strand(pool, strand);
+			continue;
+		}
+		strand->head = item->next;
+		if (strand->head == NULL)
+			strand->tail = NULL;
+		strand->count--;
+		strand->running = 1;
+		pool->stats.queued--;
+		pool->stats.running++;
+		pomp_mutex_unlock(&pool->mutex);
+
+		/* Call handler without lock */
+		(void)time_get_monotonic_us(&start);
+		(*pool->cb)(strand->key, item->msg, pool->userdata);
+		(void)time_get_monotonic_us(&end);
+		elapsed = end >= start ? end - start : 0;
+		pomp_msg_destroy(item->msg);
+		free(item);
+
+		pomp_mutex_lock(&pool->mutex);
+		pool->stats.running--;
+		pool->stats.handled++;
+		pool->stats.total_handler_time_us += elapsed;
+		if (elapsed > pool->stats.max_handler_time_us)
+			pool->stats.max_handler_time_us = elapsed;
+
+		/* Keep the strand on this thread while it has messages */
+		strand->running = 0;
+		if (strand->head != NULL)
+			pool_enqueue(thread, strand);
+		else
+			pool_free_strand(pool, strand);
+
+		if (pool->cancelling > 0)
+			pomp_cond_broadcast(&pool->idlecond);
+	}
+	pomp_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/**
+ * Create a thread pool.
+ * @param threadcount : number of threads.
+ * @param cb : function to call for each message.
+ * @param userdata : user data for callback.
+ * @return pool or NULL in case of error.
+ */
+struct pomp_pool *pomp_pool_new(uint32_t threadcount,
+		pomp_pool_cb_t cb, void *userdata)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct pomp_pool *pool = NULL;
+
+	POMP_RETURN_VAL_IF_FAILED(threadcount > 0, -EINVAL, NULL);
+	POMP_RETURN_VAL_IF_FAILED(cb != NULL, -EINVAL, NULL);
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return NULL;
+	pool->cb = cb;
+	pool->userdata = userdata;
+	pool->stats.threads = threadcount;
+
+	pool->threads = calloc(threadcount, sizeof(*pool->threads));
+	if (pool->threads == NULL)
+		goto error_free;
+	pool->threadcount = threadcount;
+
+	if (pomp_mutex_init(&pool->mutex) < 0)
+		goto error_free;
+	if (pomp_cond_init(&pool->cond) < 0)
+		goto error_mutex;
+	if (pomp_cond_init(&pool->idlecond) < 0)
+		goto error_cond;
+
+	for (i = 0; i < threadcount; i++) {
+		pool->threads[i].pool = pool;
+		res = pthread_create(&pool->threads[i].thread, NULL,
+				&pool_thread_main, &pool->threads[i]);
+		if (res != 0) {
+			POMP_LOGE("pthread_create err=%d(%s)",
+					res, strerror(res));
+			(void)pomp_pool_destroy(pool);
+			return NULL;
+		}
+		pool->threads[i].started = 1;
+	}
+
+	return pool;
+
+error_cond:
+	pomp_cond_clear(&pool->cond);
+error_mutex:
+	pomp_mutex_clear(&pool->mutex);
+error_free:
+	free(pool->threads);
+	free(pool);
+	return NULL;
+}
+
+/**
+ * Destroy a thread pool. Threads are joined and messages still queued are
+ * dropped.
+ * @param pool : pool.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_pool_destroy(struct pomp_pool *pool)
+{
+	uint32_t i = 0;
+	struct pomp_pool_strand *strand = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(pool != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(!pomp_pool_is_current(pool), -EBUSY);
+
+	pomp_mutex_lock(&pool->mutex);
+	pool->stopped = 1;
+	pomp_cond_broadcast(&pool->cond);
+	pomp_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->threadcount; i++) {
+		if (pool->threads[i].started)
+			pthread_join(pool->threads[i].thread, NULL);
+	}
+
+	for (i = 0; i < POMP_POOL_HASH_SIZE; i++) {
+		while (pool->buckets[i] != NULL) {
+			strand = pool->buckets[i];
+			pool->buckets[i] = strand->hnext;
+			pool_drop_items(pool, strand);
+			free(strand);
+		}
+	}
+
+	pomp_cond_clear(&pool->idlecond);
+	pomp_cond_clear(&pool->cond);
+	pomp_mutex_clear(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+	return 0;
+}
+
+/**
+ * Queue a message to be handled by a thread of the pool. It is handled after
+ * all previous messages queued with the same key.
+ * @param pool : pool.
+ * @param key : key of the message.
+ * @param msg : message, its buffer is shared.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_pool_push(struct pomp_pool *pool, void *key,
+		const struct pomp_msg *msg)
+{
+	struct pomp_pool_strand *strand = NULL, **bucket = NULL;
+	struct pomp_pool_item *item = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(pool != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+
+	item = calloc(1, sizeof(*item));
+	if (item == NULL)
+		return -ENOMEM;
+	item->msg = pomp_msg_new_ref(msg);
+	if (item->msg == NULL) {
+		free(item);
+		return -ENOMEM;
+	}
+
+	pomp_mutex_lock(&pool->mutex);
+
+	/* Create strand of key if needed */
+	strand = pool_find(pool, key);
+	if (strand == NULL) {
+		strand = calloc(1, sizeof(*strand));
+		if (strand == NULL) {
+			pomp_mutex_unlock(&pool->mutex);
+			pomp_msg_destroy(item->msg);
+			free(item);
+			return -ENOMEM;
+		}
+		strand->key = key;
+		bucket = pool_get_bucket(pool, key);
+		strand->hnext = *bucket;
+		*bucket = strand;
+	}
+
+	/* Add message */
+	if (strand->tail == NULL)
+		strand->head = item;
+	else
+		strand->tail->next = item;
+	strand->tail = item;
+	strand->count++;
+	pool->stats.queued++;
+	if (pool->stats.queued > pool->stats.max_queued)
+		pool->stats.max_queued = pool->stats.queued;
+
+	/* Dispatch an idle strand, otherwise the thread running it or the
+	 * thread whose queue it is in will take care of it */
+	if (!strand->running && !strand->ready) {
+		pool_enqueue(&pool->threads[pool->next], strand);
+		pool->next = (pool->next + 1) % pool->threadcount;
+		pomp_cond_signal(&pool->cond);
+	}
+
+	pomp_mutex_unlock(&pool->mutex);
+	return 0;
+}
+
+/**
+ * Drop queued messages of a key and wait for its running handler to
+ * complete. If called from a thread of the pool, it does not wait.
+ * @param pool : pool.
+ * @param key : key.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_pool_cancel_key(struct pomp_pool *pool, void *key)
+{
+	int wait = 0;
+	struct pomp_pool_strand *strand = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(pool != NULL, -EINVAL);
+	wait = !pomp_pool_is_current(pool);
+
+	pomp_mutex_lock(&pool->mutex);
+	pool->cancelling++;
+	while ((strand = pool_find(pool, key)) != NULL) {
+		pool_drop_items(pool, strand);
+		if (!strand->running || !wait) {
+			/* A ready strand will be freed by the thread taking
+			 * it from its queue */
+			if (!strand->running && !strand->ready)
+				pool_free_strand(pool, strand);
+			break;
+		}
+		pomp_cond_wait(&pool->idlecond, &pool->mutex);
+	}
+	pool->cancelling--;
+	pomp_mutex_unlock(&pool->mutex);
+	return 0;
+}
+
+/**
+ * Determine if the caller is running in a thread of the pool.
+ * @param pool : pool.
+ * @return 1 if the caller is a thread of the pool, 0 otherwise.
+ */
+int pomp_pool_is_current(const struct pomp_pool *pool)
+{
+	uint32_t i = 0;
+	pthread_t self = pthread_self();
+
+	if (pool == NULL)
+		return 0;
+
+	for (i = 0; i < pool->threadcount; i++) {
+		if (pool->threads[i].started &&
+				pthread_equal(pool->threads[i].thread, self))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Get statistics of the pool.
+ * @param pool : pool.
+ * @param stats : returned statistics.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_pool_get_stats(struct pomp_pool *pool,
+		struct pomp_handler_pool_stats *stats)
+{
+	POMP_RETURN_ERR_IF_FAILED(pool != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(stats != NULL, -EINVAL);
+
+	pomp_mutex_lock(&pool->mutex);
+	*stats = pool->stats;
+	pomp_mutex_unlock(&pool->mutex);
+	return 0;
+}
+
+#else /* !POMP_HAVE_COND */
+
+/*
+ * Thread pools are only available with posix threads.
+ */
+
+struct pomp_pool *pomp_pool_new(uint32_t threadcount,
+		pomp_pool_cb_t cb, void *userdata)
+{
+	return NULL;
+}
+
+int pomp_pool_destroy(struct pomp_pool *pool)
+{
+	return -ENOSYS;
+}
+
+int pomp_pool_push(struct pomp_pool *pool, void *key,
+		const struct pomp_msg *msg)
+{
+	return -ENOSYS;
+}
+
+int pomp_pool_cancel_key(struct pomp_pool *pool, void *key)
+{
+	return -ENOSYS;
+}
+
+int pomp_pool_is_current(const struct pomp_pool *pool)
+{
+	return 0;
+}
+
+int pomp_pool_get_stats(struct pomp_pool *pool,
+		struct pomp_handler_pool_stats *stats)
+{
+	return -ENOSYS;
+}
+
+#endif /* !POMP_HAVE_COND */
@@ -0,0 +1,67 @@
+/**
+ * @file pomp_pool.h
+ *
+ * @brief Thread pool running message handlers.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _POMP_POOL_H_
+#define _POMP_POOL_H_
+
+/* Forward declaration */
+struct pomp_pool;
+
+/**
+ * Function called in a thread of the pool for each queued message.
+ * @param key : key the message has been queued with.
+ * @param msg : message.
+ * @param userdata : pool user data.
+ */
+typedef void (*pomp_pool_cb_t)(void *key, const struct pomp_msg *msg,
+		void *userdata);
+
+/* Pool functions not part of public API */
+
+struct pomp_pool *pomp_pool_new(uint32_t threadcount,
+		pomp_pool_cb_t cb, void *userdata);
+
+int pomp_pool_destroy(struct pomp_pool *pool);
+
+int pomp_pool_push(struct pomp_pool *pool, void *key,
+		const struct pomp_msg *msg);
+
+int pomp_pool_cancel_key(struct pomp_pool *pool, void *key);
+
+int pomp_pool_is_current(const struct pomp_pool *pool);
+
+int pomp_pool_get_stats(struct pomp_pool *pool,
+		struct pomp_handler_pool_stats *stats);
+
+#endif /* !_POMP_POOL_H_ */
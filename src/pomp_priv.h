@@ -90,17 +90,30 @@
 #  include "sys_timerfd.h"
 #  define POMP_HAVE_TIMER_FD
 #endif
+#ifdef HAVE_SYS_UIO_H
+#  include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_UN_H
 #  include <sys/un.h>
 #endif
 #ifdef HAVE_NETINET_TCP_H
 #  include <netinet/tcp.h>
 #endif
+#ifdef HAVE_LINUX_FILTER_H
+#  include <linux/filter.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#  define POMP_HAVE_PTHREAD
+#endif
 
 /* Detect available implementations */
 #if !defined(POMP_HAVE_TIMER_POSIX) && defined(HAVE_TIMER_CREATE)
 #  define POMP_HAVE_TIMER_POSIX
 #endif
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+#  define POMP_HAVE_ACCEPT4
+#endif
 
 #ifdef _WIN32
 #  include "pomp_priv_win32.h"
@@ -121,17 +134,21 @@
 #include "libpomp.h"
 
 #include "pomp_log.h"
+#include "pomp_thread.h"
 #include "pomp_buffer.h"
 #include "pomp_timer.h"
 #include "pomp_loop.h"
 #include "pomp_prot.h"
+#include "pomp_sub.h"
+#include "pomp_rpc.h"
+#include "pomp_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
 /** Message structure initializer */
-#define POMP_MSG_INITIALIZER		{0, 0, NULL}
+#define POMP_MSG_INITIALIZER		{0, 0, NULL, 0}
 
 /** Encoder structure initializer*/
 #define POMP_ENCODER_INITIALIZER	{NULL, 0}
@@ -144,6 +161,7 @@ struct pomp_msg {
 	uint32_t		msgid;		/**< Id of message */
 	uint32_t		finished;	/**< Header is filled */
 	struct pomp_buffer	*buf;		/**< Buffer with data */
+	uint32_t		rpcid;		/**< Id of rpc request or 0 */
 };
 
 /** Encode state */
@@ -193,6 +211,34 @@ int pomp_ctx_notify_raw_buf(struct pomp_ctx *ctx, struct pomp_conn *conn,
 int pomp_ctx_notify_send(struct pomp_ctx *ctx, struct pomp_conn *conn,
 		struct pomp_buffer *buf, uint32_t status);
 
+struct pomp_rpc *pomp_ctx_get_rpc(struct pomp_ctx *ctx,
+		struct pomp_conn *conn);
+
+int pomp_ctx_post_msg(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		const struct pomp_msg *msg);
+
+int pomp_ctx_is_pool_thread(const struct pomp_ctx *ctx);
+
+int pomp_ctx_get_family(const struct pomp_ctx *ctx);
+
+void pomp_ctx_get_pacing(const struct pomp_ctx *ctx,
+		uint32_t *rate, uint32_t *burst);
+
+void pomp_ctx_get_rate_limit(const struct pomp_ctx *ctx,
+		uint32_t *msgrate, uint32_t *msgburst,
+		uint32_t *byterate, uint32_t *byteburst);
+
+void pomp_ctx_get_read_budget(const struct pomp_ctx *ctx,
+		uint32_t *maxbytes, uint32_t *maxmsgs);
+
+int pomp_ctx_is_edge_triggered(const struct pomp_ctx *ctx);
+
+int pomp_ctx_check_migrate(struct pomp_ctx *ctx,
+		const struct pomp_conn *conn, struct pomp_loop *loop);
+
+int pomp_ctx_migrate_conn(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		struct pomp_loop *loop);
+
 /* Connection functions not part of public API */
 
 struct pomp_conn *pomp_conn_new(struct pomp_ctx *ctx,
@@ -206,6 +252,30 @@ struct pomp_conn *pomp_conn_get_next(const struct pomp_conn *conn);
 
 int pomp_conn_set_next(struct pomp_conn *conn, struct pomp_conn *next);
 
+struct pomp_ctx *pomp_conn_get_ctx(const struct pomp_conn *conn);
+
+struct pomp_loop *pomp_conn_get_loop(const struct pomp_conn *conn);
+
+uint32_t pomp_conn_get_id(const struct pomp_conn *conn);
+
+int pomp_conn_is_corked(const struct pomp_conn *conn);
+
+size_t pomp_conn_get_queued(const struct pomp_conn *conn);
+
+int pomp_conn_heartbeat(struct pomp_conn *conn, uint64_t now,
+		uint64_t timeout);
+
+int pomp_conn_process_heartbeat(struct pomp_conn *conn,
+		const struct pomp_msg *msg);
+
+int pomp_conn_cork(struct pomp_conn *conn);
+
+int pomp_conn_uncork(struct pomp_conn *conn);
+
+int pomp_conn_detach(struct pomp_conn *conn);
+
+int pomp_conn_attach(struct pomp_conn *conn, struct pomp_loop *loop);
+
 int pomp_conn_send_msg_to(struct pomp_conn *conn,
 		const struct pomp_msg *msg,
 		const struct sockaddr *addr, uint32_t addrlen);
@@ -214,6 +284,10 @@ int pomp_conn_send_raw_buf_to(struct pomp_conn *conn,
 		struct pomp_buffer *buf,
 		const struct sockaddr *addr, uint32_t addrlen);
 
+/* Message functions not part of public API */
+
+int pomp_msg_finish_at(struct pomp_msg *msg, size_t off);
+
 /* Decoder functions not part of public API */
 
 /**
@@ -232,6 +306,44 @@ int pomp_decoder_walk(struct pomp_decoder *dec,
 		pomp_decoder_walk_cb_t cb, void *userdata,
 		int checkfds);
 
+/* Time utilities */
+
+/**
+ * Get current monotonic time in milliseconds.
+ * @param ms : returned time.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static inline int time_get_monotonic_ms(uint64_t *ms)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+		POMP_LOG_ERRNO("clock_gettime");
+		return -errno;
+	}
+
+	*ms = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+	return 0;
+}
+
+/**
+ * Get current monotonic time in microseconds.
+ * @param us : returned time.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static inline int time_get_monotonic_us(uint64_t *us)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+		POMP_LOG_ERRNO("clock_gettime");
+		return -errno;
+	}
+
+	*us = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+	return 0;
+}
+
 /* Fd utilities */
 
 /**
@@ -307,6 +419,81 @@ out:
 	return res;
 }
 
+/** Scale of the tokens of a token bucket, one token per second is exactly
+ * one scaled token per microsecond */
+#define POMP_TOKEN_SCALE	1000000
+
+/** Token bucket limiting the rate of some events or bytes */
+struct pomp_token_bucket {
+	uint32_t	rate;	/**< Tokens per second, 0 for no limit */
+	uint32_t	burst;	/**< Maximum number of tokens */
+	int64_t		tokens;	/**< Scaled tokens, negative when in debt */
+	uint64_t	last;	/**< Time of last refill (in us) */
+};
+
+/**
+ * Initialize a full token bucket.
+ * @param tb : token bucket.
+ * @param rate : tokens per second, 0 for no limit.
+ * @param burst : maximum number of tokens, 0 for one second of tokens.
+ * @param now : current time (in us).
+ */
+static inline void pomp_token_bucket_init(struct pomp_token_bucket *tb,
+		uint32_t rate, uint32_t burst, uint64_t now)
+{
+	tb->rate = rate;
+	tb->burst = burst != 0 ? burst : rate;
+	tb->tokens = (int64_t)tb->burst * POMP_TOKEN_SCALE;
+	tb->last = now;
+}
+
+/**
+ * Add the tokens accumulated since the last refill.
+ * @param tb : token bucket.
+ * @param now : current time (in us).
+ */
+static inline void pomp_token_bucket_refill(struct pomp_token_bucket *tb,
+		uint64_t now)
+{
+	int64_t cap = (int64_t)tb->burst * POMP_TOKEN_SCALE;
+	uint64_t elapsed = 0;
+
+	if (tb->rate == 0 || now <= tb->last)
+		return;
+	elapsed = now - tb->last;
+	tb->last = now;
+	if (elapsed >= (uint64_t)(cap - tb->tokens) / tb->rate)
+		tb->tokens = cap;
+	else
+		tb->tokens += (int64_t)(elapsed * tb->rate);
+}
+
+/**
+ * Take tokens, the bucket can go in debt so that the long term rate is
+ * respected even when more than available was consumed.
+ * @param tb : token bucket.
+ * @param count : number of tokens.
+ */
+static inline void pomp_token_bucket_take(struct pomp_token_bucket *tb,
+		uint64_t count)
+{
+	if (tb->rate != 0)
+		tb->tokens -= (int64_t)(count * POMP_TOKEN_SCALE);
+}
+
+/**
+ * Get the time to wait until a whole token is available.
+ * @param tb : token bucket.
+ * @return delay in us, 0 if a token is available.
+ */
+static inline uint64_t pomp_token_bucket_wait(
+		const struct pomp_token_bucket *tb)
+{
+	if (tb->rate == 0 || tb->tokens >= POMP_TOKEN_SCALE)
+		return 0;
+	return (uint64_t)(POMP_TOKEN_SCALE - tb->tokens) / tb->rate + 1;
+}
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -34,6 +34,9 @@
 
 #include "pomp_priv.h"
 
+/** Maximum capacity of a buffer kept for reuse by the decoder */
+#define POMP_PROT_RECYCLE_MAX_SIZE	(64 * 1024)
+
 /** Protocol header */
 struct pomp_prot_header {
 	uint8_t		magic[4];	/**< Magic */
@@ -66,6 +69,8 @@ struct pomp_prot {
 	size_t			offpayload;
 	/** Associated message */
 	struct pomp_msg		*msg;
+	/** Buffer of a released message kept for reuse */
+	struct pomp_buffer	*freebuf;
 };
 
 /**
@@ -99,10 +104,18 @@ static int pomp_prot_alloc_msg(struct pomp_prot *prot, uint32_t msgid,
 	if (prot->msg == NULL)
 		return -ENOMEM;
 
-	/* Initialize message, setup buffer inside message */
-	res = pomp_msg_init(prot->msg, msgid);
-	if (res < 0)
-		return res;
+	/* Initialize message, setup buffer inside message, reusing the one of
+	 * a previous message if possible */
+	if (prot->freebuf != NULL && prot->msg->buf == NULL) {
+		prot->msg->msgid = msgid;
+		prot->msg->finished = 0;
+		prot->msg->buf = prot->freebuf;
+		prot->freebuf = NULL;
+	} else {
+		res = pomp_msg_init(prot->msg, msgid);
+		if (res < 0)
+			return res;
+	}
 	return pomp_buffer_ensure_capacity(prot->msg->buf, size);
 }
 
@@ -268,6 +281,8 @@ int pomp_prot_destroy(struct pomp_prot *prot)
 	POMP_RETURN_ERR_IF_FAILED(prot != NULL, -EINVAL);
 	if (prot->msg != NULL)
 		pomp_msg_destroy(prot->msg);
+	if (prot->freebuf != NULL)
+		pomp_buffer_unref(prot->freebuf);
 	pomp_prot_reset_state(prot);
 	free(prot);
 	return 0;
@@ -362,15 +377,30 @@ ssize_t pomp_prot_decode_msg(struct pomp_prot *prot, const void *buf,
  * Release a previously decoded message. This is to reuse message structure
  * if possible and avoid some malloc/free at each decoded message. If there
  * is already a internal message structure, it is simply destroyed.
+ * The buffer is also kept for the next message unless it is still referenced
+ * elsewhere (message kept or forwarded by the application), in which case a
+ * new one will be allocated.
  * @param prot : protocol decoder.
  * @param msg : message to release.
  * @return 0 in case of success, negative errno value in case of error.
  */
 int pomp_prot_release_msg(struct pomp_prot *prot, struct pomp_msg *msg)
 {
+	struct pomp_buffer *buf = NULL;
+
 	POMP_RETURN_ERR_IF_FAILED(prot != NULL, -EINVAL);
 	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
 
+	/* Keep buffer if we are the only owner */
+	buf = msg->buf;
+	if (prot->freebuf == NULL && buf != NULL && buf->refcount == 1
+			&& buf->fdcount == 0
+			&& buf->capacity <= POMP_PROT_RECYCLE_MAX_SIZE) {
+		buf->len = 0;
+		prot->freebuf = buf;
+		msg->buf = NULL;
+	}
+
 	/* if we already have one, destroy given one, otherwise get ownership
 	 * but clear it */
 	if (prot->msg != NULL) {
@@ -120,6 +120,32 @@ extern "C" {
 /** Size of protocol header */
 #define POMP_PROT_HEADER_SIZE		12
 
+/** Size of a fixed width varint able to hold any 32-bit value */
+#define POMP_PROT_VARINT32_SLOT_SIZE	5
+
+/** Size of a fixed width varint able to hold any 64-bit value */
+#define POMP_PROT_VARINT64_SLOT_SIZE	10
+
+/**
+ * Encode an integer as a varint padded to a fixed number of bytes. All bytes
+ * but the last one have their continuation bit set so any decoder will accept
+ * it as a regular varint and the value can be patched later in place.
+ * @param d : destination of encoded data.
+ * @param n : number of bytes to encode.
+ * @param v : value to encode.
+ */
+static inline void pomp_prot_encode_varint_slot(uint8_t *d, size_t n,
+		uint64_t v)
+{
+	size_t i = 0;
+	for (i = 0; i < n; i++) {
+		d[i] = (uint8_t)(v & 0x7f);
+		v >>= 7;
+		if (i + 1 < n)
+			d[i] |= 0x80;
+	}
+}
+
 /* Forward declaration */
 struct pomp_prot;
 
@@ -0,0 +1,835 @@
+/**
+ * @file pomp_rpc.c
+ *
+ * @brief Request/reply on top of messages.
+ *
+ * Requests and replies are sent in envelope messages with reserved ids
+ * carrying a rpc id, the id of the wrapped message and its arguments.
+ *
+ * Pending requests of a context are indexed by rpc id in a hash table and
+ * ordered by deadline in a binary heap so a single timer handles the
+ * timeouts of all requests.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "pomp_priv.h"
+
+/** Initial number of buckets in hash table (shall be a power of 2) */
+#define POMP_RPC_HASH_MIN_SIZE	16
+
+/** Deadline of requests without timeout */
+#define POMP_RPC_NO_DEADLINE	UINT64_MAX
+
+/** Pending request */
+struct pomp_rpc_call {
+	uint32_t		id;		/**< Rpc id */
+	struct pomp_conn	*conn;		/**< Connection of request */
+	uint64_t		deadline;	/**< Deadline (in ms) */
+	uint32_t		heapidx;	/**< Index in deadline heap */
+	pomp_rpc_cb_t		cb;		/**< Completion callback */
+	void			*userdata;	/**< Callback user data */
+	struct pomp_rpc_call	*next;		/**< Next in hash bucket */
+};
+
+/** Pending requests of a context */
+struct pomp_rpc {
+	/** Timer for request timeouts */
+	struct pomp_timer	*timer;
+
+	/** Deadline the timer is set for, 0 if not set */
+	uint64_t		armed;
+
+	/** Next rpc id to try */
+	uint32_t		nextid;
+
+	/** Hash table of requests, indexed by rpc id */
+	struct pomp_rpc_call	**buckets;
+
+	/** Number of buckets in hash table */
+	uint32_t		bucketcount;
+
+	/** Heap of requests, ordered by deadline */
+	struct pomp_rpc_call	**heap;
+
+	/** Number of pending requests */
+	uint32_t		count;
+
+	/** Allocated size of heap */
+	uint32_t		capacity;
+};
+
+/**
+ * Get the hash bucket of a rpc id.
+ * @param rpc : rpc context.
+ * @param id : rpc id.
+ * @return bucket.
+ */
+static struct pomp_rpc_call **rpc_get_bucket(struct pomp_rpc *rpc, uint32_t id)
+{
+	/* Ids are allocated sequentially, low bits are enough */
+	return &rpc->buckets[id & (rpc->bucketcount - 1)];
+}
+
+/**
+ * Find a pending request.
+ * @param rpc : rpc context.
+ * @param id : rpc id.
+ * @return request or NULL if not found.
+ */
+static struct pomp_rpc_call *rpc_find(struct pomp_rpc *rpc, uint32_t id)
+{
+	struct pomp_rpc_call *call = *rpc_get_bucket(rpc, id);
+	while (call != NULL && call->id != id)
+		call = call->next;
+	return call;
+}
+
+/**
+ * Remove a request from the hash table.
+ * @param rpc : rpc context.
+ * @param call : request.
+ */
+static void rpc_unlink(struct pomp_rpc *rpc, struct pomp_rpc_call *call)
+{
+	struct pomp_rpc_call **prev = rpc_get_bucket(rpc, call->id);
+	while (*prev != NULL && *prev != call)
+		prev = &(*prev)->next;
+	if (*prev == call)
+		*prev = call->next;
+	call->next = NULL;
+}
+
+/**
+ * Make sure one more request can be added.
+ * @param rpc : rpc context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int rpc_ensure_capacity(struct pomp_rpc *rpc)
+{
+	uint32_t i = 0, count = 0;
+	struct pomp_rpc_call **heap = NULL;
+	struct pomp_rpc_call **buckets = NULL;
+	struct pomp_rpc_call *call = NULL;
+
+	/* Grow heap */
+	if (rpc->count >= rpc->capacity) {
+		count = rpc->capacity * 2;
+		heap = realloc(rpc->heap, count * sizeof(*heap));
+		if (heap == NULL)
+			return -ENOMEM;
+		rpc->heap = heap;
+		rpc->capacity = count;
+	}
+
+	/* Grow hash table to keep a load factor below 1 */
+	if (rpc->count >= rpc->bucketcount) {
+		count = rpc->bucketcount * 2;
+		buckets = calloc(count, sizeof(*buckets));
+		if (buckets == NULL)
+			return -ENOMEM;
+		free(rpc->buckets);
+		rpc->buckets = buckets;
+		rpc->bucketcount = count;
+
+		/* Rehash all requests (all of them are in the heap) */
+		for (i = 0; i < rpc->count; i++) {
+			call = rpc->heap[i];
+			call->next = *rpc_get_bucket(rpc, call->id);
+			*rpc_get_bucket(rpc, call->id) = call;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Put a request at a given index of the heap.
+ * @param rpc : rpc context.
+ * @param idx : index in heap.
+ * @param call : request.
+ */
+static void rpc_heap_set(struct pomp_rpc *rpc, uint32_t idx,
+		struct pomp_rpc_call *call)
+{
+	rpc->heap[idx] = call;
+	call->heapidx = idx;
+}
+
+/**
+ * Move a request up in the heap until its parent has an earlier deadline.
+ * @param rpc : rpc context.
+ * @param idx : index in heap.
+ */
+static void rpc_heap_up(struct pomp_rpc *rpc, uint32_t idx)
+{
+	uint32_t parent = 0;
+	struct pomp_rpc_call *call = rpc->heap[idx];
+
+	while (idx > 0) {
+		parent = (idx - 1) / 2;
+		if (rpc->heap[parent]->deadline <= call->deadline)
+			break;
+		rpc_heap_set(rpc, idx, rpc->heap[parent]);
+		idx = parent;
+	}
+	rpc_heap_set(rpc, idx, call);
+}
+
+/**
+ * Move a request down in the heap until its children have later deadlines.
+ * @param rpc : rpc context.
+ * @param idx : index in heap.
+ */
+static void rpc_heap_down(struct pomp_rpc *rpc, uint32_t idx)
+{
+	uint32_t child = 0;
+	struct pomp_rpc_call *call = rpc->heap[idx];
+
+	for (;;) {
+		child = 2 * idx + 1;
+		if (child >= rpc->count)
+			break;
+		if (child + 1 < rpc->count && rpc->heap[child + 1]->deadline
+				< rpc->heap[child]->deadline) {
+			child++;
+		}
+		if (call->deadline <= rpc->heap[child]->deadline)
+			break;
+		rpc_heap_set(rpc, idx, rpc->heap[child]);
+		idx = child;
+	}
+	rpc_heap_set(rpc, idx, call);
+}
+
+/**
+ * Remove a request from the hash table and the heap.
+ * @param rpc : rpc context.
+ * @param call : request.
+ */
+static void rpc_remove(struct pomp_rpc *rpc, struct pomp_rpc_call *call)
+{
+	uint32_t idx = call->heapidx;
+
+	rpc_unlink(rpc, call);
+	rpc->count--;
+	if (idx >= rpc->count)
+		return;
+
+	/* Move last request in the hole and restore heap order */
+	rpc_heap_set(rpc, idx, rpc->heap[rpc->count]);
+	if (idx > 0 && rpc->heap[(idx - 1) / 2]->deadline
+			> rpc->heap[idx]->deadline) {
+		rpc_heap_up(rpc, idx);
+	} else {
+		rpc_heap_down(rpc, idx);
+	}
+}
+
+/**
+ * Setup timer for the earliest deadline.
+ * @param rpc : rpc context.
+ */
+static void rpc_update_timer(struct pomp_rpc *rpc)
+{
+	uint64_t now = 0, deadline = 0;
+	uint32_t delay = 0;
+
+	deadline = rpc->count == 0 ? POMP_RPC_NO_DEADLINE :
+			rpc->heap[0]->deadline;
+	if (deadline == rpc->armed)
+		return;
+
+	if (deadline == POMP_RPC_NO_DEADLINE) {
+		(void)pomp_timer_clear(rpc->timer);
+		rpc->armed = 0;
+		return;
+	}
+
+	/* Wait at least 1ms, 0 would disable the timer */
+	if (time_get_monotonic_ms(&now) < 0)
+		now = 0;
+	if (deadline <= now)
+		delay = 1;
+	else if (deadline - now > UINT32_MAX)
+		delay = UINT32_MAX;
+	else
+		delay = (uint32_t)(deadline - now);
+	if (pomp_timer_set(rpc->timer, delay) == 0)
+		rpc->armed = deadline;
+}
+
+/**
+ * Function called when the timer is triggered.
+ * @param timer : timer.
+ * @param userdata : rpc context.
+ */
+static void rpc_timer_cb(struct pomp_timer *timer, void *userdata)
+{
+	struct pomp_rpc *rpc = userdata;
+	struct pomp_rpc_call *call = NULL;
+	struct pomp_rpc_call *expired = NULL, **tail = &expired;
+	uint64_t now = 0;
+
+	rpc->armed = 0;
+	if (time_get_monotonic_ms(&now) < 0)
+		return;
+
+	/* Detach expired requests in deadline order */
+	while (rpc->count > 0 && rpc->heap[0]->deadline <= now) {
+		call = rpc->heap[0];
+		rpc_remove(rpc, call);
+		*tail = call;
+		tail = &call->next;
+	}
+	rpc_update_timer(rpc);
+
+	/* Notify, callbacks may add requests or destroy the rpc context */
+	while (expired != NULL) {
+		call = expired;
+		expired = call->next;
+		(*call->cb)(call->conn, -ETIMEDOUT, NULL, call->userdata);
+		free(call);
+	}
+}
+
+/**
+ * Allocate a rpc id not used by a pending request.
+ * @param rpc : rpc context.
+ * @return rpc id.
+ */
+static uint32_t rpc_next_id(struct pomp_rpc *rpc)
+{
+	uint32_t id = 0;
+
+	do {
+		id = rpc->nextid++;
+	} while (id == 0 || rpc_find(rpc, id) != NULL);
+	return id;
+}
+
+/**
+ * Create a rpc context.
+ * @param loop : loop to use for the timer.
+ * @return rpc context or NULL in case of error.
+ */
+struct pomp_rpc *pomp_rpc_new(struct pomp_loop *loop)
+{
+	struct pomp_rpc *rpc = NULL;
+
+	rpc = calloc(1, sizeof(*rpc));
+	if (rpc == NULL)
+		goto error;
+
+	rpc->nextid = 1;
+	rpc->bucketcount = POMP_RPC_HASH_MIN_SIZE;
+	rpc->buckets = calloc(rpc->bucketcount, sizeof(*rpc->buckets));
+	if (rpc->buckets == NULL)
+		goto error;
+	rpc->capacity = POMP_RPC_HASH_MIN_SIZE;
+	rpc->heap = calloc(rpc->capacity, sizeof(*rpc->heap));
+	if (rpc->heap == NULL)
+		goto error;
+
+	rpc->timer = pomp_timer_new(loop, &rpc_timer_cb, rpc);
+	if (rpc->timer == NULL)
+		goto error;
+
+	return rpc;
+
+	/* Cleanup in case of error */
+error:
+	if (rpc != NULL)
+		pomp_rpc_destroy(rpc);
+	return NULL;
+}
+
+/**
+ * Destroy a rpc context. Pending requests are freed without notification.
+ * @param rpc : rpc context.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_rpc_destroy(struct pomp_rpc *rpc)
+{
+	uint32_t i = 0;
+	POMP_RETURN_ERR_IF_FAILED(rpc != NULL, -EINVAL);
+
+	for (i = 0; i < rpc->count; i++)
+		free(rpc->heap[i]);
+	if (rpc->timer != NULL)
+		pomp_timer_destroy(rpc->timer);
+	free(rpc->heap);
+	free(rpc->buckets);
+	free(rpc);
+	return 0;
+}
+
+/**
+ * Complete all pending requests of a connection with -ECANCELED.
+ * @param rpc : rpc context.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_rpc_cancel_conn(struct pomp_rpc *rpc, struct pomp_conn *conn)
+{
+	uint32_t i = 0, count = 0;
+	struct pomp_rpc_call *call = NULL;
+	struct pomp_rpc_call *canceled = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(rpc != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+
+	/* Detach requests of connection, compact the others */
+	for (i = 0; i < rpc->count; i++) {
+		call = rpc->heap[i];
+		if (call->conn == conn) {
+			rpc_unlink(rpc, call);
+			call->next = canceled;
+			canceled = call;
+		} else {
+			rpc->heap[count++] = call;
+		}
+	}
+	if (canceled == NULL)
+		return 0;
+
+	/* Rebuild heap */
+	rpc->count = count;
+	for (i = 0; i < rpc->count; i++)
+		rpc->heap[i]->heapidx = i;
+	for (i = rpc->count / 2; i > 0; i--)
+		rpc_heap_down(rpc, i - 1);
+	rpc_update_timer(rpc);
+
+	/* Notify */
+	while (canceled != NULL) {
+		call = canceled;
+		canceled = call->next;
+		(*call->cb)(call->conn, -ECANCELED, NULL, call->userdata);
+		free(call);
+	}
+
+	return 0;
+}
+
+/**
+ * Encode an envelope message with arguments given by a format string.
+ * @param env : envelope message.
+ * @param envid : envelope message id.
+ * @param rpcid : rpc id.
+ * @param msgid : wrapped message id.
+ * @param fmt : format string.
+ * @param args : arguments.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int rpc_write_envelope(struct pomp_msg *env, uint32_t envid,
+		uint32_t rpcid, uint32_t msgid, const char *fmt, va_list args)
+{
+	int res = 0;
+	struct pomp_encoder enc = POMP_ENCODER_INITIALIZER;
+
+	res = pomp_msg_init(env, envid);
+	if (res < 0)
+		return res;
+	(void)pomp_encoder_init(&enc, env);
+
+	res = pomp_encoder_write(&enc, "%u%u", rpcid, msgid);
+	if (res < 0)
+		return res;
+	res = pomp_encoder_writev(&enc, fmt, args);
+	if (res < 0)
+		return res;
+
+	/* Arguments are copied when opening envelope, no fds allowed */
+	if (env->buf->fdcount != 0) {
+		POMP_LOGE("File descriptors not supported in rpc");
+		return -EINVAL;
+	}
+
+	return pomp_msg_finish(env);
+}
+
+/**
+ * Encode an envelope message with arguments of another message.
+ * @param env : envelope message.
+ * @param envid : envelope message id.
+ * @param rpcid : rpc id.
+ * @param msg : message to wrap.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int rpc_wrap_envelope(struct pomp_msg *env, uint32_t envid,
+		uint32_t rpcid, const struct pomp_msg *msg)
+{
+	int res = 0;
+	struct pomp_encoder enc = POMP_ENCODER_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(msg->finished, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg->buf != NULL, -EINVAL);
+	if (msg->buf->fdcount != 0) {
+		POMP_LOGE("File descriptors not supported in rpc");
+		return -EINVAL;
+	}
+
+	res = pomp_msg_init(env, envid);
+	if (res < 0)
+		return res;
+	(void)pomp_encoder_init(&enc, env);
+
+	res = pomp_encoder_write(&enc, "%u%u", rpcid, msg->msgid);
+	if (res < 0)
+		return res;
+	if (msg->buf->len > POMP_PROT_HEADER_SIZE) {
+		res = pomp_buffer_write(env->buf, &enc.pos,
+				msg->buf->data + POMP_PROT_HEADER_SIZE,
+				msg->buf->len - POMP_PROT_HEADER_SIZE);
+		if (res < 0)
+			return res;
+	}
+
+	return pomp_msg_finish(env);
+}
+
+/**
+ * Extract the wrapped message of an envelope message.
+ * @param env : envelope message.
+ * @param rpcid : returned rpc id.
+ * @param msg : wrapped message, to be cleared by caller.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int rpc_open_envelope(const struct pomp_msg *env, uint32_t *rpcid,
+		struct pomp_msg *msg)
+{
+	int res = 0;
+	size_t pos = POMP_PROT_HEADER_SIZE;
+	uint32_t msgid = 0;
+	struct pomp_decoder dec = POMP_DECODER_INITIALIZER;
+
+	if (env->buf->fdcount != 0) {
+		POMP_LOGW("File descriptors not supported in rpc");
+		return -EINVAL;
+	}
+
+	(void)pomp_decoder_init(&dec, env);
+	res = pomp_decoder_read(&dec, "%u%u", rpcid, &msgid);
+	if (res < 0)
+		return res;
+	if (*rpcid == 0 || msgid >= POMP_MSGID_RESERVED_BASE) {
+		POMP_LOGW("Invalid rpc message: rpcid=%u msgid=%u",
+				*rpcid, msgid);
+		return -EINVAL;
+	}
+
+	/* Copy arguments in a new message */
+	res = pomp_msg_init(msg, msgid);
+	if (res < 0)
+		return res;
+	if (env->buf->len > dec.pos) {
+		res = pomp_buffer_write(msg->buf, &pos,
+				env->buf->data + dec.pos,
+				env->buf->len - dec.pos);
+		if (res < 0)
+			return res;
+	}
+
+	return pomp_msg_finish(msg);
+}
+
+/**
+ * Send a request envelope and register it as pending.
+ * @param rpc : rpc context.
+ * @param conn : connection.
+ * @param id : rpc id.
+ * @param env : envelope message.
+ * @param timeout : timeout (in ms), 0 for none.
+ * @param cb : completion callback.
+ * @param userdata : callback user data.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int rpc_send_request(struct pomp_rpc *rpc, struct pomp_conn *conn,
+		uint32_t id, const struct pomp_msg *env, uint32_t timeout,
+		pomp_rpc_cb_t cb, void *userdata)
+{
+	int res = 0;
+	uint64_t now = 0;
+	struct pomp_rpc_call *call = NULL;
+	struct pomp_rpc_call **bucket = NULL;
+
+	/* Allocate everything before sending */
+	res = rpc_ensure_capacity(rpc);
+	if (res < 0)
+		return res;
+	if (timeout != 0) {
+		res = time_get_monotonic_ms(&now);
+		if (res < 0)
+			return res;
+	}
+	call = calloc(1, sizeof(*call));
+	if (call == NULL)
+		return -ENOMEM;
+	call->id = id;
+	call->conn = conn;
+	call->deadline = timeout == 0 ? POMP_RPC_NO_DEADLINE : now + timeout;
+	call->cb = cb;
+	call->userdata = userdata;
+
+	res = pomp_conn_send_msg(conn, env);
+	if (res < 0) {
+		free(call);
+		return res;
+	}
+
+	/* Register it */
+	bucket = rpc_get_bucket(rpc, id);
+	call->next = *bucket;
+	*bucket = call;
+	rpc->heap[rpc->count++] = call;
+	rpc_heap_up(rpc, rpc->count - 1);
+	rpc_update_timer(rpc);
+	return 0;
+}
+
+/**
+ * Handle a request envelope received on a connection.
+ * The wrapped message is notified to the application.
+ * @param ctx : context.
+ * @param conn : connection.
+ * @param msg : envelope message.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_rpc_process_request(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		const struct pomp_msg *msg)
+{
+	int res = 0;
+	uint32_t rpcid = 0;
+	struct pomp_msg req = POMP_MSG_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(ctx != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+
+	res = rpc_open_envelope(msg, &rpcid, &req);
+	if (res == 0) {
+		req.rpcid = rpcid;
+		res = pomp_ctx_notify_msg(ctx, conn, &req);
+	}
+
+	(void)pomp_msg_clear(&req);
+	return res;
+}
+
+/**
+ * Handle a reply envelope received on a connection.
+ * The matching request is completed.
+ * @param rpc : rpc context.
+ * @param conn : connection.
+ * @param msg : envelope message.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_rpc_process_reply(struct pomp_rpc *rpc, struct pomp_conn *conn,
+		const struct pomp_msg *msg)
+{
+	int res = 0;
+	uint32_t rpcid = 0;
+	struct pomp_rpc_call *call = NULL;
+	struct pomp_msg reply = POMP_MSG_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(rpc != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+
+	res = rpc_open_envelope(msg, &rpcid, &reply);
+	if (res < 0)
+		goto out;
+
+	/* The request may have timed out already */
+	call = rpc_find(rpc, rpcid);
+	if (call == NULL || call->conn != conn) {
+		POMP_LOGI("No pending rpc request with id %u", rpcid);
+		res = -ENOENT;
+		goto out;
+	}
+
+	rpc_remove(rpc, call);
+	rpc_update_timer(rpc);
+	(*call->cb)(conn, 0, &reply, call->userdata);
+	free(call);
+
+out:
+	(void)pomp_msg_clear(&reply);
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_rpc_call(struct pomp_conn *conn, uint32_t msgid,
+		uint32_t timeout, pomp_rpc_cb_t cb, void *userdata,
+		const char *fmt, ...)
+{
+	int res = 0;
+	va_list args;
+	va_start(args, fmt);
+	res = pomp_rpc_callv(conn, msgid, timeout, cb, userdata, fmt, args);
+	va_end(args);
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_rpc_callv(struct pomp_conn *conn, uint32_t msgid,
+		uint32_t timeout, pomp_rpc_cb_t cb, void *userdata,
+		const char *fmt, va_list args)
+{
+	int res = 0;
+	uint32_t id = 0;
+	struct pomp_rpc *rpc = NULL;
+	struct pomp_msg env = POMP_MSG_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msgid < POMP_MSGID_RESERVED_BASE, -EINVAL);
+
+	rpc = pomp_ctx_get_rpc(pomp_conn_get_ctx(conn), conn);
+	if (rpc == NULL)
+		return -ENOMEM;
+
+	/* Encode and send request */
+	id = rpc_next_id(rpc);
+	res = rpc_write_envelope(&env, POMP_MSGID_RPC_REQUEST, id, msgid,
+			fmt, args);
+	if (res == 0) {
+		res = rpc_send_request(rpc, conn, id, &env, timeout,
+				cb, userdata);
+	}
+
+	/* Always cleanup message */
+	(void)pomp_msg_clear(&env);
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_rpc_call_msg(struct pomp_conn *conn,
+		const struct pomp_msg *msg, uint32_t timeout,
+		pomp_rpc_cb_t cb, void *userdata)
+{
+	int res = 0;
+	uint32_t id = 0;
+	struct pomp_rpc *rpc = NULL;
+	struct pomp_msg env = POMP_MSG_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg->msgid < POMP_MSGID_RESERVED_BASE,
+			-EINVAL);
+
+	rpc = pomp_ctx_get_rpc(pomp_conn_get_ctx(conn), conn);
+	if (rpc == NULL)
+		return -ENOMEM;
+
+	/* Encode and send request */
+	id = rpc_next_id(rpc);
+	res = rpc_wrap_envelope(&env, POMP_MSGID_RPC_REQUEST, id, msg);
+	if (res == 0) {
+		res = rpc_send_request(rpc, conn, id, &env, timeout,
+				cb, userdata);
+	}
+
+	/* Always cleanup message */
+	(void)pomp_msg_clear(&env);
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_rpc_reply(struct pomp_conn *conn,
+		const struct pomp_msg *req, uint32_t msgid,
+		const char *fmt, ...)
+{
+	int res = 0;
+	va_list args;
+	va_start(args, fmt);
+	res = pomp_rpc_replyv(conn, req, msgid, fmt, args);
+	va_end(args);
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_rpc_replyv(struct pomp_conn *conn,
+		const struct pomp_msg *req, uint32_t msgid,
+		const char *fmt, va_list args)
+{
+	int res = 0;
+	struct pomp_msg env = POMP_MSG_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(req != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(req->rpcid != 0, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msgid < POMP_MSGID_RESERVED_BASE, -EINVAL);
+
+	res = rpc_write_envelope(&env, POMP_MSGID_RPC_REPLY, req->rpcid, msgid,
+			fmt, args);
+	if (res == 0)
+		res = pomp_conn_send_msg(conn, &env);
+
+	/* Always cleanup message */
+	(void)pomp_msg_clear(&env);
+	return res;
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_rpc_reply_msg(struct pomp_conn *conn,
+		const struct pomp_msg *req, const struct pomp_msg *msg)
+{
+	int res = 0;
+	struct pomp_msg env = POMP_MSG_INITIALIZER;
+
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(req != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(req->rpcid != 0, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(msg->msgid < POMP_MSGID_RESERVED_BASE,
+			-EINVAL);
+
+	res = rpc_wrap_envelope(&env, POMP_MSGID_RPC_REPLY, req->rpcid, msg);
+	if (res == 0)
+		res = pomp_conn_send_msg(conn, &env);
+
+	/* Always cleanup message */
+	(void)pomp_msg_clear(&env);
+	return res;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file pomp_rpc.h
+ *
+ * @brief Request/reply on top of messages.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _POMP_RPC_H_
+#define _POMP_RPC_H_
+
+/* Forward declaration */
+struct pomp_rpc;
+
+/* Rpc functions not part of public API */
+
+struct pomp_rpc *pomp_rpc_new(struct pomp_loop *loop);
+
+int pomp_rpc_destroy(struct pomp_rpc *rpc);
+
+int pomp_rpc_process_request(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		const struct pomp_msg *msg);
+
+int pomp_rpc_process_reply(struct pomp_rpc *rpc, struct pomp_conn *conn,
+		const struct pomp_msg *msg);
+
+int pomp_rpc_cancel_conn(struct pomp_rpc *rpc, struct pomp_conn *conn);
+
+#endif /* !_POMP_RPC_H_ */
@@ -0,0 +1,979 @@
+/**
+ * @file pomp_sub.c
+ *
+ * @brief Message id subscriptions.
+ *
+ * A subscription set is a sorted list of disjoint ranges of message ids.
+ * A subscription table associates a set with each connection of a server
+ * context and maintains an index of subscribers per range of message ids
+ * so broadcast only visits the connections actually interested in a message.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "pomp_priv.h"
+
+/** Number of subscribers copied on the stack during a broadcast, larger
+ * lists are allocated */
+#define POMP_SUB_SNAPSHOT_SIZE	32
+
+/** Initial number of buckets in hash table (shall be a power of 2) */
+#define POMP_SUB_HASH_MIN_SIZE	8
+
+/** End of a hash bucket */
+#define POMP_SUB_HASH_END	UINT32_MAX
+
+/** Subscriptions of a connection */
+struct pomp_sub_entry {
+	struct pomp_conn	*conn;		/**< Subscribed connection */
+	struct pomp_sub_set	set;		/**< Subscribed message ids */
+	uint32_t		next;		/**< Next entry in hash bucket */
+};
+
+/** Range of message ids with the same subscribers */
+struct pomp_sub_segment {
+	uint32_t		first;		/**< First message id of range */
+	uint32_t		last;		/**< Last message id of range */
+	struct pomp_conn	**conns;	/**< Subscribed connections */
+	uint32_t		count;		/**< Number of connections */
+	uint32_t		capacity;	/**< Allocated number of conns */
+};
+
+/** Subscription table */
+struct pomp_sub_table {
+	/** Subscriptions of connections with at least one message id */
+	struct pomp_sub_entry	*entries;
+
+	/** Number of entries */
+	uint32_t		count;
+
+	/** Allocated number of entries */
+	uint32_t		capacity;
+
+	/** Hash table of entries by connection, heads of index chains */
+	uint32_t		*buckets;
+
+	/** Number of buckets in hash table */
+	uint32_t		bucketcount;
+
+	/** Index of subscribers, sorted and disjoint segments of message ids
+	 * with at least one subscriber, adjacent segments having different
+	 * subscribers */
+	struct pomp_sub_segment	*segments;
+
+	/** Number of segments */
+	uint32_t		segcount;
+
+	/** Allocated number of segments */
+	uint32_t		segcapacity;
+
+	/** Index could not be updated, broadcast scans all subscriptions
+	 * until it is rebuilt */
+	int			stale;
+
+	/** Incremented at each change of subscriptions */
+	uint32_t		generation;
+};
+
+/**
+ * Replace some ranges of a set by new ones.
+ * @param set : subscription set.
+ * @param idx : index of first range to replace.
+ * @param oldcount : number of ranges to replace.
+ * @param ranges : new ranges.
+ * @param newcount : number of new ranges.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_set_splice(struct pomp_sub_set *set, uint32_t idx,
+		uint32_t oldcount, const struct pomp_sub_range *ranges,
+		uint32_t newcount)
+{
+	uint32_t count = set->count - oldcount + newcount;
+	uint32_t capacity = 0;
+	struct pomp_sub_range *newranges = NULL;
+
+	/* Make sure there is enough room */
+	if (count > set->capacity) {
+		capacity = set->capacity == 0 ? 4 : set->capacity * 2;
+		while (capacity < count)
+			capacity *= 2;
+		newranges = realloc(set->ranges,
+				capacity * sizeof(struct pomp_sub_range));
+		if (newranges == NULL)
+			return -ENOMEM;
+		set->ranges = newranges;
+		set->capacity = capacity;
+	}
+
+	/* Move ranges after the replaced ones and copy new ones */
+	memmove(&set->ranges[idx + newcount], &set->ranges[idx + oldcount],
+			(set->count - idx - oldcount) *
+			sizeof(struct pomp_sub_range));
+	if (newcount > 0)
+		memcpy(&set->ranges[idx], ranges,
+				newcount * sizeof(struct pomp_sub_range));
+	set->count = count;
+	return 0;
+}
+
+/**
+ * Add a range of message ids in a subscription set. Overlapping or adjacent
+ * ranges are merged.
+ * @param set : subscription set.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_sub_set_add(struct pomp_sub_set *set, uint32_t first, uint32_t last)
+{
+	uint32_t i = 0, j = 0;
+	struct pomp_sub_range range;
+	POMP_RETURN_ERR_IF_FAILED(set != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(first <= last, -EINVAL);
+
+	/* Find ranges overlapping or adjacent to the new one */
+	while (i < set->count && (uint64_t)set->ranges[i].last + 1 < first)
+		i++;
+	j = i;
+	while (j < set->count && set->ranges[j].first <= (uint64_t)last + 1)
+		j++;
+
+	/* Merge them */
+	range.first = first;
+	range.last = last;
+	if (j > i) {
+		if (set->ranges[i].first < range.first)
+			range.first = set->ranges[i].first;
+		if (set->ranges[j - 1].last > range.last)
+			range.last = set->ranges[j - 1].last;
+	}
+
+	return sub_set_splice(set, i, j - i, &range, 1);
+}
+
+/**
+ * Remove a range of message ids from a subscription set.
+ * @param set : subscription set.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_sub_set_remove(struct pomp_sub_set *set,
+		uint32_t first, uint32_t last)
+{
+	uint32_t i = 0, j = 0, n = 0;
+	struct pomp_sub_range ranges[2];
+	POMP_RETURN_ERR_IF_FAILED(set != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(first <= last, -EINVAL);
+
+	/* Find ranges overlapping the removed one */
+	while (i < set->count && set->ranges[i].last < first)
+		i++;
+	j = i;
+	while (j < set->count && set->ranges[j].first <= last)
+		j++;
+	if (j == i)
+		return 0;
+
+	/* Keep the parts outside the removed range */
+	if (set->ranges[i].first < first) {
+		ranges[n].first = set->ranges[i].first;
+		ranges[n].last = first - 1;
+		n++;
+	}
+	if (set->ranges[j - 1].last > last) {
+		ranges[n].first = last + 1;
+		ranges[n].last = set->ranges[j - 1].last;
+		n++;
+	}
+
+	return sub_set_splice(set, i, j - i, ranges, n);
+}
+
+/**
+ * Determine if a message id is in a subscription set.
+ * @param set : subscription set.
+ * @param msgid : message id.
+ * @return 1 if the message id is in the set, 0 otherwise.
+ */
+int pomp_sub_set_contains(const struct pomp_sub_set *set, uint32_t msgid)
+{
+	uint32_t lo = 0, hi = 0, mid = 0;
+	POMP_RETURN_VAL_IF_FAILED(set != NULL, -EINVAL, 0);
+
+	/* Binary search in sorted ranges */
+	hi = set->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (msgid < set->ranges[mid].first)
+			hi = mid;
+		else if (msgid > set->ranges[mid].last)
+			lo = mid + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Remove all message ids from a subscription set and free its resources.
+ * @param set : subscription set.
+ */
+void pomp_sub_set_clear(struct pomp_sub_set *set)
+{
+	if (set == NULL)
+		return;
+	free(set->ranges);
+	set->ranges = NULL;
+	set->count = 0;
+	set->capacity = 0;
+}
+
+/**
+ * Get the hash bucket of a connection.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @return address of the head of the bucket.
+ */
+static uint32_t *sub_table_bucket(const struct pomp_sub_table *table,
+		const struct pomp_conn *conn)
+{
+	uintptr_t key = (uintptr_t)conn;
+	key ^= key >> 16;
+	key ^= key >> 7;
+	return &table->buckets[key & (table->bucketcount - 1)];
+}
+
+/**
+ * Find the subscriptions of a connection.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @return index of entry or -1 if the connection has no subscription.
+ */
+static int sub_table_find(const struct pomp_sub_table *table,
+		const struct pomp_conn *conn)
+{
+	uint32_t i = 0;
+
+	if (table->count == 0)
+		return -1;
+
+	i = *sub_table_bucket(table, conn);
+	while (i != POMP_SUB_HASH_END && table->entries[i].conn != conn)
+		i = table->entries[i].next;
+	return i != POMP_SUB_HASH_END ? (int)i : -1;
+}
+
+/**
+ * Add an entry in the hash table.
+ * @param table : subscription table.
+ * @param idx : index of entry.
+ */
+static void sub_table_link(struct pomp_sub_table *table, uint32_t idx)
+{
+	uint32_t *bucket = sub_table_bucket(table, table->entries[idx].conn);
+	table->entries[idx].next = *bucket;
+	*bucket = idx;
+}
+
+/**
+ * Remove an entry from the hash table.
+ * @param table : subscription table.
+ * @param idx : index of entry.
+ */
+static void sub_table_unlink(struct pomp_sub_table *table, uint32_t idx)
+{
+	uint32_t *prev = sub_table_bucket(table, table->entries[idx].conn);
+	while (*prev != idx)
+		prev = &table->entries[*prev].next;
+	*prev = table->entries[idx].next;
+}
+
+/**
+ * Make sure one more entry can be added.
+ * @param table : subscription table.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_table_ensure_capacity(struct pomp_sub_table *table)
+{
+	uint32_t i = 0, count = 0;
+	struct pomp_sub_entry *entries = NULL;
+	uint32_t *buckets = NULL;
+
+	/* Grow entries */
+	if (table->count >= table->capacity) {
+		count = table->capacity == 0 ? 4 : table->capacity * 2;
+		entries = realloc(table->entries, count * sizeof(*entries));
+		if (entries == NULL)
+			return -ENOMEM;
+		table->entries = entries;
+		table->capacity = count;
+	}
+
+	/* Grow hash table to keep a load factor below 1 */
+	if (table->count >= table->bucketcount) {
+		count = table->bucketcount == 0 ? POMP_SUB_HASH_MIN_SIZE :
+				table->bucketcount * 2;
+		buckets = malloc(count * sizeof(*buckets));
+		if (buckets == NULL)
+			return -ENOMEM;
+		for (i = 0; i < count; i++)
+			buckets[i] = POMP_SUB_HASH_END;
+		free(table->buckets);
+		table->buckets = buckets;
+		table->bucketcount = count;
+
+		/* Rehash all entries */
+		for (i = 0; i < table->count; i++)
+			sub_table_link(table, i);
+	}
+
+	return 0;
+}
+
+/**
+ * Remove an entry from the table, the last entry takes its place.
+ * @param table : subscription table.
+ * @param idx : index of entry to remove.
+ */
+static void sub_table_remove_entry(struct pomp_sub_table *table, uint32_t idx)
+{
+	uint32_t last = table->count - 1;
+
+	pomp_sub_set_clear(&table->entries[idx].set);
+	sub_table_unlink(table, idx);
+	if (idx != last) {
+		sub_table_unlink(table, last);
+		table->entries[idx] = table->entries[last];
+		sub_table_link(table, idx);
+	}
+	table->count--;
+}
+
+/**
+ * Determine if a connection is subscribed to a message id.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @param msgid : message id.
+ * @return 1 if the connection is subscribed, 0 otherwise.
+ */
+static int sub_table_is_subscribed(const struct pomp_sub_table *table,
+		const struct pomp_conn *conn, uint32_t msgid)
+{
+	int idx = sub_table_find(table, conn);
+	return idx >= 0 && pomp_sub_set_contains(&table->entries[idx].set,
+			msgid);
+}
+
+/**
+ * Add a connection in the subscribers of a segment if not already there.
+ * @param seg : segment.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_segment_add_conn(struct pomp_sub_segment *seg,
+		struct pomp_conn *conn)
+{
+	uint32_t i = 0, capacity = 0;
+	struct pomp_conn **conns = NULL;
+
+	for (i = 0; i < seg->count; i++) {
+		if (seg->conns[i] == conn)
+			return 0;
+	}
+
+	if (seg->count >= seg->capacity) {
+		capacity = seg->capacity == 0 ? 4 : seg->capacity * 2;
+		conns = realloc(seg->conns, capacity * sizeof(*conns));
+		if (conns == NULL)
+			return -ENOMEM;
+		seg->conns = conns;
+		seg->capacity = capacity;
+	}
+	seg->conns[seg->count++] = conn;
+	return 0;
+}
+
+/**
+ * Remove a connection from the subscribers of a segment, keeping the order
+ * of the others.
+ * @param seg : segment.
+ * @param conn : connection.
+ */
+static void sub_segment_remove_conn(struct pomp_sub_segment *seg,
+		const struct pomp_conn *conn)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < seg->count; i++) {
+		if (seg->conns[i] == conn) {
+			memmove(&seg->conns[i], &seg->conns[i + 1],
+					(seg->count - i - 1) *
+					sizeof(struct pomp_conn *));
+			seg->count--;
+			return;
+		}
+	}
+}
+
+/**
+ * Determine if two segments have the same subscribers.
+ * @param seg1 : first segment.
+ * @param seg2 : second segment.
+ * @return 1 if subscribers are the same, 0 otherwise.
+ */
+static int sub_segment_same_conns(const struct pomp_sub_segment *seg1,
+		const struct pomp_sub_segment *seg2)
+{
+	uint32_t i = 0, j = 0;
+
+	if (seg1->count != seg2->count)
+		return 0;
+
+	/* Subscribers of a segment are unique */
+	for (i = 0; i < seg1->count; i++) {
+		for (j = 0; j < seg2->count; j++) {
+			if (seg1->conns[i] == seg2->conns[j])
+				break;
+		}
+		if (j == seg2->count)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Find the first segment of the index not before a message id.
+ * @param table : subscription table.
+ * @param msgid : message id.
+ * @return index of the first segment whose last message id is greater or
+ * equal to the given one, number of segments if none.
+ */
+static uint32_t sub_index_lower(const struct pomp_sub_table *table,
+		uint32_t msgid)
+{
+	uint32_t lo = 0, hi = table->segcount, mid = 0;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (table->segments[mid].last < msgid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * Insert a segment without subscribers in the index.
+ * @param table : subscription table.
+ * @param idx : position of the new segment.
+ * @param first : first message id of segment.
+ * @param last : last message id of segment.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_index_insert(struct pomp_sub_table *table, uint32_t idx,
+		uint32_t first, uint32_t last)
+{
+	uint32_t capacity = 0;
+	struct pomp_sub_segment *segments = NULL;
+
+	if (table->segcount >= table->segcapacity) {
+		capacity = table->segcapacity == 0 ? 4 :
+				table->segcapacity * 2;
+		segments = realloc(table->segments,
+				capacity * sizeof(*segments));
+		if (segments == NULL)
+			return -ENOMEM;
+		table->segments = segments;
+		table->segcapacity = capacity;
+	}
+
+	memmove(&table->segments[idx + 1], &table->segments[idx],
+			(table->segcount - idx) * sizeof(*segments));
+	memset(&table->segments[idx], 0, sizeof(table->segments[idx]));
+	table->segments[idx].first = first;
+	table->segments[idx].last = last;
+	table->segcount++;
+	return 0;
+}
+
+/**
+ * Remove a segment from the index.
+ * @param table : subscription table.
+ * @param idx : index of segment to remove.
+ */
+static void sub_index_erase(struct pomp_sub_table *table, uint32_t idx)
+{
+	free(table->segments[idx].conns);
+	memmove(&table->segments[idx], &table->segments[idx + 1],
+			(table->segcount - idx - 1) *
+			sizeof(struct pomp_sub_segment));
+	table->segcount--;
+}
+
+/**
+ * Make sure no segment of the index contains both a message id and the
+ * previous one, splitting the segment if needed.
+ * @param table : subscription table.
+ * @param msgid : message id starting a segment.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_index_split(struct pomp_sub_table *table, uint32_t msgid)
+{
+	int res = 0;
+	uint32_t idx = 0;
+	struct pomp_sub_segment *seg = NULL;
+	struct pomp_conn **conns = NULL;
+
+	idx = sub_index_lower(table, msgid);
+	if (idx >= table->segcount || table->segments[idx].first >= msgid)
+		return 0;
+
+	/* Copy subscribers for the upper part */
+	seg = &table->segments[idx];
+	conns = malloc(seg->count * sizeof(*conns));
+	if (conns == NULL)
+		return -ENOMEM;
+	memcpy(conns, seg->conns, seg->count * sizeof(*conns));
+
+	res = sub_index_insert(table, idx + 1, msgid, seg->last);
+	if (res < 0) {
+		free(conns);
+		return res;
+	}
+
+	seg = &table->segments[idx];
+	seg->last = msgid - 1;
+	table->segments[idx + 1].conns = conns;
+	table->segments[idx + 1].count = seg->count;
+	table->segments[idx + 1].capacity = seg->count;
+	return 0;
+}
+
+/**
+ * Merge a segment of the index with the previous one if they are adjacent
+ * and have the same subscribers.
+ * @param table : subscription table.
+ * @param idx : index of segment.
+ */
+static void sub_index_merge(struct pomp_sub_table *table, uint32_t idx)
+{
+	struct pomp_sub_segment *prev = NULL, *seg = NULL;
+
+	if (idx == 0 || idx >= table->segcount)
+		return;
+
+	prev = &table->segments[idx - 1];
+	seg = &table->segments[idx];
+	if (prev->last + 1 != seg->first || !sub_segment_same_conns(prev, seg))
+		return;
+
+	prev->last = seg->last;
+	sub_index_erase(table, idx);
+}
+
+/**
+ * Merge the segments of the index touched by an update.
+ * @param table : subscription table.
+ * @param lo : index of first touched segment.
+ * @param hi : index of first segment after the touched ones.
+ */
+static void sub_index_merge_range(struct pomp_sub_table *table,
+		uint32_t lo, uint32_t hi)
+{
+	uint32_t i = 0;
+
+	/* From the end so indices of remaining segments are kept */
+	for (i = hi + 1; i > lo; i--)
+		sub_index_merge(table, i - 1);
+}
+
+/**
+ * Add a connection in the index for a range of message ids.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_index_add(struct pomp_sub_table *table, struct pomp_conn *conn,
+		uint32_t first, uint32_t last)
+{
+	int res = 0;
+	uint32_t lo = 0, idx = 0, end = 0;
+	uint64_t cursor = first;
+
+	/* Bounds of the range become bounds of segments */
+	res = sub_index_split(table, first);
+	if (res == 0 && last != UINT32_MAX)
+		res = sub_index_split(table, last + 1);
+	if (res < 0)
+		return res;
+
+	/* Add the connection in existing segments, create them in gaps */
+	lo = idx = sub_index_lower(table, first);
+	while (cursor <= last) {
+		if (idx < table->segcount &&
+				table->segments[idx].first == cursor) {
+			end = table->segments[idx].last;
+		} else {
+			end = idx < table->segcount &&
+					table->segments[idx].first <= last ?
+					table->segments[idx].first - 1 : last;
+			res = sub_index_insert(table, idx,
+					(uint32_t)cursor, end);
+			if (res < 0)
+				return res;
+		}
+		res = sub_segment_add_conn(&table->segments[idx], conn);
+		if (res < 0)
+			return res;
+		cursor = (uint64_t)end + 1;
+		idx++;
+	}
+
+	sub_index_merge_range(table, lo, idx);
+	return 0;
+}
+
+/**
+ * Remove a connection from the index for a range of message ids.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_index_remove(struct pomp_sub_table *table,
+		const struct pomp_conn *conn, uint32_t first, uint32_t last)
+{
+	int res = 0;
+	uint32_t lo = 0, idx = 0;
+
+	/* Bounds of the range become bounds of segments */
+	res = sub_index_split(table, first);
+	if (res == 0 && last != UINT32_MAX)
+		res = sub_index_split(table, last + 1);
+	if (res < 0)
+		return res;
+
+	/* Segments without subscribers are removed */
+	lo = idx = sub_index_lower(table, first);
+	while (idx < table->segcount && table->segments[idx].first <= last) {
+		sub_segment_remove_conn(&table->segments[idx], conn);
+		if (table->segments[idx].count == 0)
+			sub_index_erase(table, idx);
+		else
+			idx++;
+	}
+
+	sub_index_merge_range(table, lo, idx);
+	return 0;
+}
+
+/**
+ * Remove all segments of the index.
+ * @param table : subscription table.
+ */
+static void sub_index_clear(struct pomp_sub_table *table)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < table->segcount; i++)
+		free(table->segments[i].conns);
+	table->segcount = 0;
+}
+
+/**
+ * Rebuild the index from the subscriptions of all connections.
+ * @param table : subscription table.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int sub_index_rebuild(struct pomp_sub_table *table)
+{
+	int res = 0;
+	uint32_t i = 0, j = 0;
+	const struct pomp_sub_set *set = NULL;
+
+	sub_index_clear(table);
+	for (i = 0; i < table->count; i++) {
+		set = &table->entries[i].set;
+		for (j = 0; j < set->count; j++) {
+			res = sub_index_add(table, table->entries[i].conn,
+					set->ranges[j].first,
+					set->ranges[j].last);
+			if (res < 0)
+				return res;
+		}
+	}
+
+	table->stale = 0;
+	return 0;
+}
+
+/**
+ * Remove all subscriptions of an entry from the index.
+ * @param table : subscription table.
+ * @param idx : index of entry.
+ */
+static void sub_index_remove_entry(struct pomp_sub_table *table, uint32_t idx)
+{
+	uint32_t i = 0;
+	const struct pomp_sub_entry *entry = &table->entries[idx];
+
+	for (i = 0; i < entry->set.count && !table->stale; i++) {
+		if (sub_index_remove(table, entry->conn,
+				entry->set.ranges[i].first,
+				entry->set.ranges[i].last) < 0) {
+			table->stale = 1;
+		}
+	}
+}
+
+/**
+ * Create a new subscription table.
+ * @return subscription table or NULL in case of error.
+ */
+struct pomp_sub_table *pomp_sub_table_new(void)
+{
+	return calloc(1, sizeof(struct pomp_sub_table));
+}
+
+/**
+ * Destroy a subscription table.
+ * @param table : subscription table.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_sub_table_destroy(struct pomp_sub_table *table)
+{
+	uint32_t i = 0;
+	POMP_RETURN_ERR_IF_FAILED(table != NULL, -EINVAL);
+
+	for (i = 0; i < table->count; i++)
+		pomp_sub_set_clear(&table->entries[i].set);
+	sub_index_clear(table);
+	free(table->segments);
+	free(table->buckets);
+	free(table->entries);
+	free(table);
+	return 0;
+}
+
+/**
+ * Subscribe or unsubscribe a connection to a range of message ids.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @param first : first message id of range.
+ * @param last : last message id of range (included).
+ * @param subscribe : 1 to subscribe, 0 to unsubscribe.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_sub_table_update(struct pomp_sub_table *table,
+		struct pomp_conn *conn, uint32_t first, uint32_t last,
+		int subscribe)
+{
+	int res = 0;
+	int idx = 0;
+	struct pomp_sub_entry *entry = NULL;
+
+	POMP_RETURN_ERR_IF_FAILED(table != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(first <= last, -EINVAL);
+
+	idx = sub_table_find(table, conn);
+	if (idx < 0) {
+		/* Nothing to do if connection was not subscribed */
+		if (!subscribe)
+			return 0;
+
+		/* Add a new entry */
+		res = sub_table_ensure_capacity(table);
+		if (res < 0)
+			return res;
+		idx = (int)table->count++;
+		table->entries[idx].conn = conn;
+		memset(&table->entries[idx].set, 0,
+				sizeof(table->entries[idx].set));
+		sub_table_link(table, (uint32_t)idx);
+	}
+
+	/* Update set of connection */
+	entry = &table->entries[idx];
+	if (subscribe)
+		res = pomp_sub_set_add(&entry->set, first, last);
+	else
+		res = pomp_sub_set_remove(&entry->set, first, last);
+
+	/* Only keep connections with subscriptions */
+	if (entry->set.count == 0)
+		sub_table_remove_entry(table, (uint32_t)idx);
+
+	/* Update the index with the set, or rebuild it after a failure */
+	if (res == 0 && !table->stale) {
+		if (subscribe)
+			table->stale = sub_index_add(table, conn,
+					first, last) < 0;
+		else
+			table->stale = sub_index_remove(table, conn,
+					first, last) < 0;
+	} else if (res == 0) {
+		(void)sub_index_rebuild(table);
+	}
+
+	table->generation++;
+	return res;
+}
+
+/**
+ * Remove all subscriptions of a connection.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_sub_table_remove_conn(struct pomp_sub_table *table,
+		struct pomp_conn *conn)
+{
+	int idx = 0;
+	POMP_RETURN_ERR_IF_FAILED(table != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+
+	idx = sub_table_find(table, conn);
+	if (idx >= 0) {
+		sub_index_remove_entry(table, (uint32_t)idx);
+		sub_table_remove_entry(table, (uint32_t)idx);
+		if (table->stale)
+			(void)sub_index_rebuild(table);
+		table->generation++;
+	}
+	return 0;
+}
+
+/**
+ * Remove a connection from the table, giving its subscriptions to the caller.
+ * @param table : subscription table.
+ * @param conn : connection.
+ * @param set : returned subscriptions, empty if the connection had none. The
+ * caller shall clear it with pomp_sub_set_clear.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_sub_table_take_conn(struct pomp_sub_table *table,
+		struct pomp_conn *conn, struct pomp_sub_set *set)
+{
+	int idx = 0;
+	POMP_RETURN_ERR_IF_FAILED(table != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(conn != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(set != NULL, -EINVAL);
+
+	memset(set, 0, sizeof(*set));
+	idx = sub_table_find(table, conn);
+	if (idx >= 0) {
+		/* Move the set before removing the entry */
+		sub_index_remove_entry(table, (uint32_t)idx);
+		*set = table->entries[idx].set;
+		memset(&table->entries[idx].set, 0,
+				sizeof(table->entries[idx].set));
+		sub_table_remove_entry(table, (uint32_t)idx);
+		if (table->stale)
+			(void)sub_index_rebuild(table);
+		table->generation++;
+	}
+	return 0;
+}
+
+/**
+ * Call a function for each connection subscribed to a message id.
+ * Subscribers are found in the index, so broadcast does not depend on the
+ * number of connections.
+ * @param table : subscription table.
+ * @param msgid : message id.
+ * @param cb : function to call for each subscribed connection.
+ * @param userdata : callback user data.
+ * @return 0 in case of success, negative errno value in case of error.
+ *
+ * @remarks the subscribers are taken when the iteration starts. If
+ * subscriptions are modified by the callback, connections subscribed since
+ * are not visited and connections removed since are skipped.
+ */
+int pomp_sub_table_foreach(struct pomp_sub_table *table, uint32_t msgid,
+		pomp_sub_table_cb_t cb, void *userdata)
+{
+	uint32_t i = 0, count = 0;
+	uint32_t generation = 0;
+	const struct pomp_sub_segment *seg = NULL;
+	struct pomp_conn *snapshot[POMP_SUB_SNAPSHOT_SIZE];
+	struct pomp_conn **conns = snapshot;
+
+	POMP_RETURN_ERR_IF_FAILED(table != NULL, -EINVAL);
+	POMP_RETURN_ERR_IF_FAILED(cb != NULL, -EINVAL);
+
+	/* Find subscribers in the index, or scan all subscriptions */
+	if (!table->stale) {
+		i = sub_index_lower(table, msgid);
+		if (i >= table->segcount || table->segments[i].first > msgid)
+			return 0;
+		seg = &table->segments[i];
+		count = seg->count;
+	} else {
+		count = table->count;
+	}
+
+	/* Take a snapshot, callbacks may change subscriptions */
+	if (count > POMP_SUB_SNAPSHOT_SIZE) {
+		conns = malloc(count * sizeof(*conns));
+		if (conns == NULL)
+			return -ENOMEM;
+	}
+	if (seg != NULL) {
+		memcpy(conns, seg->conns, count * sizeof(*conns));
+	} else {
+		count = 0;
+		for (i = 0; i < table->count; i++) {
+			if (pomp_sub_set_contains(&table->entries[i].set,
+					msgid)) {
+				conns[count++] = table->entries[i].conn;
+			}
+		}
+	}
+
+	generation = table->generation;
+	for (i = 0; i < count; i++) {
+		/* Skip connections removed by previous callbacks */
+		if (table->generation != generation &&
+				!sub_table_is_subscribed(table, conns[i],
+				msgid)) {
+			continue;
+		}
+		(*cb)(conns[i], userdata);
+	}
+
+	if (conns != snapshot)
+		free(conns);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file pomp_sub.h
+ *
+ * @brief Message id subscriptions.
+ *
+ * A subscription set is a sorted list of disjoint ranges of message ids.
+ * A subscription table associates a set with each connection of a server
+ * context and maintains an index of subscribers per range of message ids
+ * so broadcast only visits the connections actually interested in a message.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _POMP_SUB_H_
+#define _POMP_SUB_H_
+
+/** Range of message ids (bounds included) */
+struct pomp_sub_range {
+	uint32_t	first;		/**< First message id of range */
+	uint32_t	last;		/**< Last message id of range */
+};
+
+/** Set of message ids, stored as sorted and disjoint ranges */
+struct pomp_sub_set {
+	struct pomp_sub_range	*ranges;	/**< Array of ranges */
+	uint32_t		count;		/**< Number of ranges */
+	uint32_t		capacity;	/**< Allocated number of ranges */
+};
+
+/** Subscription set initializer */
+#define POMP_SUB_SET_INITIALIZER	{NULL, 0, 0}
+
+/* Forward declaration */
+struct pomp_sub_table;
+
+/**
+ * Subscription table iteration callback.
+ * @param conn : subscribed connection.
+ * @param userdata : callback user data.
+ */
+typedef void (*pomp_sub_table_cb_t)(struct pomp_conn *conn, void *userdata);
+
+/* Subscription set functions */
+
+int pomp_sub_set_add(struct pomp_sub_set *set, uint32_t first, uint32_t last);
+
+int pomp_sub_set_remove(struct pomp_sub_set *set,
+		uint32_t first, uint32_t last);
+
+int pomp_sub_set_contains(const struct pomp_sub_set *set, uint32_t msgid);
+
+void pomp_sub_set_clear(struct pomp_sub_set *set);
+
+/* Subscription table functions */
+
+struct pomp_sub_table *pomp_sub_table_new(void);
+
+int pomp_sub_table_destroy(struct pomp_sub_table *table);
+
+int pomp_sub_table_update(struct pomp_sub_table *table,
+		struct pomp_conn *conn, uint32_t first, uint32_t last,
+		int subscribe);
+
+int pomp_sub_table_remove_conn(struct pomp_sub_table *table,
+		struct pomp_conn *conn);
+
+int pomp_sub_table_take_conn(struct pomp_sub_table *table,
+		struct pomp_conn *conn, struct pomp_sub_set *set);
+
+int pomp_sub_table_foreach(struct pomp_sub_table *table, uint32_t msgid,
+		pomp_sub_table_cb_t cb, void *userdata);
+
+#endif /* !_POMP_SUB_H_ */
@@ -0,0 +1,259 @@
+/**
+ * @file pomp_thread.h
+ *
+ * @brief Thread synchronization primitives.
+ *
+ * @author yves-marie.morgan@parrot.com
+ *
+ * Copyright (c) 2014 Parrot S.A.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the <organization> nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _POMP_THREAD_H_
+#define _POMP_THREAD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Mutex */
+struct pomp_mutex {
+#if defined(POMP_HAVE_PTHREAD)
+	pthread_mutex_t		mutex;		/**< Posix mutex */
+#elif defined(_WIN32)
+	CRITICAL_SECTION	cs;		/**< Critical section */
+#else
+	int			dummy;		/**< No thread support */
+#endif
+};
+
+/**
+ * Initialize a mutex.
+ * @param mutex : mutex to initialize.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static inline int pomp_mutex_init(struct pomp_mutex *mutex)
+{
+#if defined(POMP_HAVE_PTHREAD)
+	int res = pthread_mutex_init(&mutex->mutex, NULL);
+	if (res != 0) {
+		POMP_LOGE("pthread_mutex_init err=%d(%s)", res, strerror(res));
+		return -res;
+	}
+#elif defined(_WIN32)
+	InitializeCriticalSection(&mutex->cs);
+#endif
+	return 0;
+}
+
+/**
+ * Clear a mutex.
+ * @param mutex : mutex to clear.
+ */
+static inline void pomp_mutex_clear(struct pomp_mutex *mutex)
+{
+#if defined(POMP_HAVE_PTHREAD)
+	pthread_mutex_destroy(&mutex->mutex);
+#elif defined(_WIN32)
+	DeleteCriticalSection(&mutex->cs);
+#endif
+}
+
+/**
+ * Lock a mutex.
+ * @param mutex : mutex to lock.
+ */
+static inline void pomp_mutex_lock(struct pomp_mutex *mutex)
+{
+#if defined(POMP_HAVE_PTHREAD)
+	pthread_mutex_lock(&mutex->mutex);
+#elif defined(_WIN32)
+	EnterCriticalSection(&mutex->cs);
+#endif
+}
+
+/**
+ * Unlock a mutex.
+ * @param mutex : mutex to unlock.
+ */
+static inline void pomp_mutex_unlock(struct pomp_mutex *mutex)
+{
+#if defined(POMP_HAVE_PTHREAD)
+	pthread_mutex_unlock(&mutex->mutex);
+#elif defined(_WIN32)
+	LeaveCriticalSection(&mutex->cs);
+#endif
+}
+
+/** Condition variables are only available with posix threads */
+#ifdef POMP_HAVE_PTHREAD
+#  define POMP_HAVE_COND
+#endif /* POMP_HAVE_PTHREAD */
+
+/** Condition variable */
+struct pomp_cond {
+#ifdef POMP_HAVE_COND
+	pthread_cond_t		cond;		/**< Posix condition */
+#else
+	int			dummy;		/**< No thread support */
+#endif
+};
+
+/**
+ * Initialize a condition variable.
+ * @param cond : condition variable to initialize.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static inline int pomp_cond_init(struct pomp_cond *cond)
+{
+#ifdef POMP_HAVE_COND
+	int res = pthread_cond_init(&cond->cond, NULL);
+	if (res != 0) {
+		POMP_LOGE("pthread_cond_init err=%d(%s)", res, strerror(res));
+		return -res;
+	}
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/**
+ * Clear a condition variable.
+ * @param cond : condition variable to clear.
+ */
+static inline void pomp_cond_clear(struct pomp_cond *cond)
+{
+#ifdef POMP_HAVE_COND
+	pthread_cond_destroy(&cond->cond);
+#endif
+}
+
+/**
+ * Wait for a condition variable to be signaled.
+ * @param cond : condition variable.
+ * @param mutex : associated mutex, locked by caller.
+ */
+static inline void pomp_cond_wait(struct pomp_cond *cond,
+		struct pomp_mutex *mutex)
+{
+#ifdef POMP_HAVE_COND
+	pthread_cond_wait(&cond->cond, &mutex->mutex);
+#endif
+}
+
+/**
+ * Wake up one waiter of a condition variable.
+ * @param cond : condition variable.
+ */
+static inline void pomp_cond_signal(struct pomp_cond *cond)
+{
+#ifdef POMP_HAVE_COND
+	pthread_cond_signal(&cond->cond);
+#endif
+}
+
+/**
+ * Wake up all waiters of a condition variable.
+ * @param cond : condition variable.
+ */
+static inline void pomp_cond_broadcast(struct pomp_cond *cond)
+{
+#ifdef POMP_HAVE_COND
+	pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+/**
+ * Atomically replace a pointer if it still has the expected value.
+ * @param ptr : address of the pointer to update.
+ * @param oldval : expected value.
+ * @param newval : new value.
+ * @return previous value, equal to 'oldval' if the pointer was updated.
+ */
+static inline void *pomp_atomic_cas_ptr(void *volatile *ptr,
+		void *oldval, void *newval)
+{
+#if defined(__GNUC__)
+	return __sync_val_compare_and_swap(ptr, oldval, newval);
+#elif defined(_WIN32)
+	return InterlockedCompareExchangePointer(ptr, newval, oldval);
+#else
+#error No atomic compare and swap function found on this platform
+#endif
+}
+
+/**
+ * Atomically increment an integer.
+ * @param ptr : address of the integer to update.
+ * @return new value.
+ */
+static inline uint32_t pomp_atomic_inc_u32(volatile uint32_t *ptr)
+{
+#if defined(__GNUC__)
+	return __sync_add_and_fetch(ptr, 1);
+#elif defined(_WIN32)
+	return (uint32_t)InterlockedIncrement((volatile LONG *)ptr);
+#else
+#error No atomic increment function found on this platform
+#endif
+}
+
+/**
+ * Atomically replace a pointer.
+ * @param ptr : address of the pointer to update.
+ * @param newval : new value.
+ * @return previous value.
+ */
+static inline void *pomp_atomic_xchg_ptr(void *volatile *ptr, void *newval)
+{
+	void *oldval = NULL;
+	do {
+		oldval = *ptr;
+	} while (pomp_atomic_cas_ptr(ptr, oldval, newval) != oldval);
+	return oldval;
+}
+
+/**
+ * Hint the cpu that the caller is spinning, to reduce power and let a
+ * sibling hardware thread run.
+ */
+static inline void pomp_cpu_relax(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__asm__ __volatile__("pause");
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+	__asm__ __volatile__("yield");
+#elif defined(_WIN32)
+	YieldProcessor();
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_POMP_THREAD_H_ */
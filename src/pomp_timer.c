@@ -67,6 +67,169 @@ const struct pomp_timer_ops *pomp_timer_set_ops(
 	return prev;
 }
 
+/**
+ * Arm the shared timer of a loop for the earliest latest expiration of its
+ * timers with slack, so all timers whose windows overlap it fire together.
+ * @param loop : loop.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_timer_slack_schedule(struct pomp_loop *loop)
+{
+	struct pomp_timer *timer = NULL;
+	uint64_t latest = 0, now = 0;
+	int res = 0;
+
+	if (loop->slack.timer == NULL)
+		return 0;
+
+	if (loop->slack.timers == NULL)
+		return (*s_pomp_timer_ops->timer_clear)(loop->slack.timer);
+
+	latest = UINT64_MAX;
+	for (timer = loop->slack.timers; timer != NULL;
+			timer = timer->slack.next) {
+		if (timer->slack.deadline + timer->slack.value < latest)
+			latest = timer->slack.deadline + timer->slack.value;
+	}
+
+	res = time_get_monotonic_us(&now);
+	if (res < 0)
+		return res;
+	return (*s_pomp_timer_ops->timer_set)(loop->slack.timer,
+			latest > now ? latest - now : 1, 0);
+}
+
+/**
+ * Remove a timer from the list of armed timers with slack of its loop.
+ * @param timer : timer.
+ */
+static void pomp_timer_slack_unlink(struct pomp_timer *timer)
+{
+	struct pomp_timer **link = NULL;
+
+	for (link = &timer->loop->slack.timers; *link != NULL;
+			link = &(*link)->slack.next) {
+		if (*link == timer) {
+			*link = timer->slack.next;
+			break;
+		}
+	}
+	timer->slack.next = NULL;
+	timer->slack.armed = 0;
+}
+
+/**
+ * Notify the timers with slack that have reached their earliest expiration.
+ * @param shared : shared timer of the loop.
+ * @param userdata : loop.
+ */
+static void pomp_timer_slack_cb(struct pomp_timer *shared, void *userdata)
+{
+	struct pomp_loop *loop = userdata;
+	struct pomp_timer *timer = NULL;
+	uint64_t now = 0;
+
+	if (time_get_monotonic_us(&now) < 0)
+		return;
+
+	/* Restart from the head after each callback as it can modify the
+	 * list, expired timers are either removed or moved to a later
+	 * deadline so this terminates */
+	timer = loop->slack.timers;
+	while (timer != NULL) {
+		if (timer->slack.deadline > now) {
+			timer = timer->slack.next;
+			continue;
+		}
+
+		if (timer->slack.period != 0) {
+			while (timer->slack.deadline <= now)
+				timer->slack.deadline += timer->slack.period;
+		} else {
+			pomp_timer_slack_unlink(timer);
+		}
+		(*timer->cb)(timer, timer->userdata);
+		timer = loop->slack.timers;
+	}
+
+	pomp_timer_slack_schedule(loop);
+}
+
+/**
+ * Set a timer with slack, coalesced with the other timers of its loop.
+ * @param timer : timer.
+ * @param delay : expiration delay in microseconds, 0 to clear.
+ * @param period : period in microseconds, 0 for a one shot timer.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_timer_slack_set(struct pomp_timer *timer, uint64_t delay,
+		uint64_t period)
+{
+	int res = 0;
+	uint64_t now = 0;
+	struct pomp_loop *loop = timer->loop;
+
+	if (timer->slack.armed)
+		pomp_timer_slack_unlink(timer);
+
+	if (delay != 0) {
+		res = time_get_monotonic_us(&now);
+		if (res < 0)
+			return res;
+
+		/* Create shared timer on first use */
+		if (loop->slack.timer == NULL) {
+			loop->slack.timer = (*s_pomp_timer_ops->timer_new)(loop,
+					&pomp_timer_slack_cb, loop);
+			if (loop->slack.timer == NULL)
+				return -ENOMEM;
+		}
+
+		timer->slack.deadline = now + delay;
+		timer->slack.period = period;
+		timer->slack.armed = 1;
+		timer->slack.next = loop->slack.timers;
+		loop->slack.timers = timer;
+	}
+
+	return pomp_timer_slack_schedule(loop);
+}
+
+/**
+ * Set a timer, with its own implementation timer or the shared one.
+ * @param timer : timer.
+ * @param delay : expiration delay in microseconds, 0 to clear.
+ * @param period : period in microseconds, 0 for a one shot timer.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+static int pomp_timer_do_set(struct pomp_timer *timer, uint64_t delay,
+		uint64_t period)
+{
+	POMP_RETURN_ERR_IF_FAILED(timer != NULL, -EINVAL);
+	if (timer->slack.value == 0)
+		return (*s_pomp_timer_ops->timer_set)(timer, delay, period);
+	else
+		return pomp_timer_slack_set(timer, delay, period);
+}
+
+/**
+ * Destroy the shared timer of a loop if no more timer with slack is armed.
+ * @param loop : loop.
+ * @return 0 in case of success, negative errno value in case of error.
+ */
+int pomp_timer_release_slack(struct pomp_loop *loop)
+{
+	int res = 0;
+
+	if (loop->slack.timer == NULL || loop->slack.timers != NULL)
+		return 0;
+
+	res = (*s_pomp_timer_ops->timer_destroy)(loop->slack.timer);
+	if (res == 0)
+		loop->slack.timer = NULL;
+	return res;
+}
+
 /*
  * See documentation in public header.
  */
@@ -81,6 +244,11 @@ struct pomp_timer *pomp_timer_new(struct pomp_loop *loop,
  */
 int pomp_timer_destroy(struct pomp_timer *timer)
 {
+	POMP_RETURN_ERR_IF_FAILED(timer != NULL, -EINVAL);
+	if (timer->slack.armed) {
+		pomp_timer_slack_unlink(timer);
+		pomp_timer_slack_schedule(timer->loop);
+	}
 	return (*s_pomp_timer_ops->timer_destroy)(timer);
 }
 
@@ -89,7 +257,7 @@ int pomp_timer_destroy(struct pomp_timer *timer)
  */
 int pomp_timer_set(struct pomp_timer *timer, uint32_t delay)
 {
-	return (*s_pomp_timer_ops->timer_set)(timer, delay, 0);
+	return pomp_timer_do_set(timer, (uint64_t)delay * 1000, 0);
 }
 
 /*
@@ -98,7 +266,25 @@ int pomp_timer_set(struct pomp_timer *timer, uint32_t delay)
 int pomp_timer_set_periodic(struct pomp_timer *timer, uint32_t delay,
 		uint32_t period)
 {
-	return (*s_pomp_timer_ops->timer_set)(timer, delay, period);
+	return pomp_timer_do_set(timer,
+			(uint64_t)delay * 1000, (uint64_t)period * 1000);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_timer_set_us(struct pomp_timer *timer, uint64_t delay)
+{
+	return pomp_timer_do_set(timer, delay, 0);
+}
+
+/*
+ * See documentation in public header.
+ */
+int pomp_timer_set_periodic_us(struct pomp_timer *timer, uint64_t delay,
+		uint64_t period)
+{
+	return pomp_timer_do_set(timer, delay, period);
 }
 
 /*
@@ -106,5 +292,31 @@ int pomp_timer_set_periodic(struct pomp_timer *timer, uint32_t delay,
  */
 int pomp_timer_clear(struct pomp_timer *timer)
 {
+	POMP_RETURN_ERR_IF_FAILED(timer != NULL, -EINVAL);
+	if (timer->slack.armed) {
+		pomp_timer_slack_unlink(timer);
+		return pomp_timer_slack_schedule(timer->loop);
+	}
 	return (*s_pomp_timer_ops->timer_clear)(timer);
 }
+
+/*
+ * See documentation in public header.
+ */
+int pomp_timer_set_slack(struct pomp_timer *timer, uint32_t slack)
+{
+	int res = 0;
+	POMP_RETURN_ERR_IF_FAILED(timer != NULL, -EINVAL);
+	if (slack == timer->slack.value)
+		return 0;
+
+	/* Current expiration is cancelled, it applies to next set */
+	if (timer->slack.armed) {
+		pomp_timer_slack_unlink(timer);
+		res = pomp_timer_slack_schedule(timer->loop);
+	} else {
+		res = (*s_pomp_timer_ops->timer_clear)(timer);
+	}
+	timer->slack.value = slack;
+	return res;
+}
@@ -41,6 +41,15 @@ struct pomp_timer {
 	pomp_timer_cb_t		cb;		/**< Notification callback */
 	void			*userdata;	/**< Notification user data */
 
+	/** Coalescing with other timers of the loop (slack not 0) */
+	struct {
+		uint32_t		value;	/**< Slack (in us) */
+		int			armed;	/**< In list of the loop */
+		uint64_t		deadline; /**< Earliest expiration */
+		uint64_t		period;	/**< Period (in us) */
+		struct pomp_timer	*next;	/**< Next armed timer */
+	} slack;
+
 #ifdef POMP_HAVE_TIMER_POSIX
 	timer_t			id;		/**< Timer id */
 	int			pipefds[2];	/**< Notification pipes */
@@ -52,7 +61,7 @@ struct pomp_timer {
 
 #ifdef POMP_HAVE_TIMER_KQUEUE
 	int			kq;		/**< kqueue */
-	uint32_t		period;		/**< Pediod (in ms)*/
+	uint64_t		period;		/**< Pediod (in us)*/
 #endif /* POMP_HAVE_TIMER_KQUEUE */
 
 #ifdef POMP_HAVE_TIMER_WIN32
@@ -70,9 +79,9 @@ struct pomp_timer_ops {
 	/** Implementation specific 'destroy' operation. */
 	int (*timer_destroy)(struct pomp_timer *timer);
 
-	/** Implementation specific 'set' operation. */
-	int (*timer_set)(struct pomp_timer *timer, uint32_t delay,
-			uint32_t period);
+	/** Implementation specific 'set' operation (delays in us). */
+	int (*timer_set)(struct pomp_timer *timer, uint64_t delay,
+			uint64_t period);
 
 	/** Implementation specific 'clear' operation. */
 	int (*timer_clear)(struct pomp_timer *timer);
@@ -103,4 +112,6 @@ extern const struct pomp_timer_ops pomp_timer_win32_ops;
 const struct pomp_timer_ops *pomp_timer_set_ops(
 		const struct pomp_timer_ops *ops);
 
+int pomp_timer_release_slack(struct pomp_loop *loop);
+
 #endif /* !_POMP_TIMER_H_ */
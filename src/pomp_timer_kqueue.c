@@ -63,7 +63,7 @@ static void pomp_timer_kqueue_cb(int fd, uint32_t revents, void *userdata)
 			event.filter = EVFILT_TIMER;
 			event.flags = EV_ADD;
 			event.fflags = NOTE_USECONDS;
-			event.data = timer->period * 1000;
+			event.data = (intptr_t)timer->period;
 
 			/* Add timer */
 			if (kevent(timer->kq, &event, 1, NULL, 0, NULL) < 0)
@@ -141,8 +141,8 @@ error:
 /**
  * @see pomp_timer_set.
  */
-static int pomp_timer_kqueue_set(struct pomp_timer *timer, uint32_t delay,
-		uint32_t period)
+static int pomp_timer_kqueue_set(struct pomp_timer *timer, uint64_t delay,
+		uint64_t period)
 {
 	int res = 0;
 	struct kevent event;
@@ -154,7 +154,7 @@ static int pomp_timer_kqueue_set(struct pomp_timer *timer, uint32_t delay,
 	event.filter = EVFILT_TIMER;
 	event.flags = EV_ADD | EV_ONESHOT;
 	event.fflags = NOTE_USECONDS;
-	event.data = delay * 1000;
+	event.data = (intptr_t)delay;
 
 	/* Add timer */
 	if (kevent(timer->kq, &event, 1, NULL, 0, NULL) < 0) {
@@ -119,18 +119,18 @@ error:
 /**
  * @see pomp_timer_set.
  */
-static int pomp_timer_fd_set(struct pomp_timer *timer, uint32_t delay,
-		uint32_t period)
+static int pomp_timer_fd_set(struct pomp_timer *timer, uint64_t delay,
+		uint64_t period)
 {
 	int res = 0;
 	struct itimerspec newval, oldval;
 	POMP_RETURN_ERR_IF_FAILED(timer != NULL, -EINVAL);
 
 	/* Setup timeout */
-	newval.it_interval.tv_sec = (time_t)(period / 1000);
-	newval.it_interval.tv_nsec = (long int)((period % 1000) * 1000 * 1000);
-	newval.it_value.tv_sec = (time_t)(delay / 1000);
-	newval.it_value.tv_nsec = (long int)((delay % 1000) * 1000 * 1000);
+	newval.it_interval.tv_sec = (time_t)(period / 1000000);
+	newval.it_interval.tv_nsec = (long int)((period % 1000000) * 1000);
+	newval.it_value.tv_sec = (time_t)(delay / 1000000);
+	newval.it_value.tv_nsec = (long int)((delay % 1000000) * 1000);
 	if (timerfd_settime(timer->tfd, 0, &newval, &oldval) < 0) {
 		res = -errno;
 		POMP_LOG_ERRNO("timerfd_settime");
@@ -135,12 +135,17 @@ error:
 /**
  * @see pomp_timer_set.
  */
-static int pomp_timer_win32_set(struct pomp_timer *timer, uint32_t delay,
-		uint32_t period)
+static int pomp_timer_win32_set(struct pomp_timer *timer, uint64_t delay,
+		uint64_t period)
 {
 	int res = 0;
+	DWORD delayms = 0, periodms = 0;
 	POMP_RETURN_ERR_IF_FAILED(timer != NULL, -EINVAL);
 
+	/* Timer queues have a millisecond resolution, round up */
+	delayms = (DWORD)((delay + 999) / 1000);
+	periodms = (DWORD)((period + 999) / 1000);
+
 	/* Delete current one if needed */
 	if (timer->htimer != NULL) {
 		/* Wait for cancellation */
@@ -150,8 +155,9 @@ static int pomp_timer_win32_set(struct pomp_timer *timer, uint32_t delay,
 	}
 
 	/* Create timer if needed */
-	if (delay != 0 && !CreateTimerQueueTimer(&timer->htimer, NULL,
-			&pomp_timer_win32_native_cb, timer, delay, period, 0)) {
+	if (delayms != 0 && !CreateTimerQueueTimer(&timer->htimer, NULL,
+			&pomp_timer_win32_native_cb, timer, delayms, periodms,
+			0)) {
 		res = -ENOMEM;
 		POMP_LOG_ERRNO("CreateTimerQueueTimer");
 	}
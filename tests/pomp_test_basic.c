@@ -1520,6 +1520,160 @@ static void test_encoder_fd(void)
 #endif /* !_WIN32 */
 }
 
+/** */
+static void test_encoder_slot(void)
+{
+	int res = 0;
+	struct pomp_msg msg = POMP_MSG_INITIALIZER;
+	struct pomp_encoder enc = POMP_ENCODER_INITIALIZER;
+	uint32_t slots[10];
+	uint32_t slot_varint = 0;
+	size_t len = 0;
+	int8_t i8 = 0;
+	uint8_t u8 = 0;
+	int16_t i16 = 0;
+	uint16_t u16 = 0;
+	int32_t i32 = 0;
+	uint32_t u32 = 0;
+	int64_t i64 = 0;
+	uint64_t u64 = 0;
+	char *str = NULL;
+	float f32 = 0;
+	double f64 = 0;
+
+	/* Encode a template with initial values */
+	res = pomp_msg_init(&msg, TEST_MSGID);
+	CU_ASSERT_EQUAL_FATAL(res, 0);
+	res = pomp_encoder_init(&enc, &msg);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_i8(&enc, 0, &slots[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_u8(&enc, 0, &slots[1]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_i16(&enc, 0, &slots[2]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_u16(&enc, 0, &slots[3]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_i32(&enc, 0, &slots[4]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_str(&enc, TEST_VAL_STR);
+	CU_ASSERT_EQUAL(res, 0);
+	slot_varint = (uint32_t)enc.pos + 1;
+	res = pomp_encoder_write_u32(&enc, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_u32(&enc, 0, &slots[5]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_i64(&enc, 0, &slots[6]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_u64(&enc, 0, &slots[7]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_f32(&enc, 0.0f, &slots[8]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_f64(&enc, 0.0, &slots[9]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_finish(&msg);
+	CU_ASSERT_EQUAL(res, 0);
+	len = msg.buf->len;
+
+	/* Slots are fixed width */
+	CU_ASSERT_EQUAL(slots[0], 13);
+	CU_ASSERT_EQUAL(slots[5] - slots[4], 5 + 18 + 2 + 1);
+	CU_ASSERT_EQUAL(slots[7] - slots[6], 10 + 1);
+
+	/* Patch values */
+	res = pomp_msg_patch_i8(&msg, slots[0], TEST_VAL_I8);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_u8(&msg, slots[1], TEST_VAL_U8);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_i16(&msg, slots[2], TEST_VAL_I16);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_u16(&msg, slots[3], TEST_VAL_U16);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_i32(&msg, slots[4], TEST_VAL_I32);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_u32(&msg, slots[5], TEST_VAL_U32);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_i64(&msg, slots[6], TEST_VAL_I64);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_u64(&msg, slots[7], TEST_VAL_U64);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_f32(&msg, slots[8], TEST_VAL_F32);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_patch_f64(&msg, slots[9], TEST_VAL_F64);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(msg.buf->len, len);
+
+	/* Decode patched message with standard decoder */
+	res = pomp_msg_read(&msg,
+			"%hhd%hhu%hd%hu%d%ms%u%u%"SCNd64"%"SCNu64"%f%lf",
+			&i8, &u8, &i16, &u16, &i32, &str, &u32, &u32,
+			&i64, &u64, &f32, &f64);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(i8, TEST_VAL_I8);
+	CU_ASSERT_EQUAL(u8, TEST_VAL_U8);
+	CU_ASSERT_EQUAL(i16, TEST_VAL_I16);
+	CU_ASSERT_EQUAL(u16, TEST_VAL_U16);
+	CU_ASSERT_EQUAL(i32, TEST_VAL_I32);
+	CU_ASSERT_EQUAL(u32, TEST_VAL_U32);
+	CU_ASSERT_EQUAL(i64, TEST_VAL_I64);
+	CU_ASSERT_EQUAL(u64, TEST_VAL_U64);
+	CU_ASSERT_EQUAL(f32, TEST_VAL_F32);
+	CU_ASSERT_EQUAL(f64, TEST_VAL_F64);
+	CU_ASSERT_STRING_EQUAL(str, TEST_VAL_STR);
+	free(str);
+
+	/* Invalid patch (type mismatch) */
+	res = pomp_msg_patch_u8(&msg, slots[0], 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_msg_patch_u32(&msg, slots[6], 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Invalid patch (not a fixed width slot) */
+	res = pomp_msg_patch_u8(&msg, slot_varint, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_msg_patch_u32(&msg, slot_varint, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Invalid patch (out of range) */
+	res = pomp_msg_patch_u32(&msg, 2, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_msg_patch_f64(&msg, (uint32_t)len - 4, 0.0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Invalid patch (NULL param) */
+	res = pomp_msg_patch_u32(NULL, slots[5], 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Busy patch (buffer shared as if queued for sending) */
+	pomp_buffer_ref(msg.buf);
+	res = pomp_msg_patch_u32(&msg, slots[5], 0);
+	CU_ASSERT_EQUAL(res, -EBUSY);
+	pomp_buffer_unref(msg.buf);
+	res = pomp_msg_patch_u32(&msg, slots[5], 0);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Invalid slot write */
+	res = pomp_encoder_write_slot_u32(&enc, 0, &slots[0]);
+	CU_ASSERT_EQUAL(res, -EPERM);
+	res = pomp_encoder_clear(&enc);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_clear(&msg);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_init(&msg, TEST_MSGID);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_init(&enc, &msg);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_encoder_write_slot_u32(&enc, 0, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_encoder_write_slot_u32(NULL, 0, &slots[0]);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	res = pomp_encoder_clear(&enc);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_msg_clear(&msg);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
 /** */
 static void test_decoder_base(void)
 {
@@ -2654,6 +2808,88 @@ static void test_prot_decode(void)
 	pomp_buffer_unref(buf);
 }
 
+/** */
+static void test_prot_release(void)
+{
+	struct pomp_buffer *buf = NULL;
+	struct pomp_buffer *msgbuf = NULL;
+	size_t pos = 0;
+	int res = 0;
+	ssize_t declen = 0;
+	struct pomp_prot *prot = NULL;
+	struct pomp_msg *msg = NULL;
+	struct pomp_msg *refmsg = NULL;
+
+	/* Creation */
+	prot = pomp_prot_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(prot);
+
+	/* Setup buffer */
+	buf = pomp_buffer_new(0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	setup_test_buf(buf);
+
+	/* Decode first message and release it */
+	declen = pomp_prot_decode_msg(prot, buf->data, buf->len, &msg);
+	CU_ASSERT_EQUAL(declen, 12 + REFDATA_ENC_SIZE);
+	pos += (size_t)declen;
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	msgbuf = msg->buf;
+	res = pomp_prot_release_msg(prot, msg);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Buffer is reused for the next message */
+	msg = NULL;
+	declen = pomp_prot_decode_msg(prot, buf->data + pos,
+			buf->len - pos, &msg);
+	CU_ASSERT_EQUAL(declen, 12 + REFDATA_ENC_SIZE);
+	pos += (size_t)declen;
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	CU_ASSERT_EQUAL(msg->buf, msgbuf);
+	verify_test_msg(msg);
+
+	/* Keep a reference on it before releasing it */
+	refmsg = pomp_msg_new_ref(msg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(refmsg);
+	CU_ASSERT_EQUAL(refmsg->buf, msgbuf);
+	CU_ASSERT_EQUAL(pomp_msg_get_id(refmsg), pomp_msg_get_id(msg));
+	res = pomp_prot_release_msg(prot, msg);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Buffer is not reused and content of kept message is intact */
+	msg = NULL;
+	declen = pomp_prot_decode_msg(prot, buf->data, buf->len, &msg);
+	CU_ASSERT_EQUAL(declen, 12 + REFDATA_ENC_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	CU_ASSERT_NOT_EQUAL(msg->buf, msgbuf);
+	verify_test_msg(msg);
+	verify_test_msg(refmsg);
+	res = pomp_prot_release_msg(prot, msg);
+	CU_ASSERT_EQUAL(res, 0);
+
+	res = pomp_msg_destroy(refmsg);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Invalid reference (NULL param or message not finished) */
+	refmsg = pomp_msg_new_ref(NULL);
+	CU_ASSERT_PTR_NULL(refmsg);
+	msg = pomp_msg_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	refmsg = pomp_msg_new_ref(msg);
+	CU_ASSERT_PTR_NULL(refmsg);
+	res = pomp_msg_init(msg, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	refmsg = pomp_msg_new_ref(msg);
+	CU_ASSERT_PTR_NULL(refmsg);
+	res = pomp_msg_destroy(msg);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Free */
+	res = pomp_prot_destroy(prot);
+	CU_ASSERT_EQUAL(res, 0);
+	pomp_buffer_unref(buf);
+}
+
 /** */
 static void test_prot_decode_no_payload(void)
 {
@@ -2798,6 +3034,7 @@ static CU_TestInfo s_encoder_tests[] = {
 	{(char *)"printf_32_64", &test_encoder_printf_32_64},
 	{(char *)"argv", &test_encoder_argv},
 	{(char *)"fd", &test_encoder_fd},
+	{(char *)"slot", &test_encoder_slot},
 	CU_TEST_INFO_NULL,
 };
 
@@ -2819,6 +3056,7 @@ static CU_TestInfo s_prot_tests[] = {
 	{(char *)"decode", &test_prot_decode},
 	{(char *)"decode_no_payload", &test_prot_decode_no_payload},
 	{(char *)"decode_error", &test_prot_decode_error},
+	{(char *)"release", &test_prot_release},
 	CU_TEST_INFO_NULL,
 };
 
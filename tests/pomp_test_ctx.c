@@ -1007,11 +1007,2815 @@ static void test_invalid_addr(void)
 
 }
 
+/** */
+struct test_tx_data {
+	uint32_t  connection;
+	uint32_t  msgcount;
+	uint32_t  msgids[8];
+	uint32_t  sendcount;
+	int       keep;
+	struct pomp_buffer  *keptbuf;
+};
+
+/** */
+static void test_tx_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	int res = 0;
+	struct test_tx_data *data = userdata;
+	uint32_t v = 0;
+	char *str = NULL;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		break;
+
+	case POMP_EVENT_MSG:
+		res = pomp_msg_read(msg, "%u%ms", &v, &str);
+		CU_ASSERT_EQUAL(res, 0);
+		CU_ASSERT_EQUAL(v, pomp_msg_get_id(msg) * 10);
+		CU_ASSERT_STRING_EQUAL(str, "tx");
+		free(str);
+		if (data->msgcount < 8)
+			data->msgids[data->msgcount] = pomp_msg_get_id(msg);
+		data->msgcount++;
+		break;
+
+	default:
+		CU_ASSERT_TRUE_FATAL(0);
+		break;
+	}
+}
+
+/** */
+static void test_tx_send_cb(struct pomp_ctx *ctx,
+		struct pomp_conn *conn,
+		struct pomp_buffer *buf,
+		uint32_t status,
+		void *cookie,
+		void *userdata)
+{
+	struct test_tx_data *data = userdata;
+	CU_ASSERT_PTR_NOT_NULL(buf);
+	CU_ASSERT_TRUE((status & POMP_SEND_STATUS_OK) != 0);
+	data->sendcount++;
+	if (data->keep && data->keptbuf == NULL) {
+		pomp_buffer_ref(buf);
+		data->keptbuf = buf;
+	}
+}
+
+/** */
+static void test_conn_begin_msg(void)
+{
+	int res = 0;
+	struct test_tx_data data;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	struct pomp_conn *conn = NULL;
+	struct pomp_encoder *enc = NULL;
+	uint32_t i = 0;
+	size_t len = 0, keptlen = 0;
+	int fds[2] = {-1, -1};
+
+	memset(&data, 0, sizeof(data));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5656);
+
+	/* Create contexts and connect them */
+	ctx1 = pomp_ctx_new(&test_tx_event_cb, &data);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_tx_event_cb, &data);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_set_send_cb(ctx2, &test_tx_send_cb);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data.connection, 2);
+	conn = pomp_ctx_get_conn(ctx2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(conn);
+
+	/* Encode some messages in place */
+	for (i = 1; i <= 3; i++) {
+		enc = pomp_conn_begin_msg(conn, i, 16);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+		res = pomp_encoder_write(enc, "%u%s", i * 10, "tx");
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_conn_commit_msg(conn);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	/* Invalid operations while a message is being encoded */
+	enc = pomp_conn_begin_msg(conn, 4, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+	res = pomp_encoder_write(enc, "%u", 0);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_PTR_NULL(pomp_conn_begin_msg(conn, 4, 0));
+	res = pomp_conn_send(conn, 4, "%u%s", 40, "tx");
+	CU_ASSERT_EQUAL(res, -EBUSY);
+
+	/* Abort it */
+	res = pomp_conn_abort_msg(conn);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_conn_abort_msg(conn);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_conn_commit_msg(conn);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+#ifndef _WIN32
+	/* Invalid commit (file descriptor) */
+	res = pipe(fds);
+	CU_ASSERT_EQUAL(res, 0);
+	enc = pomp_conn_begin_msg(conn, 4, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+	res = pomp_encoder_write_fd(enc, fds[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_conn_commit_msg(conn);
+	CU_ASSERT_EQUAL(res, -EPERM);
+	res = close(fds[0]); CU_ASSERT_EQUAL(res, 0);
+	res = close(fds[1]); CU_ASSERT_EQUAL(res, 0);
+#endif /* !_WIN32 */
+
+	/* Mix with normal send, ordering shall be kept */
+	res = pomp_conn_send(conn, 4, "%u%s", 40, "tx");
+	CU_ASSERT_EQUAL(res, 0);
+	enc = pomp_conn_begin_msg(conn, 5, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+	res = pomp_encoder_write(enc, "%u%s", 50, "tx");
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_conn_commit_msg(conn);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Invalid begin/commit/abort (NULL param) */
+	CU_ASSERT_PTR_NULL(pomp_conn_begin_msg(NULL, 1, 0));
+	res = pomp_conn_commit_msg(NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_conn_abort_msg(NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Run contexts, all messages shall be received in order */
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data.msgcount, 5);
+	for (i = 0; i < 5; i++)
+		CU_ASSERT_EQUAL(data.msgids[i], i + 1);
+
+	/* First batch, normal message, second batch */
+	CU_ASSERT_EQUAL(data.sendcount, 3);
+
+	/* Reuse transmit buffer after it was flushed */
+	enc = pomp_conn_begin_msg(conn, 6, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+	res = pomp_encoder_write(enc, "%u%s", 60, "tx");
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_conn_commit_msg(conn);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data.msgcount, 6);
+	CU_ASSERT_EQUAL(data.msgids[5], 6);
+
+	/* Transmit buffer kept by the send callback is left untouched */
+	data.keep = 1;
+	enc = pomp_conn_begin_msg(conn, 7, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+	res = pomp_encoder_write(enc, "%u%s", 70, "tx");
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_conn_commit_msg(conn);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data.keptbuf);
+	res = pomp_buffer_get_cdata(data.keptbuf, NULL, &len, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	enc = pomp_conn_begin_msg(conn, 8, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(enc);
+	res = pomp_encoder_write(enc, "%u%s", 80, "tx");
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_conn_commit_msg(conn);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data.msgcount, 8);
+	CU_ASSERT_EQUAL(data.msgids[7], 8);
+	res = pomp_buffer_get_cdata(data.keptbuf, NULL, &keptlen, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(keptlen, len);
+	pomp_buffer_unref(data.keptbuf);
+
+	/* Stop and destroy contexts */
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+struct test_sub_data {
+	uint32_t  connection;
+	uint32_t  msgcount;
+	uint32_t  msgids[8];
+};
+
+/** */
+static void test_sub_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct test_sub_data *data = userdata;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		break;
+
+	case POMP_EVENT_MSG:
+		if (data->msgcount < 8)
+			data->msgids[data->msgcount] = pomp_msg_get_id(msg);
+		data->msgcount++;
+		break;
+
+	default:
+		CU_ASSERT_TRUE_FATAL(0);
+		break;
+	}
+}
+
+/** */
+static void test_sub_set(void)
+{
+	int res = 0;
+	struct pomp_sub_set set = POMP_SUB_SET_INITIALIZER;
+
+	/* Merge overlapping and adjacent ranges */
+	res = pomp_sub_set_add(&set, 10, 19);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_sub_set_add(&set, 30, 39);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_sub_set_add(&set, 20, 25);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(set.count, 2);
+	res = pomp_sub_set_add(&set, 26, 29);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL_FATAL(set.count, 1);
+	CU_ASSERT_EQUAL(set.ranges[0].first, 10);
+	CU_ASSERT_EQUAL(set.ranges[0].last, 39);
+
+	/* Split a range */
+	res = pomp_sub_set_remove(&set, 20, 29);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL_FATAL(set.count, 2);
+	CU_ASSERT_TRUE(pomp_sub_set_contains(&set, 10));
+	CU_ASSERT_TRUE(pomp_sub_set_contains(&set, 19));
+	CU_ASSERT_FALSE(pomp_sub_set_contains(&set, 20));
+	CU_ASSERT_FALSE(pomp_sub_set_contains(&set, 29));
+	CU_ASSERT_TRUE(pomp_sub_set_contains(&set, 30));
+	CU_ASSERT_FALSE(pomp_sub_set_contains(&set, 40));
+
+	/* Bounds of id space */
+	res = pomp_sub_set_add(&set, 0, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_sub_set_add(&set, UINT32_MAX - 1, UINT32_MAX);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(set.count, 4);
+	CU_ASSERT_TRUE(pomp_sub_set_contains(&set, UINT32_MAX));
+	res = pomp_sub_set_remove(&set, 0, UINT32_MAX);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(set.count, 0);
+
+	/* Invalid range */
+	res = pomp_sub_set_add(&set, 2, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_sub_set_remove(&set, 2, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	pomp_sub_set_clear(&set);
+}
+
+#define TEST_SUB_CONNS  40
+
+struct test_sub_table_data {
+	struct pomp_sub_table  *table;
+	struct pomp_conn       *conns[TEST_SUB_CONNS];
+	uint64_t               mask;
+	uint32_t               count;
+	int                    modify;
+};
+
+/** */
+static void test_sub_table_cb(struct pomp_conn *conn, void *userdata)
+{
+	struct test_sub_table_data *data = userdata;
+	uint32_t i = 0;
+
+	for (i = 0; i < TEST_SUB_CONNS; i++) {
+		if (data->conns[i] == conn)
+			data->mask |= 1ULL << i;
+	}
+	data->count++;
+
+	/* Remove a subscriber not visited yet and add a new one */
+	if (data->modify) {
+		data->modify = 0;
+		(void)pomp_sub_table_remove_conn(data->table, data->conns[1]);
+		(void)pomp_sub_table_update(data->table, data->conns[3],
+				1, 1, 1);
+	}
+}
+
+/** */
+static uint64_t test_sub_table_visit(struct test_sub_table_data *data,
+		uint32_t msgid)
+{
+	int res = 0;
+
+	data->mask = 0;
+	data->count = 0;
+	res = pomp_sub_table_foreach(data->table, msgid, &test_sub_table_cb,
+			data);
+	CU_ASSERT_EQUAL(res, 0);
+	return data->mask;
+}
+
+/** */
+static void test_sub_table(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	char storage[TEST_SUB_CONNS];
+	struct test_sub_table_data data;
+	struct pomp_sub_set set = POMP_SUB_SET_INITIALIZER;
+
+	memset(&data, 0, sizeof(data));
+	for (i = 0; i < TEST_SUB_CONNS; i++)
+		data.conns[i] = (struct pomp_conn *)&storage[i];
+	data.table = pomp_sub_table_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data.table);
+
+	/* Overlapping ranges */
+	res = pomp_sub_table_update(data.table, data.conns[0], 10, 19, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_sub_table_update(data.table, data.conns[1], 15, 29, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_sub_table_update(data.table, data.conns[2],
+			0, UINT32_MAX, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 5), 0x4);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 12), 0x5);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 17), 0x7);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 25), 0x6);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, UINT32_MAX), 0x4);
+
+	/* Partial unsubscriptions */
+	res = pomp_sub_table_update(data.table, data.conns[2],
+			0, UINT32_MAX, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_sub_table_update(data.table, data.conns[1], 16, 16, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 5), 0);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 16), 0x1);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 17), 0x3);
+
+	/* Subscriptions given back */
+	res = pomp_sub_table_take_conn(data.table, data.conns[1], &set);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(set.count, 2);
+	pomp_sub_set_clear(&set);
+	res = pomp_sub_table_remove_conn(data.table, data.conns[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 17), 0);
+
+	/* Broadcast continues when a callback changes subscriptions */
+	for (i = 0; i < 3; i++) {
+		res = pomp_sub_table_update(data.table, data.conns[i],
+				1, 1, 1);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	data.modify = 1;
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 1), 0x5);
+	CU_ASSERT_EQUAL(data.count, 2);
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 1), 0xd);
+
+	/* More subscribers than the snapshot on the stack */
+	for (i = 0; i < TEST_SUB_CONNS; i++) {
+		res = pomp_sub_table_update(data.table, data.conns[i],
+				100, 109, 1);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 105),
+			(1ULL << TEST_SUB_CONNS) - 1);
+	CU_ASSERT_EQUAL(data.count, TEST_SUB_CONNS);
+
+	/* Connections still found after removal of others */
+	for (i = 0; i < TEST_SUB_CONNS; i += 2) {
+		res = pomp_sub_table_remove_conn(data.table, data.conns[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 105), 0xaaaaaaaaaaULL);
+	for (i = 1; i < TEST_SUB_CONNS; i += 2) {
+		res = pomp_sub_table_update(data.table, data.conns[i],
+				100, 109, 0);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	CU_ASSERT_EQUAL(test_sub_table_visit(&data, 105), 0);
+
+	res = pomp_sub_table_foreach(data.table, 1, NULL, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_sub_table_destroy(data.table);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+static void test_ctx_subscription(void)
+{
+	int res = 0;
+	struct test_sub_data data1, data2, data3;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	struct pomp_ctx *ctx3 = NULL;
+	uint32_t msgid = 0;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&data3, 0, sizeof(data3));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5656);
+
+	/* Server with subscription, 2 clients */
+	ctx1 = pomp_ctx_new(&test_sub_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_sub_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	ctx3 = pomp_ctx_new(&test_sub_event_cb, &data3);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx3);
+	res = pomp_ctx_set_subscription(ctx1, 1);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Subscription before connection shall be sent once connected */
+	res = pomp_ctx_subscribe(ctx2, 10, 19);
+	CU_ASSERT_EQUAL(res, 0);
+
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx3, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	run_ctx(ctx1, ctx3, 100);
+	CU_ASSERT_EQUAL(data1.connection, 2);
+	CU_ASSERT_EQUAL(data2.connection, 1);
+	CU_ASSERT_EQUAL(data3.connection, 1);
+
+	/* Subscribe while connected */
+	res = pomp_ctx_subscribe(ctx3, 15, 15);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx3, 100);
+
+	/* Server can't subscribe, settings can't change while started */
+	res = pomp_ctx_subscribe(ctx1, 1, 2);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_set_subscription(ctx1, 0);
+	CU_ASSERT_EQUAL(res, -EBUSY);
+
+	/* Broadcast some messages */
+	for (msgid = 5; msgid <= 20; msgid += 5) {
+		res = pomp_ctx_send(ctx1, msgid, NULL);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	run_ctx(ctx1, ctx2, 100);
+	run_ctx(ctx1, ctx3, 100);
+	CU_ASSERT_EQUAL_FATAL(data2.msgcount, 2);
+	CU_ASSERT_EQUAL(data2.msgids[0], 10);
+	CU_ASSERT_EQUAL(data2.msgids[1], 15);
+	CU_ASSERT_EQUAL_FATAL(data3.msgcount, 1);
+	CU_ASSERT_EQUAL(data3.msgids[0], 15);
+
+	/* Subscription messages are not notified to server */
+	CU_ASSERT_EQUAL(data1.msgcount, 0);
+
+	/* Partial unsubscribe */
+	res = pomp_ctx_unsubscribe(ctx2, 10, 12);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	res = pomp_ctx_send(ctx1, 11, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_send(ctx1, 13, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL_FATAL(data2.msgcount, 3);
+	CU_ASSERT_EQUAL(data2.msgids[2], 13);
+
+	/* Disconnected client shall not be a subscriber anymore */
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(pomp_ctx_get_next_conn(ctx1,
+			pomp_ctx_get_next_conn(ctx1, NULL)), NULL);
+	res = pomp_ctx_send(ctx1, 15, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data2.msgcount, 4);
+
+	/* Stop and destroy contexts */
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+#define TEST_ACCEPT_CLIENTS  8
+
+/** */
+static void test_ctx_accept_batch(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_sub_data data1;
+	struct test_sub_data data2[TEST_ACCEPT_CLIENTS];
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2[TEST_ACCEPT_CLIENTS];
+	const struct sockaddr *addr = NULL;
+	uint32_t addrlen = 0;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(data2, 0, sizeof(data2));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5658);
+
+	ctx1 = pomp_ctx_new(&test_sub_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Connections are established by the kernel before being accepted */
+	for (i = 0; i < TEST_ACCEPT_CLIENTS; i++) {
+		ctx2[i] = pomp_ctx_new(&test_sub_event_cb, &data2[i]);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2[i]);
+		res = pomp_ctx_connect(ctx2[i],
+				(const struct sockaddr *)&addr_in,
+				sizeof(addr_in));
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	for (i = 0; i < TEST_ACCEPT_CLIENTS; i++) {
+		while (data2[i].connection == 0
+				&& pomp_ctx_wait_and_process(ctx2[i], 100) == 0)
+			;
+		CU_ASSERT_EQUAL(data2[i].connection, 1);
+	}
+
+	/* All pending connections accepted by a single event */
+	res = pomp_ctx_wait_and_process(ctx1, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data1.connection, TEST_ACCEPT_CLIENTS);
+
+	/* Addresses are queried on demand */
+	addr = pomp_conn_get_peer_addr(pomp_ctx_get_next_conn(ctx1, NULL),
+			&addrlen);
+	CU_ASSERT_PTR_NOT_NULL(addr);
+	CU_ASSERT_EQUAL(addrlen, sizeof(addr_in));
+	CU_ASSERT_EQUAL(addr->sa_family, AF_INET);
+	addr = pomp_conn_get_local_addr(pomp_ctx_get_next_conn(ctx1, NULL),
+			&addrlen);
+	CU_ASSERT_PTR_NOT_NULL(addr);
+	CU_ASSERT_EQUAL(addrlen, sizeof(addr_in));
+	CU_ASSERT_EQUAL(((const struct sockaddr_in *)addr)->sin_port,
+			addr_in.sin_port);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < TEST_ACCEPT_CLIENTS; i++) {
+		res = pomp_ctx_stop(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_ctx_destroy(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+#define TEST_RECONNECT_CLIENTS  32
+#define TEST_RECONNECT_ATTEMPTS  16
+
+struct test_reconnect_data {
+	uint32_t  connection;
+	uint32_t  count;
+	uint64_t  times[TEST_RECONNECT_ATTEMPTS];
+};
+
+/** */
+static void test_reconnect_event_cb(struct pomp_ctx *ctx,
+		enum pomp_event event, struct pomp_conn *conn,
+		const struct pomp_msg *msg, void *userdata)
+{
+	struct test_reconnect_data *data = userdata;
+	if (event == POMP_EVENT_CONNECTED && data != NULL)
+		data->connection++;
+}
+
+/** */
+static void test_reconnect_socket_cb(struct pomp_ctx *ctx, int fd,
+		enum pomp_socket_kind kind, void *userdata)
+{
+	struct test_reconnect_data *data = userdata;
+	if (kind == POMP_SOCKET_KIND_CLIENT
+			&& data->count < TEST_RECONNECT_ATTEMPTS) {
+		time_get_monotonic_us(&data->times[data->count]);
+		data->count++;
+	}
+}
+
+/** */
+static void test_ctx_reconnect(void)
+{
+	int res = 0;
+	uint32_t i = 0, connected = 0;
+	struct test_reconnect_data data[TEST_RECONNECT_CLIENTS];
+	uint32_t counts[TEST_RECONNECT_CLIENTS];
+	struct sockaddr_in addr_in;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2[TEST_RECONNECT_CLIENTS];
+	uint64_t start = 0, gap = 0, mingap = UINT64_MAX, maxgap = 0;
+
+	memset(data, 0, sizeof(data));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5659);
+
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+
+	/* Invalid policies */
+	ctx1 = pomp_ctx_new_with_loop(&test_reconnect_event_cb, NULL, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_setup_reconnect(NULL, 20, 80, 200, 50, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_setup_reconnect(ctx1, 0, 80, 200, 50, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_setup_reconnect(ctx1, 20, 10, 200, 50, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_setup_reconnect(ctx1, 20, 80, 50, 50, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_setup_reconnect(ctx1, 20, 80, 200, 101, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* All clients lose the server at the same time */
+	for (i = 0; i < TEST_RECONNECT_CLIENTS; i++) {
+		ctx2[i] = pomp_ctx_new_with_loop(&test_reconnect_event_cb,
+				&data[i], loop);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2[i]);
+		res = pomp_ctx_set_socket_cb(ctx2[i],
+				&test_reconnect_socket_cb);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_ctx_setup_reconnect(ctx2[i], 20, 80, 200, 50, 1);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	for (i = 0; i < TEST_RECONNECT_CLIENTS; i++) {
+		res = pomp_ctx_connect(ctx2[i],
+				(const struct sockaddr *)&addr_in,
+				sizeof(addr_in));
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 250 * 1000)
+		pomp_loop_wait_and_process(loop, 100);
+
+	for (i = 0; i < TEST_RECONNECT_CLIENTS; i++) {
+		/* First retry is immediate, then delays grow up to max */
+		CU_ASSERT_TRUE_FATAL(data[i].count >= 4);
+		CU_ASSERT_TRUE(data[i].count < 12);
+		CU_ASSERT_TRUE(data[i].times[1] - data[i].times[0] < 10000);
+		CU_ASSERT_TRUE(data[i].times[3] - data[i].times[2] >= 20000);
+
+		/* Second retry is spread by jitter over [10, 20] ms */
+		gap = data[i].times[2] - data[i].times[1];
+		CU_ASSERT_TRUE(gap >= 10000);
+		if (gap < mingap)
+			mingap = gap;
+		if (gap > maxgap)
+			maxgap = gap;
+	}
+	CU_ASSERT_TRUE(maxgap - mingap >= 2000);
+
+	/* Server comes back, all clients connect within the maximum delay */
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (connected < TEST_RECONNECT_CLIENTS
+			&& pomp_loop_now(loop) - start < 1000 * 1000) {
+		pomp_loop_wait_and_process(loop, 100);
+		for (connected = 0, i = 0; i < TEST_RECONNECT_CLIENTS; i++)
+			connected += data[i].connection;
+	}
+	CU_ASSERT_EQUAL(connected, TEST_RECONNECT_CLIENTS);
+
+	/* Schedule was reset by the connection, retry is immediate again */
+	for (i = 0; i < TEST_RECONNECT_CLIENTS; i++)
+		counts[i] = data[i].count;
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 8 * 1000)
+		pomp_loop_wait_and_process(loop, 1);
+	for (i = 0; i < TEST_RECONNECT_CLIENTS; i++) {
+		CU_ASSERT_TRUE(data[i].count > counts[i]
+				|| counts[i] == TEST_RECONNECT_ATTEMPTS);
+	}
+
+	for (i = 0; i < TEST_RECONNECT_CLIENTS; i++) {
+		res = pomp_ctx_stop(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_ctx_destroy(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+static void test_pool_process(struct pomp_loop *loop, uint32_t *value,
+		uint32_t expected)
+{
+	uint64_t start = pomp_loop_now(loop);
+	while (*value != expected
+			&& pomp_loop_now(loop) - start < 1000 * 1000) {
+		pomp_loop_wait_and_process(loop, 100);
+	}
+}
+
+/** */
+static uint32_t test_pool_conn_count(const struct pomp_ctx *ctx)
+{
+	uint32_t count = 0;
+	struct pomp_conn *conn = NULL;
+
+	for (conn = pomp_ctx_get_next_conn(ctx, NULL); conn != NULL;
+			conn = pomp_ctx_get_next_conn(ctx, conn)) {
+		count++;
+	}
+	return count;
+}
+
+/** */
+static void test_pool_raw_cb(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		struct pomp_buffer *buf, void *userdata)
+{
+	struct test_sub_data *data = userdata;
+	data->msgcount++;
+}
+
+/** */
+static void test_ctx_client_pool(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_sub_data data1, data2, data3, data4;
+	struct sockaddr_in addr_in[2];
+	const struct sockaddr *addrs[2];
+	uint32_t addrlens[2];
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL, *ctx2 = NULL, *ctx3 = NULL;
+	struct pomp_ctx *ctx4 = NULL;
+	struct pomp_msg *msg = NULL;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&data3, 0, sizeof(data3));
+	memset(&data4, 0, sizeof(data4));
+	for (i = 0; i < 2; i++) {
+		memset(&addr_in[i], 0, sizeof(addr_in[i]));
+		addr_in[i].sin_family = AF_INET;
+		addr_in[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr_in[i].sin_port = htons(5660 + i);
+		addrs[i] = (const struct sockaddr *)&addr_in[i];
+		addrlens[i] = sizeof(addr_in[i]);
+	}
+
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+	msg = pomp_msg_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	res = pomp_msg_write(msg, 42, "%u", 1);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Two servers, and a pool of 4 connections */
+	ctx1 = pomp_ctx_new_with_loop(&test_sub_event_cb, &data1, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_listen(ctx1, addrs[0], addrlens[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	ctx2 = pomp_ctx_new_with_loop(&test_sub_event_cb, &data2, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_listen(ctx2, addrs[1], addrlens[1]);
+	CU_ASSERT_EQUAL(res, 0);
+	ctx3 = pomp_ctx_new_with_loop(&test_sub_event_cb, &data3, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx3);
+	res = pomp_ctx_setup_reconnect(ctx3, 10, 20, 200, 50, 0);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Invalid parameters */
+	res = pomp_ctx_connect_pool(NULL, addrs, addrlens, 2, 4,
+			POMP_BALANCE_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_connect_pool(ctx3, addrs, addrlens, 0, 4,
+			POMP_BALANCE_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_connect_pool(ctx3, addrs, addrlens, 2, 0,
+			POMP_BALANCE_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_send_msg_key(NULL, 0, msg);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Not connected yet */
+	res = pomp_ctx_connect_pool(ctx3, addrs, addrlens, 2, 4,
+			POMP_BALANCE_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect_pool(ctx3, addrs, addrlens, 2, 4,
+			POMP_BALANCE_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EBUSY);
+	test_pool_process(loop, &data3.connection, 4);
+	CU_ASSERT_EQUAL(data3.connection, 4);
+	test_pool_process(loop, &data1.connection, 2);
+	CU_ASSERT_EQUAL(data1.connection, 2);
+	CU_ASSERT_EQUAL(data2.connection, 2);
+
+	/* Connections of the pool are listed */
+	CU_ASSERT_EQUAL(test_pool_conn_count(ctx3), 4);
+	CU_ASSERT_PTR_NOT_NULL(pomp_ctx_get_conn(ctx3));
+
+	/* Round robin spreads messages over both servers */
+	for (i = 0; i < 8; i++) {
+		res = pomp_ctx_send_msg(ctx3, msg);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	test_pool_process(loop, &data2.msgcount, 4);
+	test_pool_process(loop, &data1.msgcount, 4);
+	CU_ASSERT_EQUAL(data1.msgcount, 4);
+	CU_ASSERT_EQUAL(data2.msgcount, 4);
+
+	/* Server restart, sends fail over to the other one */
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	data1.msgcount = data2.msgcount = 0;
+	while (test_pool_conn_count(ctx3) > 2)
+		pomp_loop_wait_and_process(loop, 100);
+	for (i = 0; i < 6; i++) {
+		res = pomp_ctx_send_msg(ctx3, msg);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	test_pool_process(loop, &data2.msgcount, 6);
+	CU_ASSERT_EQUAL(data2.msgcount, 6);
+	data1.connection = 0;
+	res = pomp_ctx_listen(ctx1, addrs[0], addrlens[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	test_pool_process(loop, &data1.connection, 2);
+	CU_ASSERT_EQUAL(data1.connection, 2);
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Hashing keeps a key on a single connection */
+	data3.connection = 0;
+	res = pomp_ctx_connect_pool(ctx3, addrs, addrlens, 2, 4,
+			POMP_BALANCE_POLICY_HASH);
+	CU_ASSERT_EQUAL(res, 0);
+	test_pool_process(loop, &data3.connection, 4);
+	CU_ASSERT_EQUAL(data3.connection, 4);
+	data1.msgcount = data2.msgcount = 0;
+	for (i = 0; i < 10; i++) {
+		res = pomp_ctx_send_msg_key(ctx3, 1234, msg);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	pomp_loop_wait_and_process(loop, 100);
+	pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(data1.msgcount + data2.msgcount, 10);
+	CU_ASSERT_TRUE(data1.msgcount == 0 || data2.msgcount == 0);
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Least queued */
+	data3.connection = 0;
+	res = pomp_ctx_connect_pool(ctx3, addrs, addrlens, 2, 2,
+			POMP_BALANCE_POLICY_LEAST_QUEUED);
+	CU_ASSERT_EQUAL(res, 0);
+	test_pool_process(loop, &data3.connection, 2);
+	CU_ASSERT_EQUAL(data3.connection, 2);
+	data1.msgcount = data2.msgcount = 0;
+	for (i = 0; i < 4; i++) {
+		res = pomp_ctx_send_msg(ctx3, msg);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	pomp_loop_wait_and_process(loop, 100);
+	pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(data1.msgcount + data2.msgcount, 4);
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* No connection */
+	res = pomp_ctx_send_msg_key(ctx3, 1234, msg);
+	CU_ASSERT_EQUAL(res, -ENOTCONN);
+
+	/* Pool of raw contexts */
+	ctx4 = pomp_ctx_new_with_loop(&test_sub_event_cb, &data4, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx4);
+	res = pomp_ctx_set_raw(ctx4, &test_pool_raw_cb);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect_pool(ctx4, addrs, addrlens, 2, 2,
+			POMP_BALANCE_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, 0);
+	test_pool_process(loop, &data4.connection, 2);
+	CU_ASSERT_EQUAL(data4.connection, 2);
+	CU_ASSERT_EQUAL(test_pool_conn_count(ctx4), 2);
+	res = pomp_ctx_stop(ctx4);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx4);
+	CU_ASSERT_EQUAL(res, 0);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+	pomp_msg_destroy(msg);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+struct test_heartbeat_data {
+	uint32_t          connection;
+	uint32_t          disconnection;
+	uint32_t          msgcount;
+	struct pomp_conn  *conn;
+};
+
+/** */
+static void test_heartbeat_event_cb(struct pomp_ctx *ctx,
+		enum pomp_event event, struct pomp_conn *conn,
+		const struct pomp_msg *msg, void *userdata)
+{
+	struct test_heartbeat_data *data = userdata;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		data->conn = conn;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		data->disconnection++;
+		data->conn = NULL;
+		break;
+
+	case POMP_EVENT_MSG:
+		data->msgcount++;
+		break;
+	}
+}
+
+/** */
+static void test_ctx_heartbeat(void)
+{
+	int res = 0;
+	struct test_heartbeat_data data1, data2;
+	struct sockaddr_in addr_in;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL, *ctx2 = NULL;
+	struct pomp_conn_rtt rtt;
+	uint64_t start = 0;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5662);
+
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+
+	/* Server only answers pings */
+	ctx1 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data1, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Client detects a stalled server after 50 ms */
+	ctx2 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data2, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_set_heartbeat(NULL, 10, 50);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_set_heartbeat(ctx2, 10, 50);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_setup_reconnect(ctx2, 1000, 1000, 100, 0, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Round trip times are measured, pings are not notified */
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 100 * 1000)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(data2.connection, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data1.conn);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data2.conn);
+	res = pomp_conn_get_rtt(data2.conn, &rtt);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_TRUE(rtt.count >= 3);
+	CU_ASSERT_TRUE(rtt.min <= rtt.srtt);
+	CU_ASSERT_TRUE(rtt.min <= rtt.last);
+	res = pomp_conn_get_rtt(data1.conn, &rtt);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(rtt.count, 0);
+	res = pomp_conn_get_rtt(NULL, &rtt);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	CU_ASSERT_EQUAL(data1.msgcount, 0);
+	CU_ASSERT_EQUAL(data2.msgcount, 0);
+
+	/* Server stops processing its connection */
+	res = pomp_conn_suspend_read(data1.conn);
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (data2.disconnection == 0
+			&& pomp_loop_now(loop) - start < 500 * 1000) {
+		pomp_loop_wait_and_process(loop, 100);
+	}
+	CU_ASSERT_EQUAL(data2.disconnection, 1);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start < 200 * 1000);
+
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+static void test_ctx_rate_limit(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_heartbeat_data data1, data2, data3, data4;
+	struct sockaddr_in addr_in;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL, *ctx2 = NULL;
+	struct pomp_ctx *ctx3 = NULL, *ctx4 = NULL;
+	struct pomp_throttle_stats stats;
+	uint64_t start = 0;
+	char str[1000];
+
+	memset(str, 'a', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&data3, 0, sizeof(data3));
+	memset(&data4, 0, sizeof(data4));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5663);
+
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+
+	/* Server reads 200 messages per second, 20 at once, 1 connection */
+	ctx1 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data1, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_set_rate_limit(NULL, 200, 20, 0, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_set_rate_limit(ctx1, 200, 20, 0, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_admission(NULL, 1, 0, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_set_admission(ctx1, 1, 0, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	ctx2 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data2, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	while (data1.connection == 0 || data2.connection == 0)
+		pomp_loop_wait_and_process(loop, 100);
+
+	/* Flood of the client is spread over time, a few messages per read */
+	for (i = 0; i < 200; i++) {
+		res = pomp_ctx_send(ctx2, 1, "%u%s", i, str);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 100 * 1000)
+		pomp_loop_wait_and_process(loop, 10);
+	CU_ASSERT_TRUE(data1.msgcount >= 20);
+	CU_ASSERT_TRUE(data1.msgcount < 100);
+	res = pomp_conn_get_throttle_stats(data1.conn, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_TRUE(stats.throttles > 0);
+	CU_ASSERT_TRUE(stats.throttled_us > 0);
+	res = pomp_conn_get_throttle_stats(NULL, &stats);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	while (data1.msgcount < 200)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start >= 800 * 1000);
+
+	/* Connections beyond the maximum are rejected */
+	ctx3 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data3, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx3);
+	res = pomp_ctx_connect(ctx3, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	memset(&stats, 0, sizeof(stats));
+	while (stats.rejected == 0) {
+		pomp_loop_wait_and_process(loop, 100);
+		res = pomp_ctx_get_throttle_stats(ctx1, &stats);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	CU_ASSERT_EQUAL(stats.rejected, 1);
+	CU_ASSERT_EQUAL(data1.connection, 1);
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Accepts beyond the rate are postponed */
+	res = pomp_ctx_set_admission(ctx1, 0, 10, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	ctx4 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data4, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx4);
+	res = pomp_ctx_connect(ctx3, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx4, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (data1.connection < 3)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start >= 50 * 1000);
+	res = pomp_ctx_get_throttle_stats(ctx1, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_TRUE(stats.throttles >= 1);
+	CU_ASSERT_TRUE(stats.throttled_us > 0);
+	CU_ASSERT_EQUAL(stats.rejected, 1);
+
+	res = pomp_ctx_stop(ctx4);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx4);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+#define TEST_BUDGET_MSGS  100
+
+/** */
+static void test_ctx_read_budget(void)
+{
+	int res = 0;
+	uint32_t i = 0, count = 0;
+	struct test_sub_data data1, data2;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	char str[1000];
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(str, 'a', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5659);
+
+	ctx1 = pomp_ctx_new(&test_sub_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_sub_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+
+	/* Invalid parameters */
+	res = pomp_ctx_set_read_budget(NULL, 4096, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Server reading at most 4 messages per iteration */
+	res = pomp_ctx_set_read_budget(ctx1, 0, 4);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 10 && data1.connection < 1; i++)
+		run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL_FATAL(data1.connection, 1);
+
+	/* Messages larger than a read, all available at once */
+	for (i = 0; i < TEST_BUDGET_MSGS; i++) {
+		res = pomp_ctx_send(ctx2, i, "%s", str);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	for (i = 0; i < 10 && data1.msgcount == 0; i++)
+		pomp_ctx_wait_and_process(ctx1, 100);
+	CU_ASSERT_TRUE(data1.msgcount > 0);
+	CU_ASSERT_TRUE(data1.msgcount < TEST_BUDGET_MSGS);
+
+	/* Remaining data processed at following iterations */
+	for (i = 0; i < 2000 && data1.msgcount < TEST_BUDGET_MSGS; i++) {
+		count = data1.msgcount;
+		pomp_ctx_wait_and_process(ctx1, 10);
+		CU_ASSERT_TRUE(data1.msgcount - count <= 8);
+	}
+	CU_ASSERT_EQUAL(data1.msgcount, TEST_BUDGET_MSGS);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+static void test_et_socket_cb(struct pomp_ctx *ctx, int fd,
+		enum pomp_socket_kind kind, void *userdata)
+{
+	int size = 4096;
+
+	/* Small buffers so writes block */
+	(void)setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+/** */
+static void test_ctx_edge_triggered(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_sub_data data1, data2;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	struct pomp_loop_stats stats1, stats2;
+	char str[1000];
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(str, 'a', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5660);
+
+	ctx1 = pomp_ctx_new(&test_sub_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_sub_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+
+	/* Invalid parameters */
+	res = pomp_ctx_set_edge_triggered(NULL, 1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_loop_get_stats(NULL, &stats1);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_loop_get_stats(pomp_ctx_get_loop(ctx1), NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Only available with epoll */
+	res = pomp_ctx_set_edge_triggered(ctx1, 1);
+	if (res == -ENOSYS)
+		goto out;
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_edge_triggered(ctx2, 1);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Server reading at most 2 messages per iteration, needs re-arm */
+	res = pomp_ctx_set_read_budget(ctx1, 0, 2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_socket_cb(ctx2, &test_et_socket_cb);
+	CU_ASSERT_EQUAL(res, 0);
+
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 10 && (data1.connection < 1 || data2.connection < 1);
+			i++) {
+		run_ctx(ctx1, ctx2, 100);
+	}
+	CU_ASSERT_EQUAL_FATAL(data1.connection, 1);
+	CU_ASSERT_EQUAL_FATAL(data2.connection, 1);
+
+	/* Queue more than socket buffers can hold */
+	res = pomp_loop_get_stats(pomp_ctx_get_loop(ctx2), &stats1);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < TEST_BUDGET_MSGS; i++) {
+		res = pomp_ctx_send(ctx2, i, "%s", str);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	for (i = 0; i < 2000 && data1.msgcount < TEST_BUDGET_MSGS; i++)
+		run_ctx(ctx1, ctx2, 10);
+	CU_ASSERT_EQUAL(data1.msgcount, TEST_BUDGET_MSGS);
+	for (i = 0; i < 8; i++)
+		CU_ASSERT_EQUAL(data1.msgids[i], i);
+
+	/* Output queue drained without updating the loop */
+	res = pomp_loop_get_stats(pomp_ctx_get_loop(ctx2), &stats2);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats2.fd_changes, stats1.fd_changes);
+	CU_ASSERT_TRUE(stats2.waits > stats1.waits);
+	CU_ASSERT_TRUE(stats2.events > stats1.events);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+
+out:
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+struct test_rpc_data {
+	uint32_t  connection;
+	uint32_t  reqcount;
+	uint32_t  cbcount;
+	int       status;
+	uint32_t  msgid;
+	uint32_t  value;
+};
+
+/** */
+static void test_rpc_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	int res = 0;
+	struct test_rpc_data *data = userdata;
+	uint32_t v = 0;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		break;
+
+	case POMP_EVENT_MSG:
+		data->reqcount++;
+		CU_ASSERT_NOT_EQUAL(pomp_msg_get_rpc_id(msg), 0);
+		res = pomp_msg_read(msg, "%u", &v);
+		CU_ASSERT_EQUAL(res, 0);
+
+		/* Only reply to message 1 */
+		if (pomp_msg_get_id(msg) == 1) {
+			res = pomp_rpc_reply(conn, msg, 2, "%u", v * 2);
+			CU_ASSERT_EQUAL(res, 0);
+		}
+		break;
+
+	default:
+		CU_ASSERT_TRUE_FATAL(0);
+		break;
+	}
+}
+
+/** */
+static void test_rpc_cb(struct pomp_conn *conn, int status,
+		const struct pomp_msg *msg, void *userdata)
+{
+	int res = 0;
+	struct test_rpc_data *data = userdata;
+
+	data->cbcount++;
+	data->status = status;
+	if (status == 0) {
+		CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+		CU_ASSERT_EQUAL(pomp_msg_get_rpc_id(msg), 0);
+		data->msgid = pomp_msg_get_id(msg);
+		res = pomp_msg_read(msg, "%u", &data->value);
+		CU_ASSERT_EQUAL(res, 0);
+	} else {
+		CU_ASSERT_PTR_NULL(msg);
+	}
+}
+
+/** */
+static void test_rpc(void)
+{
+	int res = 0;
+	struct test_rpc_data data1, data2;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	struct pomp_conn *conn = NULL;
+	struct pomp_msg *msg = NULL;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5656);
+
+	/* Create contexts and connect them */
+	ctx1 = pomp_ctx_new(&test_rpc_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_rpc_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data1.connection, 1);
+	conn = pomp_ctx_get_conn(ctx2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(conn);
+
+	/* Request with reply */
+	res = pomp_rpc_call(conn, 1, 1000, &test_rpc_cb, &data2, "%u", 21);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data1.reqcount, 1);
+	CU_ASSERT_EQUAL(data2.cbcount, 1);
+	CU_ASSERT_EQUAL(data2.status, 0);
+	CU_ASSERT_EQUAL(data2.msgid, 2);
+	CU_ASSERT_EQUAL(data2.value, 42);
+
+	/* Request with an already encoded message */
+	msg = pomp_msg_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	res = pomp_msg_write(msg, 1, "%u", 50);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_rpc_call_msg(conn, msg, 0, &test_rpc_cb, &data2);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL(data2.cbcount, 2);
+	CU_ASSERT_EQUAL(data2.status, 0);
+	CU_ASSERT_EQUAL(data2.value, 100);
+
+	/* Not a request */
+	res = pomp_rpc_reply(conn, msg, 2, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_msg_destroy(msg);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Invalid parameters */
+	res = pomp_rpc_call(NULL, 1, 0, &test_rpc_cb, &data2, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_rpc_call(conn, 1, 0, NULL, &data2, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_rpc_call_msg(conn, NULL, 0, &test_rpc_cb, &data2);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_rpc_reply(NULL, NULL, 2, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Requests without reply, shall timeout together */
+	res = pomp_rpc_call(conn, 3, 50, &test_rpc_cb, &data2, "%u", 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_rpc_call(conn, 3, 50, &test_rpc_cb, &data2, "%u", 0);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 200);
+	CU_ASSERT_EQUAL(data1.reqcount, 4);
+	CU_ASSERT_EQUAL(data2.cbcount, 4);
+	CU_ASSERT_EQUAL(data2.status, -ETIMEDOUT);
+
+	/* Requests canceled by disconnection */
+	res = pomp_rpc_call(conn, 3, 0, &test_rpc_cb, &data2, "%u", 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_rpc_call(conn, 3, 10000, &test_rpc_cb, &data2, "%u", 0);
+	CU_ASSERT_EQUAL(res, 0);
+	run_ctx(ctx1, ctx2, 100);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data2.cbcount, 6);
+	CU_ASSERT_EQUAL(data2.status, -ECANCELED);
+
+	/* Stop and destroy contexts */
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
 /* Disable some gcc warnings for test suite descriptions */
 #ifdef __GNUC__
 #  pragma GCC diagnostic ignored "-Wcast-qual"
 #endif /* __GNUC__ */
 
+#ifndef _WIN32
+
+struct test_worker_data {
+	pthread_t  mainthread;
+	uint32_t   connection;
+	uint32_t   disconnection;
+	uint32_t   msgcount;
+	uint32_t   offmain;
+	pthread_t  threads[2];
+	uint32_t   threadcount;
+};
+
+struct test_worker_loop {
+	struct pomp_loop  *loop;
+	pthread_t         thread;
+	volatile int      stop;
+};
+
+/** */
+static void test_worker_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct test_worker_data *data = userdata;
+	uint32_t idx = 0;
+
+	if (!pthread_equal(pthread_self(), data->mainthread))
+		__sync_add_and_fetch(&data->offmain, 1);
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		idx = __sync_fetch_and_add(&data->connection, 1);
+		if (idx < 2) {
+			data->threads[idx] = pthread_self();
+			__sync_add_and_fetch(&data->threadcount, 1);
+		}
+		/* Stopping would wait for this thread */
+		if (!pthread_equal(pthread_self(), data->mainthread))
+			CU_ASSERT_EQUAL(pomp_ctx_stop(ctx), -EBUSY);
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		__sync_add_and_fetch(&data->disconnection, 1);
+		break;
+
+	case POMP_EVENT_MSG:
+		__sync_add_and_fetch(&data->msgcount, 1);
+		/* Reply from the thread owning the connection */
+		if (pomp_msg_get_id(msg) == 1)
+			CU_ASSERT_EQUAL(pomp_conn_send(conn, 2, NULL), 0);
+		break;
+	}
+}
+
+/** */
+static void *test_worker_thread(void *arg)
+{
+	struct test_worker_loop *worker = arg;
+	while (!worker->stop)
+		pomp_loop_wait_and_process(worker->loop, -1);
+	return NULL;
+}
+
+/** */
+static void test_ctx_workers_policy(enum pomp_worker_policy policy)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_worker_data data1;
+	struct test_sub_data data2, data3;
+	struct test_worker_loop workers[2];
+	struct pomp_loop *loops[2];
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	struct pomp_ctx *ctx3 = NULL;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&data3, 0, sizeof(data3));
+	data1.mainthread = pthread_self();
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5656);
+
+	/* Worker loops, each one run by its own thread */
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 0;
+		workers[i].loop = pomp_loop_new();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(workers[i].loop);
+		loops[i] = workers[i].loop;
+		res = pthread_create(&workers[i].thread, NULL,
+				&test_worker_thread, &workers[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+	}
+
+	ctx1 = pomp_ctx_new(&test_worker_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_sub_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	ctx3 = pomp_ctx_new(&test_sub_event_cb, &data3);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx3);
+
+	/* Invalid parameters */
+	res = pomp_ctx_set_workers(NULL, loops, 2,
+			POMP_WORKER_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_set_workers(ctx1, NULL, 2,
+			POMP_WORKER_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	loops[1] = pomp_ctx_get_loop(ctx1);
+	res = pomp_ctx_set_workers(ctx1, loops, 2,
+			POMP_WORKER_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	loops[1] = workers[1].loop;
+
+	res = pomp_ctx_set_workers(ctx1, loops, 2, policy);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Server with 2 workers, 2 clients */
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx3, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 50 && (data1.threadcount < 2 || data2.connection < 1
+			|| data3.connection < 1); i++) {
+		run_ctx(ctx1, ctx2, 100);
+		run_ctx(ctx1, ctx3, 100);
+	}
+	CU_ASSERT_EQUAL_FATAL(data1.connection, 2);
+	CU_ASSERT_EQUAL_FATAL(data1.threadcount, 2);
+	CU_ASSERT_EQUAL(data2.connection, 1);
+	CU_ASSERT_EQUAL(data3.connection, 1);
+
+	/* Connections are notified in worker threads, round robin gives each
+	 * one to a different worker (the kernel balances SO_REUSEPORT shards,
+	 * possibly on the same one) */
+	for (i = 0; i < 2; i++) {
+		CU_ASSERT_TRUE(pthread_equal(data1.threads[i],
+				workers[0].thread) ||
+				pthread_equal(data1.threads[i],
+				workers[1].thread));
+	}
+	if (policy == POMP_WORKER_POLICY_ROUND_ROBIN) {
+		CU_ASSERT_FALSE(pthread_equal(data1.threads[0],
+				data1.threads[1]));
+	}
+	CU_ASSERT_PTR_NULL(pomp_ctx_get_next_conn(ctx1, NULL));
+	res = pomp_ctx_set_workers(ctx1, loops, 2,
+			POMP_WORKER_POLICY_LEAST_LOADED);
+	CU_ASSERT_EQUAL(res, -EBUSY);
+
+	/* Broadcast from main thread goes through workers */
+	res = pomp_ctx_send(ctx1, 3, "%u", 42);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 10 && (data2.msgcount < 1 || data3.msgcount < 1); i++)
+		run_ctx(ctx2, ctx3, 100);
+	CU_ASSERT_EQUAL(data2.msgcount, 1);
+	CU_ASSERT_EQUAL(data3.msgcount, 1);
+
+	/* Message handled and replied by the worker */
+	res = pomp_ctx_send(ctx2, 1, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 10 && data2.msgcount < 2; i++)
+		run_ctx(ctx2, ctx3, 100);
+	CU_ASSERT_EQUAL(data1.msgcount, 1);
+	CU_ASSERT_EQUAL(data2.msgcount, 2);
+
+	/* Stop waits for workers to disconnect their connections */
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data1.disconnection, 2);
+	CU_ASSERT_EQUAL(data1.offmain, 5);
+
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx3);
+	CU_ASSERT_EQUAL(res, 0);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 1;
+		pomp_loop_wakeup(workers[i].loop);
+		pthread_join(workers[i].thread, NULL);
+		res = pomp_loop_destroy(workers[i].loop);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+/** */
+static void test_ctx_workers(void)
+{
+	test_ctx_workers_policy(POMP_WORKER_POLICY_ROUND_ROBIN);
+}
+
+/** */
+static void test_ctx_workers_reuseport(void)
+{
+	test_ctx_workers_policy(POMP_WORKER_POLICY_REUSEPORT);
+	test_ctx_workers_policy(POMP_WORKER_POLICY_REUSEPORT_CPU);
+}
+
+/** */
+static void test_ctx_heartbeat_workers(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_worker_data data1;
+	struct test_heartbeat_data data2;
+	struct test_worker_loop workers[2];
+	struct pomp_loop *loops[2];
+	struct sockaddr_in addr_in;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL, *ctx2 = NULL;
+	uint64_t start = 0;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	data1.mainthread = pthread_self();
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5664);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 0;
+		workers[i].loop = pomp_loop_new();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(workers[i].loop);
+		loops[i] = workers[i].loop;
+		res = pthread_create(&workers[i].thread, NULL,
+				&test_worker_thread, &workers[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+	}
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+
+	/* Server connections are owned by workers */
+	ctx1 = pomp_ctx_new_with_loop(&test_worker_event_cb, &data1, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_set_workers(ctx1, loops, 2,
+			POMP_WORKER_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_heartbeat(ctx1, 10, 50);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	ctx2 = pomp_ctx_new_with_loop(&test_heartbeat_event_cb, &data2, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Peer answering pings stays connected */
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 100 * 1000)
+		pomp_loop_wait_and_process(loop, 10);
+	CU_ASSERT_EQUAL(data2.connection, 1);
+	CU_ASSERT_EQUAL(__sync_fetch_and_add(&data1.connection, 0), 1);
+	CU_ASSERT_EQUAL(data2.disconnection, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data2.conn);
+
+	/* Silent peer is disconnected by its worker */
+	res = pomp_conn_suspend_read(data2.conn);
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (__sync_fetch_and_add(&data1.disconnection, 0) == 0
+			&& pomp_loop_now(loop) - start < 500 * 1000) {
+		pomp_loop_wait_and_process(loop, 10);
+	}
+	CU_ASSERT_EQUAL(__sync_fetch_and_add(&data1.disconnection, 0), 1);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start < 200 * 1000);
+
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data1.disconnection, 1);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 1;
+		pomp_loop_wakeup(workers[i].loop);
+		pthread_join(workers[i].thread, NULL);
+		res = pomp_loop_destroy(workers[i].loop);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+/** */
+static void test_ctx_admission_workers(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_worker_data data1;
+	struct test_heartbeat_data data2[3];
+	struct test_worker_loop workers[2];
+	struct pomp_loop *loops[2];
+	struct sockaddr_in addr_in;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL, *ctx2[3];
+	struct pomp_throttle_stats stats;
+	uint64_t start = 0;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(data2, 0, sizeof(data2));
+	data1.mainthread = pthread_self();
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5665);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 0;
+		workers[i].loop = pomp_loop_new();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(workers[i].loop);
+		loops[i] = workers[i].loop;
+		res = pthread_create(&workers[i].thread, NULL,
+				&test_worker_thread, &workers[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+	}
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+
+	/* Workers accept on their own sockets, 2 connections, 10 per second */
+	ctx1 = pomp_ctx_new_with_loop(&test_worker_event_cb, &data1, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_set_workers(ctx1, loops, 2,
+			POMP_WORKER_POLICY_REUSEPORT);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_admission(ctx1, 2, 10, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+
+	start = pomp_loop_now(loop);
+	for (i = 0; i < 3; i++) {
+		ctx2[i] = pomp_ctx_new_with_loop(&test_heartbeat_event_cb,
+				&data2[i], loop);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2[i]);
+		res = pomp_ctx_connect(ctx2[i],
+				(const struct sockaddr *)&addr_in,
+				sizeof(addr_in));
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	/* Maximum and rate are shared by the sockets of all workers */
+	memset(&stats, 0, sizeof(stats));
+	while (stats.rejected == 0
+			&& pomp_loop_now(loop) - start < 2000 * 1000) {
+		pomp_loop_wait_and_process(loop, 10);
+		res = pomp_ctx_get_throttle_stats(ctx1, &stats);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	CU_ASSERT_EQUAL(stats.rejected, 1);
+	CU_ASSERT_TRUE(stats.throttles >= 1);
+	CU_ASSERT_TRUE(stats.throttled_us > 0);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start >= 100 * 1000);
+	CU_ASSERT_EQUAL(__sync_fetch_and_add(&data1.connection, 0), 2);
+
+	for (i = 0; i < 3; i++) {
+		res = pomp_ctx_stop(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_ctx_destroy(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 1;
+		pomp_loop_wakeup(workers[i].loop);
+		pthread_join(workers[i].thread, NULL);
+		res = pomp_loop_destroy(workers[i].loop);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+#define TEST_MIGRATE_MSGS  200
+#define TEST_MIGRATE_AT    10
+
+struct test_migrate_data {
+	struct pomp_loop  *loops[2];
+	struct pomp_loop  *target;
+	uint32_t          connection;
+	uint32_t          disconnection;
+	uint32_t          msgcount;
+	uint32_t          unordered;
+	uint32_t          corrupted;
+	uint32_t          lastid;
+	int               migrateres;
+	int               invalidres;
+	int               busyres;
+	pthread_t         srcthread;
+	pthread_t         lastthread;
+};
+
+/** */
+static void test_migrate_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct test_migrate_data *data = userdata;
+	uint32_t msgid = 0, val = 0;
+	char *str = NULL;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		data->disconnection++;
+		break;
+
+	case POMP_EVENT_MSG:
+		msgid = pomp_msg_get_id(msg);
+		if (msgid != data->lastid + 1)
+			data->unordered++;
+		data->lastid = msgid;
+		data->msgcount++;
+		if (pomp_msg_read(msg, "%u%ms", &val, &str) < 0
+				|| val != msgid || strlen(str) != 999) {
+			data->corrupted++;
+		}
+		free(str);
+
+		if (msgid == TEST_MIGRATE_AT) {
+			/* Move to the other worker */
+			data->srcthread = pthread_self();
+			data->target = pomp_conn_get_loop(conn) ==
+					data->loops[0] ?
+					data->loops[1] : data->loops[0];
+			data->invalidres = pomp_conn_migrate(conn,
+					pomp_ctx_get_loop(ctx));
+			data->migrateres = pomp_conn_migrate(conn,
+					data->target);
+			data->busyres = pomp_conn_migrate(conn, data->target);
+		} else if (msgid == TEST_MIGRATE_MSGS) {
+			/* Reply from the new worker */
+			data->lastthread = pthread_self();
+			CU_ASSERT_EQUAL(pomp_conn_get_loop(conn),
+					data->target);
+			CU_ASSERT_EQUAL(pomp_conn_send(conn, msgid, NULL), 0);
+		}
+		break;
+	}
+}
+
+/** */
+static void test_conn_migrate(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_migrate_data data1;
+	struct test_sub_data data2;
+	struct test_worker_loop workers[2];
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	char str[1000];
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(str, 'a', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5657);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 0;
+		workers[i].loop = pomp_loop_new();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(workers[i].loop);
+		data1.loops[i] = workers[i].loop;
+		res = pthread_create(&workers[i].thread, NULL,
+				&test_worker_thread, &workers[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+	}
+
+	ctx1 = pomp_ctx_new(&test_migrate_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_sub_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+
+	/* Invalid parameters */
+	res = pomp_conn_migrate(NULL, workers[0].loop);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	res = pomp_ctx_set_workers(ctx1, data1.loops, 2,
+			POMP_WORKER_POLICY_ROUND_ROBIN);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 10 && data2.connection < 1; i++)
+		run_ctx(ctx1, ctx2, 100);
+	CU_ASSERT_EQUAL_FATAL(data2.connection, 1);
+
+	/* Messages larger than a read, migrated in the middle of the stream */
+	for (i = 1; i <= TEST_MIGRATE_MSGS; i++) {
+		res = pomp_ctx_send(ctx2, i, "%u%s", i, str);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	for (i = 0; i < 2000 && data2.msgcount < 1; i++)
+		pomp_ctx_wait_and_process(ctx2, 10);
+	CU_ASSERT_EQUAL(data2.msgcount, 1);
+	CU_ASSERT_EQUAL(data2.msgids[0], TEST_MIGRATE_MSGS);
+
+	CU_ASSERT_EQUAL(data1.connection, 1);
+	CU_ASSERT_EQUAL(data1.invalidres, -EINVAL);
+	CU_ASSERT_EQUAL(data1.migrateres, 0);
+	CU_ASSERT_EQUAL(data1.busyres, -EBUSY);
+	CU_ASSERT_EQUAL(data1.msgcount, TEST_MIGRATE_MSGS);
+	CU_ASSERT_EQUAL(data1.unordered, 0);
+	CU_ASSERT_EQUAL(data1.corrupted, 0);
+	CU_ASSERT_FALSE(pthread_equal(data1.srcthread, data1.lastthread));
+	CU_ASSERT_TRUE(pthread_equal(data1.lastthread,
+			data1.target == workers[0].loop ?
+			workers[0].thread : workers[1].thread));
+
+	/* Migrated connection is removed by its new worker */
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data1.disconnection, 1);
+
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+
+	for (i = 0; i < 2; i++) {
+		workers[i].stop = 1;
+		pomp_loop_wakeup(workers[i].loop);
+		pthread_join(workers[i].thread, NULL);
+		res = pomp_loop_destroy(workers[i].loop);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+#define TEST_ASYNC_THREADS  4
+#define TEST_ASYNC_MSGS     1000
+
+struct test_async_data {
+	uint32_t          connection;
+	uint32_t          msgcount;
+	uint32_t          unordered;
+	uint32_t          next[TEST_ASYNC_THREADS];
+	struct pomp_conn  *conn;
+};
+
+struct test_async_producer {
+	pthread_t         thread;
+	uint32_t          idx;
+	uint32_t          errors;
+	struct pomp_ctx   *ctx;
+	struct pomp_conn  *conn;
+};
+
+/** */
+static void test_async_event_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct test_async_data *data = userdata;
+	uint32_t idx = 0, seq = 0;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		data->conn = conn;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		data->conn = NULL;
+		break;
+
+	case POMP_EVENT_MSG:
+		/* Messages of a same producer shall be received in order */
+		idx = pomp_msg_get_id(msg);
+		CU_ASSERT_EQUAL(pomp_msg_read(msg, "%u", &seq), 0);
+		CU_ASSERT_FATAL(idx < TEST_ASYNC_THREADS);
+		if (seq != data->next[idx])
+			data->unordered++;
+		data->next[idx] = seq + 1;
+		data->msgcount++;
+		break;
+	}
+}
+
+/** */
+static void *test_async_thread(void *arg)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_async_producer *producer = arg;
+	struct pomp_msg *msg = pomp_msg_new();
+
+	for (i = 0; i < TEST_ASYNC_MSGS; i++) {
+		res = pomp_msg_write(msg, producer->idx, "%u", i);
+		if (res == 0 && producer->conn != NULL)
+			res = pomp_conn_send_msg_async(producer->conn, msg);
+		else if (res == 0)
+			res = pomp_ctx_send_msg_async(producer->ctx, msg);
+		if (res < 0)
+			producer->errors++;
+		pomp_msg_clear(msg);
+	}
+
+	pomp_msg_destroy(msg);
+	return NULL;
+}
+
+/** */
+static void test_async_run(struct pomp_ctx *ctx, struct pomp_conn *conn,
+		struct pomp_ctx *ctx1, struct pomp_ctx *ctx2,
+		struct test_async_data *data)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_async_producer producers[TEST_ASYNC_THREADS];
+
+	for (i = 0; i < TEST_ASYNC_THREADS; i++) {
+		producers[i].idx = i;
+		producers[i].errors = 0;
+		producers[i].ctx = ctx;
+		producers[i].conn = conn;
+		res = pthread_create(&producers[i].thread, NULL,
+				&test_async_thread, &producers[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+	}
+
+	/* Loops keep running while producers are queuing */
+	for (i = 0; i < TEST_ASYNC_THREADS; i++) {
+		pthread_join(producers[i].thread, NULL);
+		CU_ASSERT_EQUAL(producers[i].errors, 0);
+		run_ctx(ctx1, ctx2, 10);
+	}
+	for (i = 0; i < 50 && data->msgcount <
+			TEST_ASYNC_THREADS * TEST_ASYNC_MSGS; i++) {
+		run_ctx(ctx1, ctx2, 100);
+	}
+
+	CU_ASSERT_EQUAL(data->msgcount, TEST_ASYNC_THREADS * TEST_ASYNC_MSGS);
+	CU_ASSERT_EQUAL(data->unordered, 0);
+}
+
+/** */
+static void test_ctx_async(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_async_data data1, data2;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2 = NULL;
+	struct pomp_msg *msg = NULL;
+
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5656);
+
+	ctx1 = pomp_ctx_new(&test_async_event_cb, &data1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	ctx2 = pomp_ctx_new(&test_async_event_cb, &data2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+
+	/* Invalid parameters */
+	msg = pomp_msg_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+	res = pomp_ctx_send_msg_async(ctx2, msg);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_msg_write(msg, 0, "%u", 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_send_msg_async(NULL, msg);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_send_msg_async(ctx2, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_conn_send_msg_async(NULL, msg);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 10 && (data1.connection < 1 ||
+			data2.connection < 1); i++) {
+		run_ctx(ctx1, ctx2, 100);
+	}
+	CU_ASSERT_EQUAL_FATAL(data1.connection, 1);
+	CU_ASSERT_EQUAL_FATAL(data2.connection, 1);
+
+	/* Client context to server */
+	test_async_run(ctx2, NULL, ctx1, ctx2, &data1);
+
+	/* Server connection to client */
+	test_async_run(NULL, data1.conn, ctx1, ctx2, &data2);
+
+	/* Messages still queued are dropped */
+	res = pomp_ctx_send_msg_async(ctx2, msg);
+	CU_ASSERT_EQUAL(res, 0);
+	pomp_msg_destroy(msg);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+#define TEST_POOL_THREADS	4
+#define TEST_POOL_CLIENTS	3
+#define TEST_POOL_MSGS		50
+
+struct test_pool_data {
+	pthread_t         main;
+	pthread_mutex_t   mutex;
+	uint32_t          connection;
+	uint32_t          disconnection;
+	uint32_t          msgcount;
+	uint32_t          unordered;
+	uint32_t          inloop;
+	uint32_t          active;
+	uint32_t          max_active;
+	uint32_t          next[TEST_POOL_CLIENTS];
+};
+
+struct test_pool_client {
+	uint32_t          connection;
+	uint32_t          replycount;
+	uint32_t          unordered;
+	uint32_t          rpccount;
+	struct pomp_conn  *conn;
+};
+
+/** */
+static void test_pool_server_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	int res = 0;
+	struct test_pool_data *data = userdata;
+	uint32_t idx = 0, seq = 0;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		CU_ASSERT_TRUE(pthread_equal(pthread_self(), data->main));
+		data->connection++;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		CU_ASSERT_TRUE(pthread_equal(pthread_self(), data->main));
+		data->disconnection++;
+		break;
+
+	case POMP_EVENT_MSG:
+		res = pomp_msg_read(msg, "%u%u", &idx, &seq);
+		CU_ASSERT_EQUAL(res, 0);
+		CU_ASSERT_FATAL(idx < TEST_POOL_CLIENTS);
+
+		pthread_mutex_lock(&data->mutex);
+		if (pthread_equal(pthread_self(), data->main))
+			data->inloop++;
+		if (++data->active > data->max_active)
+			data->max_active = data->active;
+		pthread_mutex_unlock(&data->mutex);
+
+		/* Messages of a connection are handled one at a time */
+		if (seq != data->next[idx])
+			data->unordered++;
+		data->next[idx] = seq + 1;
+		usleep(1000);
+
+		/* Replies are sent by the loop */
+		if (pomp_msg_get_rpc_id(msg) != 0)
+			res = pomp_rpc_reply(conn, msg, 3, "%u", seq);
+		else
+			res = pomp_conn_send(conn, 2, "%u", seq);
+		CU_ASSERT_EQUAL(res, 0);
+
+		pthread_mutex_lock(&data->mutex);
+		data->active--;
+		data->msgcount++;
+		pthread_mutex_unlock(&data->mutex);
+		break;
+	}
+}
+
+/** */
+static void test_pool_client_cb(struct pomp_ctx *ctx, enum pomp_event event,
+		struct pomp_conn *conn, const struct pomp_msg *msg,
+		void *userdata)
+{
+	struct test_pool_client *client = userdata;
+	uint32_t seq = 0;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		client->connection++;
+		client->conn = conn;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		client->conn = NULL;
+		break;
+
+	case POMP_EVENT_MSG:
+		CU_ASSERT_EQUAL(pomp_msg_read(msg, "%u", &seq), 0);
+		if (seq != client->replycount)
+			client->unordered++;
+		client->replycount++;
+		break;
+	}
+}
+
+/** */
+static void test_pool_rpc_cb(struct pomp_conn *conn, int status,
+		const struct pomp_msg *msg, void *userdata)
+{
+	struct test_pool_client *client = userdata;
+	CU_ASSERT_EQUAL(status, 0);
+	client->rpccount++;
+}
+
+/** */
+static void test_ctx_handler_pool(void)
+{
+	int res = 0;
+	uint32_t i = 0, j = 0, done = 0;
+	struct test_pool_data data;
+	struct test_pool_client clients[TEST_POOL_CLIENTS];
+	struct pomp_handler_pool_stats stats;
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2[TEST_POOL_CLIENTS];
+	struct pomp_loop *loop = NULL;
+
+	memset(&data, 0, sizeof(data));
+	memset(clients, 0, sizeof(clients));
+	data.main = pthread_self();
+	pthread_mutex_init(&data.mutex, NULL);
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5656);
+
+	ctx1 = pomp_ctx_new(&test_pool_server_cb, &data);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	loop = pomp_ctx_get_loop(ctx1);
+	for (i = 0; i < TEST_POOL_CLIENTS; i++) {
+		ctx2[i] = pomp_ctx_new_with_loop(&test_pool_client_cb,
+				&clients[i], loop);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2[i]);
+	}
+
+	/* Invalid parameters */
+	res = pomp_ctx_set_handler_pool(NULL, TEST_POOL_THREADS);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_get_handler_pool_stats(ctx1, NULL);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_get_handler_pool_stats(ctx1, &stats);
+	CU_ASSERT_EQUAL(res, -ENOENT);
+
+	res = pomp_ctx_set_handler_pool(ctx1, TEST_POOL_THREADS);
+	CU_ASSERT_EQUAL(res, 0);
+
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_handler_pool(ctx1, 0);
+	CU_ASSERT_EQUAL(res, -EBUSY);
+	for (i = 0; i < TEST_POOL_CLIENTS; i++) {
+		res = pomp_ctx_connect(ctx2[i],
+				(const struct sockaddr *)&addr_in,
+				sizeof(addr_in));
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	for (i = 0; i < 20 && data.connection < TEST_POOL_CLIENTS; i++)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL_FATAL(data.connection, TEST_POOL_CLIENTS);
+	for (i = 0; i < TEST_POOL_CLIENTS; i++)
+		CU_ASSERT_PTR_NOT_NULL_FATAL(clients[i].conn);
+
+	/* Interleave messages of all clients, last one is a rpc request */
+	for (j = 0; j < TEST_POOL_MSGS; j++) {
+		for (i = 0; i < TEST_POOL_CLIENTS; i++) {
+			if (j == TEST_POOL_MSGS - 1) {
+				res = pomp_rpc_call(clients[i].conn, 1, 5000,
+						&test_pool_rpc_cb, &clients[i],
+						"%u%u", i, j);
+			} else {
+				res = pomp_conn_send(clients[i].conn, 1,
+						"%u%u", i, j);
+			}
+			CU_ASSERT_EQUAL(res, 0);
+		}
+	}
+
+	/* Replies wake up the loop, so bound the number of iterations */
+	for (i = 0; i < 2000 && !done; i++) {
+		pomp_loop_wait_and_process(loop, 10);
+		done = 1;
+		for (j = 0; j < TEST_POOL_CLIENTS; j++) {
+			if (clients[j].replycount < TEST_POOL_MSGS - 1 ||
+					clients[j].rpccount < 1)
+				done = 0;
+		}
+	}
+
+	/* Handlers may still be returning after sending their reply */
+	for (i = 0; i < 100; i++) {
+		res = pomp_ctx_get_handler_pool_stats(ctx1, &stats);
+		CU_ASSERT_EQUAL(res, 0);
+		if (stats.handled == TEST_POOL_CLIENTS * TEST_POOL_MSGS &&
+				stats.running == 0)
+			break;
+		usleep(1000);
+	}
+
+	for (i = 0; i < TEST_POOL_CLIENTS; i++) {
+		CU_ASSERT_EQUAL(clients[i].replycount, TEST_POOL_MSGS - 1);
+		CU_ASSERT_EQUAL(clients[i].rpccount, 1);
+		CU_ASSERT_EQUAL(clients[i].unordered, 0);
+	}
+	CU_ASSERT_EQUAL(data.msgcount, TEST_POOL_CLIENTS * TEST_POOL_MSGS);
+	CU_ASSERT_EQUAL(data.unordered, 0);
+	CU_ASSERT_EQUAL(data.inloop, 0);
+	CU_ASSERT_TRUE(data.max_active > 1);
+	CU_ASSERT_TRUE(data.max_active <= TEST_POOL_CLIENTS);
+
+	res = pomp_ctx_get_handler_pool_stats(ctx1, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats.threads, TEST_POOL_THREADS);
+	CU_ASSERT_EQUAL(stats.queued, 0);
+	CU_ASSERT_EQUAL(stats.running, 0);
+	CU_ASSERT_TRUE(stats.max_queued > 0);
+	CU_ASSERT_EQUAL(stats.handled, TEST_POOL_CLIENTS * TEST_POOL_MSGS);
+	CU_ASSERT_TRUE(stats.max_handler_time_us >= 1000);
+	CU_ASSERT_TRUE(stats.total_handler_time_us >=
+			stats.max_handler_time_us);
+
+	/* Queued messages are dropped on disconnection */
+	for (j = 0; j < TEST_POOL_MSGS; j++) {
+		res = pomp_conn_send(clients[0].conn, 1, "%u%u", 0, j);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	pomp_loop_wait_and_process(loop, 50);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.disconnection, TEST_POOL_CLIENTS);
+	res = pomp_ctx_get_handler_pool_stats(ctx1, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats.queued, 0);
+	CU_ASSERT_EQUAL(stats.running, 0);
+
+	for (i = 0; i < TEST_POOL_CLIENTS; i++) {
+		res = pomp_ctx_stop(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_ctx_destroy(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+struct test_pool_reuse_data {
+	uint32_t          started;
+	uint32_t          replied;
+	uint32_t          connection;
+	uint32_t          disconnection;
+};
+
+/** */
+static void test_pool_reuse_server_cb(struct pomp_ctx *ctx,
+		enum pomp_event event, struct pomp_conn *conn,
+		const struct pomp_msg *msg, void *userdata)
+{
+	struct test_pool_reuse_data *data = userdata;
+
+	switch (event) {
+	case POMP_EVENT_CONNECTED:
+		data->connection++;
+		break;
+
+	case POMP_EVENT_DISCONNECTED:
+		data->disconnection++;
+		break;
+
+	case POMP_EVENT_MSG:
+		/* Reply once the client is gone and another one connected */
+		__sync_add_and_fetch(&data->started, 1);
+		usleep(50 * 1000);
+		CU_ASSERT_EQUAL(pomp_conn_send(conn, 2, "%u", 0), 0);
+		__sync_add_and_fetch(&data->replied, 1);
+		break;
+	}
+}
+
+/** */
+static void test_ctx_handler_pool_reuse(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_pool_reuse_data data;
+	struct test_pool_client clients[2];
+	struct sockaddr_in addr_in;
+	struct pomp_ctx *ctx1 = NULL;
+	struct pomp_ctx *ctx2[2];
+	struct pomp_loop *loop = NULL;
+
+	memset(&data, 0, sizeof(data));
+	memset(clients, 0, sizeof(clients));
+	memset(&addr_in, 0, sizeof(addr_in));
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr_in.sin_port = htons(5666);
+
+	ctx1 = pomp_ctx_new(&test_pool_reuse_server_cb, &data);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	loop = pomp_ctx_get_loop(ctx1);
+	res = pomp_ctx_set_handler_pool(ctx1, 1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 2; i++) {
+		ctx2[i] = pomp_ctx_new_with_loop(&test_pool_client_cb,
+				&clients[i], loop);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2[i]);
+	}
+
+	res = pomp_ctx_connect(ctx2[0], (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 20 && data.connection < 1; i++)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL_FATAL(data.connection, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(clients[0].conn);
+
+	/* Wait for the handler to run */
+	res = pomp_conn_send(clients[0].conn, 1, "%u%u", 0, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 20 && __sync_fetch_and_add(&data.started, 0) == 0; i++)
+		pomp_loop_wait_and_process(loop, 10);
+	CU_ASSERT_EQUAL_FATAL(__sync_fetch_and_add(&data.started, 0), 1);
+	CU_ASSERT_EQUAL(__sync_fetch_and_add(&data.replied, 0), 0);
+
+	/* The server sees the disconnection and the new connection before
+	 * the reply, the new connection may reuse the freed address */
+	res = pomp_ctx_stop(ctx2[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2[1], (const struct sockaddr *)&addr_in,
+			sizeof(addr_in));
+	CU_ASSERT_EQUAL(res, 0);
+	usleep(10 * 1000);
+	for (i = 0; i < 20 && (data.connection < 2 ||
+			clients[1].connection == 0); i++) {
+		pomp_loop_wait_and_process(loop, 10);
+	}
+	CU_ASSERT_EQUAL(data.disconnection, 1);
+	CU_ASSERT_EQUAL_FATAL(data.connection, 2);
+	CU_ASSERT_EQUAL(clients[1].connection, 1);
+	CU_ASSERT_EQUAL(__sync_fetch_and_add(&data.replied, 0), 1);
+
+	/* The reply of the closed connection is dropped */
+	for (i = 0; i < 5; i++)
+		pomp_loop_wait_and_process(loop, 10);
+	CU_ASSERT_EQUAL(clients[0].replycount, 0);
+	CU_ASSERT_EQUAL(clients[1].replycount, 0);
+
+	for (i = 0; i < 2; i++) {
+		res = pomp_ctx_stop(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_ctx_destroy(ctx2[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+struct test_pacing_data {
+	uint32_t  connection;
+	uint32_t  msgcount;
+	uint32_t  sendcount;
+	uint32_t  abortcount;
+	uint32_t  lastempty;
+};
+
+/** */
+static void test_pacing_event_cb(struct pomp_ctx *ctx,
+		enum pomp_event event, struct pomp_conn *conn,
+		const struct pomp_msg *msg, void *userdata)
+{
+	struct test_pacing_data *data = userdata;
+
+	if (event == POMP_EVENT_CONNECTED)
+		data->connection++;
+	else if (event == POMP_EVENT_MSG)
+		data->msgcount++;
+}
+
+/** */
+static void test_pacing_send_cb(struct pomp_ctx *ctx,
+		struct pomp_conn *conn,
+		struct pomp_buffer *buf,
+		uint32_t status,
+		void *cookie,
+		void *userdata)
+{
+	struct test_pacing_data *data = userdata;
+
+	data->sendcount++;
+	if (status & POMP_SEND_STATUS_ABORTED)
+		data->abortcount++;
+	data->lastempty = (status & POMP_SEND_STATUS_QUEUE_EMPTY) != 0;
+}
+
+/** */
+static void test_ctx_pacing(void)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_pacing_data data1, data2;
+	struct sockaddr_un addr_un;
+	struct pomp_loop *loop = NULL;
+	struct pomp_ctx *ctx1 = NULL, *ctx2 = NULL;
+	uint64_t start = 0;
+	char str[5000];
+
+	memset(str, 'a', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+	memset(&data1, 0, sizeof(data1));
+	memset(&data2, 0, sizeof(data2));
+	memset(&addr_un, 0, sizeof(addr_un));
+	addr_un.sun_family = AF_UNIX;
+	strcpy(addr_un.sun_path, "/tmp/tst-pomp-pacing");
+
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+
+	ctx1 = pomp_ctx_new_with_loop(&test_pacing_event_cb, &data1, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx1);
+	res = pomp_ctx_listen(ctx1, (const struct sockaddr *)&addr_un,
+			sizeof(addr_un));
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Client sends 200 kB/s, 10 kB at once, paced in userspace */
+	ctx2 = pomp_ctx_new_with_loop(&test_pacing_event_cb, &data2, loop);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx2);
+	res = pomp_ctx_set_pacing(NULL, 200000, 10000);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_ctx_set_pacing(ctx2, 200000, 10000);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_set_send_cb(ctx2, &test_pacing_send_cb);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_connect(ctx2, (const struct sockaddr *)&addr_un,
+			sizeof(addr_un));
+	CU_ASSERT_EQUAL(res, 0);
+	while (data1.connection == 0 || data2.connection == 0)
+		pomp_loop_wait_and_process(loop, 100);
+
+	/* About 50 kB take 200 ms after the burst */
+	for (i = 0; i < 10; i++) {
+		res = pomp_ctx_send(ctx2, 1, "%s", str);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 50 * 1000)
+		pomp_loop_wait_and_process(loop, 10);
+	CU_ASSERT_TRUE(data1.msgcount < 10);
+	CU_ASSERT_TRUE(data2.sendcount < 10);
+	while (data2.sendcount < 10)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start >= 150 * 1000);
+	CU_ASSERT_EQUAL(data2.abortcount, 0);
+	CU_ASSERT_EQUAL(data2.lastempty, 1);
+	while (data1.msgcount < 10)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(data1.msgcount, 10);
+
+	/* Paced buffers are aborted when the connection is closed */
+	data2.sendcount = 0;
+	for (i = 0; i < 10; i++) {
+		res = pomp_ctx_send(ctx2, 1, "%s", str);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_ctx_stop(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data2.sendcount, 10);
+	CU_ASSERT_TRUE(data2.abortcount > 0);
+	CU_ASSERT_EQUAL(data2.lastempty, 1);
+
+	res = pomp_ctx_stop(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_ctx_destroy(ctx1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+#endif /* !_WIN32 */
+
 /** */
 static CU_TestInfo s_ctx_tests[] = {
 	{(char *)"ctx_normal_inet_tcp", &test_ctx_normal_inet_tcp},
@@ -1024,6 +3828,29 @@ static CU_TestInfo s_ctx_tests[] = {
 #endif /* !_WIN32 */
 	{(char *)"ctx_local_addr", &test_local_addr},
 	{(char *)"ctx_invalid_addr", &test_invalid_addr},
+	{(char *)"conn_begin_msg", &test_conn_begin_msg},
+	{(char *)"ctx_sub_set", &test_sub_set},
+	{(char *)"ctx_sub_table", &test_sub_table},
+	{(char *)"ctx_subscription", &test_ctx_subscription},
+	{(char *)"ctx_accept_batch", &test_ctx_accept_batch},
+	{(char *)"ctx_reconnect", &test_ctx_reconnect},
+	{(char *)"ctx_client_pool", &test_ctx_client_pool},
+	{(char *)"ctx_heartbeat", &test_ctx_heartbeat},
+	{(char *)"ctx_rate_limit", &test_ctx_rate_limit},
+	{(char *)"ctx_read_budget", &test_ctx_read_budget},
+	{(char *)"ctx_edge_triggered", &test_ctx_edge_triggered},
+	{(char *)"ctx_rpc", &test_rpc},
+#ifndef _WIN32
+	{(char *)"ctx_workers", &test_ctx_workers},
+	{(char *)"ctx_workers_reuseport", &test_ctx_workers_reuseport},
+	{(char *)"ctx_heartbeat_workers", &test_ctx_heartbeat_workers},
+	{(char *)"ctx_admission_workers", &test_ctx_admission_workers},
+	{(char *)"conn_migrate", &test_conn_migrate},
+	{(char *)"ctx_async", &test_ctx_async},
+	{(char *)"ctx_handler_pool", &test_ctx_handler_pool},
+	{(char *)"ctx_handler_pool_reuse", &test_ctx_handler_pool_reuse},
+	{(char *)"ctx_pacing", &test_ctx_pacing},
+#endif /* !_WIN32 */
 	CU_TEST_INFO_NULL,
 };
 
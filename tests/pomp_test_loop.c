@@ -275,6 +275,503 @@ static void test_loop_wakeup(void)
 	CU_ASSERT_EQUAL(res, 0);
 }
 
+/** */
+struct test_loop_post_data {
+	struct pomp_loop  *loop;
+	uint32_t          count;
+	uint32_t          ordered;
+};
+
+/** */
+static void test_loop_post_cb(void *userdata)
+{
+	struct test_loop_post_data *data = userdata;
+	data->count++;
+}
+
+/** */
+static void test_loop_post_order_cb(void *userdata)
+{
+	struct test_loop_post_data *data = userdata;
+	if (data->ordered == data->count)
+		data->ordered++;
+	test_loop_post_cb(userdata);
+}
+
+/** */
+static void *test_loop_post_thread(void *arg)
+{
+	int res = 0, i = 0;
+	struct test_loop_post_data *data = arg;
+
+	for (i = 0; i < 100; i++) {
+		res = pomp_loop_post(data->loop, &test_loop_post_order_cb,
+				data);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	return NULL;
+}
+
+/** */
+static void test_loop_post(void)
+{
+	int res = 0, i = 0;
+	struct test_loop_post_data data;
+	pthread_t thread;
+
+	memset(&data, 0, sizeof(data));
+
+	/* Create loop */
+	data.loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data.loop);
+
+	/* Post from another thread, entries shall be called in order */
+	res = pthread_create(&thread, NULL, &test_loop_post_thread, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 0; i < 100 && data.count < 100; i++) {
+		res = pomp_loop_wait_and_process(data.loop, 1000);
+		CU_ASSERT_TRUE(res == 0 || res == -ETIMEDOUT);
+	}
+	res = pthread_join(thread, NULL);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 100);
+	CU_ASSERT_EQUAL(data.ordered, 100);
+
+	/* Post from loop thread, shall wakeup the loop */
+	res = pomp_loop_post(data.loop, &test_loop_post_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 101);
+
+	/* Invalid parameters */
+	res = pomp_loop_post(NULL, &test_loop_post_cb, &data);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_loop_post(data.loop, NULL, &data);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Pending entries are dropped by destroy */
+	res = pomp_loop_post(data.loop, &test_loop_post_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(data.loop);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 101);
+}
+
+/** */
+#define TEST_LOOP_BATCH_FDS	100
+
+/** */
+static void test_loop_batch_cb(int fd, uint32_t revents, void *userdata)
+{
+	uint32_t *count = userdata;
+	(*count)++;
+}
+
+/** */
+static void test_loop_batch(int is_epoll)
+{
+	int res = 0, i = 0;
+	struct pomp_loop *loop = NULL;
+	int fds[TEST_LOOP_BATCH_FDS][2];
+	uint32_t count = 0;
+	struct pomp_loop_stats stats;
+
+	/* Create loop */
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+	res = pomp_loop_set_max_events(loop, 64);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Pipes that stay readable as the callback does not read them */
+	for (i = 0; i < TEST_LOOP_BATCH_FDS; i++) {
+		res = pipe(fds[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+		res = (int)write(fds[i][1], "x", 1);
+		CU_ASSERT_EQUAL(res, 1);
+		res = pomp_loop_add(loop, fds[i][0], POMP_FD_EVENT_IN,
+				&test_loop_batch_cb, &count);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	/* Batch shall grow up to the maximum while waits are full */
+	for (i = 0; i < 4; i++) {
+		count = 0;
+		res = pomp_loop_wait_and_process(loop, 0);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_loop_get_stats(loop, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	if (is_epoll) {
+		CU_ASSERT_EQUAL(count, 64);
+		CU_ASSERT_EQUAL(stats.batch_size, 64);
+		CU_ASSERT_EQUAL(stats.full_waits, 4);
+	} else {
+		CU_ASSERT_EQUAL(count, TEST_LOOP_BATCH_FDS);
+		CU_ASSERT_EQUAL(stats.batch_size, 0);
+	}
+
+	/* Lowering the maximum shall shrink the batch */
+	res = pomp_loop_set_max_events(loop, 8);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_wait_and_process(loop, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	count = 0;
+	res = pomp_loop_wait_and_process(loop, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_get_stats(loop, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	if (is_epoll) {
+		CU_ASSERT_EQUAL(count, 8);
+		CU_ASSERT_EQUAL(stats.batch_size, 8);
+	}
+
+	/* Invalid parameters */
+	res = pomp_loop_set_max_events(NULL, 64);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_loop_set_max_events(loop, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	for (i = 0; i < TEST_LOOP_BATCH_FDS; i++) {
+		res = pomp_loop_remove(loop, fds[i][0]);
+		CU_ASSERT_EQUAL(res, 0);
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+
+	/* Destroy loop */
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+struct test_loop_now_data {
+	struct pomp_loop  *loop;
+	uint64_t          now;
+};
+
+/** */
+static void test_loop_now_cb(int fd, uint32_t revents, void *userdata)
+{
+	struct test_loop_now_data *data = userdata;
+	uint8_t dummy = 0;
+
+	/* Time shall not change during the iteration */
+	data->now = pomp_loop_now(data->loop);
+	usleep(2000);
+	CU_ASSERT_EQUAL(pomp_loop_now(data->loop), data->now);
+	CU_ASSERT_EQUAL(read(fd, &dummy, 1), 1);
+}
+
+/** */
+static void test_loop_now(void)
+{
+	int res = 0;
+	struct test_loop_now_data data;
+	int fds[2];
+	uint64_t now = 0;
+
+	memset(&data, 0, sizeof(data));
+
+	/* Create loop */
+	data.loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data.loop);
+	res = pipe(fds);
+	CU_ASSERT_EQUAL_FATAL(res, 0);
+	res = pomp_loop_add(data.loop, fds[0], POMP_FD_EVENT_IN,
+			&test_loop_now_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Outside of processing, time is always read */
+	now = pomp_loop_now(data.loop);
+	CU_ASSERT_NOT_EQUAL(now, 0);
+	usleep(2000);
+	CU_ASSERT_TRUE(pomp_loop_now(data.loop) >= now + 2000);
+
+	/* Time is read again at each iteration */
+	res = (int)write(fds[1], "x", 1);
+	CU_ASSERT_EQUAL(res, 1);
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_TRUE(data.now >= now + 2000);
+	now = data.now;
+	res = (int)write(fds[1], "x", 1);
+	CU_ASSERT_EQUAL(res, 1);
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_TRUE(data.now >= now + 2000);
+
+	/* Invalid parameters */
+	CU_ASSERT_EQUAL(pomp_loop_now(NULL), 0);
+
+	res = pomp_loop_remove(data.loop, fds[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	close(fds[0]);
+	close(fds[1]);
+
+	/* Destroy loop */
+	res = pomp_loop_destroy(data.loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+struct test_loop_remove_data {
+	struct pomp_loop  *loop;
+	int               fds[8][2];
+	uint32_t          count;
+};
+
+/** */
+static void test_loop_remove_cb(int fd, uint32_t revents, void *userdata)
+{
+	int res = 0, i = 0;
+	struct test_loop_remove_data *data = userdata;
+
+	/* Remove every other fd, none of them shall be notified anymore */
+	data->count++;
+	for (i = 0; i < 8; i++) {
+		if (data->fds[i][0] == fd ||
+				!pomp_loop_has_fd(data->loop, data->fds[i][0]))
+			continue;
+		res = pomp_loop_remove(data->loop, data->fds[i][0]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+/** */
+static void test_loop_remove_in_cb(void)
+{
+	int res = 0, i = 0;
+	struct test_loop_remove_data data;
+
+	memset(&data, 0, sizeof(data));
+
+	/* Create loop */
+	data.loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data.loop);
+
+	for (i = 0; i < 8; i++) {
+		res = pipe(data.fds[i]);
+		CU_ASSERT_EQUAL_FATAL(res, 0);
+		res = (int)write(data.fds[i][1], "x", 1);
+		CU_ASSERT_EQUAL(res, 1);
+		res = pomp_loop_add(data.loop, data.fds[i][0],
+				POMP_FD_EVENT_IN, &test_loop_remove_cb, &data);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	/* Only the first notified fd remains */
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 1);
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 2);
+
+	for (i = 0; i < 8; i++) {
+		if (pomp_loop_has_fd(data.loop, data.fds[i][0])) {
+			res = pomp_loop_remove(data.loop, data.fds[i][0]);
+			CU_ASSERT_EQUAL(res, 0);
+		}
+		close(data.fds[i][0]);
+		close(data.fds[i][1]);
+	}
+
+	/* Destroy loop */
+	res = pomp_loop_destroy(data.loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+struct test_loop_changes_data {
+	struct pomp_loop  *loop;
+	int               fd;
+	int               remove;
+	uint32_t          count;
+	int               badfd;
+	int               badres;
+};
+
+/** */
+static void test_loop_changes_cb(int fd, uint32_t revents, void *userdata)
+{
+	int res = 0, i = 0;
+	struct test_loop_changes_data *data = userdata;
+
+	/* Toggle output events several times, leaving them enabled */
+	data->count++;
+	for (i = 0; i < 10; i++) {
+		res = pomp_loop_update2(data->loop, data->fd,
+				POMP_FD_EVENT_OUT, 0);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_loop_update2(data->loop, data->fd,
+				0, POMP_FD_EVENT_OUT);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	res = pomp_loop_update(data->loop, data->fd,
+			POMP_FD_EVENT_IN | POMP_FD_EVENT_OUT);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Failure of a deferred update is returned by the next one */
+	if (data->badfd >= 0) {
+		data->badres = pomp_loop_update(data->loop, data->badfd,
+				POMP_FD_EVENT_IN | POMP_FD_EVENT_OUT);
+	}
+
+	if (data->remove) {
+		res = pomp_loop_remove(data->loop, data->fd);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+}
+
+/** */
+static void test_loop_changes(int is_epoll)
+{
+	int res = 0;
+	struct test_loop_changes_data data;
+	int fds[2], fds2[2];
+	struct pomp_loop_stats stats1, stats2;
+
+	memset(&data, 0, sizeof(data));
+	data.badfd = -1;
+
+	/* Create loop */
+	data.loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data.loop);
+
+	/* Socket pair so output events are reported */
+	res = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	CU_ASSERT_EQUAL_FATAL(res, 0);
+	data.fd = fds[0];
+	res = (int)write(fds[1], "x", 1);
+	CU_ASSERT_EQUAL(res, 1);
+	res = pomp_loop_add(data.loop, fds[0], POMP_FD_EVENT_IN,
+			&test_loop_changes_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Registered fd closed behind the loop */
+	res = socketpair(AF_UNIX, SOCK_STREAM, 0, fds2);
+	CU_ASSERT_EQUAL_FATAL(res, 0);
+	res = pomp_loop_add(data.loop, fds2[0], POMP_FD_EVENT_IN,
+			&test_loop_changes_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	close(fds2[0]);
+	close(fds2[1]);
+	data.badfd = fds2[0];
+
+	/* Updates done outside of event processing are applied at once */
+	res = pomp_loop_get_stats(data.loop, &stats1);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_update(data.loop, fds[0], 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_update(data.loop, fds[0], POMP_FD_EVENT_IN);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_get_stats(data.loop, &stats2);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats2.fd_changes - stats1.fd_changes, 2);
+
+	/* Updates done in callback shall be applied once */
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 1);
+	CU_ASSERT_EQUAL(data.badres, 0);
+	res = pomp_loop_get_stats(data.loop, &stats1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats1.fd_changes - stats2.fd_changes, 2);
+	CU_ASSERT_EQUAL(stats1.fd_coalesced - stats2.fd_coalesced, 20);
+
+	/* Updates shall be visible by next wait (output now ready) */
+	data.remove = 1;
+	res = pomp_loop_wait_and_process(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.count, 2);
+	/* Only epoll rejects the update of a closed fd */
+	CU_ASSERT_EQUAL(data.badres, is_epoll ? -EBADF : 0);
+
+	/* Updates followed by removal shall only remove */
+	res = pomp_loop_get_stats(data.loop, &stats2);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats2.fd_changes - stats1.fd_changes, 1);
+	CU_ASSERT_EQUAL(pomp_loop_has_fd(data.loop, fds[0]), 0);
+	res = pomp_loop_remove(data.loop, fds2[0]);
+	CU_ASSERT_EQUAL(res, 0);
+
+	close(fds[0]);
+	close(fds[1]);
+
+	/* Destroy loop */
+	res = pomp_loop_destroy(data.loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
+/** */
+static void test_loop_busy_poll(void)
+{
+	int res = 0;
+	struct pomp_loop *loop = NULL;
+	int fds[2];
+	uint32_t count = 0;
+	struct pomp_loop_stats stats;
+	struct timespec start, end;
+	int64_t elapsed = 0;
+
+	/* Create loop */
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(loop);
+	res = pomp_loop_set_busy_poll(loop, 100 * 1000);
+	CU_ASSERT_EQUAL(res, 0);
+
+	res = pipe(fds);
+	CU_ASSERT_EQUAL_FATAL(res, 0);
+	res = pomp_loop_add(loop, fds[0], POMP_FD_EVENT_IN,
+			&test_loop_batch_cb, &count);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Nothing ready, timeout shall be respected while spinning */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	res = pomp_loop_wait_and_process(loop, 20);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	elapsed = (end.tv_sec - start.tv_sec) * 1000 +
+			(end.tv_nsec - start.tv_nsec) / 1000000;
+	CU_ASSERT_TRUE(elapsed >= 19 && elapsed < 100);
+	CU_ASSERT_EQUAL(count, 0);
+
+	/* Ready fd shall be found while spinning */
+	res = (int)write(fds[1], "x", 1);
+	CU_ASSERT_EQUAL(res, 1);
+	res = pomp_loop_wait_and_process(loop, -1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(count, 1);
+	res = pomp_loop_get_stats(loop, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats.busy_polls, 1);
+
+	/* Disabled, wait shall block */
+	res = pomp_loop_set_busy_poll(loop, 0);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_wait_and_process(loop, -1);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(count, 2);
+	res = pomp_loop_get_stats(loop, &stats);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(stats.busy_polls, 1);
+
+	/* Invalid parameters */
+	res = pomp_loop_set_busy_poll(NULL, 10);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	res = pomp_loop_remove(loop, fds[0]);
+	CU_ASSERT_EQUAL(res, 0);
+	close(fds[0]);
+	close(fds[1]);
+
+	/* Destroy loop */
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, 0);
+}
+
 #endif /* !_WIN32 */
 
 #ifdef _WIN32
@@ -442,6 +939,9 @@ static void test_loop_wakeup(void)
 struct idle_data {
 	struct pomp_loop  *loop;
 	int               n;
+	int               readd;
+	int               sleep;
+	struct idle_data  *other;
 };
 
 /** */
@@ -451,15 +951,29 @@ static void idle_cb(void *userdata)
 	struct idle_data *data = userdata;
 	data->n++;
 
-	res = pomp_loop_idle_add(data->loop, &idle_cb, data);
-	CU_ASSERT_EQUAL(res, -EPERM);
+	/* Entries added now shall be called during next iteration */
+	if (data->readd > 0) {
+		data->readd--;
+		res = pomp_loop_idle_add(data->loop, &idle_cb, data);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	if (data->other != NULL) {
+		res = pomp_loop_idle_remove(data->loop, &idle_cb, data->other);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	if (data->sleep > 0)
+		usleep(data->sleep);
 }
 
 /** */
 static void test_loop_idle(void)
 {
 	int res = 0;
-	struct idle_data data = {NULL, 0};
+	int i = 0;
+	struct idle_data data = {NULL, 0, 0, 0, NULL};
+	struct idle_data data2 = {NULL, 0, 0, 0, NULL};
 
 	/* Create loop */
 	data.loop = pomp_loop_new();
@@ -496,12 +1010,70 @@ static void test_loop_idle(void)
 	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
 	CU_ASSERT_EQUAL(data.n, 0);
 
+	/* Check function registered again by itself is called at next
+	 * iteration, which shall not block */
+	data.n = 0;
+	data.readd = 2;
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	for (i = 1; i <= 3; i++) {
+		res = pomp_loop_wait_and_process(data.loop, -1);
+		CU_ASSERT_EQUAL(res, 0);
+		CU_ASSERT_EQUAL(data.n, i);
+	}
+	res = pomp_loop_wait_and_process(data.loop, 0);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	CU_ASSERT_EQUAL(data.n, 3);
+
+	/* Check function removed by a previous one is not called */
+	data.n = 0;
+	data2.loop = data.loop;
+	data.other = &data2;
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_process_fd(data.loop);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	CU_ASSERT_EQUAL(data.n, 1);
+	CU_ASSERT_EQUAL(data2.n, 0);
+	data.other = NULL;
+
+	/* Check budget defers remaining functions to next iteration */
+	res = pomp_loop_set_idle_budget(data.loop, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	data.n = 0;
+	data.sleep = 2000;
+	data2.n = 0;
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data2);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_process_fd(data.loop);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	CU_ASSERT_EQUAL(data.n, 1);
+	CU_ASSERT_EQUAL(data2.n, 0);
+	res = pomp_loop_process_fd(data.loop);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	CU_ASSERT_EQUAL(data2.n, 1);
+	data.sleep = 0;
+	res = pomp_loop_set_idle_budget(data.loop, 0);
+	CU_ASSERT_EQUAL(res, 0);
+
 	res = pomp_loop_idle_add(NULL, &idle_cb, &data);
 	CU_ASSERT_EQUAL(res, -EINVAL);
 	res = pomp_loop_idle_add(data.loop, NULL, &data);
 	CU_ASSERT_EQUAL(res, -EINVAL);
 	res = pomp_loop_idle_remove(NULL, &idle_cb, &data);
 	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_loop_set_idle_budget(NULL, 0);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
+	/* Pending functions are dropped by destroy */
+	res = pomp_loop_idle_add(data.loop, &idle_cb, &data);
+	CU_ASSERT_EQUAL(res, 0);
 
 	/* Destroy loop */
 	res = pomp_loop_destroy(data.loop);
@@ -516,6 +1088,12 @@ static void test_loop_epoll(void)
 	loop_ops = pomp_loop_set_ops(&pomp_loop_epoll_ops);
 	test_loop(1);
 	test_loop_wakeup();
+	test_loop_post();
+	test_loop_batch(1);
+	test_loop_busy_poll();
+	test_loop_changes(1);
+	test_loop_remove_in_cb();
+	test_loop_now();
 	test_loop_idle();
 	pomp_loop_set_ops(loop_ops);
 }
@@ -529,6 +1107,12 @@ static void test_loop_poll(void)
 	loop_ops = pomp_loop_set_ops(&pomp_loop_poll_ops);
 	test_loop(0);
 	test_loop_wakeup();
+	test_loop_post();
+	test_loop_batch(0);
+	test_loop_busy_poll();
+	test_loop_changes(0);
+	test_loop_remove_in_cb();
+	test_loop_now();
 	test_loop_idle();
 	pomp_loop_set_ops(loop_ops);
 }
@@ -44,6 +44,43 @@ static void timer_cb(struct pomp_timer *timer, void *userdata)
 	data->counter++;
 }
 
+/** */
+static void test_timer_slack(struct pomp_loop *loop, uint32_t slack,
+		uint32_t *wakeups, uint32_t *counter)
+{
+	int res = 0;
+	uint32_t i = 0;
+	struct test_data data;
+	struct pomp_timer *timers[10];
+	uint64_t start = 0;
+
+	memset(&data, 0, sizeof(data));
+	*wakeups = 0;
+
+	/* Periodic timers with staggered phases */
+	for (i = 0; i < 10; i++) {
+		timers[i] = pomp_timer_new(loop, &timer_cb, &data);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(timers[i]);
+		res = pomp_timer_set_slack(timers[i], slack);
+		CU_ASSERT_EQUAL(res, 0);
+		res = pomp_timer_set_periodic_us(timers[i],
+				(i + 1) * 1000, 10 * 1000);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 200 * 1000) {
+		if (pomp_loop_wait_and_process(loop, 100) == 0)
+			(*wakeups)++;
+	}
+
+	for (i = 0; i < 10; i++) {
+		res = pomp_timer_destroy(timers[i]);
+		CU_ASSERT_EQUAL(res, 0);
+	}
+	*counter = data.counter;
+}
+
 /** */
 static void test_timer(void)
 {
@@ -52,6 +89,9 @@ static void test_timer(void)
 	struct pomp_loop *loop = NULL;
 	struct pomp_timer *timer = NULL;
 	struct pomp_timer *timer2 = NULL;
+	uint64_t start = 0;
+	uint32_t wakeups = 0, wakeups2 = 0;
+	uint32_t counter = 0, counter2 = 0;
 
 	memset(&data, 0, sizeof(data));
 
@@ -135,9 +175,76 @@ static void test_timer(void)
 	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
 	CU_ASSERT_EQUAL(data.counter, 3);
 
+	/* Microsecond one shot timer, shall not fire before 2500us */
+	data.counter = 0;
+	res = pomp_timer_set_us(timer, 2500);
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	res = pomp_loop_wait_and_process(loop, 1);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	CU_ASSERT_EQUAL(data.counter, 0);
+	res = pomp_loop_wait_and_process(loop, 500);
+	CU_ASSERT_EQUAL(res, 0);
+	CU_ASSERT_EQUAL(data.counter, 1);
+	CU_ASSERT_TRUE(pomp_loop_now(loop) - start >= 2500);
+
+	/* Microsecond periodic timer */
+	data.counter = 0;
+	res = pomp_timer_set_periodic_us(timer, 1000, 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 100 * 1000)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_TRUE(data.counter >= 50 && data.counter <= 101);
+	res = pomp_timer_clear(timer);
+	CU_ASSERT_EQUAL(res, 0);
+
+	/* Timers with slack are coalesced */
+	test_timer_slack(loop, 0, &wakeups, &counter);
+	CU_ASSERT_TRUE(counter >= 100);
+	test_timer_slack(loop, 10 * 1000, &wakeups2, &counter2);
+	CU_ASSERT_TRUE(counter2 >= 100);
+	CU_ASSERT_TRUE(wakeups2 * 3 < wakeups);
+
+	/* One shot timer with slack */
+	data.counter = 0;
+	res = pomp_timer_set_slack(timer, 5 * 1000);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_timer_set(timer, 10);
+	CU_ASSERT_EQUAL(res, 0);
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 50 * 1000)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(data.counter, 1);
+
+	/* Clear timer with slack */
+	res = pomp_timer_set(timer, 10);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_timer_clear(timer);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_wait_and_process(loop, 30);
+	CU_ASSERT_EQUAL(res, -ETIMEDOUT);
+	CU_ASSERT_EQUAL(data.counter, 1);
+
+	/* Loop can not be destroyed, timer with slack still fires */
+	res = pomp_timer_set(timer, 10);
+	CU_ASSERT_EQUAL(res, 0);
+	res = pomp_loop_destroy(loop);
+	CU_ASSERT_EQUAL(res, -EBUSY);
+	start = pomp_loop_now(loop);
+	while (pomp_loop_now(loop) - start < 50 * 1000)
+		pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(data.counter, 2);
+
+	/* Invalid slack (NULL param) */
+	res = pomp_timer_set_slack(NULL, 1000);
+	CU_ASSERT_EQUAL(res, -EINVAL);
+
 	/* Invalid set (NULL param) */
 	res = pomp_timer_set(NULL, 500);
 	CU_ASSERT_EQUAL(res, -EINVAL);
+	res = pomp_timer_set_us(NULL, 500);
+	CU_ASSERT_EQUAL(res, -EINVAL);
 
 	/* Invalid clear (NULL param) */
 	res = pomp_timer_clear(NULL);